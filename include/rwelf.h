@@ -38,6 +38,67 @@
 #define NULL ((void*)0)
 #endif
 
+/**
+ * rwelf_vaddr_to_offset return values
+ */
+#define RWELF_VADDR_UNMAPPED -1  /* Not in any PT_LOAD segment */
+#define RWELF_VADDR_FILE      0  /* Backed by the file */
+#define RWELF_VADDR_BSS       1  /* Only in memory (p_filesz < p_memsz) */
+
+/**
+ * rwelf_open_flags flags
+ */
+#define RWELF_OPEN_DEFAULT      0x00
+#define RWELF_OPEN_SEQUENTIAL   0x01  /* MADV_SEQUENTIAL on the whole file */
+#define RWELF_OPEN_RANDOM       0x02  /* MADV_RANDOM on the whole file */
+#define RWELF_OPEN_PREFETCH     0x04  /* MADV_WILLNEED on headers and tables */
+#define RWELF_OPEN_RANDOM_DEBUG 0x08  /* MADV_RANDOM on .debug_* sections */
+#define RWELF_OPEN_POPULATE     0x10  /* MAP_POPULATE small files */
+#define RWELF_OPEN_HUGEPAGE     0x20  /* MADV_HUGEPAGE on the whole file */
+#define RWELF_OPEN_PREAD        0x40  /* Read on demand instead of mmap */
+
+#define RWELF_POPULATE_MAX (16 * 1024 * 1024)
+
+/**
+ * I/O backends (rwelf.backend)
+ */
+#define RWELF_IO_MMAP   0  /* Whole file mapped */
+#define RWELF_IO_PREAD  1  /* Requested ranges read into a block cache */
+#define RWELF_IO_MEMORY 2  /* Whole stream read into memory (pipes) */
+#define RWELF_IO_BUFFER 3  /* Caller owned buffer (rwelf_open_memory) */
+
+/**
+ * Instrumentation counters (see rwelf_get_stats), only counted when the
+ * library is built with RWELF_STATS
+ */
+#define RWELF_STAT_OPENS           0
+#define RWELF_STAT_BYTES_MAPPED    1  /* Mapped, or read by pread */
+#define RWELF_STAT_RESIDENT_PAGES  2  /* Pages of the file in memory (mincore) */
+#define RWELF_STAT_SECTION_BY_NAME 3
+#define RWELF_STAT_SECTION_BY_NUM  4
+#define RWELF_STAT_SYMBOL_BY_NAME  5
+#define RWELF_STAT_SYMBOL_BY_NUM   6  /* .symtab and .dynsym */
+#define RWELF_STAT_DYNAMIC_BY_TAG  7
+#define RWELF_STAT_DYNAMIC_BY_NUM  8
+#define RWELF_STAT_INDEX_LOOKUPS   9  /* By name or address */
+#define RWELF_STAT_SCAN_STEPS      10 /* Entries visited by linear lookups */
+#define RWELF_STAT_INDEX_BUILDS    11
+#define RWELF_STAT_INDEX_BUILD_NS  12
+#define RWELF_STAT_MAX             13
+
+#define RWELF_STAT_PAGE 4096
+
+#ifdef RWELF_STATS
+# define RWELF_STAT(_elf, _id, _n) rwelf_stat_add(_elf, _id, _n)
+#else
+# define RWELF_STAT(_elf, _id, _n) ((void) 0)
+#endif
+
+/**
+ * rwelf_scan head size: files up to this size are parsed from a single read
+ */
+#define RWELF_SCAN_HEAD (64 * 1024)
+
 /**
  * Helper to access librwelf's struct member
  */
@@ -57,6 +118,14 @@
 #define DYNSYM64(_elf) RWELF_DATA(_elf,  dynsym, _64)
 #define RELA32(_elf)   RWELF_DATA(_elf,  rela, _32)
 #define RELA64(_elf)   RWELF_DATA(_elf,  rela, _64)
+#define JMPREL32(_elf) RWELF_DATA(_elf,  jmprel, _32)
+#define JMPREL64(_elf) RWELF_DATA(_elf,  jmprel, _64)
+#define DYNRELA32(_elf) RWELF_DATA(_elf, dynrela, _32)
+#define DYNRELA64(_elf) RWELF_DATA(_elf, dynrela, _64)
+#define PLTREL32(_elf) RWELF_DATA(_elf,  pltrel, _32)
+#define PLTREL64(_elf) RWELF_DATA(_elf,  pltrel, _64)
+#define DYNREL32(_elf) RWELF_DATA(_elf,  dynrel, _32)
+#define DYNREL64(_elf) RWELF_DATA(_elf,  dynrel, _64)
 
 #define ELF_IS_32(_elf) (_elf->class == ELFCLASS32)
 #define ELF_IS_64(_elf) (_elf->class == ELFCLASS64)
@@ -116,10 +185,177 @@ typedef union {
 	Elf64_Rela *_64;
 } rwelf_rela;
 
+typedef union {
+	Elf32_Rel *_32;
+	Elf64_Rel *_64;
+} rwelf_rel;
+
+/**
+ * PT_LOAD segment
+ */
+typedef struct {
+	uint64_t vaddr;           /* Virtual address of the segment */
+	uint64_t memsz;           /* Size in memory */
+	uint64_t offset;          /* Offset in the file */
+	uint64_t filesz;          /* Size in the file */
+	uint32_t flags;           /* PF_* flags */
+} rwelf_segment;
+
+/**
+ * PLT stub and GOT slot (see rwelf_plt_build)
+ */
+typedef struct {
+	uint64_t addr;            /* Address of the stub */
+	uint64_t size;            /* Size of the stub */
+	uint64_t got;             /* GOT slot the stub jumps through */
+	size_t sym;               /* Imported symbol (.dynsym index) */
+	const char *name;         /* Name of the imported symbol */
+} rwelf_plt_entry;
+
+/**
+ * Function recovered by rwelf_funcs_build
+ */
+#define RWELF_FUNC_SYMTAB   0x01  /* Sources of the function */
+#define RWELF_FUNC_DYNSYM   0x02
+#define RWELF_FUNC_EH_FRAME 0x04
+#define RWELF_FUNC_INIT     0x08  /* Init/fini arrays, DT_INIT, DT_FINI */
+#define RWELF_FUNC_ENTRY    0x10
+
+typedef struct {
+	uint64_t addr;
+	uint64_t size;
+	const char *name;         /* Best symbol name, or NULL */
+	size_t shndx;             /* ET_REL: section addr is an offset in */
+	int sources;              /* RWELF_FUNC_* flags */
+} rwelf_func;
+
+/**
+ * Sections held by a program header and the bytes they leave uncovered
+ */
+typedef struct {
+	size_t *sections;         /* Section numbers, ascending */
+	size_t nsections;
+	uint64_t file_padding;    /* File bytes of the segment in no section */
+	uint64_t mem_padding;     /* Memory bytes of the segment in no section */
+	uint64_t page_slack;      /* PT_LOAD: bytes up to the page boundaries */
+} rwelf_segment_map;
+
+typedef struct {
+	uint64_t addr;            /* Address of the GOT slot */
+	size_t sym;               /* Symbol (.dynsym index) */
+	const char *name;         /* Name of the symbol */
+} rwelf_got_entry;
+
+/**
+ * Allocator for handles and arenas (see rwelf_set_allocator)
+ */
+typedef struct {
+	void *(*alloc)(size_t, void*);
+	void (*free)(void*, void*);
+	void *ctx;                /* Passed to both functions */
+} rwelf_allocator;
+
+/**
+ * Content hash of a section or function (see rwelf_foreach_hash)
+ */
+typedef struct {
+	int what;                 /* RWELF_HASH_SECTIONS or _FUNCTIONS */
+	const char *name;
+	size_t index;             /* Section or symbol number */
+	uint64_t offset;          /* Offset of the bytes in the file */
+	uint64_t size;
+	uint64_t hash;            /* XXH64, seed 0 */
+} rwelf_hash_entry;
+
+/**
+ * Bytes given to one label by rwelf_size_profile
+ */
+#define RWELF_SIZE_SEGMENTS 0  /* Domains of the profile */
+#define RWELF_SIZE_SECTIONS 1
+#define RWELF_SIZE_SYMBOLS  2
+#define RWELF_SIZE_UNITS    3  /* Compile units, from DWARF */
+
+typedef struct {
+	const char *name;
+	uint64_t file_size;
+	uint64_t vm_size;
+} rwelf_size_entry;
+
+/**
+ * Record the caller keeps per file in the scan-state database (see
+ * rwelf_scan_incremental)
+ */
+typedef struct {
+	const void *data;
+	size_t size;
+	int cached;               /* Unchanged file, data is the stored record */
+} rwelf_scan_record;
+
+typedef struct {
+	uint64_t counters[RWELF_STAT_MAX];  /* Indexed by RWELF_STAT_* */
+} rwelf_stats;
+
+typedef struct rwelf_pool rwelf_pool;
+typedef struct rwelf_resolver rwelf_resolver;
+typedef struct rwelf_dep rwelf_dep;
+typedef struct rwelf_binding rwelf_binding;
+typedef struct rwelf_scandb rwelf_scandb;
+typedef struct rwelf_strtab rwelf_strtab;
+
+/**
+ * Difference between two files (see rwelf_diff)
+ */
+#define RWELF_DIFF_SYMBOL  0x1  /* Tables, also the what argument */
+#define RWELF_DIFF_SECTION 0x2
+#define RWELF_DIFF_DYNAMIC 0x4
+#define RWELF_DIFF_ALL     0x7
+
+#define RWELF_DIFF_ADDED   0
+#define RWELF_DIFF_REMOVED 1
+#define RWELF_DIFF_RESIZED 2
+#define RWELF_DIFF_CHANGED 3  /* Same size, other type, flags or contents */
+
+typedef struct {
+	int what;                 /* RWELF_DIFF_SYMBOL, _SECTION or _DYNAMIC */
+	int change;               /* RWELF_DIFF_ADDED... */
+	const char *scope;        /* STT_FILE of a local symbol, or NULL */
+	const char *name;         /* String value or tag name for .dynamic */
+	int64_t tag;              /* .dynamic tag */
+	uint64_t old_value;       /* Address, or d_val for .dynamic */
+	uint64_t new_value;
+	uint64_t old_size;
+	uint64_t new_size;
+} rwelf_diff_entry;
+
+/**
+ * Undefined symbol reference and interposed definition (see
+ * rwelf_bind_files). Objects are numbered in load order
+ */
+#define RWELF_BIND_NONE ((size_t) -1)
+
+typedef struct {
+	const char *name;
+	size_t object;            /* Object with the reference */
+	size_t def;               /* Object it binds to, or RWELF_BIND_NONE */
+	uint64_t value;           /* st_value of the definition */
+	int weak;                 /* Weak reference, may stay unresolved */
+} rwelf_bind_ref;
+
+typedef struct {
+	const char *name;
+	size_t def;               /* Object whose definition is used */
+	size_t object;            /* Object whose definition is hidden */
+} rwelf_bind_interposed;
+
 typedef struct {
 	int fd;
-	unsigned char *file;      /* Mapped memory of file */
+	char *fname;              /* Path used to open the file */
+	unsigned char *file;      /* Mapped memory of file (not for pread) */
 	size_t size;              /* Size of the file */
+	int backend;              /* RWELF_IO_* backend */
+	void *io;                 /* Block cache of the pread backend */
+	int flags;                /* RWELF_OPEN_* flags */
+	int64_t mtime;            /* Modification time of the file (ns) */
 	unsigned char class;      /* ELF class 32/64 bit */
 	rwelf_ehdr ehdr;
 	rwelf_phdr phdr;
@@ -130,12 +366,46 @@ typedef struct {
 	size_t nsyms;             /* Number of symbols on .symtab */
 	size_t ndyns;             /* Number of entries on .dynamic */
 	size_t ndynsyms;          /* Number of symbols on .dynsym */
+	rwelf_rela jmprel;        /* PLT relocations (DT_JMPREL) */
+	size_t njmprels;          /* Number of PLT relocations */
+	rwelf_rela dynrela;       /* Dynamic relocations (DT_RELA) */
+	size_t ndynrelas;         /* Number of dynamic relocations */
+	rwelf_rel pltrel;         /* PLT relocations when DT_PLTREL is DT_REL */
+	size_t npltrels;          /* Number of REL PLT relocations */
+	rwelf_rel dynrel;         /* Dynamic relocations (DT_REL) */
+	size_t ndynrels;          /* Number of REL dynamic relocations */
 
 	unsigned char *dynstr;    /* Dynamic string table (.dynstr) */
 	unsigned char *shstrtab;  /* Section name string table (.shstrtab) */
 	unsigned char *strtab;    /* Symbol name string table (.strtab) */
+
+	rwelf_segment *loads;     /* PT_LOAD segments sorted by address */
+	size_t nloads;            /* Number of PT_LOAD segments */
+
+	void *index;              /* Symbol index (see rwelf_index_open) */
+	size_t index_size;        /* Size of the symbol index */
+	int index_mapped;         /* Whether the index is mapped from disk */
+
+	rwelf_plt_entry *plt;     /* PLT stubs sorted by address */
+	size_t nplt;
+	rwelf_got_entry *got;     /* GOT slots sorted by address */
+	size_t ngot;
+	int plt_built;            /* Whether rwelf_plt_build ran */
+
+	rwelf_func *funcs;        /* Functions sorted by address */
+	size_t nfuncs;
+	int funcs_built;          /* Whether rwelf_funcs_build ran */
+
+	rwelf_segment_map *segmaps; /* Per program header */
+	int segmaps_built;        /* Whether rwelf_segment_map_build ran */
+
+	void *stats;              /* Counters of the handle (RWELF_STATS) */
+	void *arena;              /* Derived data, freed by rwelf_close */
+	rwelf_pool *pool;         /* Pool the handle goes back to */
 } rwelf;
 
+typedef void (*rwelf_trace_hook)(const rwelf*, int, uint64_t, void*);
+
 /**
  * ElfN_[ESP]hdr class independent-version
  */
@@ -167,16 +437,112 @@ typedef struct {
 typedef struct {
 	const rwelf *elf;
 	rwelf_rela rela;
+	size_t link;              /* Symbol table section, 0 from .dynamic */
 } Elf_Rela;
 
+typedef struct {
+	const rwelf *elf;
+	uint32_t type;
+	const char *name;
+	const unsigned char *desc;
+	uint32_t descsz;
+} Elf_Note;
+
+/**
+ * Symbol filter (see rwelf_foreach_symbol). Masks are made of RWELF_SYMT,
+ * RWELF_SYMB and RWELF_SYMV bits, an empty mask matches anything
+ */
+#define RWELF_SYMT(_stt) (1u << (_stt))   /* STT_* */
+#define RWELF_SYMB(_stb) (1u << (_stb))   /* STB_* */
+#define RWELF_SYMV(_stv) (1u << (_stv))   /* STV_* */
+
+#define RWELF_SYMF_DYNAMIC 0x1  /* Walk .dynsym instead of .symtab */
+#define RWELF_SYMF_DEFINED 0x2  /* Skip SHN_UNDEF symbols */
+#define RWELF_SYMF_SECTION 0x4  /* Only symbols of the shndx section */
+
+typedef struct {
+	uint32_t types;
+	uint32_t binds;
+	uint32_t visibilities;
+	int flags;                /* RWELF_SYMF_* flags */
+	uint16_t shndx;           /* Section for RWELF_SYMF_SECTION */
+} rwelf_sym_filter;
+
+typedef struct {
+	const rwelf *elf;
+	rwelf_sym_filter filter;
+	int dynamic;
+	const unsigned char *strtab;
+	size_t count;             /* Symbols in the table */
+	size_t pos;               /* Next symbol to look at */
+	size_t index;             /* Number of the current symbol */
+} rwelf_sym_cursor;
+
+/**
+ * ET_CORE related data
+ */
+typedef struct {
+	int32_t pid;
+	int32_t signo;            /* Current signal */
+	const unsigned char *regs; /* elf_gregset_t, inside the note */
+	size_t regs_size;
+} rwelf_core_thread;
+
+typedef struct {
+	uint64_t start;           /* Mapped address range */
+	uint64_t end;
+	uint64_t offset;          /* Offset in the mapped file */
+	const char *name;
+} rwelf_core_file;
+
+typedef struct {
+	const rwelf *elf;
+	rwelf_core_thread *threads; /* NT_PRSTATUS */
+	size_t nthreads;
+	rwelf_core_file *files;   /* NT_FILE */
+	size_t nfiles;
+	rwelf **modules;          /* Files opened through rwelf_core_open_file */
+	const unsigned char *auxv; /* NT_AUXV */
+	size_t auxv_size;
+} rwelf_core;
+
 /**
  * Functions for handling internal rwelf data
  */
 extern rwelf *rwelf_open(const char*);
+extern rwelf *rwelf_open_flags(const char*, int);
+extern rwelf *rwelf_open_memory(const void*, size_t);
+extern rwelf *rwelf_pool_open(rwelf_pool*, const char*, int);
+extern rwelf *rwelf_pool_open_memory(rwelf_pool*, const void*, size_t);
+extern size_t rwelf_resident_bytes(const rwelf*);
 extern void rwelf_close(rwelf*);
 extern uint16_t rwelf_num_symbols(const rwelf*);
+extern size_t rwelf_num_dynamic(const rwelf*);
 extern void rwelf_get_header(const rwelf*, Elf_Ehdr*);
 
+/**
+ * Memory related functions
+ */
+extern void rwelf_set_allocator(const rwelf_allocator*);
+extern void *rwelf_mem_alloc(size_t);
+extern void rwelf_mem_free(void*);
+extern void *rwelf_arena_alloc(rwelf*, size_t);
+extern char *rwelf_arena_strdup(rwelf*, const char*);
+extern void rwelf_arena_free(rwelf*, int);
+extern rwelf *rwelf_alloc(rwelf_pool*);
+extern void rwelf_release(rwelf*);
+extern rwelf_pool *rwelf_pool_create(void);
+extern void rwelf_pool_destroy(rwelf_pool*);
+
+/**
+ * I/O backend related functions
+ */
+extern int rwelf_io_open(rwelf*, int, size_t, int);
+extern void rwelf_io_open_buffer(rwelf*, const void*, size_t);
+extern void rwelf_io_close(rwelf*);
+extern const unsigned char *rwelf_get_data(const rwelf*, uint64_t, uint64_t);
+extern size_t rwelf_io_cached_bytes(const rwelf*);
+
 /**
  * ElfN_Ehdr related functions
  */
@@ -199,6 +565,13 @@ extern uint64_t rwelf_get_section_flags(const Elf_Shdr*);
 extern uint64_t rwelf_get_section_addr(const Elf_Shdr*);
 extern uint64_t rwelf_get_section_size(const Elf_Shdr*);
 extern uint64_t rwelf_get_num_entries(const Elf_Shdr*);
+extern uint64_t rwelf_get_section_offset(const Elf_Shdr*);
+extern uint32_t rwelf_get_section_link(const Elf_Shdr*);
+extern uint32_t rwelf_get_section_info(const Elf_Shdr*);
+extern uint64_t rwelf_get_section_addralign(const Elf_Shdr*);
+extern uint64_t rwelf_get_section_entsize(const Elf_Shdr*);
+extern const unsigned char *rwelf_get_section_data(const Elf_Shdr*);
+extern const char *rwelf_get_section_type_name(const Elf_Shdr*);
 
 /**
  * Elf_Phdr related functions
@@ -207,8 +580,22 @@ extern void rwelf_get_pheader_by_num(const rwelf*, size_t, Elf_Phdr*);
 extern uint32_t rwelf_get_pheader_type(const Elf_Phdr*);
 extern uint32_t rwelf_get_pheader_flags(const Elf_Phdr*);
 extern uint64_t rwelf_get_pheader_vaddr(const Elf_Phdr*);
+extern uint64_t rwelf_get_pheader_offset(const Elf_Phdr*);
+extern uint64_t rwelf_get_pheader_paddr(const Elf_Phdr*);
+extern uint64_t rwelf_get_pheader_filesz(const Elf_Phdr*);
+extern uint64_t rwelf_get_pheader_memsz(const Elf_Phdr*);
+extern uint64_t rwelf_get_pheader_align(const Elf_Phdr*);
 extern const char *rwelf_get_pheader_type_name(const Elf_Phdr*);
 
+/**
+ * Virtual address translation functions (PT_LOAD segments)
+ */
+extern int rwelf_build_loads(rwelf*);
+extern const rwelf_segment *rwelf_vaddr_find_segment(const rwelf*, uint64_t);
+extern int rwelf_vaddr_to_offset(const rwelf*, uint64_t, uint64_t*);
+extern const unsigned char *rwelf_vaddr_to_ptr(const rwelf*, uint64_t, uint64_t);
+extern int rwelf_offset_to_vaddr(const rwelf*, uint64_t, uint64_t*);
+
 /**
  * Elf_Sym related functions
  */
@@ -218,17 +605,39 @@ extern const unsigned char *rwelf_get_symbol_name(const Elf_Sym*);
 extern const unsigned char *rwelf_get_symbol_section(const Elf_Sym*);
 extern uint64_t rwelf_get_symbol_size(const Elf_Sym*);
 extern uint64_t rwelf_get_symbol_value(const Elf_Sym*);
+extern uint16_t rwelf_get_symbol_shndx(const Elf_Sym*);
+extern unsigned char rwelf_get_symbol_type(const Elf_Sym*);
+extern unsigned char rwelf_get_symbol_bind(const Elf_Sym*);
+extern unsigned char rwelf_get_symbol_visibility(const Elf_Sym*);
+extern const char *rwelf_get_symbol_type_name(const Elf_Sym*);
+extern const char *rwelf_get_symbol_bind_name(const Elf_Sym*);
+extern const char *rwelf_get_symbol_visibility_name(const Elf_Sym*);
 extern uint16_t rwelf_num_dyn_symbols(const rwelf*);
 
 extern void rwelf_get_dyn_symbol_by_num(const rwelf*, size_t, Elf_Sym*);
 extern const unsigned char *rwelf_get_dyn_symbol_name(const Elf_Sym*);
 
+extern void rwelf_sym_cursor_init(rwelf_sym_cursor*, const rwelf*, const rwelf_sym_filter*);
+extern int rwelf_sym_cursor_next(rwelf_sym_cursor*, Elf_Sym*);
+extern const char *rwelf_sym_cursor_name(const rwelf_sym_cursor*, const Elf_Sym*);
+extern void rwelf_foreach_symbol(const rwelf*, const rwelf_sym_filter*,
+	int (*)(const Elf_Sym*, size_t, const char*, void*), void*);
+
+/**
+ * C++ demangling related functions
+ */
+extern int rwelf_demangle_available(void);
+extern const char *rwelf_demangle(const char*);
+extern void rwelf_demangle_batch(const char**, const char**, size_t);
+extern void rwelf_demangle_cache_clear(void);
+
 /**
  * Elf_Dyn related functions
  */
 extern void rwelf_get_dynamic_by_num(const rwelf*, size_t, Elf_Dyn*);
 extern int64_t rwelf_get_dynamic_tag(const Elf_Dyn*);
 extern const char *rwelf_get_dynamic_tag_name(const Elf_Dyn*);
+extern uint64_t rwelf_get_dynamic_val(const Elf_Dyn*);
 extern const unsigned char *rwelf_get_dynamic_strval(const Elf_Dyn*);
 extern int rwelf_get_dynamic_by_tag(const rwelf*, int64_t, Elf_Dyn*);
 
@@ -241,5 +650,179 @@ extern uint64_t rwelf_get_rela_info(const Elf_Rela*);
 extern int64_t rwelf_get_rela_addend(const Elf_Rela*);
 extern uint64_t rwelf_get_rela_type(const Elf_Rela*);
 extern const unsigned char *rwelf_get_rela_symbol(const Elf_Rela*);
+extern size_t rwelf_get_rela_sym_index(const Elf_Rela*);
+extern size_t rwelf_num_jmprels(const rwelf*);
+extern void rwelf_get_jmprel_by_num(const rwelf*, size_t, Elf_Rela*);
+extern size_t rwelf_num_dyn_relas(const rwelf*);
+extern void rwelf_get_dyn_rela_by_num(const rwelf*, size_t, Elf_Rela*);
+
+/**
+ * PLT/GOT map related functions
+ */
+extern int rwelf_plt_build(rwelf*);
+extern size_t rwelf_num_plt(const rwelf*);
+extern const rwelf_plt_entry *rwelf_get_plt_by_num(const rwelf*, size_t);
+extern const rwelf_plt_entry *rwelf_plt_lookup(const rwelf*, uint64_t);
+extern size_t rwelf_num_got(const rwelf*);
+extern const rwelf_got_entry *rwelf_get_got_by_num(const rwelf*, size_t);
+extern const rwelf_got_entry *rwelf_got_lookup(const rwelf*, uint64_t);
+
+/**
+ * Elf_Note related functions
+ */
+extern void rwelf_foreach_note(const rwelf*, int (*)(const Elf_Note*, void*), void*);
+extern const unsigned char *rwelf_get_build_id(const rwelf*, size_t*);
+
+/**
+ * ET_CORE related functions
+ */
+extern rwelf_core *rwelf_core_open(const rwelf*);
+extern void rwelf_core_close(rwelf_core*);
+extern int rwelf_core_vaddr_to_offset(const rwelf_core*, uint64_t, uint64_t*);
+extern const unsigned char *rwelf_core_read(const rwelf_core*, uint64_t, size_t);
+extern size_t rwelf_core_num_threads(const rwelf_core*);
+extern const rwelf_core_thread *rwelf_core_get_thread(const rwelf_core*, size_t);
+extern size_t rwelf_core_num_files(const rwelf_core*);
+extern const rwelf_core_file *rwelf_core_get_file(const rwelf_core*, size_t);
+extern rwelf *rwelf_core_open_file(rwelf_core*, size_t);
+extern int rwelf_core_get_auxv(const rwelf_core*, uint64_t, uint64_t*);
+
+/**
+ * Bulk scanning related functions
+ */
+#define RWELF_SCANDB_BUILD_ID 0x1  /* Also match files by build-id */
+
+extern int rwelf_scan(const char *const*, size_t, int,
+	int (*)(const char*, rwelf*, void*), void*);
+extern rwelf_scandb *rwelf_scandb_open(const char*, uint64_t, int);
+extern void rwelf_scandb_close(rwelf_scandb*);
+extern int rwelf_scandb_save(const rwelf_scandb*, const char*);
+extern size_t rwelf_scandb_num_entries(const rwelf_scandb*);
+extern size_t rwelf_scandb_prune(rwelf_scandb*);
+extern int rwelf_scan_incremental(rwelf_scandb*, const char *const*, size_t,
+	int, int (*)(const char*, rwelf*, rwelf_scan_record*, void*), void*);
+
+/**
+ * Dependency resolution related functions
+ */
+#define RWELF_RESOLVE_ENV 0x1  /* Search LD_LIBRARY_PATH too */
+
+extern rwelf_resolver *rwelf_resolver_create(int);
+extern void rwelf_resolver_destroy(rwelf_resolver*);
+extern const rwelf_dep *rwelf_resolve(rwelf_resolver*, const char*);
+extern int rwelf_resolve_many(rwelf_resolver*, const char *const*, size_t, int,
+	const rwelf_dep**);
+extern void rwelf_dep_foreach(const rwelf_dep*,
+	int (*)(const rwelf_dep*, const char*, const char*, void*), void*);
+extern const char *rwelf_dep_path(const rwelf_dep*);
+extern int rwelf_dep_found(const rwelf_dep*);
+extern const char *rwelf_dep_soname(const rwelf_dep*);
+extern const char *rwelf_dep_interp(const rwelf_dep*);
+extern size_t rwelf_dep_num_needed(const rwelf_dep*);
+extern const char *rwelf_dep_needed_name(const rwelf_dep*, size_t);
+extern const rwelf_dep *rwelf_dep_get_needed(const rwelf_dep*, size_t);
+extern const char *rwelf_dep_needed_path(const rwelf_dep*, size_t);
+
+/**
+ * Symbol binding related functions
+ */
+extern rwelf_binding *rwelf_bind_files(const char *const*, size_t);
+extern rwelf_binding *rwelf_bind_deps(const rwelf_dep*);
+extern void rwelf_bind_free(rwelf_binding*);
+extern size_t rwelf_bind_num_objects(const rwelf_binding*);
+extern const char *rwelf_bind_object_path(const rwelf_binding*, size_t);
+extern size_t rwelf_bind_num_refs(const rwelf_binding*);
+extern const rwelf_bind_ref *rwelf_bind_get_ref(const rwelf_binding*, size_t);
+extern size_t rwelf_bind_num_unresolved(const rwelf_binding*);
+extern size_t rwelf_bind_num_interposed(const rwelf_binding*);
+extern const rwelf_bind_interposed *rwelf_bind_get_interposed(
+	const rwelf_binding*, size_t);
+extern size_t rwelf_bind_lookup(const rwelf_binding*, const char*, uint64_t*);
+
+/**
+ * Structural diff related functions
+ */
+extern int rwelf_diff(const rwelf*, const rwelf*, int,
+	int (*)(const rwelf_diff_entry*, void*), void*);
+extern const char *rwelf_diff_change_name(int);
+
+/**
+ * Function recovery related functions
+ */
+extern int rwelf_funcs_build(rwelf*);
+extern size_t rwelf_num_funcs(const rwelf*);
+extern const rwelf_func *rwelf_get_func_by_num(const rwelf*, size_t);
+extern const rwelf_func *rwelf_func_lookup(const rwelf*, uint64_t);
+
+/**
+ * Segment mapping related functions
+ */
+extern int rwelf_segment_map_build(rwelf*);
+extern const rwelf_segment_map *rwelf_get_segment_map(const rwelf*, size_t);
+
+/**
+ * Size profiling related functions
+ */
+extern int rwelf_size_profile(const rwelf*, int,
+	int (*)(const rwelf_size_entry*, void*), void*);
+
+/**
+ * Content hashing related functions
+ */
+#define RWELF_HASH_SECTIONS    0x1  /* Hash the sections */
+#define RWELF_HASH_FUNCTIONS   0x2  /* Hash the STT_FUNC symbols */
+#define RWELF_HASH_MASK_RELOCS 0x4  /* Hash relocated bytes as zeros */
+
+extern uint64_t rwelf_hash64(const void*, size_t, uint64_t);
+extern int rwelf_hash_section(const rwelf*, size_t, int, uint64_t*);
+extern int rwelf_hash_symbol(const Elf_Sym*, int, uint64_t*);
+extern int rwelf_foreach_hash(const rwelf*, int,
+	int (*)(const rwelf_hash_entry*, void*), void*);
+
+/**
+ * Instrumentation related functions
+ */
+extern int rwelf_stats_enabled(void);
+extern const char *rwelf_stat_name(int);
+extern void rwelf_stat_add(const rwelf*, int, uint64_t);
+extern int rwelf_get_stats(const rwelf*, rwelf_stats*);
+extern int rwelf_get_global_stats(rwelf_stats*);
+extern void rwelf_reset_global_stats(void);
+extern void rwelf_set_trace_hook(rwelf_trace_hook, void*);
+
+/**
+ * String table building related functions
+ */
+#define RWELF_STRTAB_SYMTAB   0x1  /* .strtab, names of .symtab */
+#define RWELF_STRTAB_DYNSTR   0x2  /* .dynstr */
+#define RWELF_STRTAB_SHSTRTAB 0x4  /* Section names */
+#define RWELF_STRTAB_ALL      0x7
+
+extern rwelf_strtab *rwelf_strtab_create(void);
+extern void rwelf_strtab_destroy(rwelf_strtab*);
+extern size_t rwelf_strtab_add(rwelf_strtab*, const char*);
+extern int rwelf_strtab_finalize(rwelf_strtab*);
+extern uint64_t rwelf_strtab_offset(const rwelf_strtab*, size_t);
+extern const unsigned char *rwelf_strtab_data(const rwelf_strtab*, size_t*);
+extern int rwelf_rewrite_strtabs(const rwelf*, const char*, int);
+
+/**
+ * Symbol export related functions
+ */
+#define RWELF_EXPORT_SYMTAB 0x1  /* Export .symtab */
+#define RWELF_EXPORT_DYNSYM 0x2  /* Export .dynsym */
+
+extern int rwelf_export_symbols(const rwelf*, int, int);
+
+/**
+ * Persistent symbol index related functions
+ */
+extern int rwelf_index_open(rwelf*, const char*);
+extern int rwelf_index_build(rwelf*);
+extern int rwelf_index_load(rwelf*, const char*);
+extern int rwelf_index_save(const rwelf*, const char*);
+extern void rwelf_index_close(rwelf*);
+extern int rwelf_index_lookup_name(const rwelf*, const char*, Elf_Sym*);
+extern int rwelf_index_lookup_addr(const rwelf*, uint64_t, Elf_Sym*);
 
 #endif /* RWELF_H */
@@ -0,0 +1,281 @@
+/**
+ * rwelf
+ * Copyright (c) 2012-2013 Felipe Pena <felipensp(at)gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "rwelf.h"
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * Memory management
+ *
+ * Handles and the data derived from a file live in an arena owned by the
+ * handle: a list of chunks served by bumping a pointer, released at once
+ * by rwelf_close. Chunks and handles come from the allocator set through
+ * rwelf_set_allocator, malloc by default.
+ *
+ * A pool keeps closed handles together with the first chunk of their
+ * arena, so opening many files in a row (rwelf_scan) reuses the same
+ * memory instead of going back to the allocator. A pool is not locked,
+ * each thread is expected to use its own.
+ */
+
+#define _ARENA_CHUNK 4096
+#define _ARENA_ALIGN 16
+#define _POOL_MAX    64
+
+typedef struct _arena_chunk {
+	struct _arena_chunk *next;
+	size_t size;              /* Usable bytes after the header */
+	size_t used;
+} _arena_chunk;
+
+/* Keeps the data after the header aligned */
+#define _CHUNK_HDR ((sizeof(_arena_chunk) + _ARENA_ALIGN - 1) & ~(_ARENA_ALIGN - 1))
+
+struct rwelf_pool {
+	rwelf *handles[_POOL_MAX];
+	size_t nhandles;
+};
+
+static void *_malloc(size_t size, void *ctx)
+{
+	return malloc(size);
+}
+
+static void _free(void *ptr, void *ctx)
+{
+	free(ptr);
+}
+
+static rwelf_allocator _allocator = { _malloc, _free, NULL };
+
+/**
+ * rwelf_set_allocator(const rwelf_allocator*)
+ * Sets the allocator used for handles and arenas, NULL restores malloc.
+ * Must be called before any file is opened
+ */
+void rwelf_set_allocator(const rwelf_allocator *allocator)
+{
+	if (allocator) {
+		assert(allocator->alloc != NULL);
+		assert(allocator->free != NULL);
+
+		_allocator = *allocator;
+	} else {
+		_allocator.alloc = _malloc;
+		_allocator.free  = _free;
+		_allocator.ctx   = NULL;
+	}
+}
+
+/**
+ * rwelf_mem_alloc(size_t)
+ * Allocates memory through the current allocator
+ */
+void *rwelf_mem_alloc(size_t size)
+{
+	return _allocator.alloc(size, _allocator.ctx);
+}
+
+/**
+ * rwelf_mem_free(void*)
+ * Releases memory got from rwelf_mem_alloc
+ */
+void rwelf_mem_free(void *ptr)
+{
+	if (ptr) {
+		_allocator.free(ptr, _allocator.ctx);
+	}
+}
+
+/**
+ * rwelf_arena_alloc(rwelf*, size_t)
+ * Allocates zeroed memory which lives until the handle is closed.
+ * Returns NULL when out of memory
+ */
+void *rwelf_arena_alloc(rwelf *elf, size_t size)
+{
+	_arena_chunk *chunk;
+	size_t csize;
+	void *ptr;
+
+	assert(elf != NULL);
+
+	size = (size + _ARENA_ALIGN - 1) & ~(size_t)(_ARENA_ALIGN - 1);
+	chunk = elf->arena;
+
+	if (!chunk || chunk->size - chunk->used < size) {
+		/* Chunks double up to a point, larger requests get their own */
+		csize = chunk ? chunk->size * 2 : _ARENA_CHUNK;
+
+		if (csize > 64 * _ARENA_CHUNK) {
+			csize = 64 * _ARENA_CHUNK;
+		}
+		if (csize < size) {
+			csize = size;
+		}
+
+		if ((chunk = rwelf_mem_alloc(_CHUNK_HDR + csize)) == NULL) {
+			return NULL;
+		}
+		chunk->size = csize;
+		chunk->used = 0;
+		chunk->next = elf->arena;
+		elf->arena  = chunk;
+	}
+
+	ptr = (unsigned char*) chunk + _CHUNK_HDR + chunk->used;
+	chunk->used += size;
+
+	memset(ptr, 0, size);
+
+	return ptr;
+}
+
+/**
+ * rwelf_arena_strdup(rwelf*, const char*)
+ * Copies the string into the arena of the handle
+ */
+char *rwelf_arena_strdup(rwelf *elf, const char *str)
+{
+	size_t len;
+	char *ptr;
+
+	assert(str != NULL);
+
+	len = strlen(str) + 1;
+
+	if ((ptr = rwelf_arena_alloc(elf, len)) != NULL) {
+		memcpy(ptr, str, len);
+	}
+	return ptr;
+}
+
+/**
+ * rwelf_arena_free(rwelf*, int)
+ * Releases the arena of the handle. When keep is set, the oldest chunk is
+ * kept for reuse and only emptied
+ */
+void rwelf_arena_free(rwelf *elf, int keep)
+{
+	_arena_chunk *chunk, *next;
+
+	assert(elf != NULL);
+
+	for (chunk = elf->arena; chunk; chunk = next) {
+		next = chunk->next;
+
+		if (keep && !next) {
+			chunk->used = 0;
+			break;
+		}
+		rwelf_mem_free(chunk);
+	}
+	elf->arena = keep ? chunk : NULL;
+}
+
+/**
+ * rwelf_alloc(rwelf_pool*)
+ * Returns a zeroed handle, taken from the pool when it has one
+ */
+rwelf *rwelf_alloc(rwelf_pool *pool)
+{
+	rwelf *elf;
+	void *arena = NULL;
+
+	if (pool && pool->nhandles) {
+		elf = pool->handles[--pool->nhandles];
+		arena = elf->arena;
+	} else if ((elf = rwelf_mem_alloc(sizeof(rwelf))) == NULL) {
+		return NULL;
+	}
+
+	memset(elf, 0, sizeof(rwelf));
+
+	elf->fd    = -1;
+	elf->arena = arena;
+	elf->pool  = pool;
+
+#ifdef RWELF_STATS
+	/* Counted from here on; without memory the handle is not counted */
+	elf->stats = rwelf_arena_alloc(elf, sizeof(rwelf_stats));
+#endif
+
+	return elf;
+}
+
+/**
+ * rwelf_release(rwelf*)
+ * Gives a closed handle back to its pool, or releases it
+ */
+void rwelf_release(rwelf *elf)
+{
+	rwelf_pool *pool;
+
+	assert(elf != NULL);
+
+	pool = elf->pool;
+
+	if (pool && pool->nhandles < _POOL_MAX) {
+		rwelf_arena_free(elf, 1);
+		pool->handles[pool->nhandles++] = elf;
+		return;
+	}
+
+	rwelf_arena_free(elf, 0);
+	rwelf_mem_free(elf);
+}
+
+/**
+ * rwelf_pool_create()
+ * Creates an empty pool of handles
+ */
+rwelf_pool *rwelf_pool_create(void)
+{
+	rwelf_pool *pool;
+
+	if ((pool = rwelf_mem_alloc(sizeof(rwelf_pool))) != NULL) {
+		pool->nhandles = 0;
+	}
+	return pool;
+}
+
+/**
+ * rwelf_pool_destroy(rwelf_pool*)
+ * Releases the pool and the handles it keeps. Handles still open must not
+ * be closed after the pool is destroyed
+ */
+void rwelf_pool_destroy(rwelf_pool *pool)
+{
+	size_t i;
+
+	assert(pool != NULL);
+
+	for (i = 0; i < pool->nhandles; ++i) {
+		rwelf_arena_free(pool->handles[i], 0);
+		rwelf_mem_free(pool->handles[i]);
+	}
+	rwelf_mem_free(pool);
+}
@@ -0,0 +1,573 @@
+/**
+ * rwelf
+ * Copyright (c) 2012-2013 Felipe Pena <felipensp(at)gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "rwelf.h"
+#include "internal.h"
+#include <sys/types.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * Whole-program symbol binding
+ *
+ * The objects of a dependency set are read once each, in load order. Every
+ * exported .dynsym definition goes into a single global table keyed by
+ * name, where the first object defining a name owns it and later
+ * definitions are recorded as interposed, the way ld.so's global scope
+ * resolves them. Undefined references are collected on the way and bound
+ * in one pass at the end, each with a single table lookup, so the cost is
+ * linear in the number of symbols whatever the number of objects.
+ *
+ * The table is keyed by the GNU hash of the name. For definitions it is
+ * taken from the object's DT_GNU_HASH chain instead of hashing the name
+ * again; the chain keeps 31 bits of it, so the low bit is ignored
+ * everywhere. Names are copied into the table, so only one object is open
+ * at a time.
+ *
+ * Symbol versions only decide which definitions are visible: non-default
+ * (hidden) versions are not entered. References bind by name.
+ */
+
+#define _VERSYM_HIDDEN 0x8000
+
+typedef struct {
+	uint32_t hash;
+	size_t name;              /* Offset into the string heap */
+	size_t def;               /* First object defining it */
+	uint64_t value;
+} _bind_sym;
+
+typedef struct {
+	size_t sym;
+	size_t object;
+	int weak;
+} _bind_ref;
+
+typedef struct {
+	size_t sym;
+	size_t object;            /* Object whose definition is hidden */
+} _bind_ip;
+
+struct rwelf_binding {
+	char **paths;             /* Objects in load order */
+	size_t nobjects;
+	char *heap;               /* Symbol names */
+	size_t heap_len;
+	size_t heap_cap;
+	_bind_sym *syms;
+	size_t nsyms;
+	size_t syms_cap;
+	size_t *slots;            /* Symbol number + 1, 0 when empty */
+	size_t cap;               /* Power of two */
+	_bind_ref *raw;           /* References, while loading */
+	size_t nraw;
+	size_t raw_cap;
+	_bind_ip *raw_ip;         /* Interposed definitions, while loading */
+	size_t nraw_ip;
+	size_t raw_ip_cap;
+	rwelf_bind_ref *refs;
+	size_t nrefs;
+	size_t nunresolved;
+	rwelf_bind_interposed *interposed;
+	size_t ninterposed;
+};
+
+/**
+ * Grows an array to hold one more element
+ */
+static int _grow(void **ptr, size_t *cap, size_t n, size_t size)
+{
+	void *p;
+
+	if (n < *cap) {
+		return 0;
+	}
+	if ((p = realloc(*ptr, (*cap ? *cap * 2 : 256) * size)) == NULL) {
+		return -1;
+	}
+	*ptr = p;
+	*cap = *cap ? *cap * 2 : 256;
+
+	return 0;
+}
+
+static int _rehash(rwelf_binding *b)
+{
+	size_t *slots, cap = b->cap ? b->cap * 2 : 4096, i, j;
+
+	if ((slots = calloc(cap, sizeof(size_t))) == NULL) {
+		return -1;
+	}
+	for (i = 0; i < b->nsyms; ++i) {
+		for (j = b->syms[i].hash & (cap - 1); slots[j]; j = (j + 1) & (cap - 1));
+		slots[j] = i + 1;
+	}
+	free(b->slots);
+	b->slots = slots;
+	b->cap = cap;
+
+	return 0;
+}
+
+/**
+ * Returns the number of the symbol, adding it when it is new. Returns -1
+ * when out of memory
+ */
+static ssize_t _intern(rwelf_binding *b, const char *name, uint32_t hash)
+{
+	size_t i, len;
+	_bind_sym *sym;
+
+	hash &= ~1u;
+
+	if ((b->nsyms + 1) * 4 > b->cap * 3 && _rehash(b) == -1) {
+		return -1;
+	}
+
+	for (i = hash & (b->cap - 1); b->slots[i]; i = (i + 1) & (b->cap - 1)) {
+		sym = &b->syms[b->slots[i] - 1];
+
+		if (sym->hash == hash && strcmp(b->heap + sym->name, name) == 0) {
+			return b->slots[i] - 1;
+		}
+	}
+
+	len = strlen(name) + 1;
+
+	while (b->heap_len + len > b->heap_cap) {
+		size_t cap = b->heap_cap ? b->heap_cap * 2 : 64 * 1024;
+		char *heap = realloc(b->heap, cap);
+
+		if (!heap) {
+			return -1;
+		}
+		b->heap = heap;
+		b->heap_cap = cap;
+	}
+	if (_grow((void**) &b->syms, &b->syms_cap, b->nsyms, sizeof(_bind_sym)) == -1) {
+		return -1;
+	}
+
+	sym = &b->syms[b->nsyms];
+	sym->hash  = hash;
+	sym->name  = b->heap_len;
+	sym->def   = RWELF_BIND_NONE;
+	sym->value = 0;
+
+	memcpy(b->heap + b->heap_len, name, len);
+	b->heap_len += len;
+	b->slots[i] = ++b->nsyms;
+
+	return b->nsyms - 1;
+}
+
+/**
+ * Returns the DT_GNU_HASH chain of the object and the index of its first
+ * symbol, or NULL when it has none
+ */
+static const uint32_t *_gnu_chain(const rwelf *elf, size_t *symoffset)
+{
+	const uint32_t *hdr;
+	size_t word = ELF_IS_64(elf) ? 8 : 4;
+	uint64_t vaddr;
+	Elf_Dyn dyn;
+
+	if (rwelf_get_dynamic_by_tag(elf, DT_GNU_HASH, &dyn) == -1) {
+		return NULL;
+	}
+	vaddr = rwelf_get_dynamic_val(&dyn);
+
+	if ((hdr = (const uint32_t*) rwelf_vaddr_to_ptr(elf, vaddr, 16)) == NULL
+		|| hdr[1] > elf->ndynsyms) {
+		return NULL;
+	}
+	*symoffset = hdr[1];
+
+	return (const uint32_t*) rwelf_vaddr_to_ptr(elf,
+		vaddr + 16 + (uint64_t) hdr[2] * word + (uint64_t) hdr[0] * 4,
+		(elf->ndynsyms - hdr[1]) * sizeof(uint32_t));
+}
+
+static const uint16_t *_versym(const rwelf *elf)
+{
+	Elf_Dyn dyn;
+
+	if (rwelf_get_dynamic_by_tag(elf, DT_VERSYM, &dyn) == -1) {
+		return NULL;
+	}
+	return (const uint16_t*) rwelf_vaddr_to_ptr(elf,
+		rwelf_get_dynamic_val(&dyn), elf->ndynsyms * sizeof(uint16_t));
+}
+
+/**
+ * Enters the definitions and collects the references of an object
+ */
+static int _load(rwelf_binding *b, const rwelf *elf, size_t object)
+{
+	const uint32_t *chain;
+	const uint16_t *versym;
+	size_t symoffset = 0, i;
+
+	if (!elf->dynstr) {
+		return 0;
+	}
+	chain  = _gnu_chain(elf, &symoffset);
+	versym = _versym(elf);
+
+	/* Symbol 0 is always the null symbol */
+	for (i = 1; i < elf->ndynsyms; ++i) {
+		unsigned char info = RWELF(elf, DYNSYM, st_info, i);
+		uint16_t shndx = RWELF(elf, DYNSYM, st_shndx, i);
+		const char *name;
+		uint32_t hash;
+		ssize_t n;
+
+		if (ELF64_ST_BIND(info) == STB_LOCAL
+			|| ELF64_ST_TYPE(info) == STT_SECTION
+			|| ELF64_ST_TYPE(info) == STT_FILE) {
+			continue;
+		}
+		name = (const char*)(elf->dynstr + RWELF(elf, DYNSYM, st_name, i));
+
+		if (!*name) {
+			continue;
+		}
+
+		if (shndx == SHN_UNDEF) {
+			if ((n = _intern(b, name, _str_hash(name))) == -1
+				|| _grow((void**) &b->raw, &b->raw_cap, b->nraw,
+					sizeof(_bind_ref)) == -1) {
+				return -1;
+			}
+			b->raw[b->nraw].sym    = n;
+			b->raw[b->nraw].object = object;
+			b->raw[b->nraw].weak   = ELF64_ST_BIND(info) == STB_WEAK;
+			++b->nraw;
+			continue;
+		}
+
+		if ((versym && (versym[i] & _VERSYM_HIDDEN))
+			|| ELF64_ST_VISIBILITY(RWELF(elf, DYNSYM, st_other, i)) == STV_HIDDEN
+			|| ELF64_ST_VISIBILITY(RWELF(elf, DYNSYM, st_other, i)) == STV_INTERNAL) {
+			continue;
+		}
+
+		hash = chain && i >= symoffset ? chain[i - symoffset] : _str_hash(name);
+
+		if ((n = _intern(b, name, hash)) == -1) {
+			return -1;
+		}
+
+		if (b->syms[n].def == RWELF_BIND_NONE) {
+			b->syms[n].def   = object;
+			b->syms[n].value = RWELF(elf, DYNSYM, st_value, i);
+		} else if (b->syms[n].def != object) {
+			if (_grow((void**) &b->raw_ip, &b->raw_ip_cap, b->nraw_ip,
+					sizeof(_bind_ip)) == -1) {
+				return -1;
+			}
+			b->raw_ip[b->nraw_ip].sym    = n;
+			b->raw_ip[b->nraw_ip].object = object;
+			++b->nraw_ip;
+		}
+	}
+	return 0;
+}
+
+/**
+ * Binds every reference, now that the table is complete
+ */
+static int _bind_refs(rwelf_binding *b)
+{
+	size_t i;
+
+	if ((b->nraw && (b->refs = malloc(b->nraw * sizeof(rwelf_bind_ref))) == NULL)
+		|| (b->nraw_ip && (b->interposed = malloc(b->nraw_ip
+			* sizeof(rwelf_bind_interposed))) == NULL)) {
+		return -1;
+	}
+
+	for (i = 0; i < b->nraw; ++i) {
+		const _bind_sym *sym = &b->syms[b->raw[i].sym];
+		rwelf_bind_ref *ref = &b->refs[i];
+
+		ref->name   = b->heap + sym->name;
+		ref->object = b->raw[i].object;
+		ref->def    = sym->def;
+		ref->value  = sym->value;
+		ref->weak   = b->raw[i].weak;
+
+		if (ref->def == RWELF_BIND_NONE && !ref->weak) {
+			++b->nunresolved;
+		}
+	}
+	b->nrefs = b->nraw;
+
+	for (i = 0; i < b->nraw_ip; ++i) {
+		const _bind_sym *sym = &b->syms[b->raw_ip[i].sym];
+
+		b->interposed[i].name   = b->heap + sym->name;
+		b->interposed[i].def    = sym->def;
+		b->interposed[i].object = b->raw_ip[i].object;
+	}
+	b->ninterposed = b->nraw_ip;
+
+	free(b->raw);
+	free(b->raw_ip);
+	b->raw = NULL;
+	b->raw_ip = NULL;
+
+	return 0;
+}
+
+/**
+ * rwelf_bind_files(const char *const*, size_t)
+ * Binds the undefined dynamic symbols of a set of objects given in load
+ * order, the executable first. Objects which cannot be read are kept in
+ * the set without symbols. Returns NULL when out of memory
+ */
+rwelf_binding *rwelf_bind_files(const char *const *paths, size_t n)
+{
+	rwelf_binding *b;
+	size_t i;
+
+	assert(paths != NULL);
+
+	if ((b = calloc(1, sizeof(rwelf_binding))) == NULL) {
+		return NULL;
+	}
+	if ((n && (b->paths = calloc(n, sizeof(char*))) == NULL)
+		|| _rehash(b) == -1) {
+		rwelf_bind_free(b);
+		return NULL;
+	}
+
+	for (i = 0; i < n; ++i) {
+		rwelf *elf;
+		int ret = 0;
+
+		if ((b->paths[i] = strdup(paths[i])) == NULL) {
+			rwelf_bind_free(b);
+			return NULL;
+		}
+		b->nobjects = i + 1;
+
+		if ((elf = rwelf_open_flags(paths[i], RWELF_OPEN_PREAD)) != NULL) {
+			ret = _load(b, elf, i);
+			rwelf_close(elf);
+		}
+		if (ret == -1) {
+			rwelf_bind_free(b);
+			return NULL;
+		}
+	}
+
+	if (_bind_refs(b) == -1) {
+		rwelf_bind_free(b);
+		return NULL;
+	}
+	return b;
+}
+
+typedef struct {
+	const char **paths;
+	size_t n;
+	size_t cap;
+} _bind_list;
+
+static int _add_dep(const rwelf_dep *dep, const char *name, const char *path,
+	void *arg)
+{
+	_bind_list *list = arg;
+
+	if (!dep) {
+		return 0;
+	}
+	if (_grow((void**) &list->paths, &list->cap, list->n, sizeof(char*)) == -1) {
+		return 1;
+	}
+	list->paths[list->n++] = path;
+
+	return 0;
+}
+
+/**
+ * rwelf_bind_deps(const rwelf_dep*)
+ * Binds the undefined dynamic symbols of a resolved file and of every
+ * library it loads (see rwelf_resolve). Returns NULL when out of memory
+ */
+rwelf_binding *rwelf_bind_deps(const rwelf_dep *root)
+{
+	_bind_list list = { NULL, 0, 0 };
+	rwelf_binding *b = NULL;
+
+	assert(root != NULL);
+
+	if (_grow((void**) &list.paths, &list.cap, 0, sizeof(char*)) == 0) {
+		list.paths[list.n++] = rwelf_dep_path(root);
+
+		rwelf_dep_foreach(root, _add_dep, &list);
+
+		b = rwelf_bind_files(list.paths, list.n);
+	}
+	free(list.paths);
+
+	return b;
+}
+
+/**
+ * rwelf_bind_free(rwelf_binding*)
+ * Releases the binding table
+ */
+void rwelf_bind_free(rwelf_binding *b)
+{
+	size_t i;
+
+	assert(b != NULL);
+
+	for (i = 0; i < b->nobjects; ++i) {
+		free(b->paths[i]);
+	}
+	free(b->paths);
+	free(b->heap);
+	free(b->syms);
+	free(b->slots);
+	free(b->raw);
+	free(b->raw_ip);
+	free(b->refs);
+	free(b->interposed);
+	free(b);
+}
+
+/**
+ * rwelf_bind_num_objects(const rwelf_binding*)
+ * Returns the number of objects in the set
+ */
+size_t rwelf_bind_num_objects(const rwelf_binding *b)
+{
+	assert(b != NULL);
+
+	return b->nobjects;
+}
+
+/**
+ * rwelf_bind_object_path(const rwelf_binding*, size_t)
+ * Returns the path of an object by load order
+ */
+const char *rwelf_bind_object_path(const rwelf_binding *b, size_t n)
+{
+	assert(b != NULL);
+	assert(b->nobjects > n);
+
+	return b->paths[n];
+}
+
+/**
+ * rwelf_bind_num_refs(const rwelf_binding*)
+ * Returns the number of undefined references of every object
+ */
+size_t rwelf_bind_num_refs(const rwelf_binding *b)
+{
+	assert(b != NULL);
+
+	return b->nrefs;
+}
+
+/**
+ * rwelf_bind_get_ref(const rwelf_binding*, size_t)
+ * Returns a reference by number. References are ordered by object and
+ * then by .dynsym index
+ */
+const rwelf_bind_ref *rwelf_bind_get_ref(const rwelf_binding *b, size_t n)
+{
+	assert(b != NULL);
+	assert(b->nrefs > n);
+
+	return &b->refs[n];
+}
+
+/**
+ * rwelf_bind_num_unresolved(const rwelf_binding*)
+ * Returns the number of non-weak references which bind to nothing
+ */
+size_t rwelf_bind_num_unresolved(const rwelf_binding *b)
+{
+	assert(b != NULL);
+
+	return b->nunresolved;
+}
+
+/**
+ * rwelf_bind_num_interposed(const rwelf_binding*)
+ * Returns the number of definitions hidden by an earlier object
+ */
+size_t rwelf_bind_num_interposed(const rwelf_binding *b)
+{
+	assert(b != NULL);
+
+	return b->ninterposed;
+}
+
+/**
+ * rwelf_bind_get_interposed(const rwelf_binding*, size_t)
+ * Returns an interposed definition by number
+ */
+const rwelf_bind_interposed *rwelf_bind_get_interposed(
+	const rwelf_binding *b, size_t n)
+{
+	assert(b != NULL);
+	assert(b->ninterposed > n);
+
+	return &b->interposed[n];
+}
+
+/**
+ * rwelf_bind_lookup(const rwelf_binding*, const char*, uint64_t*)
+ * Returns the object a name binds to, filling value with the st_value of
+ * the definition, or RWELF_BIND_NONE when no object defines it
+ */
+size_t rwelf_bind_lookup(const rwelf_binding *b, const char *name,
+	uint64_t *value)
+{
+	uint32_t hash;
+	size_t i;
+
+	assert(b != NULL);
+	assert(name != NULL);
+
+	hash = _str_hash(name) & ~1u;
+
+	for (i = hash & (b->cap - 1); b->slots[i]; i = (i + 1) & (b->cap - 1)) {
+		const _bind_sym *sym = &b->syms[b->slots[i] - 1];
+
+		if (sym->hash == hash && strcmp(b->heap + sym->name, name) == 0) {
+			if (value && sym->def != RWELF_BIND_NONE) {
+				*value = sym->value;
+			}
+			return sym->def;
+		}
+	}
+	return RWELF_BIND_NONE;
+}
@@ -0,0 +1,339 @@
+/**
+ * rwelf
+ * Copyright (c) 2012-2013 Felipe Pena <felipensp(at)gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "rwelf.h"
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * Offsets inside the NT_PRSTATUS descriptor (struct elf_prstatus). The
+ * generic part of the structure is the same on every Linux architecture,
+ * only the size of long (and so of struct timeval) depends on the class
+ */
+#define PRSTATUS_CURSIG_OFF        12
+#define PRSTATUS_PID_OFF(_is64)    ((_is64) ? 32 : 24)
+#define PRSTATUS_REG_OFF(_is64)    ((_is64) ? 112 : 72)
+#define PRSTATUS_TRAILER(_is64)    ((_is64) ? 8 : 4)    /* pr_fpvalid */
+
+/**
+ * Reads a word of the core's class from a note descriptor
+ */
+static uint64_t _word(const rwelf *elf, const unsigned char *p)
+{
+	if (ELF_IS_64(elf)) {
+		uint64_t v;
+		memcpy(&v, p, sizeof(v));
+		return v;
+	} else {
+		uint32_t v;
+		memcpy(&v, p, sizeof(v));
+		return v;
+	}
+}
+
+static void _decode_prstatus(rwelf_core *core, const Elf_Note *note)
+{
+	int is64 = ELF_IS_64(core->elf);
+	rwelf_core_thread *thr, *threads;
+	int16_t cursig;
+	int32_t pid;
+
+	if (note->descsz < PRSTATUS_REG_OFF(is64) + PRSTATUS_TRAILER(is64)) {
+		return;
+	}
+
+	threads = realloc(core->threads,
+		(core->nthreads + 1) * sizeof(rwelf_core_thread));
+	if (!threads) {
+		return;
+	}
+	core->threads = threads;
+	thr = &threads[core->nthreads++];
+
+	memcpy(&cursig, note->desc + PRSTATUS_CURSIG_OFF, sizeof(cursig));
+	memcpy(&pid, note->desc + PRSTATUS_PID_OFF(is64), sizeof(pid));
+
+	thr->pid       = pid;
+	thr->signo     = cursig;
+	thr->regs      = note->desc + PRSTATUS_REG_OFF(is64);
+	thr->regs_size = note->descsz - PRSTATUS_REG_OFF(is64)
+		- PRSTATUS_TRAILER(is64);
+}
+
+/**
+ * NT_FILE layout: count, page size, count * (start, end, page offset)
+ * and then count NUL-terminated file names, all words of the core's class
+ */
+static void _decode_file(rwelf_core *core, const Elf_Note *note)
+{
+	size_t word = ELF_IS_64(core->elf) ? 8 : 4;
+	const unsigned char *p = note->desc, *end = note->desc + note->descsz;
+	const char *name;
+	uint64_t count, page_size, i;
+
+	if (note->descsz < 2 * word) {
+		return;
+	}
+
+	count     = _word(core->elf, p);
+	page_size = _word(core->elf, p + word);
+	p += 2 * word;
+
+	if (count > (note->descsz - 2 * word) / (3 * word)) {
+		return;
+	}
+
+	core->files   = calloc(count, sizeof(rwelf_core_file));
+	core->modules = calloc(count, sizeof(rwelf*));
+
+	if (!core->files || !core->modules) {
+		return;
+	}
+
+	name = (const char*)(p + count * 3 * word);
+
+	for (i = 0; i < count && (const unsigned char*) name < end; ++i) {
+		rwelf_core_file *file = &core->files[i];
+		size_t len = strnlen(name, end - (const unsigned char*) name);
+
+		/* A name running to the end of the note is cut, drop it */
+		if ((const unsigned char*) name + len == end) {
+			break;
+		}
+		file->start  = _word(core->elf, p);
+		file->end    = _word(core->elf, p + word);
+		file->offset = _word(core->elf, p + 2 * word) * page_size;
+		file->name   = name;
+		p += 3 * word;
+
+		name += len + 1;
+	}
+	core->nfiles = i;
+}
+
+static int _decode_note(const Elf_Note *note, void *arg)
+{
+	rwelf_core *core = arg;
+
+	if (strcmp(note->name, "CORE") != 0) {
+		return 0;
+	}
+
+	switch (note->type) {
+		case NT_PRSTATUS:
+			_decode_prstatus(core, note);
+			break;
+		case NT_FILE:
+			if (!core->files) {
+				_decode_file(core, note);
+			}
+			break;
+		case NT_AUXV:
+			core->auxv      = note->desc;
+			core->auxv_size = note->descsz;
+			break;
+	}
+	return 0;
+}
+
+/**
+ * rwelf_core_open(const rwelf*)
+ * Parses the notes of an ET_CORE file. Returns NULL when the file is not
+ * a core file
+ */
+rwelf_core *rwelf_core_open(const rwelf *elf)
+{
+	rwelf_core *core;
+
+	assert(elf != NULL);
+
+	if (RWELF_EHDR(elf, e_type) != ET_CORE) {
+		return NULL;
+	}
+
+	if ((core = calloc(1, sizeof(rwelf_core))) == NULL) {
+		return NULL;
+	}
+	core->elf = elf;
+
+	/* PT_LOAD segments are already indexed by rwelf_open */
+	rwelf_foreach_note(elf, _decode_note, core);
+
+	return core;
+}
+
+/**
+ * rwelf_core_close(rwelf_core*)
+ * Releases the core data and the modules opened through it
+ */
+void rwelf_core_close(rwelf_core *core)
+{
+	size_t i;
+
+	assert(core != NULL);
+
+	for (i = 0; core->modules && i < core->nfiles; ++i) {
+		if (core->modules[i]) {
+			rwelf_close(core->modules[i]);
+		}
+	}
+
+	free(core->modules);
+	free(core->files);
+	free(core->threads);
+	free(core);
+}
+
+/**
+ * rwelf_core_vaddr_to_offset(const rwelf_core*, uint64_t, uint64_t*)
+ * Translates a virtual address of the dumped process to an offset in the
+ * core file. Returns -1 when the address has no data in the file
+ */
+int rwelf_core_vaddr_to_offset(const rwelf_core *core, uint64_t vaddr,
+	uint64_t *offset)
+{
+	assert(core != NULL);
+
+	if (rwelf_vaddr_to_offset(core->elf, vaddr, offset) != RWELF_VADDR_FILE) {
+		return -1;
+	}
+	return 0;
+}
+
+/**
+ * rwelf_core_read(const rwelf_core*, uint64_t, size_t)
+ * Returns a pointer into the mapped core for len bytes of process memory
+ * starting at vaddr, otherwise NULL is returned. Nothing is copied
+ */
+const unsigned char *rwelf_core_read(const rwelf_core *core, uint64_t vaddr,
+	size_t len)
+{
+	assert(core != NULL);
+
+	return rwelf_vaddr_to_ptr(core->elf, vaddr, len);
+}
+
+/**
+ * rwelf_core_num_threads(const rwelf_core*)
+ * Returns the number of threads (NT_PRSTATUS notes) in the core
+ */
+size_t rwelf_core_num_threads(const rwelf_core *core)
+{
+	assert(core != NULL);
+
+	return core->nthreads;
+}
+
+/**
+ * rwelf_core_get_thread(const rwelf_core*, size_t)
+ * Returns the thread by number. The registers point into the note, their
+ * layout is the elf_gregset_t of the core's machine
+ */
+const rwelf_core_thread *rwelf_core_get_thread(const rwelf_core *core,
+	size_t n)
+{
+	assert(core != NULL);
+	assert(core->nthreads > n);
+
+	return &core->threads[n];
+}
+
+/**
+ * rwelf_core_num_files(const rwelf_core*)
+ * Returns the number of mapped file entries (NT_FILE) in the core
+ */
+size_t rwelf_core_num_files(const rwelf_core *core)
+{
+	assert(core != NULL);
+
+	return core->nfiles;
+}
+
+/**
+ * rwelf_core_get_file(const rwelf_core*, size_t)
+ * Returns the mapped file entry by number
+ */
+const rwelf_core_file *rwelf_core_get_file(const rwelf_core *core, size_t n)
+{
+	assert(core != NULL);
+	assert(core->nfiles > n);
+
+	return &core->files[n];
+}
+
+/**
+ * rwelf_core_open_file(rwelf_core*, size_t)
+ * Opens the file behind a mapped file entry on first use. Entries sharing
+ * the same file share the handle, which is closed by rwelf_core_close.
+ * Returns NULL when the file cannot be opened
+ */
+rwelf *rwelf_core_open_file(rwelf_core *core, size_t n)
+{
+	size_t i;
+
+	assert(core != NULL);
+	assert(core->nfiles > n);
+
+	/* The handle lives on the first entry of the file */
+	for (i = 0; i < n; ++i) {
+		if (strcmp(core->files[i].name, core->files[n].name) == 0) {
+			break;
+		}
+	}
+
+	if (!core->modules[i]) {
+		core->modules[i] = rwelf_open(core->files[i].name);
+	}
+	return core->modules[i];
+}
+
+/**
+ * rwelf_core_get_auxv(const rwelf_core*, uint64_t, uint64_t*)
+ * Finds the auxiliary vector (NT_AUXV) entry by type and fills the out
+ * param with its value. Returns -1 when the entry is not found
+ */
+int rwelf_core_get_auxv(const rwelf_core *core, uint64_t type, uint64_t *val)
+{
+	size_t word, i;
+
+	assert(core != NULL);
+
+	word = ELF_IS_64(core->elf) ? 8 : 4;
+
+	for (i = 0; i + 2 * word <= core->auxv_size; i += 2 * word) {
+		uint64_t a_type = _word(core->elf, core->auxv + i);
+
+		if (a_type == AT_NULL) {
+			break;
+		}
+		if (a_type == type) {
+			if (val) {
+				*val = _word(core->elf, core->auxv + i + word);
+			}
+			return 0;
+		}
+	}
+	return -1;
+}
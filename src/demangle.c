@@ -0,0 +1,342 @@
+/**
+ * rwelf
+ * Copyright (c) 2012-2013 Felipe Pena <felipensp(at)gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "rwelf.h"
+#include <dlfcn.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * C++ demangling
+ *
+ * __cxa_demangle is looked up at run time, from the process itself or from
+ * libstdc++, so the library does not depend on the C++ runtime. Results are
+ * kept in a cache shared by every handle, since binaries linked against
+ * the same libraries carry the same mangled names. The cache is split in
+ * shards by hash, each with its own lock, so threads demangling different
+ * names rarely wait on each other. Cached strings stay valid until
+ * rwelf_demangle_cache_clear is called.
+ */
+
+#define _SHARD_BITS 4
+#define _SHARDS     (1 << _SHARD_BITS)
+
+typedef char *(*_cxa_demangle_fn)(const char*, char*, size_t*, int*);
+
+typedef struct {
+	uint64_t hash;
+	char *mangled;
+	char *demangled;          /* NULL when the name does not demangle */
+} _dm_entry;
+
+typedef struct {
+	pthread_mutex_t lock;
+	_dm_entry *entries;
+	size_t cap;               /* Power of two */
+	size_t used;
+} _dm_shard;
+
+static _dm_shard _shards[_SHARDS] = {
+#define S { PTHREAD_MUTEX_INITIALIZER, NULL, 0, 0 }
+	S, S, S, S, S, S, S, S, S, S, S, S, S, S, S, S
+#undef S
+};
+
+static pthread_once_t _init_once = PTHREAD_ONCE_INIT;
+static _cxa_demangle_fn _cxa_demangle;
+
+static void _init_demangler(void)
+{
+	void *handle;
+
+	*(void**)&_cxa_demangle = dlsym(RTLD_DEFAULT, "__cxa_demangle");
+
+	if (!_cxa_demangle
+		&& (handle = dlopen("libstdc++.so.6", RTLD_LAZY | RTLD_LOCAL)) != NULL) {
+		*(void**)&_cxa_demangle = dlsym(handle, "__cxa_demangle");
+	}
+}
+
+/* FNV-1a */
+static uint64_t _dm_hash(const char *s)
+{
+	uint64_t h = 0xcbf29ce484222325ULL;
+
+	while (*s) {
+		h = (h ^ (unsigned char) *s++) * 0x100000001b3ULL;
+	}
+	return h;
+}
+
+static _dm_shard *_dm_shard_of(uint64_t hash)
+{
+	return &_shards[hash >> (64 - _SHARD_BITS)];
+}
+
+/**
+ * Finds the slot of the name in the shard, which is empty when the name is
+ * not cached. The shard must be locked and have room
+ */
+static _dm_entry *_dm_find(_dm_shard *shard, uint64_t hash, const char *name)
+{
+	size_t i = hash & (shard->cap - 1);
+
+	for (;; i = (i + 1) & (shard->cap - 1)) {
+		_dm_entry *e = &shard->entries[i];
+
+		if (!e->mangled
+			|| (e->hash == hash && strcmp(e->mangled, name) == 0)) {
+			return e;
+		}
+	}
+}
+
+static int _dm_grow(_dm_shard *shard)
+{
+	_dm_entry *old = shard->entries;
+	size_t oldcap = shard->cap, i;
+
+	shard->cap = oldcap ? oldcap * 2 : 256;
+
+	if ((shard->entries = calloc(shard->cap, sizeof(_dm_entry))) == NULL) {
+		shard->entries = old;
+		shard->cap = oldcap;
+		return -1;
+	}
+	for (i = 0; i < oldcap; ++i) {
+		if (old[i].mangled) {
+			*_dm_find(shard, old[i].hash, old[i].mangled) = old[i];
+		}
+	}
+	free(old);
+
+	return 0;
+}
+
+/**
+ * Caches the result for the name, the shard must be locked. Returns the
+ * cached demangled string, or NULL when the name does not demangle
+ */
+static const char *_dm_insert(_dm_shard *shard, uint64_t hash,
+	const char *name, char *demangled)
+{
+	_dm_entry *e;
+
+	if ((shard->used + 1) * 10 > shard->cap * 7 && _dm_grow(shard) == -1) {
+		return demangled;     /* Leaked on purpose, the caller keeps it */
+	}
+
+	e = _dm_find(shard, hash, name);
+
+	if (e->mangled) {
+		/* Another thread got here first */
+		free(demangled);
+		return e->demangled;
+	}
+	if ((e->mangled = strdup(name)) == NULL) {
+		return demangled;
+	}
+	e->hash      = hash;
+	e->demangled = demangled;
+	++shard->used;
+
+	return demangled;
+}
+
+static char *_dm_run(const char *name)
+{
+	int status;
+
+	return _cxa_demangle ? _cxa_demangle(name, NULL, NULL, &status) : NULL;
+}
+
+/**
+ * rwelf_demangle_available()
+ * Returns 1 when a C++ demangler was found, otherwise 0
+ */
+int rwelf_demangle_available(void)
+{
+	pthread_once(&_init_once, _init_demangler);
+
+	return _cxa_demangle != NULL;
+}
+
+/**
+ * rwelf_demangle(const char*)
+ * Returns the demangled form of a C++ symbol name. Names which are not
+ * mangled, or when no demangler is available, are returned unchanged
+ */
+const char *rwelf_demangle(const char *name)
+{
+	const char *ret;
+	_dm_shard *shard;
+	uint64_t hash;
+	_dm_entry *e;
+	char *demangled;
+
+	assert(name != NULL);
+
+	if (name[0] != '_' || name[1] != 'Z' || !rwelf_demangle_available()) {
+		return name;
+	}
+
+	hash  = _dm_hash(name);
+	shard = _dm_shard_of(hash);
+
+	pthread_mutex_lock(&shard->lock);
+	if (shard->cap && (e = _dm_find(shard, hash, name))->mangled) {
+		ret = e->demangled;
+		pthread_mutex_unlock(&shard->lock);
+		return ret ? ret : name;
+	}
+	pthread_mutex_unlock(&shard->lock);
+
+	/* Demangle without holding the lock */
+	demangled = _dm_run(name);
+
+	pthread_mutex_lock(&shard->lock);
+	ret = _dm_insert(shard, hash, name, demangled);
+	pthread_mutex_unlock(&shard->lock);
+
+	return ret ? ret : name;
+}
+
+/**
+ * rwelf_demangle_batch(const char**, const char**, size_t)
+ * Demangles n names into out, like rwelf_demangle. Names are grouped by
+ * shard so each shard is locked once for the lookups and once for the
+ * insertions, instead of twice per name
+ */
+void rwelf_demangle_batch(const char **names, const char **out, size_t n)
+{
+	uint64_t *hashes;
+	size_t *order, count[_SHARDS + 1] = {0}, i, s;
+
+	assert(names != NULL);
+	assert(out != NULL);
+
+	if (!rwelf_demangle_available()) {
+		memcpy(out, names, n * sizeof(char*));
+		return;
+	}
+
+	hashes = malloc(n * sizeof(uint64_t));
+	order  = malloc(n * sizeof(size_t));
+
+	if (!hashes || !order) {
+		free(hashes);
+		free(order);
+		for (i = 0; i < n; ++i) {
+			out[i] = rwelf_demangle(names[i]);
+		}
+		return;
+	}
+
+	/* Counting sort of the mangled names by shard */
+	for (i = 0; i < n; ++i) {
+		out[i] = names[i];
+
+		if (names[i][0] == '_' && names[i][1] == 'Z') {
+			hashes[i] = _dm_hash(names[i]);
+			++count[(hashes[i] >> (64 - _SHARD_BITS)) + 1];
+		}
+	}
+	for (s = 0; s < _SHARDS; ++s) {
+		count[s + 1] += count[s];
+	}
+	for (i = 0; i < n; ++i) {
+		if (names[i][0] == '_' && names[i][1] == 'Z') {
+			order[count[hashes[i] >> (64 - _SHARD_BITS)]++] = i;
+		}
+	}
+
+	/* count[s] is now the end of shard s, and the start of shard s + 1 */
+	for (s = 0; s < _SHARDS; ++s) {
+		_dm_shard *shard = &_shards[s];
+		size_t start = s ? count[s - 1] : 0, end = count[s], j, nmiss = 0;
+
+		pthread_mutex_lock(&shard->lock);
+		for (j = start; j < end; ++j) {
+			_dm_entry *e;
+
+			i = order[j];
+
+			if (shard->cap
+				&& (e = _dm_find(shard, hashes[i], names[i]))->mangled) {
+				out[i] = e->demangled ? e->demangled : names[i];
+			} else {
+				order[start + nmiss++] = i;
+			}
+		}
+		pthread_mutex_unlock(&shard->lock);
+
+		if (!nmiss) {
+			continue;
+		}
+
+		/* Misses are demangled unlocked, results parked in out */
+		for (j = start; j < start + nmiss; ++j) {
+			out[order[j]] = _dm_run(names[order[j]]);
+		}
+
+		pthread_mutex_lock(&shard->lock);
+		for (j = start; j < start + nmiss; ++j) {
+			const char *ret;
+
+			i = order[j];
+			ret = _dm_insert(shard, hashes[i], names[i], (char*) out[i]);
+			out[i] = ret ? ret : names[i];
+		}
+		pthread_mutex_unlock(&shard->lock);
+	}
+
+	free(hashes);
+	free(order);
+}
+
+/**
+ * rwelf_demangle_cache_clear()
+ * Drops every cached name. Strings returned before become invalid
+ */
+void rwelf_demangle_cache_clear(void)
+{
+	size_t s, i;
+
+	for (s = 0; s < _SHARDS; ++s) {
+		_dm_shard *shard = &_shards[s];
+
+		pthread_mutex_lock(&shard->lock);
+		for (i = 0; i < shard->cap; ++i) {
+			free(shard->entries[i].mangled);
+			free(shard->entries[i].demangled);
+		}
+		free(shard->entries);
+		shard->entries = NULL;
+		shard->cap     = 0;
+		shard->used    = 0;
+		pthread_mutex_unlock(&shard->lock);
+	}
+}
@@ -0,0 +1,1022 @@
+/**
+ * rwelf
+ * Copyright (c) 2012-2013 Felipe Pena <felipensp(at)gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "rwelf.h"
+#include "internal.h"
+#include <sys/stat.h>
+#include <sys/utsname.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <glob.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * Shared library dependency resolver
+ *
+ * DT_NEEDED names are resolved the way ld.so does it, without running
+ * anything: a name with a slash is a path, otherwise the directories of
+ * DT_RPATH (ignored when DT_RUNPATH exists), LD_LIBRARY_PATH (with
+ * RWELF_RESOLVE_ENV), DT_RUNPATH, ld.so.cache and the default directories
+ * are tried in order. $ORIGIN, $LIB and $PLATFORM are expanded. A
+ * candidate is only taken when its class and machine match the object
+ * needing it. DT_RPATH is applied to the object's own dependencies only,
+ * not inherited down the tree, so a library resolves the same way from
+ * every binary and can be shared between them.
+ *
+ * As in ld.so, a needed name matching an object already loaded (by its
+ * needed name or DT_SONAME) is that object, whatever the search would
+ * find; this is applied while walking the tree in load order.
+ *
+ * Every object is kept in a table keyed by path (and by real path, so
+ * symlinks lead to the same object) and is parsed once for the life of
+ * the resolver, whichever binary reaches it first. Parsing and linking an
+ * object have their own locks, and parsing never waits on another
+ * object, so resolutions running on several threads cannot deadlock even
+ * on cyclic dependencies.
+ */
+
+#define _LD_SO_CACHE     "/etc/ld.so.cache"
+#define _LD_SO_CONF      "/etc/ld.so.conf"
+#define _CACHE_MAGIC     "glibc-ld.so.cache"
+#define _CACHE_VERSION   "1.1"
+#define _CACHE_OLD_MAGIC "ld.so-1.7.0"
+
+struct rwelf_dep {
+	char *path;               /* Path the object was first found at */
+	char *origin;             /* Directory of path ($ORIGIN) */
+	int found;                /* Whether it is a readable ELF file */
+	unsigned char class;
+	uint16_t machine;
+	char *soname;
+	char *interp;             /* PT_INTERP */
+	char *rpath;
+	char *runpath;
+	char **needed;
+	size_t nneeded;
+	rwelf_dep **deps;         /* Resolved needed objects, NULL if not found */
+	char **paths;             /* Where each of them was found */
+	int parsed;
+	int linked;
+	pthread_mutex_t parse_lock;
+	pthread_mutex_t link_lock;
+};
+
+typedef struct {
+	char *key;
+	rwelf_dep *dep;
+} _dep_slot;
+
+typedef struct {
+	const char *name;
+	const char *path;
+	size_t order;             /* Position in the cache, the preference */
+} _cache_entry;
+
+struct rwelf_resolver {
+	int flags;
+	pthread_mutex_t lock;     /* Protects the table */
+	_dep_slot *slots;
+	size_t cap;               /* Power of two */
+	size_t used;
+	rwelf_dep **all;          /* Every object, for destroy */
+	size_t nall;
+	char *cache;              /* ld.so.cache contents */
+	_cache_entry *entries;    /* Sorted by name */
+	size_t nentries;
+	char **conf_dirs;         /* ld.so.conf, used without a cache */
+	size_t nconf_dirs;
+	char *env_path;           /* LD_LIBRARY_PATH */
+	char platform[65];
+};
+
+static int _name_cmp(const void *a, const void *b)
+{
+	return strcmp(((const _cache_entry*) a)->name,
+		((const _cache_entry*) b)->name);
+}
+
+static int _entry_cmp(const void *a, const void *b)
+{
+	const _cache_entry *x = a, *y = b;
+	int ret;
+
+	if ((ret = strcmp(x->name, y->name)) != 0) {
+		return ret;
+	}
+	return x->order < y->order ? -1 : x->order > y->order;
+}
+
+/**
+ * Loads the new format ld.so.cache, which may follow an old format one.
+ * Its string offsets are relative to the new format header
+ */
+static void _load_cache(rwelf_resolver *r)
+{
+	size_t size = 0, off = 0, i, strings = 0;
+	const char *base;
+	uint32_t nlibs;
+	struct stat st;
+	ssize_t n;
+	int fd;
+
+	if ((fd = open(_LD_SO_CACHE, O_RDONLY | O_CLOEXEC)) == -1) {
+		return;
+	}
+	if (fstat(fd, &st) == 0 && st.st_size > 48
+		&& (r->cache = malloc(st.st_size)) != NULL) {
+		while (size < st.st_size
+			&& (n = read(fd, r->cache + size, st.st_size - size)) > 0) {
+			size += n;
+		}
+	}
+	close(fd);
+
+	if (size >= 16 && memcmp(r->cache, _CACHE_OLD_MAGIC,
+			sizeof(_CACHE_OLD_MAGIC) - 1) == 0) {
+		memcpy(&nlibs, r->cache + 12, sizeof(nlibs));
+		off = (16 + (uint64_t) nlibs * 12 + 7) & ~(size_t) 7;
+	}
+
+	if (size < off + 48 || memcmp(r->cache + off, _CACHE_MAGIC _CACHE_VERSION,
+			sizeof(_CACHE_MAGIC _CACHE_VERSION) - 1) != 0) {
+		free(r->cache);
+		r->cache = NULL;
+		return;
+	}
+
+	base = r->cache + off;
+	size -= off;
+	memcpy(&nlibs, base + 20, sizeof(nlibs));
+
+	if (nlibs > (size - 48) / 24
+		|| (r->entries = calloc(nlibs, sizeof(_cache_entry))) == NULL) {
+		return;
+	}
+
+	/* Entries: flags, key, value, osversion (4 bytes each), hwcap (8) */
+	for (i = 0; i < nlibs; ++i) {
+		const char *entry = base + 48 + i * 24;
+		uint32_t key, value;
+
+		memcpy(&key, entry + 4, sizeof(key));
+		memcpy(&value, entry + 8, sizeof(value));
+
+		if (key >= size || value >= size
+			|| !memchr(base + key, 0, size - key)
+			|| !memchr(base + value, 0, size - value)) {
+			continue;
+		}
+		r->entries[strings].name = base + key;
+		r->entries[strings].path = base + value;
+		r->entries[strings].order = i;
+		++strings;
+	}
+	r->nentries = strings;
+
+	qsort(r->entries, r->nentries, sizeof(_cache_entry), _entry_cmp);
+}
+
+static void _add_conf_dir(rwelf_resolver *r, const char *dir)
+{
+	char **dirs = realloc(r->conf_dirs, (r->nconf_dirs + 1) * sizeof(char*));
+
+	if (dirs && (dirs[r->nconf_dirs] = strdup(dir)) != NULL) {
+		++r->nconf_dirs;
+	}
+	if (dirs) {
+		r->conf_dirs = dirs;
+	}
+}
+
+/**
+ * Reads the directories of ld.so.conf, following include lines
+ */
+static void _load_conf(rwelf_resolver *r, const char *fname, int depth)
+{
+	char line[PATH_MAX];
+	FILE *fp;
+
+	if (depth > 8 || (fp = fopen(fname, "r")) == NULL) {
+		return;
+	}
+
+	while (fgets(line, sizeof(line), fp)) {
+		char *p = line, *end;
+
+		if ((end = strchr(p, '#')) != NULL) {
+			*end = '\0';
+		}
+		while (*p == ' ' || *p == '\t') {
+			++p;
+		}
+		end = p + strlen(p);
+		while (end > p && (end[-1] == '\n' || end[-1] == ' '
+				|| end[-1] == '\t')) {
+			*--end = '\0';
+		}
+		if (!*p) {
+			continue;
+		}
+
+		if (strncmp(p, "include", 7) == 0 && (p[7] == ' ' || p[7] == '\t')) {
+			glob_t g;
+			size_t i;
+
+			for (p += 8; *p == ' ' || *p == '\t'; ++p);
+
+			if (glob(p, 0, NULL, &g) == 0) {
+				for (i = 0; i < g.gl_pathc; ++i) {
+					_load_conf(r, g.gl_pathv[i], depth + 1);
+				}
+				globfree(&g);
+			}
+		} else if (*p == '/') {
+			_add_conf_dir(r, p);
+		}
+	}
+	fclose(fp);
+}
+
+/**
+ * rwelf_resolver_create(int)
+ * Creates a resolver. With RWELF_RESOLVE_ENV the LD_LIBRARY_PATH of the
+ * process is searched too. Returns NULL when out of memory
+ */
+rwelf_resolver *rwelf_resolver_create(int flags)
+{
+	rwelf_resolver *r;
+	struct utsname un;
+	const char *env;
+
+	if ((r = calloc(1, sizeof(rwelf_resolver))) == NULL) {
+		return NULL;
+	}
+
+	r->flags = flags;
+	r->cap   = 1024;
+
+	if ((r->slots = calloc(r->cap, sizeof(_dep_slot))) == NULL) {
+		free(r);
+		return NULL;
+	}
+	pthread_mutex_init(&r->lock, NULL);
+
+	if ((flags & RWELF_RESOLVE_ENV) && (env = getenv("LD_LIBRARY_PATH"))) {
+		r->env_path = strdup(env);
+	}
+
+	if (uname(&un) == 0) {
+		strncpy(r->platform, un.machine, sizeof(r->platform) - 1);
+	}
+
+	_load_cache(r);
+
+	/* ld.so only reads the cache, ld.so.conf is what it was built from */
+	if (!r->entries) {
+		_load_conf(r, _LD_SO_CONF, 0);
+	}
+
+	return r;
+}
+
+static void _dep_free(rwelf_dep *dep)
+{
+	size_t i;
+
+	for (i = 0; i < dep->nneeded; ++i) {
+		free(dep->needed[i]);
+		free(dep->paths ? dep->paths[i] : NULL);
+	}
+	pthread_mutex_destroy(&dep->parse_lock);
+	pthread_mutex_destroy(&dep->link_lock);
+	free(dep->needed);
+	free(dep->deps);
+	free(dep->paths);
+	free(dep->path);
+	free(dep->origin);
+	free(dep->soname);
+	free(dep->interp);
+	free(dep->rpath);
+	free(dep->runpath);
+	free(dep);
+}
+
+/**
+ * rwelf_resolver_destroy(rwelf_resolver*)
+ * Releases the resolver and every object it found
+ */
+void rwelf_resolver_destroy(rwelf_resolver *r)
+{
+	size_t i;
+
+	assert(r != NULL);
+
+	for (i = 0; i < r->cap; ++i) {
+		free(r->slots[i].key);
+	}
+	for (i = 0; i < r->nall; ++i) {
+		_dep_free(r->all[i]);
+	}
+	for (i = 0; i < r->nconf_dirs; ++i) {
+		free(r->conf_dirs[i]);
+	}
+	pthread_mutex_destroy(&r->lock);
+	free(r->conf_dirs);
+	free(r->env_path);
+	free(r->entries);
+	free(r->cache);
+	free(r->slots);
+	free(r->all);
+	free(r);
+}
+
+/**
+ * Finds the slot of the key, the table lock must be held
+ */
+static _dep_slot *_slot(rwelf_resolver *r, const char *key)
+{
+	size_t i = _str_hash(key) & (r->cap - 1);
+
+	while (r->slots[i].key && strcmp(r->slots[i].key, key) != 0) {
+		i = (i + 1) & (r->cap - 1);
+	}
+	return &r->slots[i];
+}
+
+static int _insert(rwelf_resolver *r, const char *key, rwelf_dep *dep)
+{
+	_dep_slot *slot;
+
+	if ((r->used + 1) * 10 > r->cap * 7) {
+		_dep_slot *old = r->slots;
+		size_t oldcap = r->cap, i;
+
+		if ((r->slots = calloc(oldcap * 2, sizeof(_dep_slot))) == NULL) {
+			r->slots = old;
+			return -1;
+		}
+		r->cap = oldcap * 2;
+
+		for (i = 0; i < oldcap; ++i) {
+			if (old[i].key) {
+				*_slot(r, old[i].key) = old[i];
+			}
+		}
+		free(old);
+	}
+
+	if ((slot = _slot(r, key))->key) {
+		return 0;
+	}
+	if ((slot->key = strdup(key)) == NULL) {
+		return -1;
+	}
+	slot->dep = dep;
+	++r->used;
+
+	return 0;
+}
+
+/**
+ * ld.so takes $ORIGIN from the path the object was opened by, symlinks
+ * are not followed
+ */
+static char *_origin(const char *path)
+{
+	char cwd[PATH_MAX], *origin;
+	const char *slash = strrchr(path, '/');
+	size_t len = slash ? (slash == path ? 1 : (size_t)(slash - path)) : 0;
+
+	if (*path == '/') {
+		return strndup(path, len);
+	}
+	if (getcwd(cwd, sizeof(cwd)) == NULL
+		|| (origin = malloc(strlen(cwd) + len + 2)) == NULL) {
+		return NULL;
+	}
+	sprintf(origin, "%s%s%.*s", cwd, len ? "/" : "", (int) len, path);
+
+	return origin;
+}
+
+/**
+ * Returns the object for the path, creating it unparsed on first use.
+ * Paths leading to the same file share the object, and so the $ORIGIN of
+ * the first one
+ */
+static rwelf_dep *_dep_get(rwelf_resolver *r, const char *path)
+{
+	char real[PATH_MAX];
+	rwelf_dep *dep, **all;
+	_dep_slot *slot;
+	int has_real;
+
+	pthread_mutex_lock(&r->lock);
+	dep = (slot = _slot(r, path))->key ? slot->dep : NULL;
+	pthread_mutex_unlock(&r->lock);
+
+	if (dep) {
+		return dep;
+	}
+
+	has_real = realpath(path, real) != NULL;
+
+	pthread_mutex_lock(&r->lock);
+
+	if ((slot = _slot(r, path))->key) {
+		dep = slot->dep;
+	} else if (has_real && (slot = _slot(r, real))->key) {
+		dep = slot->dep;
+		_insert(r, path, dep);
+	} else if ((dep = calloc(1, sizeof(rwelf_dep))) != NULL
+		&& (all = realloc(r->all, (r->nall + 1) * sizeof(rwelf_dep*))) != NULL) {
+		r->all = all;
+		r->all[r->nall++] = dep;
+
+		pthread_mutex_init(&dep->parse_lock, NULL);
+		pthread_mutex_init(&dep->link_lock, NULL);
+		dep->path   = strdup(path);
+		dep->origin = _origin(path);
+
+		if (has_real) {
+			_insert(r, real, dep);
+		}
+		_insert(r, path, dep);
+	} else {
+		free(dep);
+		dep = NULL;
+	}
+
+	pthread_mutex_unlock(&r->lock);
+
+	return dep;
+}
+
+/**
+ * Reads the dynamic entries of the object, once
+ */
+static void _dep_parse(rwelf_dep *dep)
+{
+	Elf_Dyn dyn;
+	rwelf *elf;
+	size_t i;
+
+	pthread_mutex_lock(&dep->parse_lock);
+
+	if (dep->parsed) {
+		pthread_mutex_unlock(&dep->parse_lock);
+		return;
+	}
+
+	if (dep->path && (elf = rwelf_open_flags(dep->path, RWELF_OPEN_PREAD))) {
+		dep->found   = 1;
+		dep->class   = elf->class;
+		dep->machine = RWELF_EHDR(elf, e_machine);
+
+		for (i = 0; elf->dynstr && i < rwelf_num_dynamic(elf); ++i) {
+			const char *val;
+			char **needed;
+
+			rwelf_get_dynamic_by_num(elf, i, &dyn);
+
+			if (rwelf_get_dynamic_tag(&dyn) == DT_NULL) {
+				break;
+			}
+			if ((val = (const char*) rwelf_get_dynamic_strval(&dyn)) == NULL) {
+				continue;
+			}
+
+			switch (rwelf_get_dynamic_tag(&dyn)) {
+				case DT_NEEDED:
+					needed = realloc(dep->needed,
+						(dep->nneeded + 1) * sizeof(char*));
+					if (needed) {
+						dep->needed = needed;
+						dep->needed[dep->nneeded++] = strdup(val);
+					}
+					break;
+				case DT_SONAME:  dep->soname  = strdup(val); break;
+				case DT_RPATH:   dep->rpath   = strdup(val); break;
+				case DT_RUNPATH: dep->runpath = strdup(val); break;
+			}
+		}
+
+		for (i = 0; i < RWELF_EHDR(elf, e_phnum); ++i) {
+			const char *interp;
+
+			if (RWELF_PHDR(elf, p_type, i) != PT_INTERP) {
+				continue;
+			}
+			interp = (const char*) rwelf_get_data(elf,
+				RWELF_PHDR(elf, p_offset, i), RWELF_PHDR(elf, p_filesz, i));
+
+			if (interp && RWELF_PHDR(elf, p_filesz, i)) {
+				dep->interp = strndup(interp, RWELF_PHDR(elf, p_filesz, i));
+			}
+		}
+		rwelf_close(elf);
+	}
+
+	dep->parsed = 1;
+
+	pthread_mutex_unlock(&dep->parse_lock);
+}
+
+/**
+ * Expands $ORIGIN, $LIB and $PLATFORM (also in the ${} form). Returns -1
+ * when the result does not fit
+ */
+static int _expand(const rwelf_resolver *r, const rwelf_dep *dep,
+	const char *in, size_t len, char *out, size_t size)
+{
+	static const char *vars[] = { "ORIGIN", "LIB", "PLATFORM" };
+	const char *end = in + len;
+	size_t n = 0, i;
+
+	while (in < end) {
+		const char *val = NULL;
+		size_t skip = 0;
+
+		if (*in == '$') {
+			for (i = 0; i < 3 && !val; ++i) {
+				size_t vlen = strlen(vars[i]);
+
+				if ((size_t)(end - in) >= vlen + 1
+					&& strncmp(in + 1, vars[i], vlen) == 0) {
+					skip = vlen + 1;
+				} else if ((size_t)(end - in) >= vlen + 3 && in[1] == '{'
+					&& strncmp(in + 2, vars[i], vlen) == 0
+					&& in[vlen + 2] == '}') {
+					skip = vlen + 3;
+				} else {
+					continue;
+				}
+
+				switch (i) {
+					case 0: val = dep->origin ? dep->origin : "."; break;
+					case 1: val = dep->class == ELFCLASS64 ? "lib64" : "lib"; break;
+					case 2: val = r->platform; break;
+				}
+			}
+		}
+
+		if (val) {
+			size_t vlen = strlen(val);
+
+			if (n + vlen >= size) {
+				return -1;
+			}
+			memcpy(out + n, val, vlen);
+			n  += vlen;
+			in += skip;
+		} else {
+			if (n + 1 >= size) {
+				return -1;
+			}
+			out[n++] = *in++;
+		}
+	}
+	out[n] = '\0';
+
+	return 0;
+}
+
+/**
+ * Takes the candidate when it is an ELF file of the same kind, keeping the
+ * path it was found at in at
+ */
+static rwelf_dep *_try(rwelf_resolver *r, const rwelf_dep *dep,
+	const char *path, char **at)
+{
+	rwelf_dep *cand;
+
+	if ((cand = _dep_get(r, path)) == NULL) {
+		return NULL;
+	}
+	_dep_parse(cand);
+
+	if (cand->found && cand->class == dep->class
+		&& cand->machine == dep->machine) {
+		*at = strdup(path);
+		return cand;
+	}
+	return NULL;
+}
+
+/**
+ * Tries name in every directory of a colon separated list
+ */
+static rwelf_dep *_try_dirs(rwelf_resolver *r, const rwelf_dep *dep,
+	const char *dirs, const char *name, char **at)
+{
+	char dir[PATH_MAX], path[PATH_MAX];
+	rwelf_dep *found;
+
+	while (dirs && *dirs) {
+		const char *colon = strchr(dirs, ':');
+		size_t len = colon ? (size_t)(colon - dirs) : strlen(dirs);
+
+		/* An empty entry is the current directory */
+		if (_expand(r, dep, len ? dirs : ".", len ? len : 1, dir,
+				sizeof(dir)) == 0
+			&& (size_t) snprintf(path, sizeof(path), "%s/%s", dir, name)
+				< sizeof(path)
+			&& (found = _try(r, dep, path, at)) != NULL) {
+			return found;
+		}
+		dirs = colon ? colon + 1 : NULL;
+	}
+	return NULL;
+}
+
+static rwelf_dep *_find_lib(rwelf_resolver *r, const rwelf_dep *dep,
+	const char *name, char **at)
+{
+	char path[PATH_MAX];
+	rwelf_dep *found;
+	_cache_entry key, *e;
+	size_t i;
+
+	if (strchr(name, '/')) {
+		if (_expand(r, dep, name, strlen(name), path, sizeof(path)) == -1) {
+			return NULL;
+		}
+		return _try(r, dep, path, at);
+	}
+
+	if (dep->rpath && !dep->runpath
+		&& (found = _try_dirs(r, dep, dep->rpath, name, at)) != NULL) {
+		return found;
+	}
+	if (r->env_path && (found = _try_dirs(r, dep, r->env_path, name, at)) != NULL) {
+		return found;
+	}
+	if (dep->runpath && (found = _try_dirs(r, dep, dep->runpath, name, at)) != NULL) {
+		return found;
+	}
+
+	if (r->nentries) {
+		key.name = name;
+
+		if ((e = bsearch(&key, r->entries, r->nentries, sizeof(_cache_entry),
+				_name_cmp)) != NULL) {
+			/* Back to the first entry of the name */
+			while (e > r->entries && strcmp(e[-1].name, name) == 0) {
+				--e;
+			}
+			for (; e < r->entries + r->nentries
+				&& strcmp(e->name, name) == 0; ++e) {
+				if ((found = _try(r, dep, e->path, at)) != NULL) {
+					return found;
+				}
+			}
+		}
+	} else {
+		for (i = 0; i < r->nconf_dirs; ++i) {
+			if ((found = _try_dirs(r, dep, r->conf_dirs[i], name, at)) != NULL) {
+				return found;
+			}
+		}
+	}
+
+	return _try_dirs(r, dep, dep->class == ELFCLASS64 ?
+		"/lib64:/usr/lib64:/lib:/usr/lib" : "/lib:/usr/lib", name, at);
+}
+
+/**
+ * Resolves the needed objects of an object, once
+ */
+static void _dep_link(rwelf_resolver *r, rwelf_dep *dep)
+{
+	size_t i;
+
+	pthread_mutex_lock(&dep->link_lock);
+
+	if (!dep->linked && dep->nneeded
+		&& (dep->paths = calloc(dep->nneeded, sizeof(char*))) != NULL
+		&& (dep->deps = calloc(dep->nneeded, sizeof(rwelf_dep*))) != NULL) {
+		for (i = 0; i < dep->nneeded; ++i) {
+			dep->deps[i] = _find_lib(r, dep, dep->needed[i], &dep->paths[i]);
+		}
+	}
+	dep->linked = 1;
+
+	pthread_mutex_unlock(&dep->link_lock);
+}
+
+typedef struct {
+	const rwelf_dep *dep;
+	const char *name;         /* Needed name it was loaded for */
+	const char *path;         /* Path it was found at */
+} _load;
+
+/**
+ * Returns the entry already queued for the name, as ld.so matches a
+ * needed name against the loaded objects before searching for it
+ */
+static const _load *_loaded(const _load *queue, size_t n, const char *name)
+{
+	size_t i;
+
+	for (i = 0; i < n; ++i) {
+		if ((queue[i].name && strcmp(queue[i].name, name) == 0)
+			|| (queue[i].dep && queue[i].dep->soname
+				&& strcmp(queue[i].dep->soname, name) == 0)) {
+			return &queue[i];
+		}
+	}
+	return NULL;
+}
+
+/**
+ * Calls cb for every object below the root in breadth-first (load) order,
+ * each once. Names which were not found are queued as a NULL object, so
+ * they are reported in order too. When link is set the objects are linked
+ * on the way
+ */
+static void _walk(rwelf_resolver *r, const rwelf_dep *root, int link,
+	int (*cb)(const rwelf_dep*, const char*, const char*, void*), void *arg)
+{
+	size_t head = 0, tail = 0, cap = 64, i, j;
+	_load *queue;
+
+	if ((queue = malloc(cap * sizeof(_load))) == NULL) {
+		return;
+	}
+	queue[tail].dep  = root;
+	queue[tail].name = NULL;
+	queue[tail].path = root->path;
+	++tail;
+
+	while (head < tail) {
+		const rwelf_dep *dep = queue[head].dep;
+
+		if (link && dep) {
+			_dep_link(r, (rwelf_dep*) dep);
+		}
+		if (cb && head && cb(dep, queue[head].name, queue[head].path, arg)) {
+			break;
+		}
+		++head;
+
+		for (i = 0; dep && dep->deps && i < dep->nneeded; ++i) {
+			const rwelf_dep *child = dep->deps[i];
+
+			if (_loaded(queue, tail, dep->needed[i])) {
+				continue;
+			}
+			for (j = 0; child && j < tail && queue[j].dep != child; ++j);
+
+			if (child && j < tail) {
+				continue;
+			}
+			if (tail == cap) {
+				_load *q = realloc(queue, cap * 2 * sizeof(_load));
+
+				if (!q) {
+					goto out;
+				}
+				queue = q;
+				cap *= 2;
+			}
+			queue[tail].dep  = child;
+			queue[tail].name = dep->needed[i];
+			queue[tail].path = dep->paths[i];
+			++tail;
+		}
+	}
+out:
+	free(queue);
+}
+
+/**
+ * rwelf_resolve(rwelf_resolver*, const char*)
+ * Resolves the whole dependency tree of a file. Objects already resolved
+ * for other files are reused. Returns NULL when out of memory; the
+ * returned object may be not found (see rwelf_dep_found)
+ */
+const rwelf_dep *rwelf_resolve(rwelf_resolver *r, const char *path)
+{
+	rwelf_dep *root;
+
+	assert(r != NULL);
+	assert(path != NULL);
+
+	if ((root = _dep_get(r, path)) == NULL) {
+		return NULL;
+	}
+	_dep_parse(root);
+
+	if (root->found) {
+		_walk(r, root, 1, NULL, NULL);
+	}
+	return root;
+}
+
+typedef struct {
+	rwelf_resolver *r;
+	const char *const *paths;
+	const rwelf_dep **out;
+	size_t n;
+	size_t next;
+	pthread_mutex_t lock;
+} _resolve_job;
+
+static void *_resolve_worker(void *arg)
+{
+	_resolve_job *job = arg;
+	size_t i;
+
+	for (;;) {
+		pthread_mutex_lock(&job->lock);
+		i = job->next++;
+		pthread_mutex_unlock(&job->lock);
+
+		if (i >= job->n) {
+			return NULL;
+		}
+		job->out[i] = rwelf_resolve(job->r, job->paths[i]);
+	}
+}
+
+/**
+ * rwelf_resolve_many(rwelf_resolver*, const char *const*, size_t, int,
+ *   const rwelf_dep**)
+ * Resolves n files on nthreads threads, filling out with the roots.
+ * Libraries shared between the files are resolved once. Returns 0, or -1
+ * when the threads cannot be started
+ */
+int rwelf_resolve_many(rwelf_resolver *r, const char *const *paths, size_t n,
+	int nthreads, const rwelf_dep **out)
+{
+	_resolve_job job;
+	pthread_t *threads;
+	int i, started = 0;
+
+	assert(r != NULL);
+	assert(paths != NULL);
+	assert(out != NULL);
+
+	job.r     = r;
+	job.paths = paths;
+	job.out   = out;
+	job.n     = n;
+	job.next  = 0;
+	pthread_mutex_init(&job.lock, NULL);
+
+	if (nthreads > 1 && (threads = calloc(nthreads, sizeof(pthread_t))) != NULL) {
+		for (i = 0; i < nthreads; ++i) {
+			if (pthread_create(&threads[started], NULL, _resolve_worker, &job) == 0) {
+				++started;
+			}
+		}
+		for (i = 0; i < started; ++i) {
+			pthread_join(threads[i], NULL);
+		}
+		free(threads);
+	}
+
+	/* Whatever is left, or everything when running on one thread */
+	_resolve_worker(&job);
+
+	pthread_mutex_destroy(&job.lock);
+
+	return 0;
+}
+
+/**
+ * rwelf_dep_foreach(const rwelf_dep*, int (*)(const rwelf_dep*,
+ *   const char*, const char*, void*), void*)
+ * Calls cb for every object below a resolved root in load order, each
+ * once, with the needed name it was loaded for and the path it was found
+ * at. Libraries which were not found are passed as a NULL object and
+ * path. Stops when cb returns non-zero
+ */
+void rwelf_dep_foreach(const rwelf_dep *root,
+	int (*cb)(const rwelf_dep*, const char*, const char*, void*), void *arg)
+{
+	assert(root != NULL);
+	assert(cb != NULL);
+
+	_walk(NULL, root, 0, cb, arg);
+}
+
+/**
+ * rwelf_dep_path(const rwelf_dep*)
+ * Returns the path the object was first found at, of the paths leading to
+ * the same file
+ */
+const char *rwelf_dep_path(const rwelf_dep *dep)
+{
+	assert(dep != NULL);
+
+	return dep->path;
+}
+
+/**
+ * rwelf_dep_found(const rwelf_dep*)
+ * Returns 1 when the object is a readable ELF file, otherwise 0
+ */
+int rwelf_dep_found(const rwelf_dep *dep)
+{
+	assert(dep != NULL);
+
+	return dep->found;
+}
+
+/**
+ * rwelf_dep_soname(const rwelf_dep*)
+ * Returns the DT_SONAME of the object, or NULL
+ */
+const char *rwelf_dep_soname(const rwelf_dep *dep)
+{
+	assert(dep != NULL);
+
+	return dep->soname;
+}
+
+/**
+ * rwelf_dep_interp(const rwelf_dep*)
+ * Returns the program interpreter (PT_INTERP) of the object, or NULL
+ */
+const char *rwelf_dep_interp(const rwelf_dep *dep)
+{
+	assert(dep != NULL);
+
+	return dep->interp;
+}
+
+/**
+ * rwelf_dep_num_needed(const rwelf_dep*)
+ * Returns the number of DT_NEEDED entries of the object
+ */
+size_t rwelf_dep_num_needed(const rwelf_dep *dep)
+{
+	assert(dep != NULL);
+
+	return dep->nneeded;
+}
+
+/**
+ * rwelf_dep_needed_name(const rwelf_dep*, size_t)
+ * Returns the name of a DT_NEEDED entry by number
+ */
+const char *rwelf_dep_needed_name(const rwelf_dep *dep, size_t n)
+{
+	assert(dep != NULL);
+	assert(dep->nneeded > n);
+
+	return dep->needed[n];
+}
+
+/**
+ * rwelf_dep_get_needed(const rwelf_dep*, size_t)
+ * Returns the object a DT_NEEDED entry resolved to, or NULL when it was
+ * not found
+ */
+const rwelf_dep *rwelf_dep_get_needed(const rwelf_dep *dep, size_t n)
+{
+	assert(dep != NULL);
+	assert(dep->nneeded > n);
+
+	return dep->deps ? dep->deps[n] : NULL;
+}
+
+/**
+ * rwelf_dep_needed_path(const rwelf_dep*, size_t)
+ * Returns the path a DT_NEEDED entry was found at, or NULL when it was not
+ * found
+ */
+const char *rwelf_dep_needed_path(const rwelf_dep *dep, size_t n)
+{
+	assert(dep != NULL);
+	assert(dep->nneeded > n);
+
+	return dep->paths ? dep->paths[n] : NULL;
+}
@@ -0,0 +1,435 @@
+/**
+ * rwelf
+ * Copyright (c) 2012-2013 Felipe Pena <felipensp(at)gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "rwelf.h"
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * Structural diff
+ *
+ * Each table (symbols, sections, .dynamic entries) of both files is turned
+ * into an array of items keyed by the hash of their name, sorted once and
+ * then walked side by side, so comparing two files is O(n log n) whatever
+ * their size. Local symbols are keyed by the STT_FILE symbol they follow
+ * as well, so statics of different translation units do not mix. Items
+ * still sharing a name (several DT_NEEDED, a static in two functions) are
+ * told apart by their rank in address order, the k-th of one file being
+ * matched with the k-th of the other.
+ *
+ * Symbols come from .symtab when both files have one, otherwise from
+ * .dynsym, and only defined ones are compared. Addresses are expected to
+ * move between builds and are never compared. Of the .dynamic entries, the
+ * ones holding a string are matched by it and the flags by value; the
+ * others (addresses and sizes of tables) only count when they appear or
+ * disappear.
+ */
+
+typedef struct {
+	uint32_t hash;
+	int64_t tag;              /* .dynamic tag, 0 for the other tables */
+	const char *scope;        /* STT_FILE of a local symbol */
+	const char *name;
+	uint64_t order;           /* Ranks items sharing a name */
+	uint32_t rank;
+	uint64_t value;           /* Address, or d_val */
+	uint64_t size;
+	uint64_t attr;            /* Compared as is: type, flags, binding... */
+	const unsigned char *data; /* Section contents */
+} _diff_item;
+
+typedef struct {
+	_diff_item *items;
+	size_t n;
+} _diff_table;
+
+typedef struct {
+	rwelf_diff_entry *entries;
+	size_t n;
+	size_t cap;
+} _diff_out;
+
+static uint32_t _hash(uint32_t h, const char *s)
+{
+	while (*s) {
+		h = (h ^ (unsigned char) *s++) * 16777619u;
+	}
+	return h;
+}
+
+static int _strcmp_null(const char *x, const char *y)
+{
+	if (!x || !y) {
+		return x ? 1 : y ? -1 : 0;
+	}
+	return strcmp(x, y);
+}
+
+/**
+ * Compares the keys of two items, the rank included when set
+ */
+static int _key_cmp(const _diff_item *x, const _diff_item *y, int rank)
+{
+	int ret;
+
+	if (x->hash != y->hash) {
+		return x->hash < y->hash ? -1 : 1;
+	}
+	if (x->tag != y->tag) {
+		return x->tag < y->tag ? -1 : 1;
+	}
+	if ((ret = strcmp(x->name, y->name)) != 0
+		|| (ret = _strcmp_null(x->scope, y->scope)) != 0) {
+		return ret;
+	}
+	if (rank) {
+		return x->rank < y->rank ? -1 : x->rank > y->rank;
+	}
+	return x->order < y->order ? -1 : x->order > y->order;
+}
+
+static int _item_cmp(const void *a, const void *b)
+{
+	return _key_cmp(a, b, 0);
+}
+
+static int _add(_diff_table *t, size_t *cap, int64_t tag, const char *scope,
+	const char *name, uint64_t order)
+{
+	_diff_item *item;
+
+	if (t->n == *cap) {
+		size_t n = *cap ? *cap * 2 : 256;
+		_diff_item *items = realloc(t->items, n * sizeof(_diff_item));
+
+		if (!items) {
+			return -1;
+		}
+		t->items = items;
+		*cap = n;
+	}
+	item = &t->items[t->n++];
+	memset(item, 0, sizeof(_diff_item));
+
+	item->hash  = _hash(_hash(2166136261u ^ (uint32_t) tag, name),
+		scope ? scope : "");
+	item->tag   = tag;
+	item->scope = scope;
+	item->name  = name;
+	item->order = order;
+
+	return 0;
+}
+
+static int _load_symbols(_diff_table *t, const rwelf *elf, int dynamic)
+{
+	size_t n = dynamic ? elf->ndynsyms : elf->nsyms, cap = 0, i;
+	const unsigned char *strtab = dynamic ? elf->dynstr : elf->strtab;
+	const char *scope = NULL;
+
+	for (i = 1; strtab && i < n; ++i) {
+		unsigned char info;
+		const char *name;
+		_diff_item *item;
+
+#define SYM(_field) (dynamic ? RWELF(elf, DYNSYM, _field, i) : RWELF(elf, SYM, _field, i))
+		info = SYM(st_info);
+		name = (const char*)(strtab + SYM(st_name));
+
+		if (ELF64_ST_TYPE(info) == STT_FILE) {
+			scope = name;
+			continue;
+		}
+		if (SYM(st_shndx) == SHN_UNDEF || !*name
+			|| ELF64_ST_TYPE(info) == STT_SECTION) {
+			continue;
+		}
+		if (_add(t, &cap, 0, ELF64_ST_BIND(info) == STB_LOCAL ? scope : NULL,
+				name, SYM(st_value)) == -1) {
+			return -1;
+		}
+		item = &t->items[t->n - 1];
+		item->value = SYM(st_value);
+		item->size  = SYM(st_size);
+		item->attr  = info | (uint64_t) ELF64_ST_VISIBILITY(SYM(st_other)) << 8;
+#undef SYM
+	}
+	return 0;
+}
+
+static int _load_sections(_diff_table *t, const rwelf *elf)
+{
+	size_t cap = 0, i;
+
+	for (i = 1; elf->shstrtab && i < RWELF_EHDR(elf, e_shnum); ++i) {
+		const char *name = (const char*)(elf->shstrtab
+			+ RWELF_SHDR(elf, sh_name, i));
+		_diff_item *item;
+
+		if (!*name || _add(t, &cap, 0, NULL, name, i) == -1) {
+			if (*name) {
+				return -1;
+			}
+			continue;
+		}
+		item = &t->items[t->n - 1];
+		item->value = RWELF_SHDR(elf, sh_addr, i);
+		item->size  = RWELF_SHDR(elf, sh_size, i);
+		item->attr  = RWELF_SHDR(elf, sh_type, i)
+			| RWELF_SHDR(elf, sh_flags, i) << 32;
+
+		if (RWELF_SHDR(elf, sh_type, i) != SHT_NOBITS) {
+			item->data = rwelf_get_data(elf, RWELF_SHDR(elf, sh_offset, i),
+				item->size);
+		}
+	}
+	return 0;
+}
+
+static int _load_dynamic(_diff_table *t, const rwelf *elf)
+{
+	size_t cap = 0, i;
+	Elf_Dyn dyn;
+
+	for (i = 0; i < rwelf_num_dynamic(elf); ++i) {
+		const char *name = NULL;
+		int64_t tag;
+		_diff_item *item;
+
+		rwelf_get_dynamic_by_num(elf, i, &dyn);
+
+		if ((tag = rwelf_get_dynamic_tag(&dyn)) == DT_NULL) {
+			break;
+		}
+		if (elf->dynstr) {
+			name = (const char*) rwelf_get_dynamic_strval(&dyn);
+		}
+		if (_add(t, &cap, tag, NULL,
+				name ? name : rwelf_get_dynamic_tag_name(&dyn), i) == -1) {
+			return -1;
+		}
+		item = &t->items[t->n - 1];
+		item->value = rwelf_get_dynamic_val(&dyn);
+
+		switch (tag) {
+			case DT_FLAGS:
+			case DT_FLAGS_1:
+			case DT_PLTREL:
+			case DT_VERDEFNUM:
+			case DT_VERNEEDNUM:
+				item->attr = item->value;
+				break;
+		}
+	}
+	return 0;
+}
+
+/**
+ * Orders the items and ranks the ones sharing a name
+ */
+static void _sort(_diff_table *t)
+{
+	size_t i;
+
+	qsort(t->items, t->n, sizeof(_diff_item), _item_cmp);
+
+	for (i = 1; i < t->n; ++i) {
+		const _diff_item *prev = &t->items[i - 1];
+
+		if (prev->hash == t->items[i].hash && prev->tag == t->items[i].tag
+			&& strcmp(prev->name, t->items[i].name) == 0
+			&& _strcmp_null(prev->scope, t->items[i].scope) == 0) {
+			t->items[i].rank = prev->rank + 1;
+		}
+	}
+}
+
+static int _emit(_diff_out *out, int what, int change, const _diff_item *old,
+	const _diff_item *new)
+{
+	const _diff_item *item = new ? new : old;
+	rwelf_diff_entry *e;
+
+	if (out->n == out->cap) {
+		size_t cap = out->cap ? out->cap * 2 : 64;
+		rwelf_diff_entry *entries = realloc(out->entries,
+			cap * sizeof(rwelf_diff_entry));
+
+		if (!entries) {
+			return -1;
+		}
+		out->entries = entries;
+		out->cap = cap;
+	}
+	e = &out->entries[out->n++];
+	memset(e, 0, sizeof(rwelf_diff_entry));
+
+	e->what   = what;
+	e->change = change;
+	e->scope  = item->scope;
+	e->name   = item->name;
+	e->tag    = item->tag;
+
+	if (old) {
+		e->old_value = old->value;
+		e->old_size  = old->size;
+	}
+	if (new) {
+		e->new_value = new->value;
+		e->new_size  = new->size;
+	}
+	return 0;
+}
+
+/**
+ * Walks both sorted tables side by side
+ */
+static int _merge(_diff_out *out, int what, const _diff_table *a,
+	const _diff_table *b)
+{
+	size_t i = 0, j = 0;
+	int ret = 0;
+
+	while (ret == 0 && (i < a->n || j < b->n)) {
+		const _diff_item *x = i < a->n ? &a->items[i] : NULL;
+		const _diff_item *y = j < b->n ? &b->items[j] : NULL;
+		int c = !x ? 1 : !y ? -1 : _key_cmp(x, y, 1);
+
+		if (c < 0) {
+			ret = _emit(out, what, RWELF_DIFF_REMOVED, x, NULL);
+			++i;
+			continue;
+		}
+		if (c > 0) {
+			ret = _emit(out, what, RWELF_DIFF_ADDED, NULL, y);
+			++j;
+			continue;
+		}
+
+		if (x->size != y->size) {
+			ret = _emit(out, what, RWELF_DIFF_RESIZED, x, y);
+		} else if (x->attr != y->attr || (x->data && y->data
+				&& memcmp(x->data, y->data, x->size) != 0)) {
+			ret = _emit(out, what, RWELF_DIFF_CHANGED, x, y);
+		}
+		++i;
+		++j;
+	}
+	return ret;
+}
+
+static int _entry_cmp(const void *a, const void *b)
+{
+	const rwelf_diff_entry *x = a, *y = b;
+	int ret;
+
+	if (x->what != y->what) {
+		return x->what - y->what;
+	}
+	if (x->tag != y->tag) {
+		return x->tag < y->tag ? -1 : 1;
+	}
+	if ((ret = strcmp(x->name, y->name)) != 0
+		|| (ret = _strcmp_null(x->scope, y->scope)) != 0) {
+		return ret;
+	}
+	return x->change - y->change;
+}
+
+/**
+ * rwelf_diff(const rwelf*, const rwelf*, int, int (*)(const
+ *   rwelf_diff_entry*, void*), void*)
+ * Compares the tables selected by what (RWELF_DIFF_SYMBOL, _SECTION,
+ * _DYNAMIC) of an old and a new file, calling cb for every difference in
+ * table and name order; names point into the files. Stops when cb returns
+ * non-zero. Returns the number of differences, or -1 when out of memory
+ */
+int rwelf_diff(const rwelf *a, const rwelf *b, int what,
+	int (*cb)(const rwelf_diff_entry*, void*), void *arg)
+{
+	_diff_table ta = { NULL, 0 }, tb = { NULL, 0 };
+	_diff_out out = { NULL, 0, 0 };
+	int ret = 0, dynamic;
+	size_t i;
+
+	assert(a != NULL);
+	assert(b != NULL);
+	assert(cb != NULL);
+
+	dynamic = !a->nsyms || !b->nsyms;
+
+#define TABLE(_what, _load_a, _load_b) \
+	if (ret == 0 && (what & _what)) {                                  \
+		ret = (_load_a) == -1 || (_load_b) == -1 ? -1 : 0;             \
+		if (ret == 0) {                                                \
+			_sort(&ta);                                                \
+			_sort(&tb);                                                \
+			ret = _merge(&out, _what, &ta, &tb);                       \
+		}                                                              \
+		free(ta.items);                                                \
+		free(tb.items);                                                \
+		ta.items = tb.items = NULL;                                    \
+		ta.n = tb.n = 0;                                               \
+	}
+
+	TABLE(RWELF_DIFF_SYMBOL, _load_symbols(&ta, a, dynamic),
+		_load_symbols(&tb, b, dynamic));
+	TABLE(RWELF_DIFF_SECTION, _load_sections(&ta, a), _load_sections(&tb, b));
+	TABLE(RWELF_DIFF_DYNAMIC, _load_dynamic(&ta, a), _load_dynamic(&tb, b));
+#undef TABLE
+
+	if (ret == -1) {
+		free(out.entries);
+		return -1;
+	}
+
+	/* Only the differences are put in a readable order */
+	qsort(out.entries, out.n, sizeof(rwelf_diff_entry), _entry_cmp);
+
+	for (i = 0; i < out.n; ++i) {
+		if (cb(&out.entries[i], arg)) {
+			break;
+		}
+	}
+	free(out.entries);
+
+	return out.n;
+}
+
+/**
+ * rwelf_diff_change_name(int)
+ * Returns the RWELF_DIFF_* change as string
+ */
+const char *rwelf_diff_change_name(int change)
+{
+	switch (change) {
+		case RWELF_DIFF_ADDED:   return "added";
+		case RWELF_DIFF_REMOVED: return "removed";
+		case RWELF_DIFF_RESIZED: return "resized";
+		case RWELF_DIFF_CHANGED: return "changed";
+		default:
+			return "UNKNOWN";
+	}
+}
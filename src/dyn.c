@@ -45,6 +45,8 @@ void rwelf_get_dynamic_by_num(const rwelf *elf, size_t num, Elf_Dyn *dyn)
 {
 	assert(elf != NULL);
 
+	RWELF_STAT(elf, RWELF_STAT_DYNAMIC_BY_NUM, 1);
+
 	if (dyn) {
 		_copy_dyn(elf, dyn, num);
 	}
@@ -61,14 +63,20 @@ int rwelf_get_dynamic_by_tag(const rwelf *elf, int64_t tag, Elf_Dyn *dyn)
 
 	assert(elf != NULL);
 
+	RWELF_STAT(elf, RWELF_STAT_DYNAMIC_BY_TAG, 1);
+
 	for (i = 0; i < elf->ndyns; ++i) {
 		if (RWELF_DYN(elf, d_tag, i) == tag) {
+			RWELF_STAT(elf, RWELF_STAT_SCAN_STEPS, i + 1);
+
 			if (dyn) {
 				_copy_dyn(elf, dyn, i);
 			}
 			return i;
 		}
 	}
+	RWELF_STAT(elf, RWELF_STAT_SCAN_STEPS, i);
+
 	return -1;
 }
 
@@ -105,6 +113,18 @@ int64_t rwelf_get_dynamic_tag(const Elf_Dyn *dyn)
 	return RWELF_DYN_DATA(dyn, d_tag);
 }
 
+/**
+ * rwelf_get_dynamic_val(const Elf_Dyn*)
+ * Returns the .dynamic entry's value (d_val or d_ptr)
+ */
+uint64_t rwelf_get_dynamic_val(const Elf_Dyn *dyn)
+{
+	assert(dyn != NULL);
+	assert(dyn->elf != NULL);
+
+	return RWELF_DYN_DATA(dyn, d_un.d_val);
+}
+
 /**
  * rwelf_get_dynamic_tag_name(const Elf_Dyn *dyn)
  * Returns the .dynamic entry's tag as string
@@ -142,6 +162,22 @@ const char *rwelf_get_dynamic_tag_name(const Elf_Dyn *dyn)
 		CASE(DT_JMPREL);
 		CASE(DT_BIND_NOW);
 		CASE(DT_RUNPATH);
+		CASE(DT_INIT_ARRAY);
+		CASE(DT_FINI_ARRAY);
+		CASE(DT_INIT_ARRAYSZ);
+		CASE(DT_FINI_ARRAYSZ);
+		CASE(DT_FLAGS);
+		CASE(DT_PREINIT_ARRAY);
+		CASE(DT_PREINIT_ARRAYSZ);
+		CASE(DT_GNU_HASH);
+		CASE(DT_VERSYM);
+		CASE(DT_RELACOUNT);
+		CASE(DT_RELCOUNT);
+		CASE(DT_FLAGS_1);
+		CASE(DT_VERDEF);
+		CASE(DT_VERDEFNUM);
+		CASE(DT_VERNEED);
+		CASE(DT_VERNEEDNUM);
 		CASE(DT_LOPROC);
 		CASE(DT_HIPROC);
 		default:
@@ -36,90 +36,397 @@
  */
 static void inline _find_str_tables(rwelf *elf)
 {
+	const unsigned char *data;
 	Elf_Shdr shdr;
 
+	/* Stripped files may have no section header table at all */
+	if (RWELF_EHDR(elf, e_shnum) == 0
+		|| RWELF_EHDR(elf, e_shstrndx) >= RWELF_EHDR(elf, e_shnum)) {
+		return;
+	}
+
 	/* String table for section names (.shstrtab) */
-	elf->shstrtab = elf->file +
-		RWELF_SHDR(elf, sh_offset, RWELF_EHDR(elf, e_shstrndx));
+	elf->shstrtab = (unsigned char*) rwelf_get_data(elf,
+		RWELF_SHDR(elf, sh_offset, RWELF_EHDR(elf, e_shstrndx)),
+		RWELF_SHDR(elf, sh_size, RWELF_EHDR(elf, e_shstrndx)));
+
+	if (!elf->shstrtab) {
+		return;
+	}
 
 	/* Symbol table */
-	if (rwelf_get_section_by_name(elf, ".symtab", &shdr) != -1) {
+	if (rwelf_get_section_by_name(elf, ".symtab", &shdr) != -1
+		&& (data = rwelf_get_section_data(&shdr)) != NULL) {
 		if (ELF_IS_64(elf)) {
-			SYM64(elf) = (Elf64_Sym*)(elf->file +
-				RWELF_SHDR_DATA(&shdr, sh_offset));
+			SYM64(elf) = (Elf64_Sym*) data;
 		} else {
-			SYM32(elf) = (Elf32_Sym*)(elf->file +
-				RWELF_SHDR_DATA(&shdr, sh_offset));
+			SYM32(elf) = (Elf32_Sym*) data;
 		}
 		elf->nsyms = rwelf_get_num_entries(&shdr);
 	}
 
 	/* Symbol name string table */
 	if (rwelf_get_section_by_name(elf, ".strtab", &shdr) != -1) {
-		elf->strtab = elf->file + RWELF_SHDR_DATA(&shdr, sh_offset);
+		elf->strtab = (unsigned char*) rwelf_get_section_data(&shdr);
 	}
 
 	/* Dynamic string table */
 	if (rwelf_get_section_by_name(elf, ".dynstr", &shdr) != -1) {
-		elf->dynstr = elf->file + RWELF_SHDR_DATA(&shdr, sh_offset);
+		elf->dynstr = (unsigned char*) rwelf_get_section_data(&shdr);
 	}
 
 	/* Dynamic symbol table */
-	if (rwelf_get_section_by_name(elf, ".dynsym", &shdr) != -1) {
+	if (rwelf_get_section_by_name(elf, ".dynsym", &shdr) != -1
+		&& (data = rwelf_get_section_data(&shdr)) != NULL) {
 		if (ELF_IS_32(elf)) {
-			DYNSYM32(elf) = (Elf32_Sym*)(elf->file +
-				RWELF_SHDR_DATA(&shdr, sh_offset));
+			DYNSYM32(elf) = (Elf32_Sym*) data;
 		} else {
-			DYNSYM64(elf) = (Elf64_Sym*)(elf->file +
-				RWELF_SHDR_DATA(&shdr, sh_offset));
+			DYNSYM64(elf) = (Elf64_Sym*) data;
 		}
 		elf->ndynsyms = rwelf_get_num_entries(&shdr);
 	}
 
 	/* Dynamic section */
-	if (rwelf_get_section_by_name(elf, ".dynamic", &shdr) != -1) {
+	if (rwelf_get_section_by_name(elf, ".dynamic", &shdr) != -1
+		&& (data = rwelf_get_section_data(&shdr)) != NULL) {
 		if (ELF_IS_32(elf)) {
-			DYN32(elf) = (Elf32_Dyn*)(elf->file +
-				RWELF_SHDR_DATA(&shdr, sh_offset));
+			DYN32(elf) = (Elf32_Dyn*) data;
 		} else {
-			DYN64(elf) = (Elf64_Dyn*)(elf->file +
-				RWELF_SHDR_DATA(&shdr, sh_offset));
+			DYN64(elf) = (Elf64_Dyn*) data;
 		}
 		elf->ndyns = rwelf_get_num_entries(&shdr);
 	}
 }
 
+/**
+ * Counts the symbols of .dynsym through the DT_GNU_HASH table: the highest
+ * symbol reachable from the buckets is followed down its chain until the
+ * end-of-chain bit
+ */
+static size_t _gnu_hash_nsyms(const rwelf *elf, uint64_t vaddr)
+{
+	const uint32_t *hdr, *buckets, *h;
+	uint32_t nbuckets, symoffset, bloom_size, max = 0, i;
+	size_t word = ELF_IS_64(elf) ? 8 : 4;
+	uint64_t chain;
+
+	if ((hdr = (const uint32_t*) rwelf_vaddr_to_ptr(elf, vaddr, 16)) == NULL) {
+		return 0;
+	}
+
+	nbuckets   = hdr[0];
+	symoffset  = hdr[1];
+	bloom_size = hdr[2];
+
+	buckets = (const uint32_t*) rwelf_vaddr_to_ptr(elf,
+		vaddr + 16 + bloom_size * word, nbuckets * sizeof(uint32_t));
+	if (!buckets) {
+		return 0;
+	}
+
+	for (i = 0; i < nbuckets; ++i) {
+		if (buckets[i] > max) {
+			max = buckets[i];
+		}
+	}
+	if (max < symoffset) {
+		return symoffset;
+	}
+
+	chain = vaddr + 16 + bloom_size * word + nbuckets * sizeof(uint32_t);
+
+	while ((h = (const uint32_t*) rwelf_vaddr_to_ptr(elf,
+			chain + (max - symoffset) * sizeof(uint32_t),
+			sizeof(uint32_t))) != NULL && !(*h & 1)) {
+		++max;
+	}
+	return max + 1;
+}
+
+/**
+ * Finds .dynamic, .dynsym, .dynstr and the dynamic relocations through
+ * PT_DYNAMIC, using the segments only. Tables already found by section
+ * name are kept
+ */
+static void _find_dyn_tables(rwelf *elf)
+{
+	uint64_t strtab = 0, symtab = 0, hash = 0, gnu_hash = 0;
+	uint64_t jmprel = 0, pltrelsz = 0, pltrel = 0, rela = 0, relasz = 0;
+	uint64_t rel = 0, relsz = 0, strsz = 0;
+	const unsigned char *p;
+	size_t i, entsize;
+
+	entsize = ELF_IS_64(elf) ? sizeof(Elf64_Dyn) : sizeof(Elf32_Dyn);
+
+	if (!elf->ndyns) {
+		for (i = 0; i < RWELF_EHDR(elf, e_phnum); ++i) {
+			if (RWELF_PHDR(elf, p_type, i) != PT_DYNAMIC) {
+				continue;
+			}
+			p = rwelf_get_data(elf, RWELF_PHDR(elf, p_offset, i),
+				RWELF_PHDR(elf, p_filesz, i));
+			if (!p) {
+				break;
+			}
+			if (ELF_IS_32(elf)) {
+				DYN32(elf) = (Elf32_Dyn*) p;
+			} else {
+				DYN64(elf) = (Elf64_Dyn*) p;
+			}
+			elf->ndyns = RWELF_PHDR(elf, p_filesz, i) / entsize;
+			break;
+		}
+	}
+
+	for (i = 0; i < elf->ndyns; ++i) {
+		uint64_t val = RWELF_DYN(elf, d_un.d_val, i);
+
+		switch (RWELF_DYN(elf, d_tag, i)) {
+			case DT_STRTAB:   strtab   = val; break;
+			case DT_STRSZ:    strsz    = val; break;
+			case DT_SYMTAB:   symtab   = val; break;
+			case DT_HASH:     hash     = val; break;
+			case DT_GNU_HASH: gnu_hash = val; break;
+			case DT_JMPREL:   jmprel   = val; break;
+			case DT_PLTRELSZ: pltrelsz = val; break;
+			case DT_PLTREL:   pltrel   = val; break;
+			case DT_RELA:     rela     = val; break;
+			case DT_RELASZ:   relasz   = val; break;
+			case DT_REL:      rel      = val; break;
+			case DT_RELSZ:    relsz    = val; break;
+		}
+		if (RWELF_DYN(elf, d_tag, i) == DT_NULL) {
+			break;
+		}
+	}
+
+	if (!elf->dynstr && strtab) {
+		elf->dynstr = (unsigned char*) rwelf_vaddr_to_ptr(elf, strtab, strsz);
+	}
+
+	if (!elf->ndynsyms && symtab) {
+		size_t n = 0;
+
+		if (hash && (p = rwelf_vaddr_to_ptr(elf, hash, 8)) != NULL) {
+			n = ((const uint32_t*) p)[1]; /* nchain */
+		} else if (gnu_hash) {
+			n = _gnu_hash_nsyms(elf, gnu_hash);
+		}
+
+		entsize = ELF_IS_64(elf) ? sizeof(Elf64_Sym) : sizeof(Elf32_Sym);
+		p = rwelf_vaddr_to_ptr(elf, symtab, n * entsize);
+
+		if (p && n) {
+			if (ELF_IS_32(elf)) {
+				DYNSYM32(elf) = (Elf32_Sym*) p;
+			} else {
+				DYNSYM64(elf) = (Elf64_Sym*) p;
+			}
+			elf->ndynsyms = n;
+		}
+	}
+
+	/* Elf_Rela cannot describe REL entries, which get their own tables */
+	entsize = ELF_IS_64(elf) ? sizeof(Elf64_Rela) : sizeof(Elf32_Rela);
+
+	if (jmprel && pltrel == DT_RELA) {
+		if ((p = rwelf_vaddr_to_ptr(elf, jmprel, pltrelsz)) != NULL) {
+			if (ELF_IS_32(elf)) {
+				JMPREL32(elf) = (Elf32_Rela*) p;
+			} else {
+				JMPREL64(elf) = (Elf64_Rela*) p;
+			}
+			elf->njmprels = pltrelsz / entsize;
+		}
+	}
+
+	if (rela) {
+		if ((p = rwelf_vaddr_to_ptr(elf, rela, relasz)) != NULL) {
+			if (ELF_IS_32(elf)) {
+				DYNRELA32(elf) = (Elf32_Rela*) p;
+			} else {
+				DYNRELA64(elf) = (Elf64_Rela*) p;
+			}
+			elf->ndynrelas = relasz / entsize;
+		}
+	}
+
+	entsize = ELF_IS_64(elf) ? sizeof(Elf64_Rel) : sizeof(Elf32_Rel);
+
+	if (jmprel && pltrel == DT_REL) {
+		if ((p = rwelf_vaddr_to_ptr(elf, jmprel, pltrelsz)) != NULL) {
+			if (ELF_IS_32(elf)) {
+				PLTREL32(elf) = (Elf32_Rel*) p;
+			} else {
+				PLTREL64(elf) = (Elf64_Rel*) p;
+			}
+			elf->npltrels = pltrelsz / entsize;
+		}
+	}
+
+	if (rel) {
+		if ((p = rwelf_vaddr_to_ptr(elf, rel, relsz)) != NULL) {
+			if (ELF_IS_32(elf)) {
+				DYNREL32(elf) = (Elf32_Rel*) p;
+			} else {
+				DYNREL64(elf) = (Elf64_Rel*) p;
+			}
+			elf->ndynrels = relsz / entsize;
+		}
+	}
+}
+
 /**
  * Prepares internal data according to ELF's class
  */
 static int _prepare_internal_data(rwelf *elf)
 {
-	elf->class = elf->file[EI_CLASS];
+	const unsigned char *ident;
+
+	if ((ident = rwelf_get_data(elf, 0, EI_NIDENT)) == NULL
+		|| memcmp(ident, ELFMAG, SELFMAG) != 0) {
+		return 0;
+	}
+
+	elf->class = ident[EI_CLASS];
 
 	if (ELF_IS_32(elf)) {
-		EHDR32(elf) = (Elf32_Ehdr*) elf->file;
-		PHDR32(elf) = (Elf32_Phdr*) (elf->file + EHDR32(elf)->e_phoff);
-		SHDR32(elf) = (Elf32_Shdr*) (elf->file + EHDR32(elf)->e_shoff);
+		EHDR32(elf) = (Elf32_Ehdr*) rwelf_get_data(elf, 0, sizeof(Elf32_Ehdr));
+		if (!EHDR32(elf)) {
+			return 0;
+		}
+		PHDR32(elf) = (Elf32_Phdr*) rwelf_get_data(elf, EHDR32(elf)->e_phoff,
+			(uint64_t) EHDR32(elf)->e_phnum * sizeof(Elf32_Phdr));
+		SHDR32(elf) = (Elf32_Shdr*) rwelf_get_data(elf, EHDR32(elf)->e_shoff,
+			(uint64_t) EHDR32(elf)->e_shnum * sizeof(Elf32_Shdr));
 	} else if (ELF_IS_64(elf)) {
-		EHDR64(elf) = (Elf64_Ehdr*) elf->file;
-		PHDR64(elf) = (Elf64_Phdr*) (elf->file + EHDR64(elf)->e_phoff);
-		SHDR64(elf) = (Elf64_Shdr*) (elf->file + EHDR64(elf)->e_shoff);
+		EHDR64(elf) = (Elf64_Ehdr*) rwelf_get_data(elf, 0, sizeof(Elf64_Ehdr));
+		if (!EHDR64(elf)) {
+			return 0;
+		}
+		PHDR64(elf) = (Elf64_Phdr*) rwelf_get_data(elf, EHDR64(elf)->e_phoff,
+			(uint64_t) EHDR64(elf)->e_phnum * sizeof(Elf64_Phdr));
+		SHDR64(elf) = (Elf64_Shdr*) rwelf_get_data(elf, EHDR64(elf)->e_shoff,
+			(uint64_t) EHDR64(elf)->e_shnum * sizeof(Elf64_Shdr));
 	} else {
 		return 0;
 	}
 
+	/* Header tables running past the end of the file */
+	if ((ELF_IS_32(elf) && (!PHDR32(elf) || !SHDR32(elf)))
+		|| (ELF_IS_64(elf) && (!PHDR64(elf) || !SHDR64(elf)))) {
+		return 0;
+	}
+
+	if (rwelf_build_loads(elf) == -1) {
+		return 0;
+	}
+
 	_find_str_tables(elf);
+	_find_dyn_tables(elf);
 
 	return 1;
 }
 
+/**
+ * Applies an madvise() hint to a range of the file, widened to whole pages
+ */
+static void _advise(const rwelf *elf, uint64_t off, uint64_t len, int advice)
+{
+	uint64_t page = sysconf(_SC_PAGESIZE), start, end;
+
+	if (off >= elf->size || !len) {
+		return;
+	}
+	if (len > elf->size - off) {
+		len = elf->size - off;
+	}
+
+	start = off & ~(page - 1);
+	end   = (off + len + page - 1) & ~(page - 1);
+
+	madvise(elf->file + start, end - start, advice);
+}
+
+/**
+ * Applies the per-region hints requested by the open flags: headers and
+ * lookup tables are prefetched, debug sections are read randomly
+ */
+static void _advise_regions(const rwelf *elf, int flags)
+{
+	size_t i;
+
+	if (flags & RWELF_OPEN_PREFETCH) {
+		size_t phsize = ELF_IS_64(elf) ? sizeof(Elf64_Phdr) : sizeof(Elf32_Phdr);
+		size_t shsize = ELF_IS_64(elf) ? sizeof(Elf64_Shdr) : sizeof(Elf32_Shdr);
+
+		_advise(elf, 0, RWELF_EHDR(elf, e_ehsize), MADV_WILLNEED);
+		_advise(elf, RWELF_EHDR(elf, e_phoff),
+			(uint64_t) RWELF_EHDR(elf, e_phnum) * phsize, MADV_WILLNEED);
+		_advise(elf, RWELF_EHDR(elf, e_shoff),
+			(uint64_t) RWELF_EHDR(elf, e_shnum) * shsize, MADV_WILLNEED);
+
+		for (i = 0; i < RWELF_EHDR(elf, e_phnum); ++i) {
+			if (RWELF_PHDR(elf, p_type, i) == PT_DYNAMIC) {
+				_advise(elf, RWELF_PHDR(elf, p_offset, i),
+					RWELF_PHDR(elf, p_filesz, i), MADV_WILLNEED);
+			}
+		}
+	}
+
+	for (i = 0; elf->shstrtab && i < RWELF_EHDR(elf, e_shnum); ++i) {
+		const char *name = (const char*)(elf->shstrtab + RWELF_SHDR(elf, sh_name, i));
+
+		switch (RWELF_SHDR(elf, sh_type, i)) {
+			case SHT_SYMTAB:
+			case SHT_DYNSYM:
+			case SHT_STRTAB:
+			case SHT_DYNAMIC:
+			case SHT_HASH:
+			case SHT_GNU_HASH:
+				if (flags & RWELF_OPEN_PREFETCH) {
+					_advise(elf, RWELF_SHDR(elf, sh_offset, i),
+						RWELF_SHDR(elf, sh_size, i), MADV_WILLNEED);
+				}
+				break;
+			case SHT_PROGBITS:
+				if ((flags & RWELF_OPEN_RANDOM_DEBUG)
+					&& (strncmp(name, ".debug_", 7) == 0
+						|| strncmp(name, ".zdebug_", 8) == 0)) {
+					_advise(elf, RWELF_SHDR(elf, sh_offset, i),
+						RWELF_SHDR(elf, sh_size, i), MADV_RANDOM);
+				}
+				break;
+		}
+	}
+}
+
 /**
  * rwelf_open(const char*)
  * Opens a ELF file for reading/writing
  */
 rwelf *rwelf_open(const char *fname)
 {
-	unsigned char *mem;
+	return rwelf_pool_open(NULL, fname, RWELF_OPEN_DEFAULT);
+}
+
+/**
+ * rwelf_open_flags(const char*, int)
+ * Opens a ELF file applying the paging hints given by flags
+ * (RWELF_OPEN_* constants)
+ */
+rwelf *rwelf_open_flags(const char *fname, int flags)
+{
+	return rwelf_pool_open(NULL, fname, flags);
+}
+
+/**
+ * rwelf_pool_open(rwelf_pool*, const char*, int)
+ * Same as rwelf_open_flags, taking the handle from the pool, which can be
+ * NULL. The handle goes back to the pool on rwelf_close
+ */
+rwelf *rwelf_pool_open(rwelf_pool *pool, const char *fname, int flags)
+{
 	struct stat st;
 	int fd;
 	rwelf *elf;
@@ -128,24 +435,80 @@ rwelf *rwelf_open(const char *fname)
 		return NULL;
 	}
 
-	fstat(fd, &st);
-
-	mem = mmap(0, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	if (fstat(fd, &st) == -1 || (elf = rwelf_alloc(pool)) == NULL) {
+		close(fd);
+		return NULL;
+	}
 
-	if (mem == MAP_FAILED || memcmp(mem, ELFMAG, SELFMAG) != 0) {
+	/* Pipes and character devices report no size, they are read whole */
+	if (rwelf_io_open(elf, fd, S_ISREG(st.st_mode) ? st.st_size : 0,
+			flags) == -1) {
 		close(fd);
+		rwelf_release(elf);
 		return NULL;
 	}
 
-	elf = calloc(1, sizeof(rwelf));
+	elf->flags = flags;
+	elf->mtime = (int64_t) st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+	elf->fname = rwelf_arena_strdup(elf, fname);
 
-	assert(elf != NULL);
+	if (elf->backend == RWELF_IO_MMAP) {
+		/* Whole file hints go first, region hints override them */
+		if (flags & RWELF_OPEN_SEQUENTIAL) {
+			madvise(elf->file, elf->size, MADV_SEQUENTIAL);
+		} else if (flags & RWELF_OPEN_RANDOM) {
+			madvise(elf->file, elf->size, MADV_RANDOM);
+		}
+#ifdef MADV_HUGEPAGE
+		if (flags & RWELF_OPEN_HUGEPAGE) {
+			madvise(elf->file, elf->size, MADV_HUGEPAGE);
+		}
+#endif
+	}
+
+	if (_prepare_internal_data(elf)) {
+		if (elf->backend == RWELF_IO_MMAP) {
+			_advise_regions(elf, flags);
+		}
+		RWELF_STAT(elf, RWELF_STAT_OPENS, 1);
+
+		if (elf->backend != RWELF_IO_PREAD) {
+			RWELF_STAT(elf, RWELF_STAT_BYTES_MAPPED, elf->size);
+		}
+		return elf;
+	}
+
+	rwelf_close(elf);
+
+	return NULL;
+}
+
+/**
+ * rwelf_open_memory(const void*, size_t)
+ * Opens a ELF image already in memory. Nothing is copied, the buffer must
+ * outlive the handle
+ */
+rwelf *rwelf_open_memory(const void *buf, size_t size)
+{
+	return rwelf_pool_open_memory(NULL, buf, size);
+}
+
+/**
+ * rwelf_pool_open_memory(rwelf_pool*, const void*, size_t)
+ * Same as rwelf_open_memory, taking the handle from the pool
+ */
+rwelf *rwelf_pool_open_memory(rwelf_pool *pool, const void *buf, size_t size)
+{
+	rwelf *elf;
 
-	elf->file = mem;
-	elf->fd   = fd;
-	elf->size = st.st_size;
+	if ((elf = rwelf_alloc(pool)) == NULL) {
+		return NULL;
+	}
+
+	rwelf_io_open_buffer(elf, buf, size);
 
 	if (_prepare_internal_data(elf)) {
+		RWELF_STAT(elf, RWELF_STAT_OPENS, 1);
 		return elf;
 	}
 
@@ -154,6 +517,39 @@ rwelf *rwelf_open(const char *fname)
 	return NULL;
 }
 
+/**
+ * rwelf_resident_bytes(const rwelf*)
+ * Returns how many bytes of the mapped file are resident in the page cache
+ * (mincore). This is residency, not access: pages read before by anyone
+ * count, and pages the library read may have been evicted. For the other
+ * backends the bytes read into memory are returned
+ */
+size_t rwelf_resident_bytes(const rwelf *elf)
+{
+	size_t page = sysconf(_SC_PAGESIZE), npages, i, n = 0;
+	unsigned char *vec;
+
+	assert(elf != NULL);
+
+	if (elf->backend != RWELF_IO_MMAP) {
+		return rwelf_io_cached_bytes(elf);
+	}
+
+	npages = (elf->size + page - 1) / page;
+
+	if ((vec = malloc(npages)) == NULL) {
+		return 0;
+	}
+	if (mincore(elf->file, elf->size, vec) == 0) {
+		for (i = 0; i < npages; ++i) {
+			n += vec[i] & 1;
+		}
+	}
+	free(vec);
+
+	return n * page;
+}
+
 /**
  * rwelf_get_header(const rwelf*, Elf_Ehdr*)
  * Fill the out param with the ELF header
@@ -193,6 +589,17 @@ uint16_t rwelf_num_dyn_symbols(const rwelf *elf)
 	return elf->ndynsyms;
 }
 
+/**
+ * rwelf_num_dynamic(const rwelf*)
+ * Returns the number of entries in the .dynamic section
+ */
+size_t rwelf_num_dynamic(const rwelf *elf)
+{
+	assert(elf != NULL);
+
+	return elf->ndyns;
+}
+
 /**
  * rwelf_close(rwelf *elf)
  * Closes fd and unmap memory related to internal rwelf data
@@ -201,11 +608,19 @@ void rwelf_close(rwelf *elf)
 {
 	assert(elf != NULL);
 
-	if (!elf->file) {
-		return;
+#ifdef RWELF_STATS
+	/* Caller owned buffers were not paged in by the library */
+	if (elf->stats && elf->size && elf->backend != RWELF_IO_BUFFER) {
+		rwelf_stat_add(NULL, RWELF_STAT_RESIDENT_PAGES,
+			(rwelf_resident_bytes(elf) + RWELF_STAT_PAGE - 1) / RWELF_STAT_PAGE);
 	}
+#endif
 
-	munmap(elf->file, elf->size);
-	close(elf->fd);
-	free(elf);
+	rwelf_index_close(elf);
+
+	rwelf_io_close(elf);
+	if (elf->fd != -1) {
+		close(elf->fd);
+	}
+	rwelf_release(elf);
 }
@@ -0,0 +1,305 @@
+/**
+ * rwelf
+ * Copyright (c) 2012-2013 Felipe Pena <felipensp(at)gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "rwelf.h"
+#include "internal.h"
+#include <unistd.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * Columnar symbol export
+ *
+ * The output is a stream of native-endian blocks:
+ *
+ *   file header:  "RWSC", version (1 byte), EI_DATA of the host (1 byte),
+ *                 number of tables (2 bytes), 8 bytes reserved
+ *   per table:    name (8 bytes, ".symtab" or ".dynsym"), count (8 bytes)
+ *                 value[count] (8 bytes each)
+ *                 size[count]  (8 bytes each)
+ *                 name[count]  (4 bytes each, offset into the string heap)
+ *                 shndx[count] (2 bytes each)
+ *                 info[count]  (1 byte each)
+ *                 other[count] (1 byte each)
+ *                 padding up to 8 bytes, heap size (8 bytes)
+ *                 string heap, padding up to 8 bytes
+ *
+ * Every column is produced by a sequential pass over the symbol table and
+ * written through a fixed size buffer, so the memory used does not depend
+ * on the size of the table. The string heap is deduplicated through a
+ * direct-mapped cache of recently seen names; since the cache is
+ * deterministic, the pass that writes the name offsets and the pass that
+ * writes the heap itself take exactly the same decisions.
+ */
+
+#define RWELF_EXPORT_MAGIC   "RWSC"
+#define RWELF_EXPORT_VERSION 1
+
+#define _WBUF_SIZE   (64 * 1024)
+#define _DEDUP_BITS  16
+#define _DEDUP_SLOTS (1 << _DEDUP_BITS)
+
+typedef struct {
+	int fd;
+	int error;
+	size_t len;
+	uint64_t total;
+	unsigned char buf[_WBUF_SIZE];
+} _wbuf;
+
+typedef struct {
+	const char *str;
+	uint32_t hash;
+	uint32_t off;
+} _dedup_slot;
+
+typedef struct {
+	const rwelf *elf;
+	int dynamic;
+	size_t count;
+	const unsigned char *strtab;
+	_dedup_slot *slots;
+	_wbuf *w;
+} _export_ctx;
+
+static void _wbuf_flush(_wbuf *w)
+{
+	size_t done = 0;
+
+	while (!w->error && done < w->len) {
+		ssize_t n = write(w->fd, w->buf + done, w->len - done);
+
+		if (n == -1) {
+			if (errno != EINTR) {
+				w->error = 1;
+			}
+			continue;
+		}
+		done += n;
+	}
+	w->len = 0;
+}
+
+static void _wbuf_put(_wbuf *w, const void *data, size_t len)
+{
+	const unsigned char *p = data;
+
+	w->total += len;
+
+	while (len) {
+		size_t n = _WBUF_SIZE - w->len;
+
+		if (n > len) {
+			n = len;
+		}
+		memcpy(w->buf + w->len, p, n);
+		w->len += n;
+		p += n;
+		len -= n;
+
+		if (w->len == _WBUF_SIZE) {
+			_wbuf_flush(w);
+		}
+	}
+}
+
+static void _wbuf_align(_wbuf *w, size_t align)
+{
+	static const unsigned char zero[8];
+
+	if (w->total % align) {
+		_wbuf_put(w, zero, align - w->total % align);
+	}
+}
+
+/**
+ * Walks the names of the table assigning them heap offsets. When emit_heap
+ * is set the string bytes are written, otherwise the name column is.
+ * Offsets are 32-bit, so a heap past UINT32_MAX fails the export.
+ * Returns the heap size.
+ */
+static uint64_t _export_strings(_export_ctx *ctx, int emit_heap)
+{
+	uint64_t heap = 1;
+	size_t i;
+
+	memset(ctx->slots, 0, sizeof(_dedup_slot) * _DEDUP_SLOTS);
+
+	/* Offset 0 is always the empty string */
+	if (emit_heap) {
+		_wbuf_put(ctx->w, "", 1);
+	}
+
+	for (i = 0; i < ctx->count; ++i) {
+		const char *name = "";
+		uint32_t off = 0;
+
+		if (ctx->strtab) {
+			name = (const char*)(ctx->strtab + (ctx->dynamic ?
+				RWELF(ctx->elf, DYNSYM, st_name, i) :
+				RWELF(ctx->elf, SYM, st_name, i)));
+		}
+
+		if (*name) {
+			uint32_t hash = _str_hash(name);
+			_dedup_slot *slot = &ctx->slots[hash & (_DEDUP_SLOTS - 1)];
+
+			if (slot->str && slot->hash == hash &&
+				(slot->str == name || strcmp(slot->str, name) == 0)) {
+				off = slot->off;
+			} else {
+				size_t len = strlen(name) + 1;
+
+				if (heap + len - 1 > UINT32_MAX) {
+					ctx->w->error = 1;
+					return heap;
+				}
+				off = heap;
+				heap += len;
+
+				slot->str  = name;
+				slot->hash = hash;
+				slot->off  = off;
+
+				if (emit_heap) {
+					_wbuf_put(ctx->w, name, len);
+				}
+			}
+		}
+
+		if (!emit_heap) {
+			_wbuf_put(ctx->w, &off, sizeof(off));
+		}
+	}
+
+	return heap;
+}
+
+static void _export_table(_export_ctx *ctx)
+{
+	const char *table = ctx->dynamic ? ".dynsym" : ".symtab";
+	char name[8] = {0};
+	uint64_t count = ctx->count, heap;
+	size_t i;
+
+	memcpy(name, table, strlen(table));
+	_wbuf_put(ctx->w, name, sizeof(name));
+	_wbuf_put(ctx->w, &count, sizeof(count));
+
+#define COLUMN(_type, _field) \
+	for (i = 0; i < ctx->count; ++i) {                 \
+		_type v = ctx->dynamic ?                       \
+			RWELF(ctx->elf, DYNSYM, _field, i) :       \
+			RWELF(ctx->elf, SYM, _field, i);           \
+		_wbuf_put(ctx->w, &v, sizeof(v));              \
+	}
+
+	COLUMN(uint64_t, st_value);
+	COLUMN(uint64_t, st_size);
+	heap = _export_strings(ctx, 0);
+	COLUMN(uint16_t, st_shndx);
+	COLUMN(uint8_t, st_info);
+	COLUMN(uint8_t, st_other);
+#undef COLUMN
+
+	_wbuf_align(ctx->w, 8);
+	_wbuf_put(ctx->w, &heap, sizeof(heap));
+	_export_strings(ctx, 1);
+	_wbuf_align(ctx->w, 8);
+}
+
+/**
+ * rwelf_export_symbols(const rwelf*, int, int)
+ * Writes the symbol tables selected by flags (RWELF_EXPORT_SYMTAB,
+ * RWELF_EXPORT_DYNSYM) to fd using the columnar layout described above.
+ * Returns 0 on success, otherwise -1 is returned
+ */
+int rwelf_export_symbols(const rwelf *elf, int fd, int flags)
+{
+	_export_ctx ctx;
+	_wbuf *w;
+	uint16_t ntables = 0;
+	int ret;
+
+	assert(elf != NULL);
+
+	if ((flags & RWELF_EXPORT_SYMTAB) && elf->nsyms) {
+		++ntables;
+	}
+	if ((flags & RWELF_EXPORT_DYNSYM) && elf->ndynsyms) {
+		++ntables;
+	}
+
+	w = malloc(sizeof(_wbuf));
+	ctx.slots = malloc(sizeof(_dedup_slot) * _DEDUP_SLOTS);
+
+	if (!w || !ctx.slots) {
+		free(w);
+		free(ctx.slots);
+		return -1;
+	}
+
+	w->fd    = fd;
+	w->error = 0;
+	w->len   = 0;
+	w->total = 0;
+
+	ctx.elf = elf;
+	ctx.w   = w;
+
+	{
+		unsigned char hdr[16] = {0};
+		uint16_t probe = 1;
+
+		memcpy(hdr, RWELF_EXPORT_MAGIC, 4);
+		hdr[4] = RWELF_EXPORT_VERSION;
+		hdr[5] = *(unsigned char*)&probe ? ELFDATA2LSB : ELFDATA2MSB;
+		memcpy(hdr + 6, &ntables, sizeof(ntables));
+		_wbuf_put(w, hdr, sizeof(hdr));
+	}
+
+	if ((flags & RWELF_EXPORT_SYMTAB) && elf->nsyms) {
+		ctx.dynamic = 0;
+		ctx.count   = elf->nsyms;
+		ctx.strtab  = elf->strtab;
+		_export_table(&ctx);
+	}
+
+	if ((flags & RWELF_EXPORT_DYNSYM) && elf->ndynsyms) {
+		ctx.dynamic = 1;
+		ctx.count   = elf->ndynsyms;
+		ctx.strtab  = elf->dynstr;
+		_export_table(&ctx);
+	}
+
+	_wbuf_flush(w);
+	ret = w->error ? -1 : 0;
+
+	free(ctx.slots);
+	free(w);
+
+	return ret;
+}
@@ -0,0 +1,782 @@
+/**
+ * rwelf
+ * Copyright (c) 2012-2013 Felipe Pena <felipensp(at)gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "rwelf.h"
+#include "internal.h"
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * Function boundary recovery
+ *
+ * Stripped binaries keep enough to find their functions without decoding
+ * any instruction: the .dynsym exports, one .eh_frame FDE per function
+ * (start and length, for every function that may be unwound through), the
+ * .init_array/.fini_array/.preinit_array entries, DT_INIT/DT_FINI and the
+ * entry point. The candidates of every source are sorted by address and
+ * merged, names coming from .symtab first, then .dynsym. Starts known
+ * without a length take the distance to the next function, bounded by
+ * their segment. .eh_frame is found through PT_GNU_EH_FRAME when there
+ * are no section headers, so sstripped files work too.
+ */
+
+#define DW_EH_PE_absptr  0x00
+#define DW_EH_PE_uleb128 0x01
+#define DW_EH_PE_udata2  0x02
+#define DW_EH_PE_udata4  0x03
+#define DW_EH_PE_udata8  0x04
+#define DW_EH_PE_sleb128 0x09
+#define DW_EH_PE_sdata2  0x0a
+#define DW_EH_PE_sdata4  0x0b
+#define DW_EH_PE_sdata8  0x0c
+#define DW_EH_PE_pcrel   0x10
+#define DW_EH_PE_omit    0xff
+
+/* Functions looked back at by rwelf_func_lookup */
+#define _NESTED_MAX 8
+
+/* Name preference of the candidates, lower wins */
+#define _RANK_SYMTAB  0
+#define _RANK_DYNSYM  2
+#define _RANK_NONAME  4
+
+typedef struct {
+	uint64_t addr;
+	uint64_t size;
+	const char *name;
+	size_t shndx;             /* Section of the offset, ET_REL only */
+	int sources;
+	int rank;
+} _cand;
+
+/* Load time value of a pointer slot, from a relocation without symbol */
+typedef struct {
+	uint64_t offset;
+	uint64_t addend;
+} _slot;
+
+typedef struct {
+	rwelf *elf;
+	int rel;
+	_slot *slots;             /* Sorted by offset, built on first use */
+	size_t nslots;
+	int slots_built;
+	_cand *cands;
+	size_t n;
+	size_t cap;
+	int error;
+} _ctx;
+
+static int _cand_cmp(const void *a, const void *b)
+{
+	const _cand *x = a, *y = b;
+
+	if (x->shndx != y->shndx) {
+		return x->shndx < y->shndx ? -1 : 1;
+	}
+	if (x->addr != y->addr) {
+		return x->addr < y->addr ? -1 : 1;
+	}
+	return x->rank - y->rank;
+}
+
+static void _add(_ctx *ctx, size_t shndx, uint64_t addr, uint64_t size,
+	const char *name, int source, int rank)
+{
+	_cand *c;
+
+	/* Offset 0 starts a section of ET_REL, elsewhere it is no function */
+	if (!addr && !ctx->rel) {
+		return;
+	}
+	if (ctx->n == ctx->cap) {
+		size_t cap = ctx->cap ? ctx->cap * 2 : 256;
+		_cand *cands = realloc(ctx->cands, cap * sizeof(_cand));
+
+		if (!cands) {
+			ctx->error = 1;
+			return;
+		}
+		ctx->cands = cands;
+		ctx->cap = cap;
+	}
+	c = &ctx->cands[ctx->n++];
+	c->addr    = addr;
+	c->size    = size;
+	c->shndx   = ctx->rel ? shndx : 0;
+	c->name    = name && *name ? name : NULL;
+	c->sources = source;
+	c->rank    = c->name ? rank : _RANK_NONAME;
+}
+
+static void _add_symbols(_ctx *ctx, int dynamic)
+{
+	const rwelf *elf = ctx->elf;
+	const unsigned char *strtab = dynamic ? elf->dynstr : elf->strtab;
+	size_t i, n = dynamic ? elf->ndynsyms : elf->nsyms;
+
+	for (i = 1; i < n; ++i) {
+#define SYM(_field) (dynamic ? RWELF(elf, DYNSYM, _field, i) : RWELF(elf, SYM, _field, i))
+		int type = ELF64_ST_TYPE(SYM(st_info));
+
+		if ((type != STT_FUNC && type != STT_GNU_IFUNC)
+			|| SYM(st_shndx) == SHN_UNDEF) {
+			continue;
+		}
+		_add(ctx, SYM(st_shndx), SYM(st_value), SYM(st_size),
+			strtab ? (const char*)(strtab + SYM(st_name)) : NULL,
+			dynamic ? RWELF_FUNC_DYNSYM : RWELF_FUNC_SYMTAB,
+			(dynamic ? _RANK_DYNSYM : _RANK_SYMTAB)
+				+ (ELF64_ST_BIND(SYM(st_info)) != STB_GLOBAL));
+#undef SYM
+	}
+}
+
+/**
+ * Reads a DW_EH_PE_* encoded pointer whose first byte is at address pc.
+ * Returns -1 when it does not fit or the encoding is not understood
+ */
+static int _read_encoded(const rwelf *elf, const unsigned char **pp,
+	const unsigned char *end, uint8_t enc, uint64_t pc, uint64_t *val)
+{
+	const unsigned char *p = *pp;
+	size_t len;
+	int64_t s;
+
+	if (enc == DW_EH_PE_omit) {
+		return -1;
+	}
+
+	switch (enc & 0x0f) {
+		case DW_EH_PE_absptr:
+			len = ELF_IS_64(elf) ? 8 : 4;
+			break;
+		case DW_EH_PE_udata2:
+		case DW_EH_PE_sdata2:
+			len = 2;
+			break;
+		case DW_EH_PE_udata4:
+		case DW_EH_PE_sdata4:
+			len = 4;
+			break;
+		case DW_EH_PE_udata8:
+		case DW_EH_PE_sdata8:
+			len = 8;
+			break;
+		case DW_EH_PE_uleb128:
+			if (_uleb(&p, end, val) == -1) {
+				return -1;
+			}
+			len = 0;
+			break;
+		case DW_EH_PE_sleb128:
+			if (_sleb(&p, end, &s) == -1) {
+				return -1;
+			}
+			*val = s;
+			len = 0;
+			break;
+		default:
+			return -1;
+	}
+
+	if (len) {
+		uint64_t u64 = 0;
+		uint32_t u32;
+		uint16_t u16;
+
+		if ((size_t)(end - p) < len) {
+			return -1;
+		}
+		switch (len) {
+			case 2:
+				memcpy(&u16, p, 2);
+				u64 = (enc & 0x08) ? (uint64_t)(int64_t)(int16_t) u16 : u16;
+				break;
+			case 4:
+				memcpy(&u32, p, 4);
+				u64 = (enc & 0x08) ? (uint64_t)(int64_t)(int32_t) u32 : u32;
+				break;
+			case 8:
+				memcpy(&u64, p, 8);
+				break;
+		}
+		*val = u64;
+		p += len;
+	}
+
+	switch (enc & 0x70) {
+		case 0:
+			break;
+		case DW_EH_PE_pcrel:
+			*val += pc;
+			break;
+		default:
+			/* textrel, datarel and funcrel are not used for FDEs on Linux */
+			return -1;
+	}
+	if (!ELF_IS_64(elf)) {
+		*val &= 0xffffffff;
+	}
+	*pp = p;
+
+	return 0;
+}
+
+/**
+ * Reads the FDE pointer encoding of the CIE at off. Returns -1 when the
+ * CIE is malformed
+ */
+static int _cie_encoding(const rwelf *elf, const unsigned char *data,
+	size_t size, uint64_t vaddr, uint64_t off, uint8_t *enc)
+{
+	const unsigned char *p = data + off, *end, *aug;
+	uint64_t len, ignored;
+	uint32_t len32, id;
+	int64_t sval;
+	uint8_t version;
+
+	if (off > size || size - off < 8) {
+		return -1;
+	}
+	memcpy(&len32, p, 4);
+	p += 4;
+
+	if (len32 == 0xffffffff) {
+		/* 64-bit DWARF, the CIE id is 8 bytes too */
+		if (size - off < 20) {
+			return -1;
+		}
+		memcpy(&len, p, 8);
+		p += 8;
+		if (len < 8 || len > (uint64_t)(data + size - p)) {
+			return -1;
+		}
+		end = p + len;
+		p += 8;
+	} else {
+		if (len32 < 4 || len32 > (uint64_t)(data + size - p)) {
+			return -1;
+		}
+		end = p + len32;
+		memcpy(&id, p, 4);
+		p += 4;
+
+		if (id != 0) {
+			return -1;
+		}
+	}
+
+	if (p >= end) {
+		return -1;
+	}
+	version = *p++;
+	aug = p;
+
+	while (p < end && *p) {
+		++p;
+	}
+	if (p++ >= end) {
+		return -1;
+	}
+
+	if (strstr((const char*) aug, "eh")) {
+		p += ELF_IS_64(elf) ? 8 : 4;
+	}
+	if (_uleb(&p, end, &ignored) == -1 || _sleb(&p, end, &sval) == -1) {
+		return -1;
+	}
+	if (version == 1) {
+		++p;
+	} else if (_uleb(&p, end, &ignored) == -1) {
+		return -1;
+	}
+
+	*enc = DW_EH_PE_absptr;
+
+	if (*aug != 'z') {
+		return 0;
+	}
+	if (_uleb(&p, end, &ignored) == -1) {
+		return -1;
+	}
+
+	for (++aug; *aug; ++aug) {
+		uint8_t penc;
+
+		if (p >= end) {
+			return -1;
+		}
+		switch (*aug) {
+			case 'R':
+				*enc = *p;
+				return 0;
+			case 'P':
+				penc = *p++;
+				if (_read_encoded(elf, &p, end, penc & 0x7f,
+						vaddr + (p - data), &ignored) == -1) {
+					return -1;
+				}
+				break;
+			case 'L':
+				++p;
+				break;
+			case 'S':
+			case 'B':
+			case 'G':
+				break;
+			default:
+				return 0;
+		}
+	}
+	return 0;
+}
+
+/**
+ * Finds .eh_frame: its section, or what PT_GNU_EH_FRAME points to up to
+ * the end of the segment. Returns -1 when there is none
+ */
+static int _find_eh_frame(const rwelf *elf, const unsigned char **data,
+	size_t *size, uint64_t *vaddr)
+{
+	const rwelf_segment *seg;
+	const unsigned char *hdr, *p;
+	Elf_Shdr shdr;
+	size_t i;
+
+	if (elf->shstrtab && rwelf_get_section_by_name(elf, ".eh_frame", &shdr) != -1
+		&& rwelf_get_section_type(&shdr) == SHT_PROGBITS) {
+		*vaddr = rwelf_get_section_addr(&shdr);
+		*size  = rwelf_get_section_size(&shdr);
+		*data  = rwelf_get_data(elf, rwelf_get_section_offset(&shdr), *size);
+
+		return *data ? 0 : -1;
+	}
+
+	for (i = 0; i < RWELF_EHDR(elf, e_phnum); ++i) {
+		uint64_t hdr_vaddr, frame;
+
+		if (RWELF_PHDR(elf, p_type, i) != PT_GNU_EH_FRAME) {
+			continue;
+		}
+		hdr_vaddr = RWELF_PHDR(elf, p_vaddr, i);
+
+		if ((hdr = rwelf_vaddr_to_ptr(elf, hdr_vaddr, 12)) == NULL || hdr[0] != 1) {
+			return -1;
+		}
+		p = hdr + 4;
+
+		if (_read_encoded(elf, &p, hdr + 12, hdr[1], hdr_vaddr + 4, &frame) == -1
+			|| (seg = rwelf_vaddr_find_segment(elf, frame)) == NULL
+			|| frame - seg->vaddr >= seg->filesz) {
+			return -1;
+		}
+		*vaddr = frame;
+		*size  = seg->filesz - (frame - seg->vaddr);
+		*data  = rwelf_vaddr_to_ptr(elf, frame, *size);
+
+		return *data ? 0 : -1;
+	}
+	return -1;
+}
+
+static void _add_fdes(_ctx *ctx)
+{
+	const rwelf *elf = ctx->elf;
+	const unsigned char *data, *p, *end;
+	uint64_t vaddr, cie_off = (uint64_t) -1;
+	uint8_t enc = DW_EH_PE_absptr;
+	int cie_ok = 0;
+	size_t size;
+
+	if (_find_eh_frame(elf, &data, &size, &vaddr) == -1) {
+		return;
+	}
+	p = data;
+	end = data + size;
+
+	while (end - p >= 4) {
+		const unsigned char *next, *id_at;
+		uint64_t len, id, begin, range;
+		uint32_t len32, id32;
+
+		memcpy(&len32, p, 4);
+		p += 4;
+
+		/* Zero terminator */
+		if (len32 == 0) {
+			break;
+		}
+		if (len32 == 0xffffffff) {
+			if (end - p < 8) {
+				break;
+			}
+			memcpy(&len, p, 8);
+			p += 8;
+		} else {
+			len = len32;
+		}
+		if (len > (uint64_t)(end - p) || len < 4) {
+			break;
+		}
+		next  = p + len;
+		id_at = p;
+
+		if (len32 == 0xffffffff) {
+			if (len < 8) {
+				break;
+			}
+			memcpy(&id, p, 8);
+			p += 8;
+		} else {
+			memcpy(&id32, p, 4);
+			id = id32;
+			p += 4;
+		}
+
+		/* CIE pointers are relative to the field, CIEs have 0 */
+		if (id && id <= (uint64_t)(id_at - data)) {
+			uint64_t off = (id_at - data) - id;
+
+			if (off != cie_off) {
+				cie_off = off;
+				cie_ok = _cie_encoding(elf, data, size, vaddr, off, &enc) == 0;
+			}
+			if (cie_ok
+				&& _read_encoded(elf, &p, next, enc, vaddr + (p - data), &begin) == 0
+				&& _read_encoded(elf, &p, next, enc & 0x0f, 0, &range) == 0
+				&& range) {
+				_add(ctx, 0, begin, range, NULL, RWELF_FUNC_EH_FRAME, _RANK_NONAME);
+			}
+		}
+		p = next;
+	}
+}
+
+static int _slot_cmp(const void *a, const void *b)
+{
+	const _slot *x = a, *y = b;
+
+	if (x->offset != y->offset) {
+		return x->offset < y->offset ? -1 : 1;
+	}
+	return 0;
+}
+
+/**
+ * Collects the relocations without symbol once, sorted by offset, so each
+ * zero slot is a binary search instead of a walk of every relocation
+ */
+static void _build_slots(_ctx *ctx)
+{
+	const rwelf *elf = ctx->elf;
+	size_t i, n = rwelf_num_dyn_relas(elf);
+	Elf_Rela rela;
+
+	ctx->slots_built = 1;
+
+	if (!n || (ctx->slots = malloc(n * sizeof(_slot))) == NULL) {
+		return;
+	}
+	for (i = 0; i < n; ++i) {
+		rwelf_get_dyn_rela_by_num(elf, i, &rela);
+
+		if (!rwelf_get_rela_sym_index(&rela)) {
+			ctx->slots[ctx->nslots].offset = rwelf_get_rela_offset(&rela);
+			ctx->slots[ctx->nslots].addend = rwelf_get_rela_addend(&rela);
+			++ctx->nslots;
+		}
+	}
+	if (ctx->nslots) {
+		qsort(ctx->slots, ctx->nslots, sizeof(_slot), _slot_cmp);
+	}
+}
+
+/**
+ * Value of a pointer slot: the file contents, or the addend of its
+ * relative relocation when the slot is filled at load time
+ */
+static uint64_t _slot_value(_ctx *ctx, uint64_t vaddr)
+{
+	const rwelf *elf = ctx->elf;
+	size_t word = ELF_IS_64(elf) ? 8 : 4, lo = 0, hi;
+	const unsigned char *p = rwelf_vaddr_to_ptr(elf, vaddr, word);
+	uint64_t val = 0;
+
+	if (!p) {
+		return 0;
+	}
+	if (word == 8) {
+		memcpy(&val, p, 8);
+	} else {
+		uint32_t v32;
+
+		memcpy(&v32, p, 4);
+		val = v32;
+	}
+	if (val) {
+		return val;
+	}
+
+	if (!ctx->slots_built) {
+		_build_slots(ctx);
+	}
+	hi = ctx->nslots;
+
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+
+		if (ctx->slots[mid].offset < vaddr) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+	return lo < ctx->nslots && ctx->slots[lo].offset == vaddr ?
+		ctx->slots[lo].addend : 0;
+}
+
+static void _add_array(_ctx *ctx, uint64_t vaddr, uint64_t size)
+{
+	size_t word = ELF_IS_64(ctx->elf) ? 8 : 4;
+	uint64_t i, all = word == 8 ? (uint64_t) -1 : 0xffffffff;
+
+	for (i = 0; i + word <= size; i += word) {
+		uint64_t val = _slot_value(ctx, vaddr + i);
+
+		/* 0 and -1 are the markers of old style arrays */
+		if (val != all) {
+			_add(ctx, 0, val, 0, NULL, RWELF_FUNC_INIT, _RANK_NONAME);
+		}
+	}
+}
+
+static void _add_init(_ctx *ctx)
+{
+	static const struct { int64_t addr, size; uint32_t type; } arrays[] = {
+		{ DT_PREINIT_ARRAY, DT_PREINIT_ARRAYSZ, SHT_PREINIT_ARRAY },
+		{ DT_INIT_ARRAY,    DT_INIT_ARRAYSZ,    SHT_INIT_ARRAY },
+		{ DT_FINI_ARRAY,    DT_FINI_ARRAYSZ,    SHT_FINI_ARRAY }
+	};
+	const rwelf *elf = ctx->elf;
+	Elf_Dyn addr, size;
+	size_t i, j;
+
+	if (elf->ndyns) {
+		for (i = 0; i < sizeof(arrays) / sizeof(arrays[0]); ++i) {
+			if (rwelf_get_dynamic_by_tag(elf, arrays[i].addr, &addr) != -1
+				&& rwelf_get_dynamic_by_tag(elf, arrays[i].size, &size) != -1) {
+				_add_array(ctx, rwelf_get_dynamic_val(&addr),
+					rwelf_get_dynamic_val(&size));
+			}
+		}
+		if (rwelf_get_dynamic_by_tag(elf, DT_INIT, &addr) != -1) {
+			_add(ctx, 0, rwelf_get_dynamic_val(&addr), 0, NULL, RWELF_FUNC_INIT,
+				_RANK_NONAME);
+		}
+		if (rwelf_get_dynamic_by_tag(elf, DT_FINI, &addr) != -1) {
+			_add(ctx, 0, rwelf_get_dynamic_val(&addr), 0, NULL, RWELF_FUNC_INIT,
+				_RANK_NONAME);
+		}
+		return;
+	}
+
+	/* Static executables have the sections only */
+	for (i = 1; elf->shstrtab && i < RWELF_EHDR(elf, e_shnum); ++i) {
+		for (j = 0; j < sizeof(arrays) / sizeof(arrays[0]); ++j) {
+			if (RWELF_SHDR(elf, sh_type, i) == arrays[j].type) {
+				_add_array(ctx, RWELF_SHDR(elf, sh_addr, i),
+					RWELF_SHDR(elf, sh_size, i));
+			}
+		}
+	}
+}
+
+/**
+ * Whether the address is inside an executable segment
+ */
+static const rwelf_segment *_code_segment(const rwelf *elf, uint64_t addr)
+{
+	const rwelf_segment *seg = rwelf_vaddr_find_segment(elf, addr);
+
+	return seg && (seg->flags & PF_X) ? seg : NULL;
+}
+
+/**
+ * rwelf_funcs_build(rwelf*)
+ * Recovers the functions of the file from .symtab, .dynsym, the .eh_frame
+ * FDEs, the init/fini arrays, DT_INIT/DT_FINI and the entry point, once
+ * per handle. Relocatable files only have their symbols, whose addresses
+ * are offsets in their section (shndx), sorted by section then offset.
+ * Returns 0 on success, otherwise -1 is returned
+ */
+int rwelf_funcs_build(rwelf *elf)
+{
+	_ctx ctx = { elf, 0, NULL, 0, 0, NULL, 0, 0, 0 };
+	size_t i, j, n = 0;
+	int rel;
+
+	assert(elf != NULL);
+
+	if (elf->funcs_built) {
+		return 0;
+	}
+	rel = ctx.rel = RWELF_EHDR(elf, e_type) == ET_REL;
+
+	_add_symbols(&ctx, 0);
+	_add_symbols(&ctx, 1);
+
+	if (!rel) {
+		_add_fdes(&ctx);
+		_add_init(&ctx);
+		free(ctx.slots);
+		_add(&ctx, 0, RWELF_EHDR(elf, e_entry), 0, NULL, RWELF_FUNC_ENTRY,
+			_RANK_NONAME);
+	}
+
+	if (ctx.error || (elf->funcs = rwelf_arena_alloc(elf,
+			(ctx.n + 1) * sizeof(rwelf_func))) == NULL) {
+		free(ctx.cands);
+		return -1;
+	}
+
+	if (ctx.n) {
+		qsort(ctx.cands, ctx.n, sizeof(_cand), _cand_cmp);
+	}
+
+	/* One function per address (per section and offset for ET_REL), the
+	 * best ranked name first */
+	for (i = 0; i < ctx.n; i = j) {
+		rwelf_func *f = &elf->funcs[n];
+
+		if (!rel && !_code_segment(elf, ctx.cands[i].addr)) {
+			for (j = i + 1; j < ctx.n && ctx.cands[j].addr == ctx.cands[i].addr; ++j);
+			continue;
+		}
+
+		f->addr    = ctx.cands[i].addr;
+		f->name    = ctx.cands[i].name;
+		f->shndx   = ctx.cands[i].shndx;
+		f->size    = 0;
+		f->sources = 0;
+
+		for (j = i; j < ctx.n && ctx.cands[j].addr == f->addr
+			&& ctx.cands[j].shndx == f->shndx; ++j) {
+			const _cand *c = &ctx.cands[j];
+
+			/* Ranked symbols first, so FDE ranges only fill the gaps */
+			if (c->size && !f->size) {
+				f->size = c->size;
+			}
+			f->sources |= c->sources;
+		}
+		++n;
+	}
+	free(ctx.cands);
+
+	/* Starts without a length run to the next function */
+	for (i = 0; !rel && i < n; ++i) {
+		rwelf_func *f = &elf->funcs[i];
+		const rwelf_segment *seg;
+		uint64_t limit;
+
+		if (f->size || (seg = _code_segment(elf, f->addr)) == NULL) {
+			continue;
+		}
+		limit = seg->vaddr + seg->memsz;
+
+		if (i + 1 < n && elf->funcs[i + 1].addr < limit) {
+			limit = elf->funcs[i + 1].addr;
+		}
+		f->size = limit - f->addr;
+	}
+
+	elf->nfuncs = n;
+	elf->funcs_built = 1;
+
+	return 0;
+}
+
+/**
+ * rwelf_num_funcs(const rwelf*)
+ * Returns the number of functions found by rwelf_funcs_build
+ */
+size_t rwelf_num_funcs(const rwelf *elf)
+{
+	assert(elf != NULL);
+
+	return elf->nfuncs;
+}
+
+/**
+ * rwelf_get_func_by_num(const rwelf*, size_t)
+ * Returns the function by number, functions are sorted by address
+ */
+const rwelf_func *rwelf_get_func_by_num(const rwelf *elf, size_t n)
+{
+	assert(elf != NULL);
+	assert(elf->nfuncs > n);
+
+	return &elf->funcs[n];
+}
+
+/**
+ * rwelf_func_lookup(const rwelf*, uint64_t)
+ * Returns the function containing the address, otherwise NULL is returned.
+ * This is the address lookup of the recovered functions, which have no
+ * symbol for rwelf_index_lookup_addr to return. ET_REL has no addresses,
+ * only offsets per section, so NULL is returned for it
+ */
+const rwelf_func *rwelf_func_lookup(const rwelf *elf, uint64_t addr)
+{
+	size_t lo = 0, hi;
+
+	assert(elf != NULL);
+
+	if (RWELF_EHDR(elf, e_type) == ET_REL) {
+		return NULL;
+	}
+	hi = elf->nfuncs;
+
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+
+		if (elf->funcs[mid].addr <= addr) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+
+	/* The address may be past a symbol nested in a longer FDE range */
+	for (hi = lo; lo > 0 && hi - lo < _NESTED_MAX; --lo) {
+		const rwelf_func *f = &elf->funcs[lo - 1];
+
+		if (addr - f->addr < f->size) {
+			return f;
+		}
+	}
+	return NULL;
+}
@@ -0,0 +1,615 @@
+/**
+ * rwelf
+ * Copyright (c) 2012-2013 Felipe Pena <felipensp(at)gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "rwelf.h"
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * Content hashing
+ *
+ * Sections and functions are hashed with XXH64 straight over the data
+ * returned by rwelf_get_data(), so nothing is copied with the mmap
+ * backend. XXH64 is a plain scalar loop; XXH3 would be faster on large
+ * inputs but needs far more code to stay portable, and XXH64 gives the
+ * same value as the reference implementation, so other tools can check it.
+ *
+ * With RWELF_HASH_MASK_RELOCS the bytes patched by relocations are hashed
+ * as zeros, so code and data which only differ by where they were linked
+ * hash the same. In relocatable objects these are the .rela sections
+ * targeting the section; in linked files the dynamic and PLT relocations,
+ * which only apply to SHF_ALLOC sections. SHT_REL sections and DT_REL
+ * tables are not read, so their targets are hashed as they are.
+ */
+
+#define _P1 0x9E3779B185EBCA87ULL
+#define _P2 0xC2B2AE3D27D4EB4FULL
+#define _P3 0x165667B19E3779F9ULL
+#define _P4 0x85EBCA77C2B2AE63ULL
+#define _P5 0x27D4EB2F165667C5ULL
+
+#define _ROTL(_x, _r) (((_x) << (_r)) | ((_x) >> (64 - (_r))))
+
+typedef struct {
+	uint64_t v[4];
+	uint64_t total;
+	unsigned char buf[32];
+	size_t buflen;
+	uint64_t seed;
+} _xxh64;
+
+typedef struct {
+	size_t shndx;             /* Section in relocatable files, else 0 */
+	uint64_t pos;             /* Section offset or address */
+	unsigned width;
+} _reloc;
+
+typedef struct {
+	_reloc *relocs;           /* Sorted by section and position */
+	size_t n;
+	int loaded;
+} _reloc_set;
+
+static inline uint64_t _read64(const unsigned char *p)
+{
+	uint64_t v;
+
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+static inline uint32_t _read32(const unsigned char *p)
+{
+	uint32_t v;
+
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+static inline uint64_t _round(uint64_t acc, uint64_t input)
+{
+	acc += input * _P2;
+	acc  = _ROTL(acc, 31);
+	return acc * _P1;
+}
+
+static inline uint64_t _merge(uint64_t acc, uint64_t val)
+{
+	acc ^= _round(0, val);
+	return acc * _P1 + _P4;
+}
+
+static void _xxh64_init(_xxh64 *st, uint64_t seed)
+{
+	st->v[0]   = seed + _P1 + _P2;
+	st->v[1]   = seed + _P2;
+	st->v[2]   = seed;
+	st->v[3]   = seed - _P1;
+	st->total  = 0;
+	st->buflen = 0;
+	st->seed   = seed;
+}
+
+/**
+ * Consumes whole stripes, returns how many bytes were used
+ */
+static size_t _xxh64_stripes(_xxh64 *st, const unsigned char *p, size_t len)
+{
+	uint64_t v0 = st->v[0], v1 = st->v[1], v2 = st->v[2], v3 = st->v[3];
+	const unsigned char *start = p, *end = p + (len & ~(size_t) 31);
+
+	for (; p < end; p += 32) {
+		v0 = _round(v0, _read64(p));
+		v1 = _round(v1, _read64(p + 8));
+		v2 = _round(v2, _read64(p + 16));
+		v3 = _round(v3, _read64(p + 24));
+	}
+	st->v[0] = v0;
+	st->v[1] = v1;
+	st->v[2] = v2;
+	st->v[3] = v3;
+
+	return p - start;
+}
+
+static void _xxh64_update(_xxh64 *st, const unsigned char *p, size_t len)
+{
+	size_t n;
+
+	st->total += len;
+
+	if (st->buflen) {
+		n = 32 - st->buflen < len ? 32 - st->buflen : len;
+		memcpy(st->buf + st->buflen, p, n);
+		st->buflen += n;
+		p   += n;
+		len -= n;
+
+		if (st->buflen < 32) {
+			return;
+		}
+		_xxh64_stripes(st, st->buf, 32);
+		st->buflen = 0;
+	}
+
+	n = _xxh64_stripes(st, p, len);
+	memcpy(st->buf, p + n, len - n);
+	st->buflen = len - n;
+}
+
+static void _xxh64_zeros(_xxh64 *st, size_t len)
+{
+	static const unsigned char zero[32];
+
+	while (len) {
+		size_t n = len < sizeof(zero) ? len : sizeof(zero);
+
+		_xxh64_update(st, zero, n);
+		len -= n;
+	}
+}
+
+static uint64_t _xxh64_final(const _xxh64 *st)
+{
+	const unsigned char *p = st->buf, *end = st->buf + st->buflen;
+	uint64_t h;
+
+	if (st->total >= 32) {
+		h = _ROTL(st->v[0], 1) + _ROTL(st->v[1], 7)
+			+ _ROTL(st->v[2], 12) + _ROTL(st->v[3], 18);
+		h = _merge(h, st->v[0]);
+		h = _merge(h, st->v[1]);
+		h = _merge(h, st->v[2]);
+		h = _merge(h, st->v[3]);
+	} else {
+		h = st->seed + _P5;
+	}
+	h += st->total;
+
+	for (; p + 8 <= end; p += 8) {
+		h ^= _round(0, _read64(p));
+		h  = _ROTL(h, 27) * _P1 + _P4;
+	}
+	if (p + 4 <= end) {
+		h ^= (uint64_t) _read32(p) * _P1;
+		h  = _ROTL(h, 23) * _P2 + _P3;
+		p += 4;
+	}
+	for (; p < end; ++p) {
+		h ^= *p * _P5;
+		h  = _ROTL(h, 11) * _P1;
+	}
+
+	h ^= h >> 33;
+	h *= _P2;
+	h ^= h >> 29;
+	h *= _P3;
+	h ^= h >> 32;
+
+	return h;
+}
+
+/**
+ * rwelf_hash64(const void*, size_t, uint64_t)
+ * Returns the XXH64 hash of len bytes
+ */
+uint64_t rwelf_hash64(const void *data, size_t len, uint64_t seed)
+{
+	_xxh64 st;
+
+	assert(data != NULL || len == 0);
+
+	_xxh64_init(&st, seed);
+	_xxh64_update(&st, data, len);
+
+	return _xxh64_final(&st);
+}
+
+/**
+ * Number of bytes a relocation type patches
+ */
+static unsigned _reloc_width(const rwelf *elf, uint64_t type)
+{
+	unsigned word = ELF_IS_64(elf) ? 8 : 4;
+
+	switch (RWELF_EHDR(elf, e_machine)) {
+		case EM_X86_64:
+			switch (type) {
+				case R_X86_64_NONE:
+				case R_X86_64_COPY:
+				case R_X86_64_TLSDESC_CALL:
+					return 0;
+				case R_X86_64_8:
+				case R_X86_64_PC8:
+					return 1;
+				case R_X86_64_16:
+				case R_X86_64_PC16:
+					return 2;
+				case R_X86_64_PC32:
+				case R_X86_64_GOT32:
+				case R_X86_64_PLT32:
+				case R_X86_64_GOTPCREL:
+				case R_X86_64_32:
+				case R_X86_64_32S:
+				case R_X86_64_TLSGD:
+				case R_X86_64_TLSLD:
+				case R_X86_64_DTPOFF32:
+				case R_X86_64_GOTTPOFF:
+				case R_X86_64_TPOFF32:
+				case R_X86_64_GOTPC32:
+				case R_X86_64_SIZE32:
+				case R_X86_64_GOTPC32_TLSDESC:
+				case R_X86_64_GOTPCRELX:
+				case R_X86_64_REX_GOTPCRELX:
+					return 4;
+				case R_X86_64_TLSDESC:
+					return 16;
+				default:
+					return 8;
+			}
+		case EM_AARCH64:
+			switch (type) {
+				case R_AARCH64_NONE:
+				case R_AARCH64_COPY:
+					return 0;
+				case R_AARCH64_ABS16:
+				case R_AARCH64_PREL16:
+					return 2;
+				case R_AARCH64_ABS32:
+				case R_AARCH64_PREL32:
+					return 4;
+				case R_AARCH64_TLSDESC:
+					return 16;
+				default:
+					/* Data and dynamic relocations, instructions are 4 */
+					return type == R_AARCH64_ABS64 || type == R_AARCH64_PREL64
+						|| type >= R_AARCH64_COPY ? 8 : 4;
+			}
+		default:
+			return word;
+	}
+}
+
+static int _reloc_cmp(const void *a, const void *b)
+{
+	const _reloc *x = a, *y = b;
+
+	if (x->shndx != y->shndx) {
+		return x->shndx < y->shndx ? -1 : 1;
+	}
+	return x->pos < y->pos ? -1 : x->pos > y->pos;
+}
+
+static int _add_reloc(_reloc_set *set, size_t *cap, const Elf_Rela *rela,
+	size_t shndx)
+{
+	_reloc *r;
+
+	if (set->n == *cap) {
+		size_t n = *cap ? *cap * 2 : 256;
+		_reloc *relocs = realloc(set->relocs, n * sizeof(_reloc));
+
+		if (!relocs) {
+			return -1;
+		}
+		set->relocs = relocs;
+		*cap = n;
+	}
+	r = &set->relocs[set->n];
+	r->shndx = shndx;
+	r->pos   = rwelf_get_rela_offset(rela);
+	r->width = _reloc_width(rela->elf, rwelf_get_rela_type(rela));
+
+	if (r->width) {
+		++set->n;
+	}
+	return 0;
+}
+
+/**
+ * Collects the patched ranges of the whole file, once
+ */
+static int _load_relocs(const rwelf *elf, _reloc_set *set)
+{
+	size_t cap = 0, i, j;
+	Elf_Rela rela;
+	Elf_Shdr shdr;
+
+	if (set->loaded) {
+		return 0;
+	}
+	set->loaded = 1;
+
+	if (RWELF_EHDR(elf, e_type) == ET_REL) {
+		size_t entsize = ELF_IS_64(elf) ? sizeof(Elf64_Rela) : sizeof(Elf32_Rela);
+
+		for (i = 1; elf->shstrtab && i < RWELF_EHDR(elf, e_shnum); ++i) {
+			if (RWELF_SHDR(elf, sh_type, i) != SHT_RELA) {
+				continue;
+			}
+			rwelf_get_section_by_num(elf, i, &shdr);
+
+			for (j = 0; j < RWELF_SHDR(elf, sh_size, i) / entsize; ++j) {
+				rwelf_get_rela_by_num(&shdr, j, &rela);
+
+				if (!RELA64(&rela)) {
+					break;
+				}
+				if (_add_reloc(set, &cap, &rela, RWELF_SHDR(elf, sh_info, i)) == -1) {
+					return -1;
+				}
+			}
+		}
+	} else {
+		for (i = 0; i < rwelf_num_dyn_relas(elf); ++i) {
+			rwelf_get_dyn_rela_by_num(elf, i, &rela);
+
+			if (_add_reloc(set, &cap, &rela, 0) == -1) {
+				return -1;
+			}
+		}
+		for (i = 0; i < rwelf_num_jmprels(elf); ++i) {
+			rwelf_get_jmprel_by_num(elf, i, &rela);
+
+			if (_add_reloc(set, &cap, &rela, 0) == -1) {
+				return -1;
+			}
+		}
+	}
+
+	qsort(set->relocs, set->n, sizeof(_reloc), _reloc_cmp);
+
+	return 0;
+}
+
+/**
+ * Hashes size bytes at offset of the file, which are at pos (section
+ * offset or address) for the relocations of section shndx
+ */
+static int _hash_range(const rwelf *elf, const _reloc_set *set, size_t shndx,
+	uint64_t pos, uint64_t offset, uint64_t size, uint64_t *hash)
+{
+	const unsigned char *data = rwelf_get_data(elf, offset, size);
+	uint64_t done = 0;
+	size_t lo = 0, hi;
+	_xxh64 st;
+
+	if (!data) {
+		return -1;
+	}
+	if (!set || !set->n) {
+		*hash = rwelf_hash64(data, size, 0);
+		return 0;
+	}
+
+	/* First relocation which may reach into the range */
+	hi = set->n;
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		const _reloc *r = &set->relocs[mid];
+
+		if (r->shndx < shndx || (r->shndx == shndx && r->pos + 16 <= pos)) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+
+	_xxh64_init(&st, 0);
+
+	for (; lo < set->n && set->relocs[lo].shndx == shndx
+		&& set->relocs[lo].pos < pos + size; ++lo) {
+		const _reloc *r = &set->relocs[lo];
+		uint64_t start = r->pos > pos ? r->pos - pos : 0;
+		uint64_t end = r->pos + r->width - pos;
+
+		if (r->pos + r->width <= pos) {
+			continue;
+		}
+		if (end > size) {
+			end = size;
+		}
+		if (start < done) {
+			start = done;
+		}
+		if (start >= end) {
+			continue;
+		}
+		_xxh64_update(&st, data + done, start - done);
+		_xxh64_zeros(&st, end - start);
+		done = end;
+	}
+	_xxh64_update(&st, data + done, size - done);
+
+	*hash = _xxh64_final(&st);
+
+	return 0;
+}
+
+/**
+ * Hashes a section, its contents must be in the file
+ */
+static int _hash_section(const rwelf *elf, const _reloc_set *set, size_t n,
+	uint64_t *hash)
+{
+	int rel = RWELF_EHDR(elf, e_type) == ET_REL;
+
+	if (RWELF_SHDR(elf, sh_type, n) == SHT_NOBITS) {
+		return -1;
+	}
+	/* Dynamic relocations are by address, which only loaded sections have */
+	if (!rel && !(RWELF_SHDR(elf, sh_flags, n) & SHF_ALLOC)) {
+		set = NULL;
+	}
+	return _hash_range(elf, set, rel ? n : 0,
+		rel ? 0 : RWELF_SHDR(elf, sh_addr, n), RWELF_SHDR(elf, sh_offset, n),
+		RWELF_SHDR(elf, sh_size, n), hash);
+}
+
+/**
+ * Hashes the bytes of a function symbol
+ */
+static int _hash_function(const rwelf *elf, const _reloc_set *set,
+	uint16_t shndx, uint64_t value, uint64_t size, uint64_t *offset,
+	uint64_t *hash)
+{
+	if (shndx == SHN_UNDEF || shndx >= SHN_LORESERVE || !size) {
+		return -1;
+	}
+
+	if (RWELF_EHDR(elf, e_type) == ET_REL) {
+		if (!elf->shstrtab || shndx >= RWELF_EHDR(elf, e_shnum)
+			|| RWELF_SHDR(elf, sh_type, shndx) == SHT_NOBITS) {
+			return -1;
+		}
+		*offset = RWELF_SHDR(elf, sh_offset, shndx) + value;
+
+		return _hash_range(elf, set, shndx, value, *offset, size, hash);
+	}
+
+	if (rwelf_vaddr_to_offset(elf, value, offset) != RWELF_VADDR_FILE) {
+		return -1;
+	}
+	return _hash_range(elf, set, 0, value, *offset, size, hash);
+}
+
+/**
+ * rwelf_hash_section(const rwelf*, size_t, int, uint64_t*)
+ * Hashes the contents of a section by number. With RWELF_HASH_MASK_RELOCS
+ * relocated bytes are hashed as zeros. Returns -1 when the section has no
+ * contents in the file
+ */
+int rwelf_hash_section(const rwelf *elf, size_t n, int flags, uint64_t *hash)
+{
+	_reloc_set set = { NULL, 0, 0 };
+	int ret;
+
+	assert(elf != NULL);
+	assert(hash != NULL);
+	assert(RWELF_EHDR(elf, e_shnum) > n);
+
+	if ((flags & RWELF_HASH_MASK_RELOCS) && _load_relocs(elf, &set) == -1) {
+		free(set.relocs);
+		return -1;
+	}
+	ret = _hash_section(elf, &set, n, hash);
+	free(set.relocs);
+
+	return ret;
+}
+
+/**
+ * rwelf_hash_symbol(const Elf_Sym*, int, uint64_t*)
+ * Hashes the bytes covered by a defined symbol. With
+ * RWELF_HASH_MASK_RELOCS relocated bytes are hashed as zeros. Returns -1
+ * when the symbol has no bytes in the file
+ */
+int rwelf_hash_symbol(const Elf_Sym *sym, int flags, uint64_t *hash)
+{
+	_reloc_set set = { NULL, 0, 0 };
+	uint64_t offset;
+	int ret;
+
+	assert(sym != NULL);
+	assert(hash != NULL);
+
+	if ((flags & RWELF_HASH_MASK_RELOCS) && _load_relocs(sym->elf, &set) == -1) {
+		free(set.relocs);
+		return -1;
+	}
+	ret = _hash_function(sym->elf, &set, rwelf_get_symbol_shndx(sym),
+		rwelf_get_symbol_value(sym), rwelf_get_symbol_size(sym), &offset, hash);
+	free(set.relocs);
+
+	return ret;
+}
+
+/**
+ * rwelf_foreach_hash(const rwelf*, int, int (*)(const rwelf_hash_entry*,
+ *   void*), void*)
+ * Hashes every section with contents (RWELF_HASH_SECTIONS) and every
+ * defined STT_FUNC symbol (RWELF_HASH_FUNCTIONS) of .symtab, or of
+ * .dynsym when there is no .symtab, calling cb for each. The relocations
+ * are only read once for the whole file. Stops when cb returns non-zero.
+ * Returns -1 when out of memory
+ */
+int rwelf_foreach_hash(const rwelf *elf, int flags,
+	int (*cb)(const rwelf_hash_entry*, void*), void *arg)
+{
+	_reloc_set set = { NULL, 0, 0 };
+	rwelf_hash_entry entry;
+	int dynamic = !elf->nsyms;
+	size_t i, n;
+
+	assert(elf != NULL);
+	assert(cb != NULL);
+
+	if ((flags & RWELF_HASH_MASK_RELOCS) && _load_relocs(elf, &set) == -1) {
+		free(set.relocs);
+		return -1;
+	}
+
+	for (i = 1; (flags & RWELF_HASH_SECTIONS) && elf->shstrtab
+		&& i < RWELF_EHDR(elf, e_shnum); ++i) {
+		if (_hash_section(elf, &set, i, &entry.hash) == -1) {
+			continue;
+		}
+		entry.what   = RWELF_HASH_SECTIONS;
+		entry.name   = (const char*)(elf->shstrtab + RWELF_SHDR(elf, sh_name, i));
+		entry.index  = i;
+		entry.offset = RWELF_SHDR(elf, sh_offset, i);
+		entry.size   = RWELF_SHDR(elf, sh_size, i);
+
+		if (cb(&entry, arg)) {
+			goto out;
+		}
+	}
+
+	n = dynamic ? elf->ndynsyms : elf->nsyms;
+
+	for (i = 1; (flags & RWELF_HASH_FUNCTIONS) && i < n; ++i) {
+		const unsigned char *strtab = dynamic ? elf->dynstr : elf->strtab;
+
+#define SYM(_field) (dynamic ? RWELF(elf, DYNSYM, _field, i) : RWELF(elf, SYM, _field, i))
+		if (ELF64_ST_TYPE(SYM(st_info)) != STT_FUNC
+			|| _hash_function(elf, &set, SYM(st_shndx), SYM(st_value),
+				SYM(st_size), &entry.offset, &entry.hash) == -1) {
+			continue;
+		}
+		entry.what  = RWELF_HASH_FUNCTIONS;
+		entry.name  = strtab ? (const char*)(strtab + SYM(st_name)) : "";
+		entry.index = i;
+		entry.size  = SYM(st_size);
+#undef SYM
+
+		if (cb(&entry, arg)) {
+			break;
+		}
+	}
+out:
+	free(set.relocs);
+
+	return 0;
+}
@@ -0,0 +1,636 @@
+/**
+ * rwelf
+ * Copyright (c) 2012-2013 Felipe Pena <felipensp(at)gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "rwelf.h"
+#include "internal.h"
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/**
+ * Persistent symbol index
+ *
+ * The index is a single blob with the same layout on disk and in memory,
+ * so a saved index is used straight from its mapping:
+ *
+ *   header   (_index_hdr)
+ *   buckets  uint32_t[nbuckets]  first symbol of each chain + 1, 0 if empty
+ *   chains   uint32_t[nsyms]     next symbol on the same bucket + 1
+ *   hashes   uint32_t[nsyms]     name hash of each symbol
+ *   names    uint32_t[nsyms]     offset of each name on the heap
+ *   addrs    _index_addr[naddrs] defined symbols sorted by address
+ *   heap     interned symbol names
+ *
+ * It is tied to the binary by its build-id, mtime, size and number of
+ * symbols; a stale index is never used.
+ */
+
+#define RWELF_INDEX_MAGIC   "RWELFIDX"
+#define RWELF_INDEX_VERSION 1
+#define RWELF_INDEX_EXT     ".rwidx"
+
+/* Symbols before the last start looked at for one enclosing the address */
+#define _NESTED_MAX 8
+
+#define _ALIGN8(_n) (((_n) + 7) & ~(uint64_t) 7)
+
+typedef struct {
+	char magic[8];
+	uint32_t version;
+	uint32_t build_id_len;
+	unsigned char build_id[64];
+	int64_t mtime;
+	uint64_t file_size;
+	uint64_t nsyms;
+	uint64_t nbuckets;
+	uint64_t naddrs;
+	uint64_t buckets_off;
+	uint64_t chains_off;
+	uint64_t hashes_off;
+	uint64_t names_off;
+	uint64_t addrs_off;
+	uint64_t heap_off;
+	uint64_t heap_size;
+} _index_hdr;
+
+typedef struct {
+	uint64_t addr;
+	uint64_t size;
+	uint32_t sym;
+	uint32_t pad;
+} _index_addr;
+
+#define _INDEX_PART(_idx, _type, _part) \
+	((_type*)((unsigned char*)(_idx) + (_idx)->_part##_off))
+
+static int _addr_cmp(const void *a, const void *b)
+{
+	const _index_addr *x = a, *y = b;
+
+	if (x->addr != y->addr) {
+		return x->addr < y->addr ? -1 : 1;
+	}
+	return x->sym < y->sym ? -1 : (x->sym > y->sym);
+}
+
+/**
+ * Fills the fields used to validate the index against its binary
+ */
+static void _index_key(const rwelf *elf, _index_hdr *hdr)
+{
+	const unsigned char *build_id;
+	size_t len;
+
+	memset(hdr, 0, sizeof(_index_hdr));
+	memcpy(hdr->magic, RWELF_INDEX_MAGIC, sizeof(hdr->magic));
+
+	hdr->version   = RWELF_INDEX_VERSION;
+	hdr->mtime     = elf->mtime;
+	hdr->file_size = elf->size;
+	hdr->nsyms     = elf->nsyms;
+
+	if ((build_id = rwelf_get_build_id(elf, &len)) != NULL) {
+		if (len > sizeof(hdr->build_id)) {
+			len = sizeof(hdr->build_id);
+		}
+		memcpy(hdr->build_id, build_id, len);
+		hdr->build_id_len = len;
+	}
+}
+
+/**
+ * Whether count items of elsize bytes at off are inside the blob, without
+ * overflowing on the untrusted fields
+ */
+static int _part_fits(uint64_t off, uint64_t count, size_t elsize,
+	size_t align, size_t size)
+{
+	return off <= size && off % align == 0 && count <= (size - off) / elsize;
+}
+
+/**
+ * Checks that the blob is a well formed index for the binary, down to
+ * every symbol number and name offset the lookups follow
+ */
+static int _index_valid(const rwelf *elf, const _index_hdr *idx, size_t size)
+{
+	const uint32_t *buckets, *chains, *names;
+	const _index_addr *addrs;
+	const unsigned char *heap;
+	_index_hdr key;
+	uint64_t i;
+
+	if (size < sizeof(_index_hdr)) {
+		return 0;
+	}
+
+	_index_key(elf, &key);
+
+	if (memcmp(idx->magic, key.magic, sizeof(key.magic)) != 0
+		|| idx->version != key.version
+		|| idx->build_id_len != key.build_id_len
+		|| memcmp(idx->build_id, key.build_id, key.build_id_len) != 0
+		|| idx->mtime != key.mtime
+		|| idx->file_size != key.file_size
+		|| idx->nsyms != key.nsyms) {
+		return 0;
+	}
+
+	if (!idx->nbuckets || (idx->nbuckets & (idx->nbuckets - 1)) != 0
+		|| !idx->heap_size
+		|| !_part_fits(idx->heap_off, idx->heap_size, 1, 1, size)
+		|| !_part_fits(idx->buckets_off, idx->nbuckets, 4, 4, size)
+		|| !_part_fits(idx->chains_off, idx->nsyms, 4, 4, size)
+		|| !_part_fits(idx->hashes_off, idx->nsyms, 4, 4, size)
+		|| !_part_fits(idx->names_off, idx->nsyms, 4, 4, size)
+		|| !_part_fits(idx->addrs_off, idx->naddrs, sizeof(_index_addr), 8, size)) {
+		return 0;
+	}
+
+	buckets = _INDEX_PART(idx, const uint32_t, buckets);
+	chains  = _INDEX_PART(idx, const uint32_t, chains);
+	names   = _INDEX_PART(idx, const uint32_t, names);
+	addrs   = _INDEX_PART(idx, const _index_addr, addrs);
+	heap    = _INDEX_PART(idx, const unsigned char, heap);
+
+	/* Names are read up to their NUL, the last one must end the heap */
+	if (heap[idx->heap_size - 1] != '\0') {
+		return 0;
+	}
+	for (i = 0; i < idx->nbuckets; ++i) {
+		if (buckets[i] > idx->nsyms) {
+			return 0;
+		}
+	}
+	/* Chains only move to higher symbols, which also rules out loops */
+	for (i = 0; i < idx->nsyms; ++i) {
+		if ((chains[i] && chains[i] <= i + 1) || chains[i] > idx->nsyms
+			|| names[i] >= idx->heap_size) {
+			return 0;
+		}
+	}
+	for (i = 0; i < idx->naddrs; ++i) {
+		if (addrs[i].sym >= idx->nsyms) {
+			return 0;
+		}
+	}
+	return 1;
+}
+
+/**
+ * Builds the index of .symtab into a single blob on the arena
+ */
+static _index_hdr *_index_build(rwelf *elf, size_t *size)
+{
+	_index_hdr *idx;
+	uint32_t *buckets, *chains, *hashes, *names;
+	_index_addr *addrs;
+	unsigned char *heap;
+	uint64_t nbuckets = 1, naddrs = 0, heap_size = 1, total;
+	size_t i;
+
+	while (nbuckets < elf->nsyms) {
+		nbuckets <<= 1;
+	}
+
+	for (i = 0; i < elf->nsyms; ++i) {
+		const char *name = (const char*)(elf->strtab + RWELF_SYM(elf, st_name, i));
+
+		heap_size += strlen(name) + 1;
+
+		if (RWELF_SYM(elf, st_shndx, i) != SHN_UNDEF) {
+			switch (ELF64_ST_TYPE(RWELF_SYM(elf, st_info, i))) {
+				case STT_SECTION:
+				case STT_FILE:
+				case STT_TLS:
+					break;
+				default:
+					++naddrs;
+			}
+		}
+	}
+
+	/* The heap is sized for the worst case, interning only shrinks it */
+	total = _ALIGN8(sizeof(_index_hdr))
+		+ _ALIGN8(nbuckets * sizeof(uint32_t))
+		+ 3 * _ALIGN8(elf->nsyms * sizeof(uint32_t))
+		+ naddrs * sizeof(_index_addr)
+		+ heap_size;
+
+	if ((idx = rwelf_arena_alloc(elf, total)) == NULL) {
+		return NULL;
+	}
+
+	_index_key(elf, idx);
+
+	idx->nbuckets    = nbuckets;
+	idx->naddrs      = naddrs;
+	idx->buckets_off = _ALIGN8(sizeof(_index_hdr));
+	idx->chains_off  = idx->buckets_off + _ALIGN8(nbuckets * sizeof(uint32_t));
+	idx->hashes_off  = idx->chains_off + _ALIGN8(elf->nsyms * sizeof(uint32_t));
+	idx->names_off   = idx->hashes_off + _ALIGN8(elf->nsyms * sizeof(uint32_t));
+	idx->addrs_off   = idx->names_off + _ALIGN8(elf->nsyms * sizeof(uint32_t));
+	idx->heap_off    = idx->addrs_off + naddrs * sizeof(_index_addr);
+
+	buckets = _INDEX_PART(idx, uint32_t, buckets);
+	chains  = _INDEX_PART(idx, uint32_t, chains);
+	hashes  = _INDEX_PART(idx, uint32_t, hashes);
+	names   = _INDEX_PART(idx, uint32_t, names);
+	addrs   = _INDEX_PART(idx, _index_addr, addrs);
+	heap    = _INDEX_PART(idx, unsigned char, heap);
+
+	/* Inserting backwards leaves the lowest symbol first on each chain */
+	heap_size = 1;
+	naddrs = 0;
+
+	for (i = elf->nsyms; i-- > 0;) {
+		const char *name = (const char*)(elf->strtab + RWELF_SYM(elf, st_name, i));
+		uint32_t hash = _str_hash(name), *b = &buckets[hash & (nbuckets - 1)];
+		uint32_t n;
+
+		hashes[i] = hash;
+		names[i]  = 0;
+
+		/* Intern the name, reusing a previous copy on the same chain */
+		for (n = *b; n; n = chains[n - 1]) {
+			if (hashes[n - 1] == hash
+				&& strcmp((char*) heap + names[n - 1], name) == 0) {
+				names[i] = names[n - 1];
+				break;
+			}
+		}
+		if (!n && *name) {
+			size_t len = strlen(name) + 1;
+
+			memcpy(heap + heap_size, name, len);
+			names[i] = heap_size;
+			heap_size += len;
+		}
+
+		chains[i] = *b;
+		*b = i + 1;
+
+		if (RWELF_SYM(elf, st_shndx, i) != SHN_UNDEF) {
+			switch (ELF64_ST_TYPE(RWELF_SYM(elf, st_info, i))) {
+				case STT_SECTION:
+				case STT_FILE:
+				case STT_TLS:
+					break;
+				default:
+					addrs[naddrs].addr = RWELF_SYM(elf, st_value, i);
+					addrs[naddrs].size = RWELF_SYM(elf, st_size, i);
+					addrs[naddrs].sym  = i;
+					++naddrs;
+			}
+		}
+	}
+
+	qsort(addrs, naddrs, sizeof(_index_addr), _addr_cmp);
+
+	idx->heap_size = heap_size;
+	*size = idx->heap_off + heap_size;
+
+	return idx;
+}
+
+/**
+ * Computes the location of the index: next to the binary, or inside
+ * cachedir named after the build-id when one is given
+ */
+static int _index_path(const rwelf *elf, const char *cachedir,
+	char *path, size_t size)
+{
+	const unsigned char *build_id;
+	const char *base;
+	size_t i, len, n;
+
+	/* Files opened from memory have no path to derive a name from */
+	if (!cachedir) {
+		if (!elf->fname) {
+			return -1;
+		}
+		n = snprintf(path, size, "%s" RWELF_INDEX_EXT, elf->fname);
+		return n < size ? 0 : -1;
+	}
+
+	n = snprintf(path, size, "%s/", cachedir);
+
+	if ((build_id = rwelf_get_build_id(elf, &len)) != NULL) {
+		for (i = 0; i < len && n < size; ++i) {
+			n += snprintf(path + n, size - n, "%02x", build_id[i]);
+		}
+	} else if (elf->fname) {
+		base = strrchr(elf->fname, '/');
+		n += snprintf(path + n, size - n, "%s-%08x",
+			base ? base + 1 : elf->fname, _str_hash(elf->fname));
+	} else {
+		return -1;
+	}
+	if (n < size) {
+		n += snprintf(path + n, size - n, RWELF_INDEX_EXT);
+	}
+	return n < size ? 0 : -1;
+}
+
+static void _index_release(rwelf *elf)
+{
+	if (!elf->index) {
+		return;
+	}
+	/* A built index is on the arena and goes away with the handle */
+	if (elf->index_mapped) {
+		munmap(elf->index, elf->index_size);
+	}
+	elf->index = NULL;
+	elf->index_size = 0;
+	elf->index_mapped = 0;
+}
+
+/**
+ * rwelf_index_build(rwelf*)
+ * Builds the in-memory symbol index of .symtab. Returns 0 on success,
+ * otherwise -1 is returned
+ */
+int rwelf_index_build(rwelf *elf)
+{
+	_index_hdr *idx;
+	size_t size;
+#ifdef RWELF_STATS
+	struct timespec start, end;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+#endif
+
+	assert(elf != NULL);
+
+	if (!elf->strtab || (idx = _index_build(elf, &size)) == NULL) {
+		return -1;
+	}
+
+#ifdef RWELF_STATS
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	RWELF_STAT(elf, RWELF_STAT_INDEX_BUILDS, 1);
+	RWELF_STAT(elf, RWELF_STAT_INDEX_BUILD_NS,
+		(end.tv_sec - start.tv_sec) * 1000000000LL + end.tv_nsec - start.tv_nsec);
+#endif
+
+	_index_release(elf);
+
+	elf->index = idx;
+	elf->index_size = size;
+
+	return 0;
+}
+
+/**
+ * rwelf_index_save(const rwelf*, const char*)
+ * Writes the current index next to the binary, or into cachedir when it
+ * is not NULL. The file is replaced atomically. Returns 0 on success,
+ * otherwise -1 is returned
+ */
+int rwelf_index_save(const rwelf *elf, const char *cachedir)
+{
+	char path[4096], tmp[4096 + 32];
+	const unsigned char *p;
+	size_t left;
+	int fd;
+
+	assert(elf != NULL);
+
+	if (!elf->index || _index_path(elf, cachedir, path, sizeof(path)) == -1) {
+		return -1;
+	}
+
+	snprintf(tmp, sizeof(tmp), "%s.%d", path, (int) getpid());
+
+	if ((fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644)) == -1) {
+		return -1;
+	}
+
+	p = elf->index;
+	left = elf->index_size;
+
+	while (left) {
+		ssize_t n = write(fd, p, left);
+
+		if (n == -1) {
+			if (errno == EINTR) {
+				continue;
+			}
+			close(fd);
+			unlink(tmp);
+			return -1;
+		}
+		p += n;
+		left -= n;
+	}
+
+	if (close(fd) == -1 || rename(tmp, path) == -1) {
+		unlink(tmp);
+		return -1;
+	}
+	return 0;
+}
+
+/**
+ * rwelf_index_load(rwelf*, const char*)
+ * Maps a previously saved index from next to the binary, or from cachedir
+ * when it is not NULL. Returns 0 when a valid index was mapped, otherwise
+ * -1 is returned
+ */
+int rwelf_index_load(rwelf *elf, const char *cachedir)
+{
+	char path[4096];
+	struct stat st;
+	void *mem;
+	int fd;
+
+	assert(elf != NULL);
+
+	if (_index_path(elf, cachedir, path, sizeof(path)) == -1) {
+		return -1;
+	}
+
+	if ((fd = open(path, O_RDONLY)) == -1) {
+		return -1;
+	}
+
+	if (fstat(fd, &st) == -1 || st.st_size < sizeof(_index_hdr)) {
+		close(fd);
+		return -1;
+	}
+
+	mem = mmap(0, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+
+	if (mem == MAP_FAILED) {
+		return -1;
+	}
+
+	if (!_index_valid(elf, mem, st.st_size)) {
+		munmap(mem, st.st_size);
+		return -1;
+	}
+
+	_index_release(elf);
+
+	elf->index = mem;
+	elf->index_size = st.st_size;
+	elf->index_mapped = 1;
+
+	return 0;
+}
+
+/**
+ * rwelf_index_open(rwelf*, const char*)
+ * Maps the saved index when it is still valid, otherwise builds a new one
+ * and tries to save it for the next time. Returns 0 when an index is
+ * available, otherwise -1 is returned
+ */
+int rwelf_index_open(rwelf *elf, const char *cachedir)
+{
+	assert(elf != NULL);
+
+	if (rwelf_index_load(elf, cachedir) == 0) {
+		return 0;
+	}
+	if (rwelf_index_build(elf) == -1) {
+		return -1;
+	}
+
+	/* Failing to save only costs a rebuild on the next open */
+	rwelf_index_save(elf, cachedir);
+
+	return 0;
+}
+
+/**
+ * rwelf_index_close(rwelf*)
+ * Releases the index of the binary
+ */
+void rwelf_index_close(rwelf *elf)
+{
+	assert(elf != NULL);
+
+	_index_release(elf);
+}
+
+/**
+ * rwelf_index_lookup_name(const rwelf*, const char*, Elf_Sym*)
+ * Finds a .symtab symbol by name through the index. Returns the position
+ * of the symbol if found, otherwise -1 is returned
+ */
+int rwelf_index_lookup_name(const rwelf *elf, const char *sname, Elf_Sym *sym)
+{
+	const _index_hdr *idx;
+	const uint32_t *chains, *hashes, *names;
+	const char *heap;
+	uint32_t hash, n;
+
+	assert(elf != NULL);
+	assert(elf->index != NULL);
+	assert(sname != NULL);
+
+	idx    = elf->index;
+	chains = _INDEX_PART(idx, const uint32_t, chains);
+	hashes = _INDEX_PART(idx, const uint32_t, hashes);
+	names  = _INDEX_PART(idx, const uint32_t, names);
+	heap   = _INDEX_PART(idx, const char, heap);
+	hash   = _str_hash(sname);
+
+	RWELF_STAT(elf, RWELF_STAT_INDEX_LOOKUPS, 1);
+
+	n = _INDEX_PART(idx, const uint32_t, buckets)[hash & (idx->nbuckets - 1)];
+
+	for (; n; n = chains[n - 1]) {
+		if (hashes[n - 1] == hash && strcmp(heap + names[n - 1], sname) == 0) {
+			if (sym) {
+				rwelf_get_symbol_by_num(elf, n - 1, sym);
+			}
+			return n - 1;
+		}
+	}
+	return -1;
+}
+
+/**
+ * rwelf_index_lookup_addr(const rwelf*, uint64_t, Elf_Sym*)
+ * Finds the .symtab symbol which contains the address through the index.
+ * The symbols starting at the closest address are tried first, then up to
+ * _NESTED_MAX earlier ones, so a function enclosing a nested label still
+ * matches. Returns the position of the symbol if found, otherwise -1 is
+ * returned
+ */
+int rwelf_index_lookup_addr(const rwelf *elf, uint64_t addr, Elf_Sym *sym)
+{
+	const _index_hdr *idx;
+	const _index_addr *addrs;
+	size_t lo, hi, earlier = 0;
+
+	assert(elf != NULL);
+	assert(elf->index != NULL);
+
+	idx   = elf->index;
+	addrs = _INDEX_PART(idx, const _index_addr, addrs);
+
+	RWELF_STAT(elf, RWELF_STAT_INDEX_LOOKUPS, 1);
+
+	/* Last entry starting at or before addr */
+	lo = 0;
+	hi = idx->naddrs;
+
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+
+		if (addrs[mid].addr <= addr) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+
+	/* Closest starts first, a sized one winning, then enclosing symbols */
+	while (lo-- > 0) {
+		const _index_addr *a = &addrs[lo];
+
+		if (a->addr != addrs[hi - 1].addr && ++earlier > _NESTED_MAX) {
+			break;
+		}
+		if (addr < a->addr + a->size || (a->size == 0 && addr == a->addr)) {
+			if (sym) {
+				rwelf_get_symbol_by_num(elf, a->sym, sym);
+			}
+			return a->sym;
+		}
+	}
+	return -1;
+}
@@ -0,0 +1,109 @@
+/**
+ * rwelf
+ * Copyright (c) 2012-2013 Felipe Pena <felipensp(at)gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef RWELF_INTERNAL_H
+#define RWELF_INTERNAL_H
+
+#include <stdint.h>
+
+/**
+ * Helpers shared by the library sources, not part of the public API.
+ * They are static inline so they stay out of the exported symbols.
+ */
+
+/**
+ * djb2 hash of a NUL terminated string, which is also the DT_GNU_HASH
+ * function
+ */
+static inline uint32_t _str_hash(const char *s)
+{
+	uint32_t h = 5381;
+
+	while (*s) {
+		h = h * 33 + (unsigned char) *s++;
+	}
+	return h;
+}
+
+/**
+ * Reads an unsigned LEB128 value, advancing *pp past it. Bits beyond 64
+ * are dropped. Returns -1 when it runs past end
+ */
+static inline int _uleb(const unsigned char **pp, const unsigned char *end,
+	uint64_t *val)
+{
+	const unsigned char *p = *pp;
+	unsigned shift = 0;
+
+	*val = 0;
+
+	while (p < end) {
+		unsigned char b = *p++;
+
+		if (shift < 64) {
+			*val |= (uint64_t)(b & 0x7f) << shift;
+		}
+		shift += 7;
+
+		if (!(b & 0x80)) {
+			*pp = p;
+			return 0;
+		}
+	}
+	return -1;
+}
+
+/**
+ * Reads a signed LEB128 value, advancing *pp past it. Returns -1 when it
+ * runs past end
+ */
+static inline int _sleb(const unsigned char **pp, const unsigned char *end,
+	int64_t *val)
+{
+	const unsigned char *p = *pp;
+	unsigned shift = 0;
+	uint64_t v = 0;
+
+	while (p < end) {
+		unsigned char b = *p++;
+
+		if (shift < 64) {
+			v |= (uint64_t)(b & 0x7f) << shift;
+		}
+		shift += 7;
+
+		if (!(b & 0x80)) {
+			if (shift < 64 && (b & 0x40)) {
+				v |= ~(uint64_t) 0 << shift;
+			}
+			*val = (int64_t) v;
+			*pp = p;
+			return 0;
+		}
+	}
+	return -1;
+}
+
+#endif /* RWELF_INTERNAL_H */
@@ -0,0 +1,328 @@
+/**
+ * rwelf
+ * Copyright (c) 2012-2013 Felipe Pena <felipensp(at)gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "rwelf.h"
+#include <sys/mman.h>
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * I/O backends
+ *
+ * RWELF_IO_MMAP   the whole file is mapped, the default
+ * RWELF_IO_PREAD  only the blocks asked through rwelf_get_data() are read,
+ *                 into a cache that lives until rwelf_close()
+ * RWELF_IO_MEMORY the whole stream is read into memory, used for pipes
+ *                 and other files that can be neither mapped nor pread
+ * RWELF_IO_BUFFER the file is a buffer owned by the caller
+ *
+ * The pread backend reserves an anonymous mapping as large as the file
+ * and reads every block at its own offset in it the first time a request
+ * touches it, so nearby small accesses (single relocations, hash chains)
+ * are served by the same block. Pages which are never written take no
+ * memory: what is held is the blocks read, each read once, and nothing
+ * ever moves, so pointers handed out stay valid until rwelf_close()
+ * however the requests overlap. A bitmap records the blocks read.
+ */
+
+#define _IO_BLOCK 4096
+
+typedef struct {
+	pthread_mutex_t lock;
+	unsigned char *base;      /* Reservation of the file size */
+	unsigned char *loaded;    /* One bit per block read into base */
+	size_t bytes;             /* Bytes of the file read into base */
+} _io_cache;
+
+#define _IO_LOADED(_c, _b) ((_c)->loaded[(_b) / 8] & (1 << ((_b) % 8)))
+
+static int _read_full(int fd, unsigned char *buf, size_t len, uint64_t off)
+{
+	while (len) {
+		ssize_t n = pread(fd, buf, len, off);
+
+		if (n == -1 && errno == EINTR) {
+			continue;
+		}
+		if (n <= 0) {
+			return -1;
+		}
+		buf += n;
+		off += n;
+		len -= n;
+	}
+	return 0;
+}
+
+/**
+ * Reads the whole stream into memory (RWELF_IO_MEMORY)
+ */
+static int _io_open_memory(rwelf *elf, int fd)
+{
+	size_t cap = 64 * 1024, len = 0;
+	unsigned char *buf = malloc(cap), *tmp;
+
+	while (buf) {
+		ssize_t n;
+
+		if (len == cap) {
+			if ((tmp = realloc(buf, cap * 2)) == NULL) {
+				break;
+			}
+			buf = tmp;
+			cap *= 2;
+		}
+
+		n = read(fd, buf + len, cap - len);
+
+		if (n == -1 && errno == EINTR) {
+			continue;
+		}
+		if (n == -1) {
+			break;
+		}
+		if (n == 0) {
+			elf->file    = buf;
+			elf->size    = len;
+			elf->backend = RWELF_IO_MEMORY;
+			return 0;
+		}
+		len += n;
+	}
+	free(buf);
+
+	return -1;
+}
+
+static int _io_open_pread(rwelf *elf, int fd, size_t size)
+{
+	_io_cache *cache;
+	unsigned char probe, *base;
+
+	/* Pipes and sockets fail here with ESPIPE */
+	if (pread(fd, &probe, 1, 0) != 1) {
+		return -1;
+	}
+
+	base = mmap(0, size, PROT_READ | PROT_WRITE,
+		MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+
+	if (base == MAP_FAILED) {
+		return -1;
+	}
+
+	if ((cache = rwelf_arena_alloc(elf, sizeof(_io_cache))) == NULL
+		|| (cache->loaded = rwelf_arena_alloc(elf,
+			(size / _IO_BLOCK + 8) / 8)) == NULL) {
+		munmap(base, size);
+		return -1;
+	}
+	pthread_mutex_init(&cache->lock, NULL);
+	cache->base = base;
+
+	elf->io      = cache;
+	elf->size    = size;
+	elf->backend = RWELF_IO_PREAD;
+
+	return 0;
+}
+
+/**
+ * Returns [off, off+len) of the file, reading the blocks not read yet
+ */
+static const unsigned char *_io_pread_get(const rwelf *elf, uint64_t off,
+	uint64_t len)
+{
+	_io_cache *cache = elf->io;
+	const unsigned char *ret = NULL;
+	uint64_t first, last, b, run;
+
+	first = off / _IO_BLOCK;
+	last  = (off + len + _IO_BLOCK - 1) / _IO_BLOCK;
+
+	pthread_mutex_lock(&cache->lock);
+
+	/* Every run of missing blocks is read with a single pread */
+	for (b = first; b < last; b = run) {
+		uint64_t start, end;
+
+		if (_IO_LOADED(cache, b)) {
+			run = b + 1;
+			continue;
+		}
+		for (run = b + 1; run < last && !_IO_LOADED(cache, run); ++run);
+
+		start = b * _IO_BLOCK;
+		end   = run * _IO_BLOCK < elf->size ? run * _IO_BLOCK : elf->size;
+
+		if (_read_full(elf->fd, cache->base + start, end - start, start) == -1) {
+			goto out;
+		}
+		RWELF_STAT(elf, RWELF_STAT_BYTES_MAPPED, end - start);
+		cache->bytes += end - start;
+
+		for (; b < run; ++b) {
+			cache->loaded[b / 8] |= 1 << (b % 8);
+		}
+	}
+	ret = cache->base + off;
+out:
+	pthread_mutex_unlock(&cache->lock);
+
+	return ret;
+}
+
+/**
+ * rwelf_io_open(rwelf*, int, size_t, int)
+ * Sets up the I/O backend of an opened file according to the open flags.
+ * The mmap backend falls back to pread when the file cannot be mapped,
+ * and pread falls back to reading the whole stream. Returns -1 when no
+ * backend can read the file
+ */
+int rwelf_io_open(rwelf *elf, int fd, size_t size, int flags)
+{
+	int backend = (flags & RWELF_OPEN_PREAD) ? RWELF_IO_PREAD : RWELF_IO_MMAP;
+	int mflags = MAP_SHARED;
+	void *mem;
+
+	assert(elf != NULL);
+
+	elf->fd = fd;
+
+	if (backend == RWELF_IO_MMAP && size) {
+		if ((flags & RWELF_OPEN_POPULATE) && size <= RWELF_POPULATE_MAX) {
+			mflags |= MAP_POPULATE;
+		}
+
+		mem = mmap(0, size, PROT_READ, mflags, fd, 0);
+
+		if (mem != MAP_FAILED) {
+			elf->file    = mem;
+			elf->size    = size;
+			elf->backend = RWELF_IO_MMAP;
+			return 0;
+		}
+	}
+
+	if (size && _io_open_pread(elf, fd, size) == 0) {
+		return 0;
+	}
+
+	return _io_open_memory(elf, fd);
+}
+
+/**
+ * rwelf_io_open_buffer(rwelf*, const void*, size_t)
+ * Sets up a file backed by a caller owned buffer, which must outlive the
+ * handle. There is no file descriptor behind it
+ */
+void rwelf_io_open_buffer(rwelf *elf, const void *buf, size_t size)
+{
+	assert(elf != NULL);
+	assert(buf != NULL || size == 0);
+
+	elf->fd      = -1;
+	elf->file    = (unsigned char*) buf;
+	elf->size    = size;
+	elf->backend = RWELF_IO_BUFFER;
+}
+
+/**
+ * rwelf_io_close(rwelf*)
+ * Releases the data held by the I/O backend
+ */
+void rwelf_io_close(rwelf *elf)
+{
+	_io_cache *cache;
+
+	assert(elf != NULL);
+
+	switch (elf->backend) {
+		case RWELF_IO_MMAP:
+			munmap(elf->file, elf->size);
+			break;
+		case RWELF_IO_MEMORY:
+			free(elf->file);
+			break;
+		case RWELF_IO_BUFFER:
+			break;
+		case RWELF_IO_PREAD:
+			cache = elf->io;
+
+			munmap(cache->base, elf->size);
+			pthread_mutex_destroy(&cache->lock);
+			break;
+	}
+	elf->file = NULL;
+	elf->io = NULL;
+}
+
+/**
+ * rwelf_get_data(const rwelf*, uint64_t, uint64_t)
+ * Returns a pointer to len bytes of the file starting at offset, which
+ * stays valid until the file is closed. NULL is returned when the range
+ * is past the end of the file or cannot be read
+ */
+const unsigned char *rwelf_get_data(const rwelf *elf, uint64_t offset,
+	uint64_t len)
+{
+	assert(elf != NULL);
+
+	if (offset > elf->size || len > elf->size - offset) {
+		return NULL;
+	}
+	if (elf->backend == RWELF_IO_PREAD) {
+		return _io_pread_get(elf, offset, len ? len : 1);
+	}
+	return elf->file + offset;
+}
+
+/**
+ * rwelf_io_cached_bytes(const rwelf*)
+ * Returns how many bytes of the file are held in memory by the pread
+ * backend, or the size of the file for the other backends
+ */
+size_t rwelf_io_cached_bytes(const rwelf *elf)
+{
+	_io_cache *cache;
+	size_t bytes;
+
+	assert(elf != NULL);
+
+	if (elf->backend != RWELF_IO_PREAD) {
+		return elf->size;
+	}
+
+	cache = elf->io;
+
+	pthread_mutex_lock(&cache->lock);
+	bytes = cache->bytes;
+	pthread_mutex_unlock(&cache->lock);
+
+	return bytes;
+}
@@ -0,0 +1,440 @@
+/**
+ * rwelf
+ * Copyright (c) 2012-2013 Felipe Pena <felipensp(at)gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "rwelf.h"
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * Section to segment mapping
+ *
+ * Testing every section against every program header costs sections x
+ * segments. Instead the sections are sorted once, allocated ones by
+ * address and the others by file offset, and the segments by start. As
+ * the segment starts only grow, the first section a segment may hold is
+ * found by a cursor that only moves forward; from there the sections are
+ * walked until past the end of the segment. Each candidate goes through
+ * the same test as binutils (ELF_SECTION_IN_SEGMENT_STRICT), so the
+ * result matches readelf -l. The padding of each segment is measured in
+ * the same pass from the sections it holds.
+ */
+
+#ifndef PT_GNU_SFRAME
+#define PT_GNU_SFRAME   0x6474e554
+#endif
+#define PT_GNU_MBIND_LO 0x6474e555
+#define PT_GNU_MBIND_HI 0x6474f554
+
+typedef struct {
+	uint64_t key;             /* Address, or offset when not allocated */
+	size_t num;
+} _sec;
+
+typedef struct {
+	uint64_t start;
+	uint64_t end;
+} _range;
+
+typedef struct {
+	const rwelf *elf;
+	_sec *secs;
+	size_t nsecs;
+	_range *ranges;           /* Scratch for the padding of a segment */
+} _ctx;
+
+static int _sec_cmp(const void *a, const void *b)
+{
+	const _sec *x = a, *y = b;
+
+	if (x->key != y->key) {
+		return x->key < y->key ? -1 : 1;
+	}
+	return x->num < y->num ? -1 : x->num > y->num;
+}
+
+static int _range_cmp(const void *a, const void *b)
+{
+	const _range *x = a, *y = b;
+
+	return x->start < y->start ? -1 : x->start > y->start;
+}
+
+/**
+ * ELF_SECTION_SIZE: .tbss only takes room in PT_TLS
+ */
+static uint64_t _section_size(const rwelf *elf, size_t s, uint32_t p_type)
+{
+	if ((RWELF_SHDR(elf, sh_flags, s) & SHF_TLS)
+		&& RWELF_SHDR(elf, sh_type, s) == SHT_NOBITS && p_type != PT_TLS) {
+		return 0;
+	}
+	return RWELF_SHDR(elf, sh_size, s);
+}
+
+/**
+ * ELF_SECTION_IN_SEGMENT_STRICT of binutils
+ */
+static int _in_segment(const rwelf *elf, size_t s, size_t p)
+{
+	uint64_t flags    = RWELF_SHDR(elf, sh_flags, s);
+	uint32_t sh_type  = RWELF_SHDR(elf, sh_type, s);
+	uint64_t sh_off   = RWELF_SHDR(elf, sh_offset, s);
+	uint64_t sh_addr  = RWELF_SHDR(elf, sh_addr, s);
+	uint32_t p_type   = RWELF_PHDR(elf, p_type, p);
+	uint64_t p_off    = RWELF_PHDR(elf, p_offset, p);
+	uint64_t p_vaddr  = RWELF_PHDR(elf, p_vaddr, p);
+	uint64_t p_filesz = RWELF_PHDR(elf, p_filesz, p);
+	uint64_t p_memsz  = RWELF_PHDR(elf, p_memsz, p);
+	uint64_t size     = _section_size(elf, s, p_type);
+
+	/* .tbss has no room anywhere but in PT_TLS (ELF_TBSS_SPECIAL) */
+	if ((flags & SHF_TLS) && sh_type == SHT_NOBITS && p_type != PT_TLS) {
+		return 0;
+	}
+
+	/* Only PT_LOAD, PT_GNU_RELRO and PT_TLS hold TLS sections, PT_TLS
+	 * nothing else and PT_PHDR no section at all */
+	if (flags & SHF_TLS) {
+		if (p_type != PT_TLS && p_type != PT_GNU_RELRO && p_type != PT_LOAD) {
+			return 0;
+		}
+	} else if (p_type == PT_TLS || p_type == PT_PHDR) {
+		return 0;
+	}
+
+	/* Loaded segments only hold allocated sections */
+	if (!(flags & SHF_ALLOC)
+		&& (p_type == PT_LOAD || p_type == PT_DYNAMIC || p_type == PT_GNU_EH_FRAME
+			|| p_type == PT_GNU_STACK || p_type == PT_GNU_RELRO
+			|| p_type == PT_GNU_SFRAME
+			|| (p_type >= PT_GNU_MBIND_LO && p_type <= PT_GNU_MBIND_HI))) {
+		return 0;
+	}
+
+	if (sh_type != SHT_NOBITS
+		&& (sh_off < p_off || sh_off - p_off > p_filesz - 1
+			|| sh_off - p_off + size > p_filesz)) {
+		return 0;
+	}
+
+	if ((flags & SHF_ALLOC)
+		&& (sh_addr < p_vaddr || sh_addr - p_vaddr > p_memsz - 1
+			|| sh_addr - p_vaddr + size > p_memsz)) {
+		return 0;
+	}
+
+	/* No empty sections at the edges of PT_DYNAMIC and PT_NOTE */
+	if ((p_type == PT_DYNAMIC || p_type == PT_NOTE) && !RWELF_SHDR(elf, sh_size, s)
+		&& p_memsz) {
+		if (sh_type != SHT_NOBITS
+			&& (sh_off <= p_off || sh_off - p_off >= p_filesz)) {
+			return 0;
+		}
+		if ((flags & SHF_ALLOC)
+			&& (sh_addr <= p_vaddr || sh_addr - p_vaddr >= p_memsz)) {
+			return 0;
+		}
+	}
+	return 1;
+}
+
+/**
+ * Bytes of [start, start + size) covered by none of the ranges
+ */
+static uint64_t _uncovered(_range *ranges, size_t n, uint64_t start,
+	uint64_t size)
+{
+	uint64_t covered = 0, end = start + size, pos = start;
+	size_t i;
+
+	qsort(ranges, n, sizeof(_range), _range_cmp);
+
+	for (i = 0; i < n; ++i) {
+		uint64_t s = ranges[i].start > pos ? ranges[i].start : pos;
+		uint64_t e = ranges[i].end < end ? ranges[i].end : end;
+
+		if (e > s) {
+			covered += e - s;
+			pos = e;
+		}
+	}
+	return size - covered;
+}
+
+/**
+ * Walks the sorted sections from the cursor of one segment and appends
+ * those it holds to the list of the segment
+ */
+static int _collect(_ctx *ctx, rwelf_segment_map *map, size_t p,
+	size_t first, size_t last, uint64_t start, uint64_t end)
+{
+	size_t i, n = 0, *sections;
+
+	for (i = first; i < last && ctx->secs[i].key <= end; ++i) {
+		if (ctx->secs[i].key >= start && _in_segment(ctx->elf, ctx->secs[i].num, p)) {
+			ctx->ranges[n++].start = ctx->secs[i].num;
+		}
+	}
+	if (!n) {
+		return 0;
+	}
+
+	sections = rwelf_arena_alloc((rwelf*) ctx->elf,
+		(map->nsections + n) * sizeof(size_t));
+
+	if (!sections) {
+		return -1;
+	}
+	if (map->nsections) {
+		memcpy(sections, map->sections, map->nsections * sizeof(size_t));
+	}
+	for (i = 0; i < n; ++i) {
+		sections[map->nsections + i] = ctx->ranges[i].start;
+	}
+	map->sections = sections;
+	map->nsections += n;
+
+	return 0;
+}
+
+static int _num_cmp(const void *a, const void *b)
+{
+	size_t x = *(const size_t*) a, y = *(const size_t*) b;
+
+	return x < y ? -1 : x > y;
+}
+
+/**
+ * Adds the ELF header and the program header table, which are no section
+ * but are not padding either, when the segment maps them from the file
+ */
+static size_t _headers(const rwelf *elf, size_t p, _range *ranges, int mem)
+{
+	uint64_t p_offset = RWELF_PHDR(elf, p_offset, p);
+	uint64_t p_filesz = RWELF_PHDR(elf, p_filesz, p);
+	_range hdrs[2];
+	size_t i, n = 0;
+
+	hdrs[0].start = 0;
+	hdrs[0].end   = RWELF_EHDR(elf, e_ehsize);
+	hdrs[1].start = RWELF_EHDR(elf, e_phoff);
+	hdrs[1].end   = hdrs[1].start
+		+ (uint64_t) RWELF_EHDR(elf, e_phnum) * RWELF_EHDR(elf, e_phentsize);
+
+	for (i = 0; i < 2; ++i) {
+		if (hdrs[i].end <= p_offset || hdrs[i].start >= p_offset + p_filesz) {
+			continue;
+		}
+		ranges[n] = hdrs[i];
+
+		if (mem) {
+			ranges[n].start = RWELF_PHDR(elf, p_vaddr, p)
+				+ (hdrs[i].start > p_offset ? hdrs[i].start - p_offset : 0);
+			ranges[n].end = ranges[n].start + (hdrs[i].end - hdrs[i].start);
+		}
+		++n;
+	}
+	return n;
+}
+
+/**
+ * Bytes of the segment, in the file and in memory, that none of its
+ * sections nor the ELF and program headers cover
+ */
+static void _padding(_ctx *ctx, rwelf_segment_map *map, size_t p)
+{
+	const rwelf *elf = ctx->elf;
+	uint32_t p_type = RWELF_PHDR(elf, p_type, p);
+	size_t i, nfile, nmem;
+
+	if (map->nsections) {
+		qsort(map->sections, map->nsections, sizeof(size_t), _num_cmp);
+	}
+
+	nfile = _headers(elf, p, ctx->ranges, 0);
+
+	for (i = 0; i < map->nsections; ++i) {
+		size_t s = map->sections[i];
+
+		if (RWELF_SHDR(elf, sh_type, s) != SHT_NOBITS) {
+			ctx->ranges[nfile].start = RWELF_SHDR(elf, sh_offset, s);
+			ctx->ranges[nfile].end   = ctx->ranges[nfile].start
+				+ _section_size(elf, s, p_type);
+			++nfile;
+		}
+	}
+	map->file_padding = _uncovered(ctx->ranges, nfile,
+		RWELF_PHDR(elf, p_offset, p), RWELF_PHDR(elf, p_filesz, p));
+
+	nmem = _headers(elf, p, ctx->ranges, 1);
+
+	for (i = 0; i < map->nsections; ++i) {
+		size_t s = map->sections[i];
+
+		if (RWELF_SHDR(elf, sh_flags, s) & SHF_ALLOC) {
+			ctx->ranges[nmem].start = RWELF_SHDR(elf, sh_addr, s);
+			ctx->ranges[nmem].end   = ctx->ranges[nmem].start
+				+ _section_size(elf, s, p_type);
+			++nmem;
+		}
+	}
+	map->mem_padding = _uncovered(ctx->ranges, nmem,
+		RWELF_PHDR(elf, p_vaddr, p), RWELF_PHDR(elf, p_memsz, p));
+}
+
+/**
+ * rwelf_segment_map_build(rwelf*)
+ * Computes, once per handle, the sections held by every program header
+ * (readelf's section to segment mapping), the bytes of each segment no
+ * section covers and, for PT_LOAD, the slack up to its p_align
+ * boundaries.
+ * Returns 0 on success, otherwise -1 is returned
+ */
+int rwelf_segment_map_build(rwelf *elf)
+{
+	size_t nphdrs, nshdrs, nalloc = 0, i, s, cur;
+	_sec *by_vaddr, *by_offset;
+	_ctx ctx;
+	int ret = -1;
+
+	assert(elf != NULL);
+
+	if (elf->segmaps_built) {
+		return 0;
+	}
+
+	nphdrs = RWELF_EHDR(elf, e_phnum);
+	nshdrs = elf->shstrtab ? RWELF_EHDR(elf, e_shnum) : 0;
+
+	if ((elf->segmaps = rwelf_arena_alloc(elf,
+			(nphdrs + 1) * sizeof(rwelf_segment_map))) == NULL) {
+		return -1;
+	}
+	memset(elf->segmaps, 0, (nphdrs + 1) * sizeof(rwelf_segment_map));
+
+	ctx.elf    = elf;
+	ctx.secs   = malloc((nshdrs + 1) * sizeof(_sec));
+	ctx.ranges = malloc((nshdrs + 3) * sizeof(_range));
+	by_vaddr   = malloc((nphdrs + 1) * sizeof(_sec));
+	by_offset  = malloc((nphdrs + 1) * sizeof(_sec));
+
+	if (!ctx.secs || !ctx.ranges || !by_vaddr || !by_offset) {
+		goto out;
+	}
+
+	/* Allocated sections by address, then the others by offset */
+	for (s = 1; s < nshdrs; ++s) {
+		if (RWELF_SHDR(elf, sh_flags, s) & SHF_ALLOC) {
+			ctx.secs[nalloc].key = RWELF_SHDR(elf, sh_addr, s);
+			ctx.secs[nalloc++].num = s;
+		}
+	}
+	ctx.nsecs = nalloc;
+
+	for (s = 1; s < nshdrs; ++s) {
+		if (!(RWELF_SHDR(elf, sh_flags, s) & SHF_ALLOC)) {
+			ctx.secs[ctx.nsecs].key = RWELF_SHDR(elf, sh_offset, s);
+			ctx.secs[ctx.nsecs++].num = s;
+		}
+	}
+	qsort(ctx.secs, nalloc, sizeof(_sec), _sec_cmp);
+	qsort(ctx.secs + nalloc, ctx.nsecs - nalloc, sizeof(_sec), _sec_cmp);
+
+	for (i = 0; i < nphdrs; ++i) {
+		by_vaddr[i].key  = RWELF_PHDR(elf, p_vaddr, i);
+		by_vaddr[i].num  = i;
+		by_offset[i].key = RWELF_PHDR(elf, p_offset, i);
+		by_offset[i].num = i;
+	}
+	qsort(by_vaddr, nphdrs, sizeof(_sec), _sec_cmp);
+	qsort(by_offset, nphdrs, sizeof(_sec), _sec_cmp);
+
+	/* Allocated sections, segments by address: the cursor only moves on */
+	for (i = 0, cur = 0; i < nphdrs; ++i) {
+		size_t p = by_vaddr[i].num;
+		uint64_t start = RWELF_PHDR(elf, p_vaddr, p);
+
+		while (cur < nalloc && ctx.secs[cur].key < start) {
+			++cur;
+		}
+		if (_collect(&ctx, &elf->segmaps[p], p, cur, nalloc,
+				start, start + RWELF_PHDR(elf, p_memsz, p)) == -1) {
+			goto out;
+		}
+	}
+
+	/* The others, by offset, only land in segments like PT_NOTE */
+	for (i = 0, cur = nalloc; i < nphdrs; ++i) {
+		size_t p = by_offset[i].num;
+		uint64_t start = RWELF_PHDR(elf, p_offset, p);
+
+		while (cur < ctx.nsecs && ctx.secs[cur].key < start) {
+			++cur;
+		}
+		if (_collect(&ctx, &elf->segmaps[p], p, cur, ctx.nsecs,
+				start, start + RWELF_PHDR(elf, p_filesz, p)) == -1) {
+			goto out;
+		}
+	}
+
+	for (i = 0; i < nphdrs; ++i) {
+		uint64_t vaddr = RWELF_PHDR(elf, p_vaddr, i);
+		uint64_t memsz = RWELF_PHDR(elf, p_memsz, i);
+		uint64_t align = RWELF_PHDR(elf, p_align, i);
+
+		_padding(&ctx, &elf->segmaps[i], i);
+
+		/* The file's own alignment, not the page size of this host */
+		if (RWELF_PHDR(elf, p_type, i) == PT_LOAD && memsz && align > 1) {
+			elf->segmaps[i].page_slack = vaddr % align
+				+ (align - (vaddr + memsz) % align) % align;
+		}
+	}
+
+	elf->segmaps_built = 1;
+	ret = 0;
+out:
+	free(ctx.secs);
+	free(ctx.ranges);
+	free(by_vaddr);
+	free(by_offset);
+
+	return ret;
+}
+
+/**
+ * rwelf_get_segment_map(const rwelf*, size_t)
+ * Returns the mapping of the program header by number, as computed by
+ * rwelf_segment_map_build, otherwise NULL is returned
+ */
+const rwelf_segment_map *rwelf_get_segment_map(const rwelf *elf, size_t n)
+{
+	assert(elf != NULL);
+
+	if (!elf->segmaps_built || n >= RWELF_EHDR(elf, e_phnum)) {
+		return NULL;
+	}
+	return &elf->segmaps[n];
+}
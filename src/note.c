@@ -0,0 +1,147 @@
+/**
+ * rwelf
+ * Copyright (c) 2012-2013 Felipe Pena <felipensp(at)gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "rwelf.h"
+#include <string.h>
+
+/**
+ * Walks the notes stored in [data, data+size) calling cb for each one.
+ * Returns 1 when cb asked to stop, otherwise 0
+ */
+static int _walk_notes(const rwelf *elf, const unsigned char *data,
+	uint64_t size, uint64_t align, int (*cb)(const Elf_Note*, void*),
+	void *arg)
+{
+	uint64_t off = 0;
+
+	/* Truncated files */
+	if (!data) {
+		return 0;
+	}
+
+	/* Notes inside 8-byte aligned segments (e.g. GNU properties) use
+	 * 8-byte padding, everything else is padded to 4 bytes */
+	align = (align == 8) ? 8 : 4;
+
+	while (off + sizeof(Elf64_Nhdr) <= size) {
+		/* Elf32_Nhdr and Elf64_Nhdr have the same layout */
+		const Elf64_Nhdr *nhdr = (const Elf64_Nhdr*)(data + off);
+		uint64_t name_off, desc_off;
+		Elf_Note note;
+
+		name_off = off + sizeof(Elf64_Nhdr);
+		desc_off = name_off + ((nhdr->n_namesz + align - 1) & ~(align - 1));
+
+		if (desc_off + nhdr->n_descsz > size) {
+			break;
+		}
+
+		note.elf    = elf;
+		note.type   = nhdr->n_type;
+		note.name   = nhdr->n_namesz ? (const char*)(data + name_off) : "";
+		note.desc   = data + desc_off;
+		note.descsz = nhdr->n_descsz;
+
+		if (cb(&note, arg)) {
+			return 1;
+		}
+
+		off = desc_off + ((nhdr->n_descsz + align - 1) & ~(align - 1));
+	}
+	return 0;
+}
+
+/**
+ * rwelf_foreach_note(const rwelf*, int (*)(const Elf_Note*, void*), void*)
+ * Calls the callback for every note found on PT_NOTE segments, or on
+ * SHT_NOTE sections when there is no program header table. Iteration
+ * stops when the callback returns non-zero
+ */
+void rwelf_foreach_note(const rwelf *elf, int (*cb)(const Elf_Note*, void*),
+	void *arg)
+{
+	size_t i;
+
+	assert(elf != NULL);
+	assert(cb != NULL);
+
+	if (RWELF_EHDR(elf, e_phnum)) {
+		for (i = 0; i < RWELF_EHDR(elf, e_phnum); ++i) {
+			if (RWELF_PHDR(elf, p_type, i) != PT_NOTE) {
+				continue;
+			}
+			if (_walk_notes(elf, rwelf_get_data(elf,
+					RWELF_PHDR(elf, p_offset, i), RWELF_PHDR(elf, p_filesz, i)),
+					RWELF_PHDR(elf, p_filesz, i),
+					RWELF_PHDR(elf, p_align, i), cb, arg)) {
+				return;
+			}
+		}
+		return;
+	}
+
+	for (i = 0; i < RWELF_EHDR(elf, e_shnum); ++i) {
+		if (RWELF_SHDR(elf, sh_type, i) != SHT_NOTE) {
+			continue;
+		}
+		if (_walk_notes(elf, rwelf_get_data(elf,
+				RWELF_SHDR(elf, sh_offset, i), RWELF_SHDR(elf, sh_size, i)),
+				RWELF_SHDR(elf, sh_size, i),
+				RWELF_SHDR(elf, sh_addralign, i), cb, arg)) {
+			return;
+		}
+	}
+}
+
+static int _find_build_id(const Elf_Note *note, void *arg)
+{
+	if (note->type == NT_GNU_BUILD_ID && strcmp(note->name, "GNU") == 0) {
+		memcpy(arg, note, sizeof(Elf_Note));
+		return 1;
+	}
+	return 0;
+}
+
+/**
+ * rwelf_get_build_id(const rwelf*, size_t*)
+ * Returns the contents of the NT_GNU_BUILD_ID note and stores its length
+ * in the out param, otherwise NULL is returned
+ */
+const unsigned char *rwelf_get_build_id(const rwelf *elf, size_t *len)
+{
+	Elf_Note note;
+
+	assert(elf != NULL);
+
+	note.desc = NULL;
+	note.descsz = 0;
+
+	rwelf_foreach_note(elf, _find_build_id, &note);
+
+	if (len) {
+		*len = note.descsz;
+	}
+	return note.desc;
+}
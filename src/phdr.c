@@ -24,6 +24,7 @@
  */
 
 #include "rwelf.h"
+#include <stdlib.h>
 
 static void inline _copy_phdr(const rwelf *elf, Elf_Phdr *phdr, size_t n)
 {
@@ -86,6 +87,66 @@ uint64_t rwelf_get_pheader_vaddr(const Elf_Phdr *phdr)
 	return RWELF_PHDR_DATA(phdr, p_vaddr);
 }
 
+/**
+ * rwelf_get_pheader_offset(const Elf_Phdr*)
+ * Returns the offset of the segment in the file
+ */
+uint64_t rwelf_get_pheader_offset(const Elf_Phdr *phdr)
+{
+	assert(phdr != NULL);
+	assert(phdr->elf != NULL);
+
+	return RWELF_PHDR_DATA(phdr, p_offset);
+}
+
+/**
+ * rwelf_get_pheader_paddr(const Elf_Phdr*)
+ * Returns the program header physical address
+ */
+uint64_t rwelf_get_pheader_paddr(const Elf_Phdr *phdr)
+{
+	assert(phdr != NULL);
+	assert(phdr->elf != NULL);
+
+	return RWELF_PHDR_DATA(phdr, p_paddr);
+}
+
+/**
+ * rwelf_get_pheader_filesz(const Elf_Phdr*)
+ * Returns the size of the segment in the file
+ */
+uint64_t rwelf_get_pheader_filesz(const Elf_Phdr *phdr)
+{
+	assert(phdr != NULL);
+	assert(phdr->elf != NULL);
+
+	return RWELF_PHDR_DATA(phdr, p_filesz);
+}
+
+/**
+ * rwelf_get_pheader_memsz(const Elf_Phdr*)
+ * Returns the size of the segment in memory
+ */
+uint64_t rwelf_get_pheader_memsz(const Elf_Phdr *phdr)
+{
+	assert(phdr != NULL);
+	assert(phdr->elf != NULL);
+
+	return RWELF_PHDR_DATA(phdr, p_memsz);
+}
+
+/**
+ * rwelf_get_pheader_align(const Elf_Phdr*)
+ * Returns the segment alignment
+ */
+uint64_t rwelf_get_pheader_align(const Elf_Phdr *phdr)
+{
+	assert(phdr != NULL);
+	assert(phdr->elf != NULL);
+
+	return RWELF_PHDR_DATA(phdr, p_align);
+}
+
 /**
  * rwelf_get_pheader_type_name(const Elf_Phdr*)
  * Returns the program header type as string
@@ -106,9 +167,184 @@ const char *rwelf_get_pheader_type_name(const Elf_Phdr *phdr)
 		CASE(PT_PHDR);
 		CASE(PT_LOPROC);
 		CASE(PT_HIPROC);
+		CASE(PT_TLS);
+		CASE(PT_GNU_EH_FRAME);
 		CASE(PT_GNU_STACK);
+		CASE(PT_GNU_RELRO);
+		CASE(PT_GNU_PROPERTY);
 		default:
 			return "UNKNOWN";
 	}
 #undef CASE
 }
+
+/* Virtual address translation */
+
+static int _load_cmp(const void *a, const void *b)
+{
+	const rwelf_segment *x = a, *y = b;
+
+	if (x->vaddr != y->vaddr) {
+		return x->vaddr < y->vaddr ? -1 : 1;
+	}
+	return 0;
+}
+
+/**
+ * rwelf_build_loads(rwelf*)
+ * Builds the table of PT_LOAD segments sorted by virtual address used by
+ * the address translation functions. Called by rwelf_open
+ */
+int rwelf_build_loads(rwelf *elf)
+{
+	size_t i, n = 0;
+
+	assert(elf != NULL);
+
+	elf->loads = NULL;
+	elf->nloads = 0;
+
+	for (i = 0; i < RWELF_EHDR(elf, e_phnum); ++i) {
+		if (RWELF_PHDR(elf, p_type, i) == PT_LOAD) {
+			++n;
+		}
+	}
+	if (!n) {
+		return 0;
+	}
+
+	if ((elf->loads = rwelf_arena_alloc(elf, n * sizeof(rwelf_segment))) == NULL) {
+		return -1;
+	}
+
+	for (i = 0; i < RWELF_EHDR(elf, e_phnum); ++i) {
+		rwelf_segment *seg = &elf->loads[elf->nloads];
+
+		if (RWELF_PHDR(elf, p_type, i) != PT_LOAD) {
+			continue;
+		}
+		seg->vaddr  = RWELF_PHDR(elf, p_vaddr, i);
+		seg->memsz  = RWELF_PHDR(elf, p_memsz, i);
+		seg->offset = RWELF_PHDR(elf, p_offset, i);
+		seg->filesz = RWELF_PHDR(elf, p_filesz, i);
+		seg->flags  = RWELF_PHDR(elf, p_flags, i);
+
+		/* Never hand out bytes past the end of a truncated file */
+		if (seg->offset > elf->size) {
+			seg->filesz = 0;
+		} else if (seg->filesz > elf->size - seg->offset) {
+			seg->filesz = elf->size - seg->offset;
+		}
+		if (seg->filesz > seg->memsz) {
+			seg->memsz = seg->filesz;
+		}
+		++elf->nloads;
+	}
+
+	qsort(elf->loads, elf->nloads, sizeof(rwelf_segment), _load_cmp);
+
+	return 0;
+}
+
+/**
+ * rwelf_vaddr_find_segment(const rwelf*, uint64_t)
+ * Returns the PT_LOAD segment which contains the address in memory,
+ * otherwise NULL is returned
+ */
+const rwelf_segment *rwelf_vaddr_find_segment(const rwelf *elf,
+	uint64_t vaddr)
+{
+	size_t lo = 0, hi;
+
+	assert(elf != NULL);
+
+	hi = elf->nloads;
+
+	/* Last segment starting at or before vaddr */
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+
+		if (elf->loads[mid].vaddr <= vaddr) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+
+	if (lo && vaddr - elf->loads[lo - 1].vaddr < elf->loads[lo - 1].memsz) {
+		return &elf->loads[lo - 1];
+	}
+	return NULL;
+}
+
+/**
+ * rwelf_vaddr_to_offset(const rwelf*, uint64_t, uint64_t*)
+ * Translates a virtual address to a file offset. Returns RWELF_VADDR_FILE
+ * when the address is backed by the file, RWELF_VADDR_BSS when it only
+ * exists in memory (p_filesz < p_memsz) and RWELF_VADDR_UNMAPPED when no
+ * PT_LOAD segment contains it. The offset is only filled for file-backed
+ * addresses
+ */
+int rwelf_vaddr_to_offset(const rwelf *elf, uint64_t vaddr, uint64_t *offset)
+{
+	const rwelf_segment *seg;
+
+	if ((seg = rwelf_vaddr_find_segment(elf, vaddr)) == NULL) {
+		return RWELF_VADDR_UNMAPPED;
+	}
+	if (vaddr - seg->vaddr >= seg->filesz) {
+		return RWELF_VADDR_BSS;
+	}
+	if (offset) {
+		*offset = seg->offset + (vaddr - seg->vaddr);
+	}
+	return RWELF_VADDR_FILE;
+}
+
+/**
+ * rwelf_vaddr_to_ptr(const rwelf*, uint64_t, uint64_t)
+ * Returns a pointer to the file data for len bytes starting at vaddr,
+ * otherwise NULL is returned when any of the bytes is not backed by the
+ * file
+ */
+const unsigned char *rwelf_vaddr_to_ptr(const rwelf *elf, uint64_t vaddr,
+	uint64_t len)
+{
+	const rwelf_segment *seg;
+	uint64_t rel;
+
+	if ((seg = rwelf_vaddr_find_segment(elf, vaddr)) == NULL) {
+		return NULL;
+	}
+
+	rel = vaddr - seg->vaddr;
+
+	if (rel > seg->filesz || len > seg->filesz - rel) {
+		return NULL;
+	}
+	return rwelf_get_data(elf, seg->offset + rel, len);
+}
+
+/**
+ * rwelf_offset_to_vaddr(const rwelf*, uint64_t, uint64_t*)
+ * Translates a file offset to the virtual address it is loaded at.
+ * Returns -1 when no PT_LOAD segment maps the offset
+ */
+int rwelf_offset_to_vaddr(const rwelf *elf, uint64_t offset, uint64_t *vaddr)
+{
+	size_t i;
+
+	assert(elf != NULL);
+
+	for (i = 0; i < elf->nloads; ++i) {
+		const rwelf_segment *seg = &elf->loads[i];
+
+		if (offset >= seg->offset && offset - seg->offset < seg->filesz) {
+			if (vaddr) {
+				*vaddr = seg->vaddr + (offset - seg->offset);
+			}
+			return 0;
+		}
+	}
+	return -1;
+}
@@ -0,0 +1,423 @@
+/**
+ * rwelf
+ * Copyright (c) 2012-2013 Felipe Pena <felipensp(at)gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "rwelf.h"
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * PLT/GOT map
+ *
+ * Every DT_JMPREL relocation names the imported symbol and the GOT slot
+ * its PLT stub jumps through. The stubs live in .plt.sec when the binary
+ * uses IBT (no header there), otherwise in .plt after a header whose size
+ * is what remains once the stubs are accounted for. On x86 the stubs are
+ * decoded to find the GOT slot they jump through, which is exact; other
+ * machines, or stubs which do not decode, assume the stubs follow the
+ * order of the relocations. Stubs in .plt.got jump through GOT slots
+ * filled by GLOB_DAT relocations and are decoded the same way.
+ *
+ * i386 and ARM use REL rather than RELA (DT_PLTREL is DT_REL), whose
+ * tables the handle keeps apart from the Elf_Rela ones. The addend of a
+ * REL slot is its contents.
+ */
+
+#define _PLT_ENTSIZE 16
+
+static int _plt_cmp(const void *a, const void *b)
+{
+	const rwelf_plt_entry *x = a, *y = b;
+
+	return x->addr < y->addr ? -1 : x->addr > y->addr;
+}
+
+static int _got_cmp(const void *a, const void *b)
+{
+	const rwelf_got_entry *x = a, *y = b;
+
+	return x->addr < y->addr ? -1 : x->addr > y->addr;
+}
+
+static int _is_glob_dat(uint16_t machine, uint64_t type)
+{
+	switch (machine) {
+		case EM_X86_64:  return type == R_X86_64_GLOB_DAT;
+		case EM_386:     return type == R_386_GLOB_DAT;
+		case EM_AARCH64: return type == R_AARCH64_GLOB_DAT;
+		case EM_ARM:     return type == R_ARM_GLOB_DAT;
+		case EM_PPC64:   return type == R_PPC64_GLOB_DAT;
+		case EM_RISCV:   return type == R_RISCV_64 || type == R_RISCV_32;
+	}
+	return 0;
+}
+
+/**
+ * Finds the GOT slot an x86 stub jumps through: jmp *disp32(%rip) on
+ * x86-64, jmp *addr32 or, in PIC code, jmp *disp32(%ebx) from the GOT
+ * base (DT_PLTGOT) on i386. All may carry endbr and bnd prefixes.
+ * Returns 0 when there is no such jump
+ */
+static uint64_t _decode_stub(const rwelf *elf, const unsigned char *code,
+	size_t size, uint64_t addr, uint64_t got_base)
+{
+	uint16_t machine = RWELF_EHDR(elf, e_machine);
+	size_t i;
+
+	if (machine != EM_X86_64 && machine != EM_386) {
+		return 0;
+	}
+
+	for (i = 0; i + 6 <= size; ++i) {
+		int32_t disp;
+
+		if (code[i] != 0xff || (code[i + 1] != 0x25
+			&& (code[i + 1] != 0xa3 || machine != EM_386 || !got_base))) {
+			continue;
+		}
+		memcpy(&disp, code + i + 2, sizeof(disp));
+
+		if (machine == EM_X86_64) {
+			return addr + i + 6 + (int64_t) disp;
+		}
+		if (code[i + 1] == 0xa3) {
+			return (uint32_t)(got_base + disp);
+		}
+		return (uint32_t) disp;
+	}
+	return 0;
+}
+
+/**
+ * Adds the GOT slot filled by a relocation, has_addend is clear for REL
+ */
+static void _add_got(rwelf *elf, uint64_t addr, uint64_t info,
+	int64_t addend, int has_addend)
+{
+	rwelf_got_entry *got = &elf->got[elf->ngot];
+	size_t word = ELF_IS_64(elf) ? 8 : 4;
+
+	got->addr = addr;
+	got->sym  = ELF_IS_64(elf) ? ELF64_R_SYM(info) : ELF32_R_SYM(info);
+	got->name = "";
+
+	if (got->sym && got->sym >= elf->ndynsyms) {
+		return;
+	}
+	if (!got->sym) {
+		/* IRELATIVE, named after the resolver like binutils does */
+		const unsigned char *slot;
+		char buf[32], *name;
+
+		if (!has_addend && (slot = rwelf_vaddr_to_ptr(elf, addr, word)) != NULL) {
+			uint32_t v32;
+			uint64_t v64 = 0;
+
+			if (word == 8) {
+				memcpy(&v64, slot, 8);
+			} else {
+				memcpy(&v32, slot, 4);
+				v64 = v32;
+			}
+			addend = v64;
+		}
+		snprintf(buf, sizeof(buf), "*ABS*+0x%" PRIx64, (uint64_t) addend);
+		if ((name = rwelf_arena_strdup(elf, buf)) != NULL) {
+			got->name = name;
+		}
+	} else if (elf->dynstr) {
+		Elf_Sym sym;
+
+		rwelf_get_dyn_symbol_by_num(elf, got->sym, &sym);
+		got->name = (const char*) rwelf_get_dyn_symbol_name(&sym);
+	}
+	++elf->ngot;
+}
+
+static const rwelf_got_entry *_got_find(const rwelf *elf, uint64_t addr)
+{
+	rwelf_got_entry key;
+
+	key.addr = addr;
+
+	return bsearch(&key, elf->got, elf->ngot, sizeof(rwelf_got_entry),
+		_got_cmp);
+}
+
+/**
+ * Adds the stubs of a section. When slots, the GOT slots of the PLT
+ * relocations in order, are given, stubs which do not decode are matched
+ * to them by position
+ */
+static void _add_stubs(rwelf *elf, const char *sname, const uint64_t *slots,
+	size_t nslots, uint64_t got_base)
+{
+	const unsigned char *code;
+	uint64_t addr, size, entsize, header = 0, n;
+	const rwelf_got_entry *got;
+	Elf_Shdr shdr;
+	size_t i;
+
+	if (rwelf_get_section_by_name(elf, sname, &shdr) == -1
+		|| (code = rwelf_get_section_data(&shdr)) == NULL) {
+		return;
+	}
+
+	addr    = rwelf_get_section_addr(&shdr);
+	size    = rwelf_get_section_size(&shdr);
+	entsize = rwelf_get_section_entsize(&shdr);
+
+	/* i386 .plt carries an entsize of 4 for 16 byte stubs */
+	if (!entsize || (RWELF_EHDR(elf, e_machine) == EM_386
+		&& strcmp(sname, ".plt") == 0)) {
+		entsize = _PLT_ENTSIZE;
+	}
+
+	if (strcmp(sname, ".plt") == 0) {
+		/* Whatever precedes the stubs is the header (PLT0) */
+		if (size < nslots * entsize) {
+			return;
+		}
+		header = size - nslots * entsize;
+	}
+
+	n = (size - header) / entsize;
+
+	for (i = 0; i < n; ++i) {
+		uint64_t off = header + i * entsize, slot;
+		rwelf_plt_entry *plt = &elf->plt[elf->nplt];
+
+		slot = _decode_stub(elf, code + off, entsize, addr + off, got_base);
+		got  = slot ? _got_find(elf, slot) : NULL;
+
+		if (!got && slots && i < nslots) {
+			got = _got_find(elf, slots[i]);
+		}
+		if (!got) {
+			continue;
+		}
+
+		plt->addr = addr + off;
+		plt->size = entsize;
+		plt->got  = got->addr;
+		plt->sym  = got->sym;
+		plt->name = got->name;
+		++elf->nplt;
+	}
+}
+
+/**
+ * rwelf_plt_build(rwelf*)
+ * Builds the PLT stub and GOT slot maps of the file. Returns -1 when out
+ * of memory, otherwise 0, even when the file has no PLT
+ */
+int rwelf_plt_build(rwelf *elf)
+{
+	uint64_t *slots, offset, info, got_base = 0;
+	uint16_t machine;
+	size_t i, nstubs = 0, nslots;
+	Elf_Shdr shdr;
+	Elf_Dyn dyn;
+
+	assert(elf != NULL);
+
+	if (elf->plt_built) {
+		return 0;
+	}
+
+	machine = RWELF_EHDR(elf, e_machine);
+
+	if (rwelf_get_dynamic_by_tag(elf, DT_PLTGOT, &dyn) != -1) {
+		got_base = rwelf_get_dynamic_val(&dyn);
+	}
+
+	nslots = elf->njmprels + elf->npltrels;
+	slots  = malloc((nslots + 1) * sizeof(uint64_t));
+	elf->got = rwelf_arena_alloc(elf,
+		(nslots + elf->ndynrelas + elf->ndynrels + 1) * sizeof(rwelf_got_entry));
+
+	if (!slots || !elf->got) {
+		free(slots);
+		return -1;
+	}
+
+	for (i = 0; i < elf->njmprels + elf->ndynrelas; ++i) {
+		Elf_Rela rela;
+
+		if (i < elf->njmprels) {
+			rwelf_get_jmprel_by_num(elf, i, &rela);
+			slots[i] = rwelf_get_rela_offset(&rela);
+		} else {
+			rwelf_get_dyn_rela_by_num(elf, i - elf->njmprels, &rela);
+
+			if (!_is_glob_dat(machine, rwelf_get_rela_type(&rela))) {
+				continue;
+			}
+		}
+		_add_got(elf, rwelf_get_rela_offset(&rela), rwelf_get_rela_info(&rela),
+			rwelf_get_rela_addend(&rela), 1);
+	}
+
+	for (i = 0; i < elf->npltrels + elf->ndynrels; ++i) {
+		if (i < elf->npltrels) {
+			offset = RWELF(elf, PLTREL, r_offset, i);
+			info   = RWELF(elf, PLTREL, r_info, i);
+			slots[elf->njmprels + i] = offset;
+		} else {
+			offset = RWELF(elf, DYNREL, r_offset, i - elf->npltrels);
+			info   = RWELF(elf, DYNREL, r_info, i - elf->npltrels);
+
+			if (!_is_glob_dat(machine, ELF_IS_64(elf) ?
+					ELF64_R_TYPE(info) : ELF32_R_TYPE(info))) {
+				continue;
+			}
+		}
+		_add_got(elf, offset, info, 0, 0);
+	}
+
+	qsort(elf->got, elf->ngot, sizeof(rwelf_got_entry), _got_cmp);
+
+	/* Upper bound on the number of stubs */
+	if (elf->shstrtab) {
+		for (i = 0; i < RWELF_EHDR(elf, e_shnum); ++i) {
+			const char *name;
+
+			rwelf_get_section_by_num(elf, i, &shdr);
+			name = (const char*) rwelf_get_section_name(&shdr);
+
+			if (strcmp(name, ".plt") == 0 || strcmp(name, ".plt.sec") == 0
+				|| strcmp(name, ".plt.got") == 0) {
+				nstubs += rwelf_get_section_size(&shdr) / 8 + 1;
+			}
+		}
+	}
+
+	elf->plt = rwelf_arena_alloc(elf, (nstubs + 1) * sizeof(rwelf_plt_entry));
+	if (!elf->plt) {
+		free(slots);
+		return -1;
+	}
+
+	/* With IBT the stubs called by the code are in .plt.sec */
+	if (rwelf_get_section_by_name(elf, ".plt.sec", &shdr) != -1) {
+		_add_stubs(elf, ".plt.sec", slots, nslots, got_base);
+	} else {
+		_add_stubs(elf, ".plt", slots, nslots, got_base);
+	}
+	_add_stubs(elf, ".plt.got", NULL, 0, got_base);
+	free(slots);
+
+	qsort(elf->plt, elf->nplt, sizeof(rwelf_plt_entry), _plt_cmp);
+
+	elf->plt_built = 1;
+
+	return 0;
+}
+
+/**
+ * rwelf_num_plt(const rwelf*)
+ * Returns the number of PLT stubs found by rwelf_plt_build
+ */
+size_t rwelf_num_plt(const rwelf *elf)
+{
+	assert(elf != NULL);
+
+	return elf->nplt;
+}
+
+/**
+ * rwelf_get_plt_by_num(const rwelf*, size_t)
+ * Returns the PLT stub by number, stubs are sorted by address
+ */
+const rwelf_plt_entry *rwelf_get_plt_by_num(const rwelf *elf, size_t n)
+{
+	assert(elf != NULL);
+	assert(elf->nplt > n);
+
+	return &elf->plt[n];
+}
+
+/**
+ * rwelf_plt_lookup(const rwelf*, uint64_t)
+ * Returns the PLT stub containing the address, otherwise NULL is returned
+ */
+const rwelf_plt_entry *rwelf_plt_lookup(const rwelf *elf, uint64_t addr)
+{
+	size_t lo = 0, hi;
+
+	assert(elf != NULL);
+
+	hi = elf->nplt;
+
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+
+		if (elf->plt[mid].addr <= addr) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+
+	if (lo && addr - elf->plt[lo - 1].addr < elf->plt[lo - 1].size) {
+		return &elf->plt[lo - 1];
+	}
+	return NULL;
+}
+
+/**
+ * rwelf_num_got(const rwelf*)
+ * Returns the number of GOT slots found by rwelf_plt_build
+ */
+size_t rwelf_num_got(const rwelf *elf)
+{
+	assert(elf != NULL);
+
+	return elf->ngot;
+}
+
+/**
+ * rwelf_get_got_by_num(const rwelf*, size_t)
+ * Returns the GOT slot by number, slots are sorted by address
+ */
+const rwelf_got_entry *rwelf_get_got_by_num(const rwelf *elf, size_t n)
+{
+	assert(elf != NULL);
+	assert(elf->ngot > n);
+
+	return &elf->got[n];
+}
+
+/**
+ * rwelf_got_lookup(const rwelf*, uint64_t)
+ * Returns the GOT slot at the address, otherwise NULL is returned
+ */
+const rwelf_got_entry *rwelf_got_lookup(const rwelf *elf, uint64_t addr)
+{
+	assert(elf != NULL);
+
+	return elf->ngot ? _got_find(elf, addr) : NULL;
+}
@@ -33,16 +33,17 @@ void rwelf_get_rela_by_num(const Elf_Shdr *shdr, size_t n,
 	if (!rela) {
 		return;
 	}
-	rela->elf = shdr->elf;
+	rela->elf  = shdr->elf;
+	rela->link = RWELF_SHDR_DATA(shdr, sh_link);
 
 	if (ELF_IS_32(shdr->elf)) {
-		RELA32(rela) = (Elf32_Rela*)(shdr->elf->file +
-			RWELF_SHDR_DATA(shdr, sh_offset));
-		RELA32(rela) += n;
+		RELA32(rela) = (Elf32_Rela*) rwelf_get_data(shdr->elf,
+			RWELF_SHDR_DATA(shdr, sh_offset) + n * sizeof(Elf32_Rela),
+			sizeof(Elf32_Rela));
 	} else {
-		RELA64(rela) = (Elf64_Rela*)(shdr->elf->file +
-			RWELF_SHDR_DATA(shdr, sh_offset));
-		RELA64(rela) += n;
+		RELA64(rela) = (Elf64_Rela*) rwelf_get_data(shdr->elf,
+			RWELF_SHDR_DATA(shdr, sh_offset) + n * sizeof(Elf64_Rela),
+			sizeof(Elf64_Rela));
 	}
 }
 
@@ -94,24 +95,124 @@ uint64_t rwelf_get_rela_type(const Elf_Rela *rela)
 		ELF32_R_TYPE(RWELF_RELA_DATA(rela, r_info));
 }
 
+/**
+ * rwelf_get_rela_sym_index(const Elf_Rela*)
+ * Returns the index of the relocation's symbol in .dynsym
+ */
+size_t rwelf_get_rela_sym_index(const Elf_Rela *rela)
+{
+	assert(rela != NULL);
+
+	return ELF_IS_64(rela->elf) ?
+		ELF64_R_SYM(RWELF_RELA_DATA(rela, r_info)) :
+		ELF32_R_SYM(RWELF_RELA_DATA(rela, r_info));
+}
+
 /**
  * rwelf_get_rela_symbol(const Elf_Rela*)
- * Returns the symbol name related to the relocation
+ * Returns the symbol name related to the relocation, an empty string
+ * when the symbol table it refers to is missing
  */
 const unsigned char *rwelf_get_rela_symbol(const Elf_Rela *rela)
 {
+	const rwelf *elf;
+	size_t n;
 	Elf_Sym sym;
 
 	assert(rela != NULL);
 	assert(rela->elf != NULL);
 
+	elf = rela->elf;
+	n = rwelf_get_rela_sym_index(rela);
+
+	/* Section relocations of ET_REL refer to .symtab through sh_link */
+	if (rela->link && rela->link < RWELF_EHDR(elf, e_shnum)
+		&& RWELF_SHDR(elf, sh_type, rela->link) == SHT_SYMTAB) {
+		if (!elf->strtab || n >= elf->nsyms) {
+			return (const unsigned char*) "";
+		}
+		rwelf_get_symbol_by_num(elf, n, &sym);
+
+		return rwelf_get_symbol_name(&sym);
+	}
+
+	if (!elf->dynstr || n >= elf->ndynsyms) {
+		return (const unsigned char*) "";
+	}
+
 	/* Read the symbol from .dynsym section + r_info */
-	rwelf_get_dyn_symbol_by_num(rela->elf,
-		(ELF_IS_64(rela->elf) ?
-			ELF64_R_SYM(RWELF_RELA_DATA(rela, r_info)) :
-			ELF32_R_SYM(RWELF_RELA_DATA(rela, r_info))),
-		&sym);
+	rwelf_get_dyn_symbol_by_num(elf, n, &sym);
 
 	/* Get the name from .dynstr */
 	return rwelf_get_dyn_symbol_name(&sym);
 }
+
+/* Relocations found through .dynamic */
+
+/**
+ * rwelf_num_jmprels(const rwelf*)
+ * Returns the number of PLT relocations (DT_JMPREL)
+ */
+size_t rwelf_num_jmprels(const rwelf *elf)
+{
+	assert(elf != NULL);
+
+	return elf->njmprels;
+}
+
+/**
+ * rwelf_get_jmprel_by_num(const rwelf*, size_t, Elf_Rela*)
+ * Finds the PLT relocation (DT_JMPREL) by number and fill the out param
+ * with it
+ */
+void rwelf_get_jmprel_by_num(const rwelf *elf, size_t n, Elf_Rela *rela)
+{
+	assert(elf != NULL);
+	assert(elf->njmprels > n);
+
+	if (!rela) {
+		return;
+	}
+	rela->elf  = elf;
+	rela->link = 0;
+
+	if (ELF_IS_32(elf)) {
+		RELA32(rela) = JMPREL32(elf) + n;
+	} else {
+		RELA64(rela) = JMPREL64(elf) + n;
+	}
+}
+
+/**
+ * rwelf_num_dyn_relas(const rwelf*)
+ * Returns the number of dynamic relocations (DT_RELA)
+ */
+size_t rwelf_num_dyn_relas(const rwelf *elf)
+{
+	assert(elf != NULL);
+
+	return elf->ndynrelas;
+}
+
+/**
+ * rwelf_get_dyn_rela_by_num(const rwelf*, size_t, Elf_Rela*)
+ * Finds the dynamic relocation (DT_RELA) by number and fill the out param
+ * with it
+ */
+void rwelf_get_dyn_rela_by_num(const rwelf *elf, size_t n, Elf_Rela *rela)
+{
+	assert(elf != NULL);
+	assert(elf->ndynrelas > n);
+
+	if (!rela) {
+		return;
+	}
+	rela->elf  = elf;
+	rela->link = 0;
+
+	if (ELF_IS_32(elf)) {
+		RELA32(rela) = DYNRELA32(elf) + n;
+	} else {
+		RELA64(rela) = DYNRELA64(elf) + n;
+	}
+}
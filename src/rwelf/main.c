@@ -26,174 +26,1839 @@
 #include <rwelf.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
 #include <getopt.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+#include "output.h"
+
+#define IS_TEXT(_out) ((_out)->format == OUTPUT_TEXT)
+
+/* Actions, in the order they are displayed */
+#define ACTION_HEADER      (1 << 0)
+#define ACTION_SECTIONS    (1 << 1)
+#define ACTION_PHEADERS    (1 << 2)
+#define ACTION_DYNAMIC     (1 << 3)
+#define ACTION_RELOCATIONS (1 << 4)
+#define ACTION_SYMBOLS     (1 << 5)
+#define ACTION_EXPORT      (1 << 6)
+#define ACTION_PLT         (1 << 7)
+#define ACTION_DEPS        (1 << 8)
+#define ACTION_BIND        (1 << 9)
+#define ACTION_DIFF        (1 << 10)
+#define ACTION_HASH        (1 << 11)
+#define ACTION_STATS       (1 << 12)
+#define ACTION_FUNCS       (1 << 13)
+#define ACTION_SIZE        (1 << 14)
+#define ACTION_ALL         (ACTION_HEADER | ACTION_SECTIONS | ACTION_PHEADERS \
+	| ACTION_DYNAMIC | ACTION_RELOCATIONS | ACTION_SYMBOLS)
+
+/* RWELF_OPEN_* flags used for every file */
+static int open_flags = RWELF_OPEN_DEFAULT;
+
+/* Symbols shown by -s (--filter option) */
+static rwelf_sym_filter sym_filter;
+
+/* Demangle C++ symbol names (--demangle option) */
+static int demangle;
+
+/* RWELF_HASH_* flags used by --hash (--mask-relocs option) */
+static int hash_flags = RWELF_HASH_SECTIONS | RWELF_HASH_FUNCTIONS;
+
+/* RWELF_SIZE_* domain of the profile (--size option) */
+static int size_domain = RWELF_SIZE_SECTIONS;
+
+/* Scan-state database of the sequential mode (--state option) */
+static const char *state_file;
+
+/* RWELF_SCANDB_* flags of the state database (--state-build-id option) */
+static int state_flags;
+
+/* Copy written with the string tables rebuilt (--rebuild-strtab option) */
+static const char *strtab_file;
+
+/* Shared by every file and worker, so libraries are resolved once */
+static rwelf_resolver *resolver;
+
+/**
+ * Displays the ELF header information (-h option)
+ */
+static void _show_elf_header(output *out, const Elf_Ehdr *ehdr)
+{
+	if (IS_TEXT(out)) {
+		output_printf(out, "Class:    %s\n", rwelf_class(ehdr));
+		output_printf(out, "Data:     %s\n", rwelf_data(ehdr));
+		output_printf(out, "Version:  %d\n", rwelf_version(ehdr));
+		output_printf(out, "Type:     %s\n", rwelf_type(ehdr));
+		output_printf(out, "Sections: %d\n", rwelf_num_sections(ehdr));
+		output_printf(out, "PHeaders: %d\n", rwelf_num_pheaders(ehdr));
+		output_printf(out, "Entry:    %p\n", (void *) rwelf_entry(ehdr));
+		return;
+	}
+
+	output_view_begin(out, "header", 0);
+	output_record_begin(out);
+	output_str(out, "class", rwelf_class(ehdr));
+	output_str(out, "data", rwelf_data(ehdr));
+	output_uint(out, "version", rwelf_version(ehdr));
+	output_str(out, "type", rwelf_type(ehdr));
+	output_uint(out, "sections", rwelf_num_sections(ehdr));
+	output_uint(out, "pheaders", rwelf_num_pheaders(ehdr));
+	output_hex(out, "entry", rwelf_entry(ehdr));
+	output_record_end(out);
+	output_view_end(out);
+}
+
+/**
+ * Builds the readelf-like flags string of a section (W, A, X, ...)
+ */
+static const char *_section_flags(uint64_t flags, char *buf)
+{
+	static const struct { uint64_t flag; char c; } names[] = {
+		{ SHF_WRITE, 'W' }, { SHF_ALLOC, 'A' }, { SHF_EXECINSTR, 'X' },
+		{ SHF_MERGE, 'M' }, { SHF_STRINGS, 'S' }, { SHF_INFO_LINK, 'I' },
+		{ SHF_LINK_ORDER, 'L' }, { SHF_OS_NONCONFORMING, 'O' },
+		{ SHF_GROUP, 'G' }, { SHF_TLS, 'T' }, { SHF_COMPRESSED, 'C' },
+		{ SHF_EXCLUDE, 'E' }
+	};
+	size_t i, n = 0;
+
+	for (i = 0; i < sizeof(names) / sizeof(names[0]); ++i) {
+		if (flags & names[i].flag) {
+			buf[n++] = names[i].c;
+		}
+	}
+	buf[n] = '\0';
+
+	return buf;
+}
+
+/**
+ * Displays the ELF sections information (-S option)
+ */
+static void _show_elf_sections(output *out, const Elf_Ehdr *ehdr)
+{
+	const rwelf *elf = ehdr->elf;
+	Elf_Shdr sec;
+	int i, num_sections;
+	char flags[16];
+
+	num_sections = rwelf_num_sections(ehdr);
+
+	output_view_begin(out, "sections", 1);
+
+	if (IS_TEXT(out)) {
+		output_printf(out, "Section Headers:\n"
+			"  [Nr] Name                 Type             Address          Off      Size     ES Flg Lk Inf Al\n");
+	}
+
+	for (i = 0; i < num_sections; ++i) {
+		rwelf_get_section_by_num(elf, i, &sec);
+
+		_section_flags(rwelf_get_section_flags(&sec), flags);
+
+		if (IS_TEXT(out)) {
+			output_printf(out,
+				"  [%2d] %-20s %-16s %016" PRIx64 " %08" PRIx64 " %08" PRIx64
+				" %02" PRIx64 " %3s %2u %3u %2" PRIu64 "\n",
+				i, rwelf_get_section_name(&sec),
+				rwelf_get_section_type_name(&sec) + 4, /* Skip SHT_ */
+				rwelf_get_section_addr(&sec),
+				rwelf_get_section_offset(&sec),
+				rwelf_get_section_size(&sec),
+				rwelf_get_section_entsize(&sec),
+				flags,
+				rwelf_get_section_link(&sec),
+				rwelf_get_section_info(&sec),
+				rwelf_get_section_addralign(&sec));
+			continue;
+		}
+		output_record_begin(out);
+		output_uint(out, "index", i);
+		output_str(out, "name", (const char*) rwelf_get_section_name(&sec));
+		output_str(out, "type", rwelf_get_section_type_name(&sec));
+		output_hex(out, "addr", rwelf_get_section_addr(&sec));
+		output_uint(out, "offset", rwelf_get_section_offset(&sec));
+		output_uint(out, "size", rwelf_get_section_size(&sec));
+		output_uint(out, "entsize", rwelf_get_section_entsize(&sec));
+		output_str(out, "flags", flags);
+		output_uint(out, "link", rwelf_get_section_link(&sec));
+		output_uint(out, "info", rwelf_get_section_info(&sec));
+		output_uint(out, "align", rwelf_get_section_addralign(&sec));
+		output_record_end(out);
+	}
+
+	output_view_end(out);
+}
+
+/**
+ * Displays a symbol table, .symtab or .dynsym
+ */
+static void _show_elf_symtab(output *out, const rwelf *elf, int dynamic)
+{
+	const char *table = dynamic ? ".dynsym" : ".symtab";
+	rwelf_sym_filter filter = sym_filter;
+	rwelf_sym_cursor cursor;
+	const char **names = NULL;
+	Elf_Sym sym;
+	size_t i, num_symbols;
+
+	/* rwelf_num_symbols() is 16-bit, larger tables would wrap */
+	num_symbols = dynamic ? elf->ndynsyms : elf->nsyms;
+
+	if (!num_symbols) {
+		return;
+	}
+
+	if (IS_TEXT(out)) {
+		output_printf(out, "\nSymbol table '%s' contains %zu entries:\n"
+			"   Num:    Value          Size Type    Bind   Vis      Ndx Name\n",
+			table, num_symbols);
+	}
+
+	if (dynamic) {
+		filter.flags |= RWELF_SYMF_DYNAMIC;
+	}
+	rwelf_sym_cursor_init(&cursor, elf, &filter);
+
+	/* The whole table is demangled at once, indexed by symbol number */
+	if (demangle && (names = calloc(cursor.count, sizeof(char*))) != NULL) {
+		while (rwelf_sym_cursor_next(&cursor, &sym)) {
+			names[cursor.index] = rwelf_sym_cursor_name(&cursor, &sym);
+		}
+		for (i = 0; i < cursor.count; ++i) {
+			if (!names[i]) {
+				names[i] = "";
+			}
+		}
+		rwelf_demangle_batch(names, names, cursor.count);
+		rwelf_sym_cursor_init(&cursor, elf, &filter);
+	}
+
+	while (rwelf_sym_cursor_next(&cursor, &sym)) {
+		const char *name = rwelf_sym_cursor_name(&cursor, &sym);
+		char ndx[8];
+		uint16_t shndx;
+
+		i = cursor.index;
+
+		if (names) {
+			name = names[i];
+		}
+		shndx = rwelf_get_symbol_shndx(&sym);
+
+		switch (shndx) {
+			case SHN_UNDEF:  strcpy(ndx, "UND"); break;
+			case SHN_ABS:    strcpy(ndx, "ABS"); break;
+			case SHN_COMMON: strcpy(ndx, "COM"); break;
+			default:
+				snprintf(ndx, sizeof(ndx), "%u", shndx);
+		}
+
+		if (IS_TEXT(out)) {
+			/* Skip the STT_, STB_ and STV_ prefixes */
+			output_printf(out, "%6zu: %016" PRIx64 " %5" PRIu64 " %-7s %-6s %-8s %3s %s\n",
+				i,
+				rwelf_get_symbol_value(&sym),
+				rwelf_get_symbol_size(&sym),
+				rwelf_get_symbol_type_name(&sym) + 4,
+				rwelf_get_symbol_bind_name(&sym) + 4,
+				rwelf_get_symbol_visibility_name(&sym) + 4,
+				ndx, name);
+			continue;
+		}
+		output_record_begin(out);
+		output_str(out, "table", table);
+		output_uint(out, "index", i);
+		output_str(out, "name", name);
+		output_hex(out, "value", rwelf_get_symbol_value(&sym));
+		output_uint(out, "size", rwelf_get_symbol_size(&sym));
+		output_str(out, "type", rwelf_get_symbol_type_name(&sym));
+		output_str(out, "bind", rwelf_get_symbol_bind_name(&sym));
+		output_str(out, "visibility", rwelf_get_symbol_visibility_name(&sym));
+		output_str(out, "ndx", ndx);
+		output_str(out, "section", (const char*) rwelf_get_symbol_section(&sym));
+		output_record_end(out);
+	}
+
+	free(names);
+}
+
+/**
+ * Displays the ELF symbols (-s option)
+ */
+static void _show_elf_symbols(output *out, const rwelf *elf)
+{
+	output_view_begin(out, "symbols", 1);
+	_show_elf_symtab(out, elf, 1);
+	_show_elf_symtab(out, elf, 0);
+	output_view_end(out);
+}
+
+/**
+ * Displays the PLT stubs and the GOT slots (--plt option)
+ */
+static void _show_elf_plt(output *out, rwelf *elf)
+{
+	size_t i;
+
+	if (rwelf_plt_build(elf) == -1) {
+		return;
+	}
+
+	output_view_begin(out, "plt", 1);
+
+	if (IS_TEXT(out) && rwelf_num_plt(elf)) {
+		output_printf(out, "\nPLT stubs:\n"
+			"  Stub             GOT slot         Symbol\n");
+	}
+	for (i = 0; i < rwelf_num_plt(elf); ++i) {
+		const rwelf_plt_entry *plt = rwelf_get_plt_by_num(elf, i);
+
+		if (IS_TEXT(out)) {
+			output_printf(out, "  %016" PRIx64 " %016" PRIx64 " %s\n",
+				plt->addr, plt->got, plt->name);
+			continue;
+		}
+		output_record_begin(out);
+		output_str(out, "entry", "stub");
+		output_hex(out, "addr", plt->addr);
+		output_hex(out, "got", plt->got);
+		output_str(out, "name", plt->name);
+		output_record_end(out);
+	}
+
+	if (IS_TEXT(out) && rwelf_num_got(elf)) {
+		output_printf(out, "\nGOT slots:\n"
+			"  Slot             Symbol\n");
+	}
+	for (i = 0; i < rwelf_num_got(elf); ++i) {
+		const rwelf_got_entry *got = rwelf_get_got_by_num(elf, i);
+
+		if (IS_TEXT(out)) {
+			output_printf(out, "  %016" PRIx64 " %s\n", got->addr, got->name);
+			continue;
+		}
+		output_record_begin(out);
+		output_str(out, "entry", "got");
+		output_hex(out, "addr", got->addr);
+		output_str(out, "name", got->name);
+		output_record_end(out);
+	}
+
+	output_view_end(out);
+}
+
+/**
+ * Displays the functions recovered from every source, which works on
+ * stripped files too (--funcs option)
+ */
+static void _show_elf_funcs(output *out, rwelf *elf)
+{
+	static const struct { int flag; char c; } sources[] = {
+		{ RWELF_FUNC_SYMTAB, 's' }, { RWELF_FUNC_DYNSYM, 'd' },
+		{ RWELF_FUNC_EH_FRAME, 'f' }, { RWELF_FUNC_INIT, 'i' },
+		{ RWELF_FUNC_ENTRY, 'e' }
+	};
+	int rel = RWELF_EHDR(elf, e_type) == ET_REL;
+	size_t i, j;
+
+	if (rwelf_funcs_build(elf) == -1) {
+		return;
+	}
+
+	output_view_begin(out, "funcs", 1);
+
+	/* Relocatable functions are offsets in their section */
+	if (IS_TEXT(out)) {
+		output_printf(out, "\nFunctions:\n  %s%-17sSize     Sources Name\n",
+			rel ? "Ndx " : "", rel ? "Offset" : "Address");
+	}
+	for (i = 0; i < rwelf_num_funcs(elf); ++i) {
+		const rwelf_func *f = rwelf_get_func_by_num(elf, i);
+		const char *name = f->name;
+		char src[sizeof(sources) / sizeof(sources[0]) + 1];
+
+		for (j = 0; j < sizeof(sources) / sizeof(sources[0]); ++j) {
+			src[j] = (f->sources & sources[j].flag) ? sources[j].c : '-';
+		}
+		src[j] = '\0';
+
+		if (name && demangle) {
+			name = rwelf_demangle(name);
+		}
+
+		if (IS_TEXT(out)) {
+			if (rel) {
+				output_printf(out, "  %3zu ", f->shndx);
+			} else {
+				output_printf(out, "  ");
+			}
+			output_printf(out, "%016" PRIx64 " %8" PRIu64 " %-7s %s\n",
+				f->addr, f->size, src, name ? name : "");
+			continue;
+		}
+		output_record_begin(out);
+		output_str(out, "entry", "func");
+		if (rel) {
+			output_uint(out, "shndx", f->shndx);
+		}
+		output_hex(out, "addr", f->addr);
+		output_uint(out, "size", f->size);
+		output_str(out, "sources", src);
+		if (name) {
+			output_str(out, "name", name);
+		}
+		output_record_end(out);
+	}
+
+	output_view_end(out);
+}
+
+static int _show_hash(const rwelf_hash_entry *e, void *arg)
+{
+	output *out = arg;
+	const char *what = e->what == RWELF_HASH_SECTIONS ? "section" : "function";
+	const char *name = e->name;
+
+	if (demangle && e->what == RWELF_HASH_FUNCTIONS) {
+		name = rwelf_demangle(name);
+	}
+
+	if (IS_TEXT(out)) {
+		output_printf(out, "  %016" PRIx64 " %-8s %8" PRIu64 " %s\n",
+			e->hash, what, e->size, name);
+		return 0;
+	}
+	output_record_begin(out);
+	output_str(out, "entry", what);
+	output_str(out, "name", name);
+	output_uint(out, "index", e->index);
+	output_hex(out, "offset", e->offset);
+	output_uint(out, "size", e->size);
+	output_hex(out, "hash", e->hash);
+	output_record_end(out);
+
+	return 0;
+}
+
+/**
+ * Displays the content hash of every section and function (--hash option)
+ */
+static void _show_elf_hash(output *out, rwelf *elf)
+{
+	output_view_begin(out, "hash", 1);
+
+	if (IS_TEXT(out)) {
+		output_printf(out, "\nContent hashes%s:\n"
+			"  Hash             Kind         Size Name\n",
+			(hash_flags & RWELF_HASH_MASK_RELOCS) ? " (relocations masked)" : "");
+	}
+	if (rwelf_foreach_hash(elf, hash_flags, _show_hash, out) == -1) {
+		fprintf(stderr, "rwelf: Error: out of memory hashing\n");
+	}
+
+	output_view_end(out);
+}
+
+typedef struct {
+	output *out;
+	uint64_t file_size;
+	uint64_t vm_size;
+} _size_ctx;
+
+static int _show_size(const rwelf_size_entry *e, void *arg)
+{
+	_size_ctx *ctx = arg;
+	const char *name = e->name;
+
+	if (demangle && size_domain == RWELF_SIZE_SYMBOLS) {
+		name = rwelf_demangle(name);
+	}
+	ctx->file_size += e->file_size;
+	ctx->vm_size   += e->vm_size;
+
+	if (IS_TEXT(ctx->out)) {
+		output_printf(ctx->out, "  %12" PRIu64 " %12" PRIu64 "  %s\n",
+			e->file_size, e->vm_size, name);
+		return 0;
+	}
+	output_record_begin(ctx->out);
+	output_str(ctx->out, "entry", "size");
+	output_str(ctx->out, "name", name);
+	output_uint(ctx->out, "file_size", e->file_size);
+	output_uint(ctx->out, "vm_size", e->vm_size);
+	output_record_end(ctx->out);
+
+	return 0;
+}
+
+/**
+ * Displays where the file and VM bytes go (--size option)
+ */
+static void _show_elf_size(output *out, const rwelf *elf)
+{
+	static const char *domains[] = { "segments", "sections", "symbols", "units" };
+	_size_ctx ctx = { out, 0, 0 };
+
+	output_view_begin(out, "size", 1);
+
+	if (IS_TEXT(out)) {
+		output_printf(out, "\nSize profile (%s):\n"
+			"     File size      VM size  Name\n", domains[size_domain]);
+	}
+	if (rwelf_size_profile(elf, size_domain, _show_size, &ctx) == -1) {
+		fprintf(stderr, "rwelf: Error: cannot profile the size by %s\n",
+			domains[size_domain]);
+	} else if (IS_TEXT(out)) {
+		output_printf(out, "  %12" PRIu64 " %12" PRIu64 "  TOTAL\n",
+			ctx.file_size, ctx.vm_size);
+	} else {
+		output_record_begin(out);
+		output_str(out, "entry", "total");
+		output_uint(out, "file_size", ctx.file_size);
+		output_uint(out, "vm_size", ctx.vm_size);
+		output_record_end(out);
+	}
+
+	output_view_end(out);
+}
+
+/**
+ * Displays the instrumentation counters of the handle (--stats option)
+ */
+static void _show_elf_stats(output *out, const rwelf *elf)
+{
+	rwelf_stats stats;
+	int i;
+
+	if (rwelf_get_stats(elf, &stats) == -1) {
+		return;
+	}
+
+	output_view_begin(out, "stats", 0);
+
+	if (IS_TEXT(out)) {
+		output_printf(out, "\nStatistics:\n");
+
+		for (i = 0; i < RWELF_STAT_MAX; ++i) {
+			output_printf(out, "  %-16s %" PRIu64 "\n", rwelf_stat_name(i),
+				stats.counters[i]);
+		}
+	} else {
+		output_record_begin(out);
+		for (i = 0; i < RWELF_STAT_MAX; ++i) {
+			output_uint(out, rwelf_stat_name(i), stats.counters[i]);
+		}
+		output_record_end(out);
+	}
+
+	output_view_end(out);
+}
+
+/**
+ * Writes the counters of the whole run to stderr (--stats option)
+ */
+static void _show_global_stats(void)
+{
+	rwelf_stats stats;
+	int i;
+
+	/* After the output of the files */
+	fflush(stdout);
+
+	if (rwelf_get_global_stats(&stats) == -1) {
+		fprintf(stderr, "rwelf: library built without RWELF_STATS, "
+			"rebuild with make DEFS=-DRWELF_STATS\n");
+		return;
+	}
+
+	fprintf(stderr, "rwelf:");
+	for (i = 0; i < RWELF_STAT_MAX; ++i) {
+		fprintf(stderr, " %s=%" PRIu64, rwelf_stat_name(i), stats.counters[i]);
+	}
+	fprintf(stderr, "\n");
+}
+
+static int _show_dep(const rwelf_dep *dep, const char *name,
+	const char *path, void *arg)
+{
+	output *out = arg;
+
+	if (IS_TEXT(out)) {
+		if (dep) {
+			output_printf(out, "\t%s => %s\n", name, path);
+		} else {
+			output_printf(out, "\t%s => not found\n", name);
+		}
+		return 0;
+	}
+	output_record_begin(out);
+	output_str(out, "entry", "needed");
+	output_str(out, "name", name);
+	if (dep) {
+		output_str(out, "path", path);
+	}
+	output_uint(out, "found", dep != NULL);
+	output_record_end(out);
+
+	return 0;
+}
+
+/**
+ * Displays the shared libraries the file loads, in load order (--deps
+ * option)
+ */
+static void _show_elf_deps(output *out, const char *file)
+{
+	const rwelf_dep *root;
+
+	if ((root = rwelf_resolve(resolver, file)) == NULL) {
+		return;
+	}
+
+	output_view_begin(out, "deps", 1);
+
+	if (IS_TEXT(out)) {
+		output_printf(out, "\nShared library dependencies:\n");
+	}
+	rwelf_dep_foreach(root, _show_dep, out);
+
+	if (rwelf_dep_interp(root)) {
+		if (IS_TEXT(out)) {
+			output_printf(out, "\t%s (interpreter)\n", rwelf_dep_interp(root));
+		} else {
+			output_record_begin(out);
+			output_str(out, "entry", "interp");
+			output_str(out, "path", rwelf_dep_interp(root));
+			output_record_end(out);
+		}
+	}
+
+	output_view_end(out);
+}
+
+/**
+ * Displays what each undefined symbol of the file binds to, and the
+ * symbols left unresolved or interposed in the whole set of libraries it
+ * loads (--bind option)
+ */
+static void _show_elf_bind(output *out, const char *file)
+{
+	const rwelf_dep *root;
+	rwelf_binding *b;
+	size_t i;
+
+	if ((root = rwelf_resolve(resolver, file)) == NULL
+		|| (b = rwelf_bind_deps(root)) == NULL) {
+		return;
+	}
+
+	output_view_begin(out, "bind", 1);
+
+	if (IS_TEXT(out)) {
+		output_printf(out, "\nSymbol bindings (%zu objects, %zu references):\n",
+			rwelf_bind_num_objects(b), rwelf_bind_num_refs(b));
+	}
+	for (i = 0; i < rwelf_bind_num_refs(b); ++i) {
+		const rwelf_bind_ref *ref = rwelf_bind_get_ref(b, i);
+		const char *def = ref->def == RWELF_BIND_NONE ? NULL :
+			rwelf_bind_object_path(b, ref->def);
+
+		/* Only the references of the file itself are listed */
+		if (ref->object != 0) {
+			break;
+		}
+		if (IS_TEXT(out)) {
+			output_printf(out, "  %s => %s%s\n", ref->name,
+				def ? def : "not found", ref->weak ? " (weak)" : "");
+			continue;
+		}
+		output_record_begin(out);
+		output_str(out, "entry", "ref");
+		output_str(out, "name", ref->name);
+		if (def) {
+			output_str(out, "def", def);
+		}
+		output_uint(out, "weak", ref->weak);
+		output_record_end(out);
+	}
+
+	if (IS_TEXT(out) && rwelf_bind_num_unresolved(b)) {
+		output_printf(out, "\nUnresolved symbols (%zu):\n",
+			rwelf_bind_num_unresolved(b));
+	}
+	for (i = 0; i < rwelf_bind_num_refs(b); ++i) {
+		const rwelf_bind_ref *ref = rwelf_bind_get_ref(b, i);
+
+		if (ref->def != RWELF_BIND_NONE || ref->weak) {
+			continue;
+		}
+		if (IS_TEXT(out)) {
+			output_printf(out, "  %s (%s)\n", ref->name,
+				rwelf_bind_object_path(b, ref->object));
+			continue;
+		}
+		output_record_begin(out);
+		output_str(out, "entry", "unresolved");
+		output_str(out, "name", ref->name);
+		output_str(out, "object", rwelf_bind_object_path(b, ref->object));
+		output_record_end(out);
+	}
+
+	if (IS_TEXT(out) && rwelf_bind_num_interposed(b)) {
+		output_printf(out, "\nInterposed symbols (%zu):\n",
+			rwelf_bind_num_interposed(b));
+	}
+	for (i = 0; i < rwelf_bind_num_interposed(b); ++i) {
+		const rwelf_bind_interposed *ip = rwelf_bind_get_interposed(b, i);
+
+		if (IS_TEXT(out)) {
+			output_printf(out, "  %s: %s hides %s\n", ip->name,
+				rwelf_bind_object_path(b, ip->def),
+				rwelf_bind_object_path(b, ip->object));
+			continue;
+		}
+		output_record_begin(out);
+		output_str(out, "entry", "interposed");
+		output_str(out, "name", ip->name);
+		output_str(out, "def", rwelf_bind_object_path(b, ip->def));
+		output_str(out, "object", rwelf_bind_object_path(b, ip->object));
+		output_record_end(out);
+	}
+
+	output_view_end(out);
+
+	rwelf_bind_free(b);
+}
+
+/**
+ * Displays the dynamic section (-d option)
+ */
+static void _show_elf_dynamic(output *out, const rwelf *elf)
+{
+	size_t i, num_dyns;
+	Elf_Dyn dyn;
+
+	num_dyns = rwelf_num_dynamic(elf);
+
+	/* Entries after the first DT_NULL are just padding */
+	for (i = 0; i < num_dyns; ++i) {
+		rwelf_get_dynamic_by_num(elf, i, &dyn);
+
+		if (rwelf_get_dynamic_tag(&dyn) == DT_NULL) {
+			num_dyns = i + 1;
+			break;
+		}
+	}
+
+	output_view_begin(out, "dynamic", 1);
+
+	if (IS_TEXT(out) && num_dyns) {
+		output_printf(out, "\nDynamic section contains %zu entries:\n"
+			"  Tag                Type                 Name/Value\n", num_dyns);
+	}
+
+	for (i = 0; i < num_dyns; ++i) {
+		const unsigned char *str;
+		const char *tag_name;
+		char type[32];
+
+		rwelf_get_dynamic_by_num(elf, i, &dyn);
+
+		tag_name = rwelf_get_dynamic_tag_name(&dyn);
+		str = rwelf_get_dynamic_strval(&dyn);
+
+		if (!IS_TEXT(out)) {
+			output_record_begin(out);
+			output_hex(out, "tag", rwelf_get_dynamic_tag(&dyn));
+			output_str(out, "type", tag_name);
+			if (str) {
+				output_str(out, "value", (const char*) str);
+			} else {
+				output_uint(out, "value", rwelf_get_dynamic_val(&dyn));
+			}
+			output_record_end(out);
+			continue;
+		}
+
+		/* Skip the DT_ prefix */
+		snprintf(type, sizeof(type), "(%s)",
+			strncmp(tag_name, "DT_", 3) == 0 ? tag_name + 3 : tag_name);
+
+		output_printf(out, " 0x%016" PRIx64 " %-20s ",
+			(uint64_t) rwelf_get_dynamic_tag(&dyn), type);
+
+		switch (rwelf_get_dynamic_tag(&dyn)) {
+			case DT_NEEDED:
+				output_printf(out, "Shared library: [%s]\n", str);
+				break;
+			case DT_SONAME:
+				output_printf(out, "Library soname: [%s]\n", str);
+				break;
+			case DT_RPATH:
+				output_printf(out, "Library rpath: [%s]\n", str);
+				break;
+			case DT_RUNPATH:
+				output_printf(out, "Library runpath: [%s]\n", str);
+				break;
+			default:
+				output_printf(out, "0x%" PRIx64 "\n", rwelf_get_dynamic_val(&dyn));
+		}
+	}
+
+	output_view_end(out);
+}
+
+/**
+ * Displays a Rela entry
+ */
+static void _show_elf_rela_entry(output *out, const char *section,
+	const Elf_Rela *rela)
+{
+	if (IS_TEXT(out)) {
+		output_printf(out, "Offset: %012lx | Info: %012lx | Addend: %012lx | Sym: %s\n",
+			rwelf_get_rela_offset(rela),
+			rwelf_get_rela_info(rela),
+			rwelf_get_rela_addend(rela),
+			rwelf_get_rela_symbol(rela));
+		return;
+	}
+	output_record_begin(out);
+	output_str(out, "section", section);
+	output_hex(out, "offset", rwelf_get_rela_offset(rela));
+	output_hex(out, "info", rwelf_get_rela_info(rela));
+	output_uint(out, "type", rwelf_get_rela_type(rela));
+	output_int(out, "addend", rwelf_get_rela_addend(rela));
+	output_str(out, "symbol", (const char*) rwelf_get_rela_symbol(rela));
+	output_record_end(out);
+}
+
+/**
+ * Displays the Rela information
+ */
+static void _show_elf_rela(output *out, const Elf_Shdr *shdr, size_t n)
+{
+	int i;
+
+	for (i = 0; i < n; ++i) {
+		Elf_Rela rela;
+
+		rwelf_get_rela_by_num(shdr, i, &rela);
+		_show_elf_rela_entry(out, (const char*) rwelf_get_section_name(shdr), &rela);
+	}
+}
+
+/**
+ * Displays the relocations found through .dynamic, for files without
+ * section headers
+ */
+static void _show_elf_dyn_relas(output *out, const rwelf *elf)
+{
+	Elf_Rela rela;
+	size_t i, n;
+
+	if ((n = rwelf_num_dyn_relas(elf)) != 0 && IS_TEXT(out)) {
+		output_printf(out, "Relocation entries: %d\n", (int) n);
+	}
+	for (i = 0; i < n; ++i) {
+		rwelf_get_dyn_rela_by_num(elf, i, &rela);
+		_show_elf_rela_entry(out, "DT_RELA", &rela);
+	}
+
+	if ((n = rwelf_num_jmprels(elf)) != 0 && IS_TEXT(out)) {
+		output_printf(out, "Relocation entries: %d\n", (int) n);
+	}
+	for (i = 0; i < n; ++i) {
+		rwelf_get_jmprel_by_num(elf, i, &rela);
+		_show_elf_rela_entry(out, "DT_JMPREL", &rela);
+	}
+}
+
+/**
+ * Displays the ELF relocations (-r option)
+ */
+static void _show_elf_relocations(output *out, const Elf_Ehdr *ehdr)
+{
+	const rwelf *elf = ehdr->elf;
+	int i, num_sections;
+
+	num_sections = rwelf_num_sections(ehdr);
+
+	output_view_begin(out, "relocations", 1);
+
+	if (!num_sections) {
+		_show_elf_dyn_relas(out, elf);
+	}
+
+	for (i = 0; i < num_sections; ++i) {
+		Elf_Shdr sec;
+		size_t n;
+
+		rwelf_get_section_by_num(elf, i, &sec);
+
+		switch (rwelf_get_section_type(&sec)) {
+			case SHT_REL:
+			case SHT_RELA:
+				n = rwelf_get_num_entries(&sec);
+				if (IS_TEXT(out)) {
+					output_printf(out, "Relocation entries: %d\n",(int) n);
+				}
+
+				_show_elf_rela(out, &sec, n);
+				break;
+		}
+	}
+
+	output_view_end(out);
+}
+
+/**
+ * Writes the names of the sections held by a segment, space separated
+ */
+static void _segment_sections(const rwelf *elf, const rwelf_segment_map *map,
+	char *buf, size_t len)
+{
+	size_t i, pos = 0;
+
+	buf[0] = '\0';
+
+	for (i = 0; map && i < map->nsections && pos < len; ++i) {
+		Elf_Shdr sec;
+		int n;
+
+		rwelf_get_section_by_num(elf, map->sections[i], &sec);
+		n = snprintf(buf + pos, len - pos, "%s%s", i ? " " : "",
+			(const char*) rwelf_get_section_name(&sec));
+		pos += n > 0 ? (size_t) n : 0;
+	}
+}
+
+/**
+ * Displays the program header information (-l option), with the sections
+ * of every segment and the padding of the loaded ones
+ */
+static void _show_elf_pheaders(output *out, rwelf *elf)
+{
+	const rwelf_segment_map *map;
+	char names[4096];
+	int i, num_phdrs, mapped;
+	Elf_Ehdr ehdr;
+
+	rwelf_get_header(elf, &ehdr);
+	num_phdrs = rwelf_num_pheaders(&ehdr);
+	mapped = rwelf_segment_map_build(elf) == 0;
+
+	output_view_begin(out, "pheaders", 1);
+
+	for (i = 0; i < num_phdrs; ++i) {
+		Elf_Phdr phdr;
+
+		rwelf_get_pheader_by_num(elf, i, &phdr);
+		map = mapped ? rwelf_get_segment_map(elf, i) : NULL;
+
+		if (IS_TEXT(out)) {
+			output_printf(out, "Type: %s\n", rwelf_get_pheader_type_name(&phdr));
+			continue;
+		}
+		_segment_sections(elf, map, names, sizeof(names));
+
+		output_record_begin(out);
+		output_str(out, "type", rwelf_get_pheader_type_name(&phdr));
+		output_uint(out, "flags", rwelf_get_pheader_flags(&phdr));
+		output_hex(out, "vaddr", rwelf_get_pheader_vaddr(&phdr));
+		if (map) {
+			output_str(out, "sections", names);
+			output_uint(out, "file_padding", map->file_padding);
+			output_uint(out, "mem_padding", map->mem_padding);
+			output_uint(out, "page_slack", map->page_slack);
+		}
+		output_record_end(out);
+	}
+
+	if (IS_TEXT(out) && mapped && num_phdrs) {
+		output_printf(out, "\nSection to segment mapping:\n");
+
+		for (i = 0; i < num_phdrs; ++i) {
+			_segment_sections(elf, rwelf_get_segment_map(elf, i),
+				names, sizeof(names));
+			output_printf(out, "  %02d     %s\n", i, names);
+		}
+
+		output_printf(out, "\nLoad segment padding:\n"
+			"  Segment  Filesz     File pad   Memsz      Mem pad    Page slack\n");
+
+		for (i = 0; i < num_phdrs; ++i) {
+			Elf_Phdr phdr;
+
+			rwelf_get_pheader_by_num(elf, i, &phdr);
+
+			if (rwelf_get_pheader_type(&phdr) != PT_LOAD) {
+				continue;
+			}
+			map = rwelf_get_segment_map(elf, i);
+			output_printf(out, "  %02d       %-10" PRIu64 " %-10" PRIu64
+				" %-10" PRIu64 " %-10" PRIu64 " %" PRIu64 "\n", i,
+				rwelf_get_pheader_filesz(&phdr), map->file_padding,
+				rwelf_get_pheader_memsz(&phdr), map->mem_padding,
+				map->page_slack);
+		}
+	}
+
+	output_view_end(out);
+}
+
+/**
+ * Exports .symtab and .dynsym in columnar format (-E option)
+ */
+static void _export_elf_symbols(output *out, const rwelf *elf)
+{
+	const int flags = RWELF_EXPORT_SYMTAB | RWELF_EXPORT_DYNSYM;
+	char buf[64 * 1024];
+	FILE *tmp;
+	size_t n;
+
+	if (out->fp) {
+		output_flush(out);
+		fflush(out->fp);
+
+		if (rwelf_export_symbols(elf, fileno(out->fp), flags) == -1) {
+			fprintf(stderr, "Failed to export the symbols\n");
+		}
+		return;
+	}
+
+	/* In-memory output (-j), go through a temporary file */
+	if ((tmp = tmpfile()) == NULL
+		|| rwelf_export_symbols(elf, fileno(tmp), flags) == -1) {
+		fprintf(stderr, "Failed to export the symbols\n");
+	} else {
+		rewind(tmp);
+		while ((n = fread(buf, 1, sizeof(buf), tmp)) > 0) {
+			output_write(out, buf, n);
+		}
+	}
+	if (tmp) {
+		fclose(tmp);
+	}
+}
+
+/**
+ * Runs every requested action on an opened file
+ */
+static int _dump_elf(output *out, const char *file, rwelf *elf,
+	int actions, int nfiles)
+{
+	Elf_Ehdr ehdr;
+
+	if (!elf) {
+		fprintf(stderr, "rwelf: Error: '%s' is not a readable ELF file\n", file);
+		return -1;
+	}
+	rwelf_get_header(elf, &ehdr);
+
+	if (actions & ACTION_EXPORT) {
+		_export_elf_symbols(out, elf);
+		return 0;
+	}
+
+	output_file_begin(out, file);
+
+	if (IS_TEXT(out) && nfiles > 1) {
+		output_printf(out, "\nFile: %s\n", file);
+	}
+	if (actions & ACTION_HEADER) {
+		_show_elf_header(out, &ehdr);
+	}
+	if (actions & ACTION_SECTIONS) {
+		_show_elf_sections(out, &ehdr);
+	}
+	if (actions & ACTION_PHEADERS) {
+		_show_elf_pheaders(out, elf);
+	}
+	if (actions & ACTION_DYNAMIC) {
+		_show_elf_dynamic(out, elf);
+	}
+	if (actions & ACTION_PLT) {
+		_show_elf_plt(out, elf);
+	}
+	if (actions & ACTION_FUNCS) {
+		_show_elf_funcs(out, elf);
+	}
+	if (actions & ACTION_HASH) {
+		_show_elf_hash(out, elf);
+	}
+	if (actions & ACTION_SIZE) {
+		_show_elf_size(out, elf);
+	}
+	if (actions & ACTION_DEPS) {
+		_show_elf_deps(out, file);
+	}
+	if (actions & ACTION_BIND) {
+		_show_elf_bind(out, file);
+	}
+	if (actions & ACTION_RELOCATIONS) {
+		_show_elf_relocations(out, &ehdr);
+	}
+	if (actions & ACTION_SYMBOLS) {
+		_show_elf_symbols(out, elf);
+	}
+	if (actions & ACTION_STATS) {
+		_show_elf_stats(out, elf);
+	}
+
+	output_file_end(out);
+
+	return 0;
+}
+
+static int _show_diff_entry(const rwelf_diff_entry *e, void *arg)
+{
+	static const char marks[] = { '+', '-', '~', '*' };
+	static const char *what[] = { NULL, "symbol", "section", NULL, "dynamic" };
+	output *out = arg;
+	const char *tag = NULL;
+
+	switch (e->tag) {
+		case DT_NEEDED:  tag = "NEEDED";  break;
+		case DT_SONAME:  tag = "SONAME";  break;
+		case DT_RPATH:   tag = "RPATH";   break;
+		case DT_RUNPATH: tag = "RUNPATH"; break;
+	}
+
+	if (IS_TEXT(out)) {
+		output_printf(out, "  %c %-8s %s%s%s%s%s", marks[e->change],
+			what[e->what], tag ? tag : "", tag ? " " : "",
+			e->scope ? e->scope : "", e->scope ? ":" : "", e->name);
+
+		if (e->what == RWELF_DIFF_DYNAMIC) {
+			if (e->change == RWELF_DIFF_CHANGED) {
+				output_printf(out, " (%#" PRIx64 " -> %#" PRIx64 ")",
+					e->old_value, e->new_value);
+			}
+			output_printf(out, "\n");
+			return 0;
+		}
+
+		switch (e->change) {
+			case RWELF_DIFF_ADDED:
+				output_printf(out, " (size %" PRIu64 ")\n", e->new_size);
+				break;
+			case RWELF_DIFF_REMOVED:
+				output_printf(out, " (size %" PRIu64 ")\n", e->old_size);
+				break;
+			case RWELF_DIFF_RESIZED:
+				output_printf(out, " (size %" PRIu64 " -> %" PRIu64 ")\n",
+					e->old_size, e->new_size);
+				break;
+			default:
+				output_printf(out, "\n");
+		}
+		return 0;
+	}
+
+	output_record_begin(out);
+	output_str(out, "entry", what[e->what]);
+	output_str(out, "change", rwelf_diff_change_name(e->change));
+	output_str(out, "name", e->name);
+	if (e->scope) {
+		output_str(out, "scope", e->scope);
+	}
+	if (e->what == RWELF_DIFF_DYNAMIC) {
+		output_int(out, "tag", e->tag);
+	}
+	if (e->change != RWELF_DIFF_ADDED) {
+		output_hex(out, "old_value", e->old_value);
+		output_uint(out, "old_size", e->old_size);
+	}
+	if (e->change != RWELF_DIFF_REMOVED) {
+		output_hex(out, "new_value", e->new_value);
+		output_uint(out, "new_size", e->new_size);
+	}
+	output_record_end(out);
+
+	return 0;
+}
 
 /**
- * Displays the ELF header information (-h option)
+ * Displays the structural differences from the old file to the new one
+ * (--diff option)
  */
-static void _show_elf_header(const Elf_Ehdr *ehdr)
-{	
-	printf("Class:    %s\n", rwelf_class(ehdr));
-	printf("Data:     %s\n", rwelf_data(ehdr));
-	printf("Version:  %d\n", rwelf_version(ehdr));
-	printf("Type:     %s\n", rwelf_type(ehdr));
-	printf("Sections: %d\n", rwelf_num_sections(ehdr));
-	printf("PHeaders: %d\n", rwelf_num_pheaders(ehdr));
-	printf("Entry:    %p\n", (void *) rwelf_entry(ehdr));
+static int _diff_files(const char *old, const char *new, output_format format)
+{
+	rwelf *a = rwelf_open_flags(old, open_flags);
+	rwelf *b = rwelf_open_flags(new, open_flags);
+	int status = 0, n;
+	output out;
+
+	if (!a || !b) {
+		fprintf(stderr, "rwelf: Error: '%s' is not a readable ELF file\n",
+			a ? new : old);
+		status = 1;
+		goto out;
+	}
+
+	if (output_init(&out, stdout, format) == -1) {
+		exit(1);
+	}
+	output_file_begin(&out, new);
+	output_view_begin(&out, "diff", 1);
+
+	if (IS_TEXT(&out)) {
+		output_printf(&out, "--- %s\n+++ %s\n", old, new);
+	}
+	if ((n = rwelf_diff(a, b, RWELF_DIFF_ALL, _show_diff_entry, &out)) == -1) {
+		status = 1;
+	}
+
+	output_view_end(&out);
+	output_file_end(&out);
+	output_free(&out);
+out:
+	if (a) {
+		rwelf_close(a);
+	}
+	if (b) {
+		rwelf_close(b);
+	}
+	return status;
 }
 
 /**
- * Displays the ELF sections information (-S option)
+ * Writes a copy of the file with minimal string tables and displays the
+ * sizes before and after (--rebuild-strtab option)
  */
-static void _show_elf_sections(const Elf_Ehdr *ehdr)
+static int _rebuild_strtabs(const char *file, const char *dest,
+	output_format format)
 {
-	const rwelf *elf = ehdr->elf;
-	Elf_Shdr sec;
-	int i, num_sections;
-	
-	num_sections = rwelf_num_sections(ehdr);
-	
-    for (i = 0; i < num_sections; ++i) {
-        rwelf_get_section_by_num(elf, i, &sec);
-        printf("Section: %s\n", rwelf_get_section_name(&sec));
-    }    
+	static const char *tables[] = { ".strtab", ".dynstr", ".shstrtab" };
+	rwelf *a = rwelf_open_flags(file, open_flags), *b = NULL;
+	output out;
+	size_t i;
+
+	if (!a) {
+		fprintf(stderr, "rwelf: Error: '%s' is not a readable ELF file\n", file);
+		return 1;
+	}
+	if (rwelf_rewrite_strtabs(a, dest, RWELF_STRTAB_ALL) == -1
+		|| (b = rwelf_open_flags(dest, open_flags)) == NULL) {
+		fprintf(stderr, "rwelf: Error: cannot rebuild the string tables of "
+			"'%s' into '%s'\n", file, dest);
+		rwelf_close(a);
+		return 1;
+	}
+
+	if (output_init(&out, stdout, format) == -1) {
+		exit(1);
+	}
+	output_file_begin(&out, dest);
+	output_view_begin(&out, "strtab", 1);
+
+	if (IS_TEXT(&out)) {
+		output_printf(&out, "String tables of %s:\n"
+			"  Name         Old size   New size\n", file);
+	}
+	for (i = 0; i < sizeof(tables) / sizeof(tables[0]); ++i) {
+		Elf_Shdr old, new;
+
+		if (rwelf_get_section_by_name(a, tables[i], &old) == -1
+			|| rwelf_get_section_by_name(b, tables[i], &new) == -1) {
+			continue;
+		}
+		if (IS_TEXT(&out)) {
+			output_printf(&out, "  %-12s %-10" PRIu64 " %" PRIu64 "\n", tables[i],
+				rwelf_get_section_size(&old), rwelf_get_section_size(&new));
+			continue;
+		}
+		output_record_begin(&out);
+		output_str(&out, "name", tables[i]);
+		output_uint(&out, "old_size", rwelf_get_section_size(&old));
+		output_uint(&out, "new_size", rwelf_get_section_size(&new));
+		output_record_end(&out);
+	}
+	if (IS_TEXT(&out)) {
+		output_printf(&out, "  %-12s %-10zu %zu\n", "(file)", a->size, b->size);
+	}
+
+	output_view_end(&out);
+	output_file_end(&out);
+	output_free(&out);
+
+	rwelf_close(a);
+	rwelf_close(b);
+
+	return 0;
 }
 
 /**
- * Displays the ELF symbols (-s option)
+ * Opens the file once and runs every requested action on it
  */
-static void _show_elf_symbols(const rwelf *elf)
+static int _dump_file(output *out, const char *file, int actions, int nfiles)
 {
-	Elf_Sym sym;
-	int i, num_symbols;
-	
-	num_symbols = rwelf_num_symbols(elf);
-	for (i = 0; i < num_symbols; ++i) {
-		rwelf_get_symbol_by_num(elf, i, &sym);
-		printf("Symbol: %s\n", rwelf_get_symbol_name(&sym));
+	rwelf *elf = rwelf_open_flags(file, open_flags);
+	int ret = _dump_elf(out, file, elf, actions, nfiles);
+
+	if (elf) {
+		rwelf_close(elf);
 	}
+	return ret;
 }
 
 /**
- * Displays the Rela information
+ * State of the sequential mode, which goes through rwelf_scan
  */
-static void _show_elf_rela(const Elf_Shdr *shdr, size_t n)
+typedef struct {
+	output *out;
+	int actions;
+	int nfiles;
+} _scan_ctx;
+
+static int _dump_scanned(const char *file, rwelf *elf, void *arg)
 {
-	int i;
-	
-	for (i = 0; i < n; ++i) {
-		Elf_Rela rela;
-		
-		rwelf_get_rela_by_num(shdr, i, &rela);
-		
-		printf("Offset: %012lx | Info: %012lx | Addend: %012lx | Sym: %s\n", 
-			rwelf_get_rela_offset(&rela),
-			rwelf_get_rela_info(&rela),
-			rwelf_get_rela_addend(&rela),
-			rwelf_get_rela_symbol(&rela));
+	_scan_ctx *ctx = arg;
+
+	_dump_elf(ctx->out, file, elf, ctx->actions, ctx->nfiles);
+
+	/* Keep binary export and text output from interleaving */
+	output_flush(ctx->out);
+
+	return 0;
+}
+
+/**
+ * State shared by the workers of the parallel mode (-j option)
+ */
+typedef struct {
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	char **files;
+	size_t nfiles;
+	size_t next;              /* Next file to be picked by a worker */
+	size_t emitted;           /* Files already written, in input order */
+	size_t window;            /* How far workers may run ahead of output */
+	output *results;          /* Per-file buffered output */
+	char *done;               /* Whether results[i] is complete */
+	int *status;              /* _dump_file() result of each file */
+	int actions;
+	output_format format;
+} _pool;
+
+static void *_worker(void *arg)
+{
+	_pool *pool = arg;
+	size_t i;
+
+	for (;;) {
+		pthread_mutex_lock(&pool->lock);
+
+		/* Bound the memory held by buffered results */
+		while (pool->next < pool->nfiles
+			&& pool->next >= pool->emitted + pool->window) {
+			pthread_cond_wait(&pool->cond, &pool->lock);
+		}
+		if (pool->next >= pool->nfiles) {
+			pthread_mutex_unlock(&pool->lock);
+			return NULL;
+		}
+		i = pool->next++;
+
+		pthread_mutex_unlock(&pool->lock);
+
+		if (output_init(&pool->results[i], NULL, pool->format) == -1) {
+			fprintf(stderr, "rwelf: Error: out of memory dumping '%s'\n",
+				pool->files[i]);
+			pool->status[i] = -1;
+		} else {
+			pool->status[i] = _dump_file(&pool->results[i], pool->files[i],
+				pool->actions, pool->nfiles);
+		}
+
+		pthread_mutex_lock(&pool->lock);
+		pool->done[i] = 1;
+		pthread_cond_broadcast(&pool->cond);
+		pthread_mutex_unlock(&pool->lock);
 	}
 }
 
 /**
- * Displays the ELF relocations (-r option)
+ * Dumps the files on a pool of workers, writing each file's output in
+ * input order as soon as it and all the files before it are done.
+ * Returns -1, with nothing written, when no worker could be started
  */
-static void _show_elf_relocations(const Elf_Ehdr *ehdr)
+static int _dump_files_parallel(char **files, size_t nfiles, int actions,
+	output_format format, int nthreads)
 {
-	const rwelf *elf = ehdr->elf;
-	int i, num_sections;
-	
-	num_sections = rwelf_num_sections(ehdr);
-	
-	for (i = 0; i < num_sections; ++i) {
-		Elf_Shdr sec;
-		size_t n;
-			
-		rwelf_get_section_by_num(elf, i, &sec);		
-		
-		switch (rwelf_get_section_type(&sec)) {
-			case SHT_REL:
-			case SHT_RELA:
-				n = rwelf_get_num_entries(&sec);
-				printf("Relocation entries: %d\n",(int) n);
-					
-				_show_elf_rela(&sec, n);
+	struct timespec start, end;
+	pthread_t *threads;
+	_pool pool;
+	double secs;
+	int status = 0;
+	size_t i, started = 0;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	memset(&pool, 0, sizeof(pool));
+	pthread_mutex_init(&pool.lock, NULL);
+	pthread_cond_init(&pool.cond, NULL);
+
+	pool.files   = files;
+	pool.nfiles  = nfiles;
+	pool.window  = nthreads * 4;
+	pool.actions = actions;
+	pool.format  = format;
+	pool.results = calloc(nfiles, sizeof(output));
+	pool.done    = calloc(nfiles, sizeof(char));
+	pool.status  = calloc(nfiles, sizeof(int));
+	threads      = calloc(nthreads, sizeof(pthread_t));
+
+	if (!pool.results || !pool.done || !pool.status || !threads) {
+		exit(1);
+	}
+
+	/* Fewer workers only make it slower, unless there are none at all */
+	for (i = 0; i < nthreads; ++i) {
+		if (pthread_create(&threads[started], NULL, _worker, &pool) == 0) {
+			++started;
+		}
+	}
+	if (!started) {
+		status = -1;
+		goto out;
+	}
+
+	for (i = 0; i < nfiles; ++i) {
+		output *res = &pool.results[i];
+
+		pthread_mutex_lock(&pool.lock);
+		while (!pool.done[i]) {
+			pthread_cond_wait(&pool.cond, &pool.lock);
+		}
+		pthread_mutex_unlock(&pool.lock);
+
+		if (res->buf) {
+			fwrite(res->buf, 1, res->len, stdout);
+			output_free(res);
+		}
+
+		if (pool.status[i] == -1) {
+			status = 1;
+		}
+
+		pthread_mutex_lock(&pool.lock);
+		pool.emitted = i + 1;
+		pthread_cond_broadcast(&pool.cond);
+		pthread_mutex_unlock(&pool.lock);
+	}
+
+	for (i = 0; i < started; ++i) {
+		pthread_join(threads[i], NULL);
+	}
+
+	fflush(stdout);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	secs = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+	fprintf(stderr, "rwelf: %zu files in %.3fs (%.1f files/sec)\n",
+		nfiles, secs, secs > 0 ? nfiles / secs : 0.0);
+out:
+	pthread_mutex_destroy(&pool.lock);
+	pthread_cond_destroy(&pool.cond);
+	free(pool.results);
+	free(pool.done);
+	free(pool.status);
+	free(threads);
+
+	return status;
+}
+
+/**
+ * Dumps the files one after the other through rwelf_scan
+ */
+static int _dump_files(char **files, size_t nfiles, int actions,
+	output_format format)
+{
+	_scan_ctx ctx;
+	output out;
+	int status = 0;
+
+	if (output_init(&out, stdout, format) == -1) {
+		exit(1);
+	}
+
+	ctx.out     = &out;
+	ctx.actions = actions;
+	ctx.nfiles  = nfiles;
+
+	if (rwelf_scan((const char *const*) files, nfiles, open_flags,
+			_dump_scanned, &ctx) != 0) {
+		status = 1;
+	}
+
+	output_free(&out);
+
+	return status;
+}
+
+/**
+ * State of the sequential mode with --state, records are the output of
+ * each file
+ */
+typedef struct {
+	output *out;              /* Unbuffered, holds the output of one file */
+	int actions;
+	int nfiles;
+	size_t unchanged;
+	int status;
+} _state_ctx;
+
+static int _dump_incremental(const char *file, rwelf *elf,
+	rwelf_scan_record *rec, void *arg)
+{
+	_state_ctx *ctx = arg;
+
+	if (rec->cached) {
+		fwrite(rec->data, 1, rec->size, stdout);
+		++ctx->unchanged;
+		return 0;
+	}
+
+	output_reset(ctx->out);
+
+	if (_dump_elf(ctx->out, file, elf, ctx->actions, ctx->nfiles) == 0) {
+		rec->data = ctx->out->buf;
+		rec->size = ctx->out->len;
+	} else {
+		ctx->status = 1;
+	}
+	fwrite(ctx->out->buf, 1, ctx->out->len, stdout);
+
+	return 0;
+}
+
+/**
+ * Dumps the files one after the other, reusing the output of the files
+ * unchanged since the last run with the same options (--state option)
+ */
+static int _dump_files_incremental(char **files, size_t nfiles, int actions,
+	output_format format)
+{
+	uint64_t options[] = {
+		1, actions, format, nfiles > 1, sym_filter.types, sym_filter.binds,
+		sym_filter.visibilities, sym_filter.flags, sym_filter.shndx,
+		demangle, hash_flags, size_domain
+	};
+	rwelf_scandb *db;
+	_state_ctx ctx;
+	output out;
+
+	db = rwelf_scandb_open(state_file, rwelf_hash64(options, sizeof(options), 0),
+		state_flags);
+
+	if (!db || output_init(&out, NULL, format) == -1) {
+		exit(1);
+	}
+
+	ctx.out       = &out;
+	ctx.actions   = actions;
+	ctx.nfiles    = nfiles;
+	ctx.unchanged = 0;
+	ctx.status    = 0;
+
+	if (rwelf_scan_incremental(db, (const char *const*) files, nfiles,
+			open_flags, _dump_incremental, &ctx) == -1) {
+		ctx.status = 1;
+	}
+	fflush(stdout);
+
+	rwelf_scandb_prune(db);
+
+	if (rwelf_scandb_save(db, state_file) == -1) {
+		fprintf(stderr, "rwelf: Error: cannot save '%s'\n", state_file);
+		ctx.status = 1;
+	}
+	fprintf(stderr, "rwelf: %zu of %zu files unchanged\n", ctx.unchanged,
+		nfiles);
+
+	rwelf_scandb_close(db);
+	output_free(&out);
+
+	return ctx.status;
+}
+
+/**
+ * Parses the --filter list, items of the same kind are or'ed
+ */
+static int _parse_filter(char *list, rwelf_sym_filter *filter)
+{
+	static const struct {
+		const char *name;
+		uint32_t type, bind;
+		int flags;
+	} items[] = {
+		{ "func",    RWELF_SYMT(STT_FUNC),      0, 0 },
+		{ "object",  RWELF_SYMT(STT_OBJECT),    0, 0 },
+		{ "section", RWELF_SYMT(STT_SECTION),   0, 0 },
+		{ "file",    RWELF_SYMT(STT_FILE),      0, 0 },
+		{ "tls",     RWELF_SYMT(STT_TLS),       0, 0 },
+		{ "ifunc",   RWELF_SYMT(STT_GNU_IFUNC), 0, 0 },
+		{ "local",   0, RWELF_SYMB(STB_LOCAL),  0 },
+		{ "global",  0, RWELF_SYMB(STB_GLOBAL), 0 },
+		{ "weak",    0, RWELF_SYMB(STB_WEAK),   0 },
+		{ "defined", 0, 0, RWELF_SYMF_DEFINED }
+	};
+	char *item;
+	size_t i;
+
+	for (item = strtok(list, ","); item; item = strtok(NULL, ",")) {
+		for (i = 0; i < sizeof(items) / sizeof(items[0]); ++i) {
+			if (strcmp(item, items[i].name) == 0) {
 				break;
+			}
 		}
+		if (i == sizeof(items) / sizeof(items[0])) {
+			fprintf(stderr, "Unknown filter: %s\n", item);
+			return -1;
+		}
+		filter->types |= items[i].type;
+		filter->binds |= items[i].bind;
+		filter->flags |= items[i].flags;
 	}
+	return 0;
+}
+
+static void _usage(void)
+{
+	printf("Usage: rwelf <option(s)> elf-file(s)\n"
+		"  -a                 Equivalent to: -h -S -l -d -r -s\n"
+		"  -h                 Display the ELF file header\n"
+		"  -S                 Display the section headers\n"
+		"  -l                 Display the program headers\n"
+		"  -d                 Display the dynamic section\n"
+		"  -r                 Display the relocations\n"
+		"  -s                 Display the symbol tables\n"
+		"  -E                 Export the symbol tables in columnar format to stdout\n"
+		"  -j N               Process the files on N threads, output keeps the\n"
+		"                     input order\n"
+		"  --format=FORMAT    Output format: text (default), json (one document\n"
+		"                     per file) or ndjson (one record per line)\n"
+		"  --pread            Read the files on demand instead of mapping them\n"
+		"  --filter=LIST      Only show the symbols matching every item of a\n"
+		"                     comma separated list: func, object, section,\n"
+		"                     file, tls, ifunc, local, global, weak, defined\n"
+		"  --demangle         Demangle C++ symbol names\n"
+		"  --plt              Display the PLT stubs and GOT slots of imports\n"
+		"  --deps             Display the shared libraries loaded, as ld.so\n"
+		"                     would find them (LD_LIBRARY_PATH included)\n"
+		"  --bind             Display what the undefined symbols bind to, and\n"
+		"                     the unresolved and interposed symbols of the\n"
+		"                     libraries loaded\n"
+		"  --diff OLD NEW     Display the symbols, sections and dynamic entries\n"
+		"                     added, removed, resized or changed\n"
+		"  --funcs            Display the functions found from the symbols,\n"
+		"                     .eh_frame, the init/fini arrays and the entry\n"
+		"                     point, which works on stripped files\n"
+		"  --hash             Display the XXH64 hash of every section and\n"
+		"                     function, for deduplication\n"
+		"  --mask-relocs      Hash the bytes patched by relocations as zeros\n"
+		"  --size[=DOMAIN]    Display the file and VM bytes by segments,\n"
+		"                     sections (default), symbols or units (compile\n"
+		"                     units, needs DWARF)\n"
+		"  --stats            Display the library counters of every file, and\n"
+		"                     of the whole run on stderr (needs a library built\n"
+		"                     with make DEFS=-DRWELF_STATS)\n"
+		"  --rebuild-strtab=OUT\n"
+		"                     Write to OUT a copy of the file whose .strtab,\n"
+		"                     .dynstr and .shstrtab only hold the names in use,\n"
+		"                     once, with shared tails merged\n"
+		"  --state=FILE       Keep the output of every file in FILE and reuse\n"
+		"                     it while the file is unchanged (not with -j, -E,\n"
+		"                     --deps or --bind)\n"
+		"  --state-build-id   With --state, also reuse the output of a file\n"
+		"                     rewritten with the same size and build-id, which\n"
+		"                     is stale when the build-id is not derived from\n"
+		"                     the whole contents\n"
+		"Eg. rwelf -h -S /bin/ls\n");
 }
 
 /**
- * Displays the program header information (-l option)
+ * Parses the domain of --size
  */
-static void _show_elf_pheaders(const Elf_Ehdr *ehdr)
+static int _parse_domain(const char *str)
 {
-	const rwelf *elf = ehdr->elf;
-	int i, num_phdrs;
-	
-	num_phdrs = rwelf_num_pheaders(ehdr);
-	
-	for (i = 0; i < num_phdrs; ++i) {
-		Elf_Phdr phdr;
-				
-		rwelf_get_pheader_by_num(elf, i, &phdr);
-	
-		printf("Type: %s\n", rwelf_get_pheader_type_name(&phdr));
+	static const struct { const char *name; int domain; } domains[] = {
+		{ "segments", RWELF_SIZE_SEGMENTS }, { "sections", RWELF_SIZE_SECTIONS },
+		{ "symbols", RWELF_SIZE_SYMBOLS }, { "units", RWELF_SIZE_UNITS }
+	};
+	size_t i;
+
+	for (i = 0; i < sizeof(domains) / sizeof(domains[0]); ++i) {
+		if (strcmp(str, domains[i].name) == 0) {
+			return domains[i].domain;
+		}
 	}
+	return -1;
 }
 
+static const struct option long_options[] = {
+	{ "format", required_argument, NULL, 'F' },
+	{ "pread",  no_argument,       NULL, 'P' },
+	{ "filter", required_argument, NULL, 'f' },
+	{ "demangle", no_argument,     NULL, 'C' },
+	{ "plt",    no_argument,       NULL, 'T' },
+	{ "deps",   no_argument,       NULL, 'D' },
+	{ "bind",   no_argument,       NULL, 'B' },
+	{ "diff",   no_argument,       NULL, 'X' },
+	{ "funcs",  no_argument,       NULL, 'R' },
+	{ "hash",   no_argument,       NULL, 'H' },
+	{ "mask-relocs", no_argument,  NULL, 'M' },
+	{ "state",  required_argument, NULL, 'W' },
+	{ "state-build-id", no_argument, NULL, 'G' },
+	{ "stats",  no_argument,       NULL, 'I' },
+	{ "size",   optional_argument, NULL, 'Z' },
+	{ "rebuild-strtab", required_argument, NULL, 'K' },
+	{ NULL, 0, NULL, 0 }
+};
+
 int main(int argc, char **argv)
 {
-	int action, c, i;
-	const char *file;
-	Elf_Ehdr ehdr;
-	rwelf *elf;
-	
-	while ((c = getopt(argc, argv, "h:l:S:s:r:")) != -1) {
+	int actions = 0, status = 0, nthreads = 1, c;
+	output_format format = OUTPUT_TEXT;
+
+	while ((c = getopt_long(argc, argv, "ahlSsrdEj:", long_options, NULL)) != -1) {
 		switch (c) {
-			case 'h': /* Header */
-			case 'l': /* Program header */
-			case 'r': /* Relocation */
-			case 'S': /* Sections */
-			case 's': /* Symbol table */
-				file = optarg;
-				action = c;
+			case 'a': actions |= ACTION_ALL;         break; /* All */
+			case 'h': actions |= ACTION_HEADER;      break; /* Header */
+			case 'l': actions |= ACTION_PHEADERS;    break; /* Program header */
+			case 'r': actions |= ACTION_RELOCATIONS; break; /* Relocation */
+			case 'S': actions |= ACTION_SECTIONS;    break; /* Sections */
+			case 's': actions |= ACTION_SYMBOLS;     break; /* Symbol table */
+			case 'd': actions |= ACTION_DYNAMIC;     break; /* Dynamic section */
+			case 'E': actions |= ACTION_EXPORT;      break; /* Symbol export */
+			case 'j': /* Parallel mode */
+				if ((nthreads = atoi(optarg)) < 1) {
+					fprintf(stderr, "Invalid number of threads: %s\n", optarg);
+					return 1;
+				}
 				break;
-			default:
+			case 'F': /* Output format */
+				if (strcmp(optarg, "json") == 0) {
+					format = OUTPUT_JSON;
+				} else if (strcmp(optarg, "ndjson") == 0) {
+					format = OUTPUT_NDJSON;
+				} else if (strcmp(optarg, "text") == 0) {
+					format = OUTPUT_TEXT;
+				} else {
+					fprintf(stderr, "Unknown format: %s\n", optarg);
+					return 1;
+				}
+				break;
+			case 'f': /* Symbol filter */
+				if (_parse_filter(optarg, &sym_filter) == -1) {
+					return 1;
+				}
+				break;
+			case 'T': actions |= ACTION_PLT;         break; /* PLT/GOT map */
+			case 'D': actions |= ACTION_DEPS;        break; /* Dependencies */
+			case 'B': actions |= ACTION_BIND;        break; /* Symbol binding */
+			case 'X': actions |= ACTION_DIFF;        break; /* Structural diff */
+			case 'R': actions |= ACTION_FUNCS;       break; /* Function recovery */
+			case 'H': actions |= ACTION_HASH;        break; /* Content hashes */
+			case 'I': actions |= ACTION_STATS;       break; /* Counters */
+			case 'M': /* Relocation masking */
+				hash_flags |= RWELF_HASH_MASK_RELOCS;
+				break;
+			case 'C': /* C++ demangling */
+				demangle = 1;
+				break;
+			case 'Z': /* Size profile */
+				actions |= ACTION_SIZE;
+
+				if (optarg && (size_domain = _parse_domain(optarg)) == -1) {
+					fprintf(stderr, "Unknown size domain: %s\n", optarg);
+					return 1;
+				}
+				break;
+			case 'K': /* String table rebuilding */
+				strtab_file = optarg;
+				break;
+			case 'W': /* Scan-state database */
+				state_file = optarg;
+				break;
+			case 'G': /* Build-id matching of the state database */
+				state_flags |= RWELF_SCANDB_BUILD_ID;
+				break;
+			case 'P': /* pread backend */
+				open_flags |= RWELF_OPEN_PREAD;
 				break;
-		}		
+			default:
+				_usage();
+				return 1;
+		}
 	}
-	
-	if (!file || !c) {
-	  printf("You have to specific options and an ELF file.\n");
-	  printf("Eg. rwelf -h /bin/ls\n");
-	  return 0;
+
+	if (strtab_file) {
+		if (argc - optind != 1) {
+			_usage();
+			return 1;
+		}
+		return _rebuild_strtabs(argv[optind], strtab_file, format);
 	}
-	
-	if (!(elf = rwelf_open(file))) {
+
+	if (!actions || optind >= argc) {
+		_usage();
+		return 0;
+	}
+
+	/* The export is a binary stream, nothing else may go to stdout */
+	if ((actions & ACTION_EXPORT) && actions != ACTION_EXPORT) {
+		fprintf(stderr, "-E cannot be used with other actions\n");
+		return 1;
+	}
+
+	if (actions & ACTION_DIFF) {
+		if (argc - optind != 2) {
+			_usage();
+			return 1;
+		}
+		return _diff_files(argv[optind], argv[optind + 1], format);
+	}
+
+	if (state_file
+		&& (nthreads > 1 || (actions & (ACTION_EXPORT | ACTION_DEPS | ACTION_BIND)))) {
+		fprintf(stderr, "--state cannot be used with -j, -E, --deps or --bind\n");
+		return 1;
+	}
+
+	if ((actions & (ACTION_DEPS | ACTION_BIND))
+		&& (resolver = rwelf_resolver_create(RWELF_RESOLVE_ENV)) == NULL) {
 		exit(1);
 	}
-	rwelf_get_header(elf, &ehdr);
 
-	switch (action) {
-		case 'l':
-			_show_elf_pheaders(&ehdr);
-			break;
-		case 'h':
-			_show_elf_header(&ehdr);
-			break;
-		case 'r':
-			_show_elf_relocations(&ehdr);
-			break;
-		case 'S':
-			_show_elf_sections(&ehdr);
-			break;
-		case 's':
-			_show_elf_symbols(elf);
-			break;
+	if (state_file) {
+		status = _dump_files_incremental(argv + optind, argc - optind, actions,
+			format);
+	} else if (nthreads > 1) {
+		status = _dump_files_parallel(argv + optind, argc - optind, actions,
+			format, nthreads);
+
+		if (status == -1) {
+			fprintf(stderr, "rwelf: cannot start workers, dumping serially\n");
+			status = _dump_files(argv + optind, argc - optind, actions, format);
+		}
+	} else {
+		status = _dump_files(argv + optind, argc - optind, actions, format);
 	}
-	
-	rwelf_close(elf);	
-	
+
+	if (resolver) {
+		rwelf_resolver_destroy(resolver);
+	}
+
+	if (actions & ACTION_STATS) {
+		_show_global_stats();
+	}
+
 	/*
 
 	
@@ -223,5 +1888,5 @@ int main(int argc, char **argv)
 
 	
 */
-	return 0;
+	return status;
 }
@@ -0,0 +1,430 @@
+/**
+ * rwelf
+ * Copyright (c) 2012-2013 Felipe Pena <felipensp(at)gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "output.h"
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * Makes room for at least n bytes, flushing the buffer when the writer
+ * has a stream and growing it when it does not
+ */
+static void _reserve(output *out, size_t n)
+{
+	if (out->len + n <= out->cap) {
+		return;
+	}
+	if (out->fp) {
+		output_flush(out);
+	}
+	if (out->len + n > out->cap) {
+		size_t cap = out->cap * 2;
+		char *buf;
+
+		while (cap < out->len + n) {
+			cap *= 2;
+		}
+		if ((buf = realloc(out->buf, cap)) == NULL) {
+			abort();
+		}
+		out->buf = buf;
+		out->cap = cap;
+	}
+}
+
+static void _put(output *out, const char *s, size_t len)
+{
+	_reserve(out, len);
+	memcpy(out->buf + out->len, s, len);
+	out->len += len;
+}
+
+#define _PUTS(_out, _s) _put(_out, _s, sizeof(_s) - 1)
+
+/**
+ * Length of the well formed UTF-8 sequence at p (no overlong forms, no
+ * surrogates, nothing past U+10FFFF), 0 when it is not one
+ */
+static size_t _utf8_len(const unsigned char *p)
+{
+	unsigned char lo = 0x80, hi = 0xbf;
+	size_t n, i;
+
+	if (*p >= 0xc2 && *p <= 0xdf) {
+		n = 2;
+	} else if (*p >= 0xe0 && *p <= 0xef) {
+		n = 3;
+		lo = *p == 0xe0 ? 0xa0 : 0x80;
+		hi = *p == 0xed ? 0x9f : 0xbf;
+	} else if (*p >= 0xf0 && *p <= 0xf4) {
+		n = 4;
+		lo = *p == 0xf0 ? 0x90 : 0x80;
+		hi = *p == 0xf4 ? 0x8f : 0xbf;
+	} else {
+		return 0;
+	}
+
+	/* The NUL terminator fails the range check, so this stops there */
+	for (i = 1; i < n; ++i, lo = 0x80, hi = 0xbf) {
+		if (p[i] < lo || p[i] > hi) {
+			return 0;
+		}
+	}
+	return n;
+}
+
+/**
+ * Writes s as a JSON string. Bytes that are not valid UTF-8, as found in
+ * names of arbitrary files, are escaped one by one as \u00XX
+ */
+static void _put_json_str(output *out, const char *s)
+{
+	static const char hex[] = "0123456789abcdef";
+	const unsigned char *p = (const unsigned char*) s;
+
+	_PUTS(out, "\"");
+
+	while (*p) {
+		const unsigned char *start = p;
+
+		/* Copy runs of plain characters and valid UTF-8 at once */
+		for (;;) {
+			size_t n;
+
+			if (*p >= 0x20 && *p < 0x80 && *p != '"' && *p != '\\') {
+				++p;
+			} else if (*p >= 0x80 && (n = _utf8_len(p)) != 0) {
+				p += n;
+			} else {
+				break;
+			}
+		}
+		if (p > start) {
+			_put(out, (const char*) start, p - start);
+		}
+		if (!*p) {
+			break;
+		}
+
+		switch (*p) {
+			case '"':  _PUTS(out, "\\\""); break;
+			case '\\': _PUTS(out, "\\\\"); break;
+			case '\n': _PUTS(out, "\\n");  break;
+			case '\t': _PUTS(out, "\\t");  break;
+			default: {
+				char esc[6] = { '\\', 'u', '0', '0', hex[*p >> 4], hex[*p & 0xf] };
+				_put(out, esc, sizeof(esc));
+			}
+		}
+		++p;
+	}
+	_PUTS(out, "\"");
+}
+
+static void _put_uint(output *out, uint64_t v)
+{
+	char tmp[20];
+	int n = sizeof(tmp);
+
+	do {
+		tmp[--n] = '0' + v % 10;
+		v /= 10;
+	} while (v);
+
+	_put(out, tmp + n, sizeof(tmp) - n);
+}
+
+static void _put_hex(output *out, uint64_t v)
+{
+	static const char hex[] = "0123456789abcdef";
+	char tmp[18];
+	int n = sizeof(tmp);
+
+	do {
+		tmp[--n] = hex[v & 0xf];
+		v >>= 4;
+	} while (v);
+
+	tmp[--n] = 'x';
+	tmp[--n] = '0';
+
+	_put(out, tmp + n, sizeof(tmp) - n);
+}
+
+/**
+ * Writes the key of a field, taking care of the separators
+ */
+static void _key(output *out, const char *key)
+{
+	if (out->nfields++) {
+		_PUTS(out, ",");
+	}
+	_put_json_str(out, key);
+	_PUTS(out, ":");
+}
+
+/**
+ * output_init(output*, FILE*, output_format)
+ * Initializes the writer. When fp is NULL the output is kept in memory
+ */
+int output_init(output *out, FILE *fp, output_format format)
+{
+	memset(out, 0, sizeof(output));
+
+	out->fp     = fp;
+	out->format = format;
+	out->cap    = OUTPUT_BUFSIZE;
+
+	if ((out->buf = malloc(out->cap)) == NULL) {
+		return -1;
+	}
+	return 0;
+}
+
+/**
+ * output_free(output*)
+ * Flushes and releases the writer
+ */
+void output_free(output *out)
+{
+	output_flush(out);
+	free(out->buf);
+	out->buf = NULL;
+}
+
+/**
+ * output_flush(output*)
+ * Writes the buffered output to the stream
+ */
+void output_flush(output *out)
+{
+	if (out->fp && out->len) {
+		fwrite(out->buf, 1, out->len, out->fp);
+		out->len = 0;
+	}
+}
+
+/**
+ * output_reset(output*)
+ * Discards the buffered output
+ */
+void output_reset(output *out)
+{
+	out->len = 0;
+}
+
+/**
+ * output_write(output*, const void*, size_t)
+ * Copies raw bytes into the buffer
+ */
+void output_write(output *out, const void *data, size_t len)
+{
+	_put(out, data, len);
+}
+
+/**
+ * output_printf(output*, const char*, ...)
+ * Formats free text into the buffer
+ */
+void output_printf(output *out, const char *fmt, ...)
+{
+	va_list args;
+	int n;
+
+	va_start(args, fmt);
+	n = vsnprintf(out->buf + out->len, out->cap - out->len, fmt, args);
+	va_end(args);
+
+	if (n < 0) {
+		return;
+	}
+	if (out->len + n >= out->cap) {
+		_reserve(out, n + 1);
+
+		va_start(args, fmt);
+		vsnprintf(out->buf + out->len, out->cap - out->len, fmt, args);
+		va_end(args);
+	}
+	out->len += n;
+}
+
+/**
+ * output_file_begin(output*, const char*)
+ * Starts the output related to a file
+ */
+void output_file_begin(output *out, const char *file)
+{
+	out->file = file;
+	out->nviews = 0;
+
+	if (out->format == OUTPUT_JSON) {
+		_PUTS(out, "{\"file\":");
+		_put_json_str(out, file);
+	}
+}
+
+/**
+ * output_file_end(output*)
+ * Finishes the output related to a file
+ */
+void output_file_end(output *out)
+{
+	if (out->format == OUTPUT_JSON) {
+		_PUTS(out, "}\n");
+	}
+}
+
+/**
+ * output_view_begin(output*, const char*, int)
+ * Starts a view (header, sections, ...) which is either a list of
+ * records or a single record
+ */
+void output_view_begin(output *out, const char *view, int is_list)
+{
+	out->view = view;
+	out->nrecords = is_list ? 0 : -1;
+
+	if (out->format == OUTPUT_JSON) {
+		_PUTS(out, ",");
+		_put_json_str(out, view);
+		if (is_list) {
+			_PUTS(out, ":[");
+		} else {
+			_PUTS(out, ":");
+		}
+	}
+	++out->nviews;
+}
+
+/**
+ * output_view_end(output*)
+ * Finishes the current view
+ */
+void output_view_end(output *out)
+{
+	if (out->format == OUTPUT_JSON && out->nrecords != -1) {
+		_PUTS(out, "]");
+	}
+}
+
+/**
+ * output_record_begin(output*)
+ * Starts a record of the current view
+ */
+void output_record_begin(output *out)
+{
+	out->nfields = 0;
+
+	switch (out->format) {
+		case OUTPUT_JSON:
+			if (out->nrecords > 0) {
+				_PUTS(out, ",");
+			}
+			_PUTS(out, "{");
+			break;
+		case OUTPUT_NDJSON:
+			_PUTS(out, "{");
+			output_str(out, "file", out->file);
+			output_str(out, "kind", out->view);
+			break;
+		default:
+			break;
+	}
+	if (out->nrecords != -1) {
+		++out->nrecords;
+	}
+}
+
+/**
+ * output_record_end(output*)
+ * Finishes the current record
+ */
+void output_record_end(output *out)
+{
+	switch (out->format) {
+		case OUTPUT_JSON:
+			_PUTS(out, "}");
+			break;
+		case OUTPUT_NDJSON:
+			_PUTS(out, "}\n");
+			break;
+		default:
+			break;
+	}
+}
+
+/**
+ * output_str(output*, const char*, const char*)
+ * Writes a string field, NULL is written as null
+ */
+void output_str(output *out, const char *key, const char *value)
+{
+	_key(out, key);
+
+	if (value) {
+		_put_json_str(out, value);
+	} else {
+		_PUTS(out, "null");
+	}
+}
+
+/**
+ * output_uint(output*, const char*, uint64_t)
+ * Writes an unsigned numeric field
+ */
+void output_uint(output *out, const char *key, uint64_t value)
+{
+	_key(out, key);
+	_put_uint(out, value);
+}
+
+/**
+ * output_int(output*, const char*, int64_t)
+ * Writes a signed numeric field
+ */
+void output_int(output *out, const char *key, int64_t value)
+{
+	_key(out, key);
+
+	if (value < 0) {
+		_PUTS(out, "-");
+		_put_uint(out, -(uint64_t) value);
+	} else {
+		_put_uint(out, value);
+	}
+}
+
+/**
+ * output_hex(output*, const char*, uint64_t)
+ * Writes an address-like field as a hexadecimal string
+ */
+void output_hex(output *out, const char *key, uint64_t value)
+{
+	_key(out, key);
+	_PUTS(out, "\"");
+	_put_hex(out, value);
+	_PUTS(out, "\"");
+}
@@ -0,0 +1,79 @@
+/**
+ * rwelf
+ * Copyright (c) 2012-2013 Felipe Pena <felipensp(at)gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef RWELF_OUTPUT_H
+#define RWELF_OUTPUT_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#define OUTPUT_BUFSIZE (256 * 1024)
+
+typedef enum {
+	OUTPUT_TEXT,
+	OUTPUT_JSON,
+	OUTPUT_NDJSON
+} output_format;
+
+/**
+ * Buffered writer used by every view of the tool. Records are formatted
+ * straight into the buffer, which is written with a single fwrite() when
+ * it fills up or when output_flush() is called
+ */
+typedef struct {
+	FILE *fp;
+	output_format format;
+	char *buf;
+	size_t len;
+	size_t cap;
+	const char *file;         /* File being dumped */
+	const char *view;         /* Current view (NDJSON "kind") */
+	int nviews;               /* Views written for the current file */
+	int nrecords;             /* Records written for the current view */
+	int nfields;              /* Fields written for the current record */
+} output;
+
+extern int output_init(output*, FILE*, output_format);
+extern void output_free(output*);
+extern void output_flush(output*);
+extern void output_reset(output*);
+
+extern void output_write(output*, const void*, size_t);
+extern void output_printf(output*, const char*, ...)
+	__attribute__((format(printf, 2, 3)));
+
+extern void output_file_begin(output*, const char*);
+extern void output_file_end(output*);
+extern void output_view_begin(output*, const char*, int);
+extern void output_view_end(output*);
+extern void output_record_begin(output*);
+extern void output_record_end(output*);
+
+extern void output_str(output*, const char*, const char*);
+extern void output_uint(output*, const char*, uint64_t);
+extern void output_int(output*, const char*, int64_t);
+extern void output_hex(output*, const char*, uint64_t);
+
+#endif /* RWELF_OUTPUT_H */
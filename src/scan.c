@@ -0,0 +1,707 @@
+/**
+ * rwelf
+ * Copyright (c) 2012-2013 Felipe Pena <felipensp(at)gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "rwelf.h"
+#include <sys/stat.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * Bulk scanning
+ *
+ * Opening a file through rwelf_open costs open, fstat, mmap, munmap and
+ * close plus the page faults on the mapping, which dominates when the
+ * files are small (object files) and only headers are looked at. The scan
+ * reads the head of each file with a single pread into a buffer reused
+ * across files, closes the descriptor right away and parses the buffer in
+ * place, so a file that fits in RWELF_SCAN_HEAD costs three syscalls.
+ * Larger files are opened again with rwelf_open_flags. Handles come from
+ * a pool private to the call, so there are no allocations per file once
+ * the pool is warm.
+ *
+ * rwelf_scan_incremental adds a scan-state database on top: each file is
+ * stat()ed first and, when its device, inode, size and modification time
+ * match the previous scan, the record the caller produced back then is
+ * handed out again without opening the file. Optionally the build-id is
+ * kept too, so files rewritten with the same contents (reinstalled
+ * packages) are recognized once opened. The database is loaded in one
+ * read and saved through a temporary file renamed over the old one; the
+ * entries loaded point into that single buffer.
+ *
+ *   header:    "RWSD", version (1 byte), EI_DATA of the host (1 byte),
+ *              2 bytes reserved, caller key (8 bytes), count (8 bytes)
+ *   per entry: dev, ino, size, mtime sec, mtime nsec (8 bytes each),
+ *              path size (4 bytes, NUL included), build-id size (4 bytes),
+ *              record size (8 bytes), path, build-id, record,
+ *              padding up to 8 bytes
+ */
+
+#define RWELF_SCANDB_MAGIC   "RWSD"
+#define RWELF_SCANDB_VERSION 1
+
+typedef struct {
+	uint64_t dev;
+	uint64_t ino;
+	uint64_t size;
+	uint64_t mtime_sec;
+	uint64_t mtime_nsec;
+} _db_key;
+
+typedef struct {
+	_db_key key;
+	const char *path;
+	const unsigned char *build_id;
+	uint32_t build_id_size;
+	const void *data;
+	uint64_t size;
+	void *block;              /* Holds path, build-id and record, or NULL */
+	int seen;                 /* Visited since the database was opened */
+	int removed;
+} _db_entry;
+
+struct rwelf_scandb {
+	uint64_t key;
+	int flags;
+	unsigned char *file;      /* Loaded database, entries point into it */
+	_db_entry *entries;
+	size_t nentries;
+	size_t cap;
+	size_t live;
+	size_t *slots;            /* Entry number + 1 by path hash, 0 is empty */
+	size_t nslots;
+};
+
+/**
+ * Reads up to size bytes from the start of the file. Returns the number of
+ * bytes read, or -1 when the file cannot be pread (e.g. pipes)
+ */
+static ssize_t _read_head(int fd, unsigned char *buf, size_t size)
+{
+	size_t len = 0;
+
+	while (len < size) {
+		ssize_t n = pread(fd, buf + len, size - len, len);
+
+		if (n == -1 && errno == EINTR) {
+			continue;
+		}
+		if (n == -1) {
+			return -1;
+		}
+		if (n == 0) {
+			break;
+		}
+		len += n;
+	}
+	return len;
+}
+
+/**
+ * Opens a file the way rwelf_scan does, buf holds RWELF_SCAN_HEAD bytes
+ */
+static rwelf *_scan_open(rwelf_pool *pool, unsigned char *buf,
+	const char *file, int flags)
+{
+	rwelf *elf = NULL;
+	ssize_t n = -1;
+	int fd;
+
+	if ((fd = open(file, O_RDONLY | O_CLOEXEC)) != -1) {
+		n = _read_head(fd, buf, RWELF_SCAN_HEAD);
+		close(fd);
+	}
+
+	if (n >= 0 && n < RWELF_SCAN_HEAD) {
+		if ((elf = rwelf_pool_open_memory(pool, buf, n)) != NULL) {
+			elf->fname = rwelf_arena_strdup(elf, file);
+			elf->flags = flags;
+		}
+	} else if (fd != -1) {
+		/* Too large for the buffer, or not a regular file */
+		elf = rwelf_pool_open(pool, file, flags);
+	}
+	return elf;
+}
+
+/**
+ * rwelf_scan(const char *const*, size_t, int, int (*)(const char*,
+ *   rwelf*, void*), void*)
+ * Opens the files one after another calling cb for each of them, with a
+ * NULL handle when the file is not a readable ELF file. The handle is only
+ * valid during the call, which may build indexes on it, and has no
+ * modification time. Files larger than RWELF_SCAN_HEAD are opened with the
+ * given RWELF_OPEN_* flags. Scanning stops when cb returns non-zero.
+ * Returns the number of files that could not be opened, or -1 on
+ * allocation failure
+ */
+int rwelf_scan(const char *const *files, size_t nfiles, int flags,
+	int (*cb)(const char*, rwelf*, void*), void *arg)
+{
+	unsigned char *buf;
+	rwelf_pool *pool;
+	int failed = 0, stop = 0;
+	size_t i;
+
+	assert(files != NULL);
+	assert(cb != NULL);
+
+	buf  = malloc(RWELF_SCAN_HEAD);
+	pool = rwelf_pool_create();
+
+	if (!buf || !pool) {
+		free(buf);
+		if (pool) {
+			rwelf_pool_destroy(pool);
+		}
+		return -1;
+	}
+
+	for (i = 0; i < nfiles && !stop; ++i) {
+		rwelf *elf = _scan_open(pool, buf, files[i], flags);
+
+		if (!elf) {
+			++failed;
+		}
+
+		stop = cb(files[i], elf, arg);
+
+		if (elf) {
+			rwelf_close(elf);
+		}
+	}
+
+	rwelf_pool_destroy(pool);
+	free(buf);
+
+	return failed;
+}
+
+static uint64_t _path_hash(const char *path)
+{
+	return rwelf_hash64(path, strlen(path), 0);
+}
+
+/**
+ * Returns the entry of the path, or the empty slot where it belongs
+ */
+static size_t *_db_slot(const rwelf_scandb *db, const char *path)
+{
+	size_t i = _path_hash(path) & (db->nslots - 1);
+
+	while (db->slots[i]) {
+		if (strcmp(db->entries[db->slots[i] - 1].path, path) == 0) {
+			break;
+		}
+		i = (i + 1) & (db->nslots - 1);
+	}
+	return &db->slots[i];
+}
+
+static int _db_grow(rwelf_scandb *db)
+{
+	size_t nslots = db->nslots ? db->nslots * 2 : 1024, i;
+	size_t *slots = calloc(nslots, sizeof(size_t)), *old = db->slots;
+
+	if (!slots) {
+		return -1;
+	}
+	db->slots  = slots;
+	db->nslots = nslots;
+
+	for (i = 0; i < db->nentries; ++i) {
+		*_db_slot(db, db->entries[i].path) = i + 1;
+	}
+	free(old);
+
+	return 0;
+}
+
+/**
+ * Appends an entry, the strings must outlive it. Returns NULL when out of
+ * memory
+ */
+static _db_entry *_db_add(rwelf_scandb *db, const char *path)
+{
+	_db_entry *e;
+
+	if ((db->nentries + 1) * 2 > db->nslots && _db_grow(db) == -1) {
+		return NULL;
+	}
+	if (db->nentries == db->cap) {
+		size_t cap = db->cap ? db->cap * 2 : 1024;
+		_db_entry *entries = realloc(db->entries, cap * sizeof(_db_entry));
+
+		if (!entries) {
+			return NULL;
+		}
+		db->entries = entries;
+		db->cap = cap;
+	}
+	e = &db->entries[db->nentries];
+	memset(e, 0, sizeof(_db_entry));
+	e->path = path;
+
+	*_db_slot(db, path) = ++db->nentries;
+	++db->live;
+
+	return e;
+}
+
+static _db_entry *_db_find(const rwelf_scandb *db, const char *path)
+{
+	size_t slot;
+
+	if (!db->nslots || (slot = *_db_slot(db, path)) == 0) {
+		return NULL;
+	}
+	return &db->entries[slot - 1];
+}
+
+/**
+ * Replaces the contents of an entry, copying the path, build-id and record
+ * into a block of their own
+ */
+static int _db_set(rwelf_scandb *db, const char *path, const _db_key *key,
+	const unsigned char *build_id, size_t build_id_size, const void *data,
+	size_t size)
+{
+	size_t len = strlen(path) + 1;
+	_db_entry *e = _db_find(db, path);
+	unsigned char *block;
+
+	if ((block = malloc(len + build_id_size + size)) == NULL) {
+		return -1;
+	}
+	if (!e && (e = _db_add(db, path)) == NULL) {
+		free(block);
+		return -1;
+	}
+	free(e->block);
+
+	memcpy(block, path, len);
+	if (build_id_size) {
+		memcpy(block + len, build_id, build_id_size);
+	}
+	if (size) {
+		memcpy(block + len + build_id_size, data, size);
+	}
+
+	if (e->removed) {
+		e->removed = 0;
+		++db->live;
+	}
+	e->key           = *key;
+	e->path          = (const char*) block;
+	e->build_id      = block + len;
+	e->build_id_size = build_id_size;
+	e->data          = block + len + build_id_size;
+	e->size          = size;
+	e->block         = block;
+	e->seen          = 1;
+
+	return 0;
+}
+
+static void _db_remove(rwelf_scandb *db, _db_entry *e)
+{
+	if (!e->removed) {
+		e->removed = 1;
+		--db->live;
+	}
+}
+
+/**
+ * Reads the whole database file, returns its size or -1
+ */
+static ssize_t _db_read(const char *path, unsigned char **buf)
+{
+	struct stat st;
+	ssize_t len;
+	int fd;
+
+	*buf = NULL;
+
+	if ((fd = open(path, O_RDONLY | O_CLOEXEC)) == -1) {
+		return -1;
+	}
+	if (fstat(fd, &st) == -1 || (*buf = malloc(st.st_size + 1)) == NULL
+		|| (len = _read_head(fd, *buf, st.st_size)) != st.st_size) {
+		close(fd);
+		free(*buf);
+		*buf = NULL;
+		return -1;
+	}
+	close(fd);
+
+	return len;
+}
+
+/**
+ * Indexes the entries of a loaded database. Stops at the first entry that
+ * does not fit, keeping the ones before it
+ */
+static int _db_load(rwelf_scandb *db, size_t len)
+{
+	const unsigned char *p = db->file, *end = db->file + len;
+	uint16_t probe = 1;
+	uint64_t key, count, i;
+
+	if (len < 24 || memcmp(p, RWELF_SCANDB_MAGIC, 4) != 0
+		|| p[4] != RWELF_SCANDB_VERSION
+		|| p[5] != (*(unsigned char*)&probe ? ELFDATA2LSB : ELFDATA2MSB)) {
+		return -1;
+	}
+	memcpy(&key, p + 8, sizeof(key));
+	memcpy(&count, p + 16, sizeof(count));
+
+	if (key != db->key) {
+		return -1;
+	}
+	p += 24;
+
+	for (i = 0; i < count; ++i) {
+		_db_key k;
+		uint32_t path_size, build_id_size;
+		uint64_t size, total;
+		_db_entry *e;
+
+		if ((size_t)(end - p) < sizeof(k) + 16) {
+			break;
+		}
+		memcpy(&k, p, sizeof(k));
+		memcpy(&path_size, p + sizeof(k), 4);
+		memcpy(&build_id_size, p + sizeof(k) + 4, 4);
+		memcpy(&size, p + sizeof(k) + 8, 8);
+		p += sizeof(k) + 16;
+
+		total = (uint64_t) path_size + build_id_size;
+
+		if (!path_size || size > (uint64_t)(end - p) || total > (uint64_t)(end - p) - size
+			|| p[path_size - 1] != '\0' || _db_find(db, (const char*) p)) {
+			break;
+		}
+		if ((e = _db_add(db, (const char*) p)) == NULL) {
+			return -1;
+		}
+		e->key           = k;
+		e->build_id      = p + path_size;
+		e->build_id_size = build_id_size;
+		e->data          = p + total;
+		e->size          = size;
+
+		p += (total + size + 7) & ~(uint64_t) 7;
+
+		if (p > end) {
+			break;
+		}
+	}
+	return 0;
+}
+
+/**
+ * rwelf_scandb_open(const char*, uint64_t, int)
+ * Loads the scan-state database saved at path. The key identifies what
+ * the records hold (e.g. a hash of the options they were produced with);
+ * a database saved with another key, or missing, unreadable or corrupt,
+ * starts empty. flags may be RWELF_SCANDB_BUILD_ID. Returns NULL when out
+ * of memory
+ */
+rwelf_scandb *rwelf_scandb_open(const char *path, uint64_t key, int flags)
+{
+	rwelf_scandb *db;
+	ssize_t len;
+
+	if ((db = calloc(1, sizeof(rwelf_scandb))) == NULL) {
+		return NULL;
+	}
+	db->key   = key;
+	db->flags = flags;
+
+	if (path && (len = _db_read(path, &db->file)) != -1
+		&& _db_load(db, len) == -1) {
+		size_t i;
+
+		/* Drop whatever was indexed before the failure */
+		for (i = 0; i < db->nentries; ++i) {
+			free(db->entries[i].block);
+		}
+		free(db->entries);
+		free(db->slots);
+		free(db->file);
+		memset(db, 0, sizeof(rwelf_scandb));
+		db->key   = key;
+		db->flags = flags;
+	}
+	return db;
+}
+
+/**
+ * rwelf_scandb_close(rwelf_scandb*)
+ * Releases the database without saving it
+ */
+void rwelf_scandb_close(rwelf_scandb *db)
+{
+	size_t i;
+
+	assert(db != NULL);
+
+	for (i = 0; i < db->nentries; ++i) {
+		free(db->entries[i].block);
+	}
+	free(db->entries);
+	free(db->slots);
+	free(db->file);
+	free(db);
+}
+
+/**
+ * rwelf_scandb_save(const rwelf_scandb*, const char*)
+ * Writes the database to a temporary file next to path and renames it
+ * over path, so a crash never leaves a truncated database behind. Returns
+ * -1 on failure
+ */
+int rwelf_scandb_save(const rwelf_scandb *db, const char *path)
+{
+	static const unsigned char zero[8];
+	unsigned char hdr[24] = {0};
+	uint64_t count = db->live;
+	uint16_t probe = 1;
+	char *tmp;
+	FILE *fp;
+	size_t i;
+	int ret;
+
+	assert(db != NULL);
+	assert(path != NULL);
+
+	if ((tmp = malloc(strlen(path) + 32)) == NULL) {
+		return -1;
+	}
+	sprintf(tmp, "%s.tmp.%ld", path, (long) getpid());
+
+	if ((fp = fopen(tmp, "wb")) == NULL) {
+		free(tmp);
+		return -1;
+	}
+
+	memcpy(hdr, RWELF_SCANDB_MAGIC, 4);
+	hdr[4] = RWELF_SCANDB_VERSION;
+	hdr[5] = *(unsigned char*)&probe ? ELFDATA2LSB : ELFDATA2MSB;
+	memcpy(hdr + 8, &db->key, sizeof(db->key));
+	memcpy(hdr + 16, &count, sizeof(count));
+	fwrite(hdr, 1, sizeof(hdr), fp);
+
+	for (i = 0; i < db->nentries; ++i) {
+		const _db_entry *e = &db->entries[i];
+		uint32_t path_size = strlen(e->path) + 1;
+		uint64_t total = path_size + e->build_id_size + e->size;
+
+		if (e->removed) {
+			continue;
+		}
+		fwrite(&e->key, 1, sizeof(e->key), fp);
+		fwrite(&path_size, 1, 4, fp);
+		fwrite(&e->build_id_size, 1, 4, fp);
+		fwrite(&e->size, 1, 8, fp);
+		fwrite(e->path, 1, path_size, fp);
+		fwrite(e->build_id, 1, e->build_id_size, fp);
+		fwrite(e->data, 1, e->size, fp);
+		fwrite(zero, 1, -total & 7, fp);
+	}
+
+	ret = ferror(fp) ? -1 : 0;
+
+	if (fclose(fp) != 0) {
+		ret = -1;
+	}
+	if (ret == 0 && rename(tmp, path) == -1) {
+		ret = -1;
+	}
+	if (ret == -1) {
+		unlink(tmp);
+	}
+	free(tmp);
+
+	return ret;
+}
+
+/**
+ * rwelf_scandb_num_entries(const rwelf_scandb*)
+ * Returns the number of files with a record
+ */
+size_t rwelf_scandb_num_entries(const rwelf_scandb *db)
+{
+	assert(db != NULL);
+
+	return db->live;
+}
+
+/**
+ * rwelf_scandb_prune(rwelf_scandb*)
+ * Drops the entries of the files no scan visited since the database was
+ * opened, e.g. deleted files. Returns how many were dropped
+ */
+size_t rwelf_scandb_prune(rwelf_scandb *db)
+{
+	size_t i, n = 0;
+
+	assert(db != NULL);
+
+	for (i = 0; i < db->nentries; ++i) {
+		if (!db->entries[i].seen && !db->entries[i].removed) {
+			_db_remove(db, &db->entries[i]);
+			++n;
+		}
+	}
+	return n;
+}
+
+static void _stat_key(const struct stat *st, _db_key *key)
+{
+	key->dev        = st->st_dev;
+	key->ino        = st->st_ino;
+	key->size       = st->st_size;
+	key->mtime_sec  = st->st_mtim.tv_sec;
+	key->mtime_nsec = st->st_mtim.tv_nsec;
+}
+
+/**
+ * rwelf_scan_incremental(rwelf_scandb*, const char *const*, size_t, int,
+ *   int (*)(const char*, rwelf*, rwelf_scan_record*, void*), void*)
+ * Scans the files like rwelf_scan, skipping the ones unchanged since the
+ * record in the database was stored: cb gets a NULL handle and the record
+ * with cached set. Otherwise the file is opened and cb gets the handle;
+ * the record it leaves in data/size is copied into the database, and when
+ * it leaves none the file is forgotten. With RWELF_SCANDB_BUILD_ID a file
+ * whose stat changed but whose size and build-id did not is treated as
+ * unchanged, which is only right when the build-id covers every byte the
+ * record depends on (a patched or restripped file keeps its build-id).
+ * Returns the number of files that could not be opened, or -1
+ * on allocation failure
+ */
+int rwelf_scan_incremental(rwelf_scandb *db, const char *const *files,
+	size_t nfiles, int flags,
+	int (*cb)(const char*, rwelf*, rwelf_scan_record*, void*), void *arg)
+{
+	unsigned char *buf;
+	rwelf_pool *pool;
+	int failed = 0, stop = 0, ret = 0;
+	size_t i;
+
+	assert(db != NULL);
+	assert(files != NULL);
+	assert(cb != NULL);
+
+	buf  = malloc(RWELF_SCAN_HEAD);
+	pool = rwelf_pool_create();
+
+	if (!buf || !pool) {
+		free(buf);
+		if (pool) {
+			rwelf_pool_destroy(pool);
+		}
+		return -1;
+	}
+
+	for (i = 0; i < nfiles && !stop; ++i) {
+		rwelf_scan_record rec = { NULL, 0, 0 };
+		const unsigned char *build_id = NULL;
+		size_t build_id_size = 0;
+		_db_entry *e = _db_find(db, files[i]);
+		rwelf *elf = NULL;
+		struct stat st;
+		_db_key key;
+
+		if (stat(files[i], &st) == -1) {
+			if (e) {
+				_db_remove(db, e);
+			}
+			++failed;
+			stop = cb(files[i], NULL, &rec, arg);
+			continue;
+		}
+		_stat_key(&st, &key);
+
+		if (e && !e->removed) {
+			e->seen = 1;
+
+			if (memcmp(&e->key, &key, sizeof(key)) == 0) {
+				rec.data   = e->data;
+				rec.size   = e->size;
+				rec.cached = 1;
+				stop = cb(files[i], NULL, &rec, arg);
+				continue;
+			}
+		}
+
+		if ((elf = _scan_open(pool, buf, files[i], flags)) == NULL) {
+			if (e) {
+				_db_remove(db, e);
+			}
+			++failed;
+			stop = cb(files[i], NULL, &rec, arg);
+			continue;
+		}
+
+		if (db->flags & RWELF_SCANDB_BUILD_ID) {
+			build_id = rwelf_get_build_id(elf, &build_id_size);
+
+			if (e && !e->removed && build_id && e->key.size == key.size
+				&& e->build_id_size == build_id_size
+				&& memcmp(e->build_id, build_id, build_id_size) == 0) {
+				/* Same contents under a new stat, only refresh the key */
+				e->key = key;
+				rwelf_close(elf);
+
+				rec.data   = e->data;
+				rec.size   = e->size;
+				rec.cached = 1;
+				stop = cb(files[i], NULL, &rec, arg);
+				continue;
+			}
+		}
+
+		stop = cb(files[i], elf, &rec, arg);
+
+		if (rec.data) {
+			if (_db_set(db, files[i], &key, build_id, build_id_size,
+					rec.data, rec.size) == -1) {
+				ret = -1;
+			}
+		} else if ((e = _db_find(db, files[i])) != NULL) {
+			_db_remove(db, e);
+		}
+		rwelf_close(elf);
+	}
+
+	rwelf_pool_destroy(pool);
+	free(buf);
+
+	return ret == -1 ? -1 : failed;
+}
@@ -49,21 +49,31 @@ int rwelf_get_section_by_name(const rwelf *elf, const char *sname, Elf_Shdr *shd
 	size_t len;
 
 	assert(elf != NULL);
-	assert(elf->shstrtab != NULL);
 	assert(sname != NULL);
 
+	RWELF_STAT(elf, RWELF_STAT_SECTION_BY_NAME, 1);
+
+	/* No section header table (e.g. sstripped files) */
+	if (!elf->shstrtab) {
+		return -1;
+	}
+
 	len = strlen(sname);
 
 	for (i = 0; i < RWELF_EHDR(elf, e_shnum); ++i) {
 		const char *name = (char*)(elf->shstrtab + RWELF_SHDR(elf, sh_name, i));
 
 		if (name && memcmp(name, sname, len+1) == 0) {
+			RWELF_STAT(elf, RWELF_STAT_SCAN_STEPS, i + 1);
+
 			if (shdr) {
 				_copy_shdr(elf, shdr, i);
 			}
 			return i;
 		}
 	}
+	RWELF_STAT(elf, RWELF_STAT_SCAN_STEPS, i);
+
 	return -1;
 }
 
@@ -79,6 +89,8 @@ void rwelf_get_section_by_num(const rwelf *elf,
 	assert(elf->shstrtab != NULL);
 	assert(RWELF_EHDR(elf, e_shnum) > num);
 
+	RWELF_STAT(elf, RWELF_STAT_SECTION_BY_NUM, 1);
+
 	if (shdr) {
 		_copy_shdr(elf, shdr, num);
 	}
@@ -157,3 +169,119 @@ uint64_t rwelf_get_num_entries(const Elf_Shdr *shdr)
 	return RWELF_SHDR_DATA(shdr, sh_size) / RWELF_SHDR_DATA(shdr, sh_entsize);
 }
 
+/**
+ * rwelf_get_section_offset(const Elf_Shdr*)
+ * Returns the offset of the section contents in the file
+ */
+uint64_t rwelf_get_section_offset(const Elf_Shdr *shdr)
+{
+	assert(shdr != NULL);
+	assert(shdr->elf != NULL);
+
+	return RWELF_SHDR_DATA(shdr, sh_offset);
+}
+
+/**
+ * rwelf_get_section_link(const Elf_Shdr*)
+ * Returns the section header table index link
+ */
+uint32_t rwelf_get_section_link(const Elf_Shdr *shdr)
+{
+	assert(shdr != NULL);
+	assert(shdr->elf != NULL);
+
+	return RWELF_SHDR_DATA(shdr, sh_link);
+}
+
+/**
+ * rwelf_get_section_info(const Elf_Shdr*)
+ * Returns the extra information of the section
+ */
+uint32_t rwelf_get_section_info(const Elf_Shdr *shdr)
+{
+	assert(shdr != NULL);
+	assert(shdr->elf != NULL);
+
+	return RWELF_SHDR_DATA(shdr, sh_info);
+}
+
+/**
+ * rwelf_get_section_addralign(const Elf_Shdr*)
+ * Returns the section alignment
+ */
+uint64_t rwelf_get_section_addralign(const Elf_Shdr *shdr)
+{
+	assert(shdr != NULL);
+	assert(shdr->elf != NULL);
+
+	return RWELF_SHDR_DATA(shdr, sh_addralign);
+}
+
+/**
+ * rwelf_get_section_entsize(const Elf_Shdr*)
+ * Returns the size of each entry when the section holds a table
+ */
+uint64_t rwelf_get_section_entsize(const Elf_Shdr *shdr)
+{
+	assert(shdr != NULL);
+	assert(shdr->elf != NULL);
+
+	return RWELF_SHDR_DATA(shdr, sh_entsize);
+}
+
+/**
+ * rwelf_get_section_data(const Elf_Shdr*)
+ * Returns a pointer to the section contents, or NULL for sections without
+ * contents (SHT_NOBITS) or past the end of the file
+ */
+const unsigned char *rwelf_get_section_data(const Elf_Shdr *shdr)
+{
+	assert(shdr != NULL);
+	assert(shdr->elf != NULL);
+
+	if (RWELF_SHDR_DATA(shdr, sh_type) == SHT_NOBITS) {
+		return NULL;
+	}
+	return rwelf_get_data(shdr->elf, RWELF_SHDR_DATA(shdr, sh_offset),
+		RWELF_SHDR_DATA(shdr, sh_size));
+}
+
+/**
+ * rwelf_get_section_type_name(const Elf_Shdr*)
+ * Returns the section type as string
+ */
+const char *rwelf_get_section_type_name(const Elf_Shdr *shdr)
+{
+	assert(shdr != NULL);
+	assert(shdr->elf != NULL);
+
+#define CASE(x) case x: return #x
+	switch (RWELF_SHDR_DATA(shdr, sh_type)) {
+		CASE(SHT_NULL);
+		CASE(SHT_PROGBITS);
+		CASE(SHT_SYMTAB);
+		CASE(SHT_STRTAB);
+		CASE(SHT_RELA);
+		CASE(SHT_HASH);
+		CASE(SHT_DYNAMIC);
+		CASE(SHT_NOTE);
+		CASE(SHT_NOBITS);
+		CASE(SHT_REL);
+		CASE(SHT_SHLIB);
+		CASE(SHT_DYNSYM);
+		CASE(SHT_INIT_ARRAY);
+		CASE(SHT_FINI_ARRAY);
+		CASE(SHT_PREINIT_ARRAY);
+		CASE(SHT_GROUP);
+		CASE(SHT_SYMTAB_SHNDX);
+		CASE(SHT_GNU_ATTRIBUTES);
+		CASE(SHT_GNU_HASH);
+		CASE(SHT_GNU_LIBLIST);
+		CASE(SHT_GNU_verdef);
+		CASE(SHT_GNU_verneed);
+		CASE(SHT_GNU_versym);
+		default:
+			return "UNKNOWN";
+	}
+#undef CASE
+}
@@ -0,0 +1,1183 @@
+/**
+ * rwelf
+ * Copyright (c) 2012-2013 Felipe Pena <felipensp(at)gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "rwelf.h"
+#include "internal.h"
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * Size profiling
+ *
+ * Every byte of the file and of the loaded image is given to exactly one
+ * label of the domain asked for (segments, sections, symbols or compile
+ * units). Labels come in tiers: the domain itself first, then what is
+ * left goes to the section holding it ("[.text]"), the ELF headers, the
+ * PT_LOAD segment ("[LOAD #2 [R X]]") and finally "[Unmapped]".
+ *
+ * Nothing works per byte. The ranges of a tier are sorted by start and
+ * swept once against the sorted, disjoint ranges already given away by
+ * the tiers before it, so only the gaps are counted; inside a tier the
+ * earlier (then the longer) range wins the overlap, as aliases do. What
+ * a tier takes is merged back into the covered list, which keeps the
+ * whole profile at O(n log n) in the number of ranges.
+ *
+ * Ranges are given by address and mapped to the file through the PT_LOAD
+ * segments (ET_REL has none, its allocated sections are laid end to end
+ * instead), so bytes outside any loaded segment never count as VM size.
+ * Compile units come from .debug_aranges, or the DW_AT_low_pc/high_pc of
+ * the unit when there is none; their names from the DW_AT_name of the
+ * unit DIE.
+ */
+
+#define _TIER_DOMAIN   0
+#define _TIER_SECTIONS 1
+#define _TIER_HEADERS  2
+#define _TIER_LOAD     3
+#define _TIER_UNMAPPED 4
+#define _TIERS         5
+
+#define _SPACE_VM   0
+#define _SPACE_FILE 1
+
+#define DW_TAG_compile_unit    0x11
+#define DW_TAG_partial_unit    0x3c
+#define DW_TAG_skeleton_unit   0x4a
+#define DW_AT_name             0x03
+#define DW_AT_low_pc           0x11
+#define DW_AT_high_pc          0x12
+#define DW_FORM_addr           0x01
+#define DW_FORM_block2         0x03
+#define DW_FORM_block4         0x04
+#define DW_FORM_data2          0x05
+#define DW_FORM_data4          0x06
+#define DW_FORM_data8          0x07
+#define DW_FORM_string         0x08
+#define DW_FORM_block          0x09
+#define DW_FORM_block1         0x0a
+#define DW_FORM_data1          0x0b
+#define DW_FORM_flag           0x0c
+#define DW_FORM_sdata          0x0d
+#define DW_FORM_strp           0x0e
+#define DW_FORM_udata          0x0f
+#define DW_FORM_ref_addr       0x10
+#define DW_FORM_ref1           0x11
+#define DW_FORM_ref2           0x12
+#define DW_FORM_ref4           0x13
+#define DW_FORM_ref8           0x14
+#define DW_FORM_ref_udata      0x15
+#define DW_FORM_indirect       0x16
+#define DW_FORM_sec_offset     0x17
+#define DW_FORM_exprloc        0x18
+#define DW_FORM_flag_present   0x19
+#define DW_FORM_strx           0x1a
+#define DW_FORM_addrx          0x1b
+#define DW_FORM_ref_sup4       0x1c
+#define DW_FORM_strp_sup       0x1d
+#define DW_FORM_data16         0x1e
+#define DW_FORM_line_strp      0x1f
+#define DW_FORM_ref_sig8       0x20
+#define DW_FORM_implicit_const 0x21
+#define DW_FORM_loclistx       0x22
+#define DW_FORM_rnglistx       0x23
+#define DW_FORM_ref_sup8       0x24
+#define DW_FORM_strx1          0x25
+#define DW_FORM_strx2          0x26
+#define DW_FORM_strx3          0x27
+#define DW_FORM_strx4          0x28
+#define DW_FORM_addrx1         0x29
+#define DW_FORM_addrx2         0x2a
+#define DW_FORM_addrx3         0x2b
+#define DW_FORM_addrx4         0x2c
+#define DW_FORM_GNU_addr_index 0x1f01
+#define DW_FORM_GNU_str_index  0x1f02
+#define DW_FORM_GNU_ref_alt    0x1f20
+#define DW_FORM_GNU_strp_alt   0x1f21
+
+typedef struct {
+	uint64_t start;
+	uint64_t end;
+	size_t label;
+} _range;
+
+typedef struct {
+	_range *r;
+	size_t n;
+	size_t cap;
+} _ranges;
+
+typedef struct {
+	uint64_t vaddr;
+	uint64_t memsz;
+	uint64_t offset;
+	uint64_t filesz;
+} _map;
+
+typedef struct {
+	const unsigned char *data;
+	uint64_t size;
+} _debug_sec;
+
+typedef struct {
+	const rwelf *elf;
+	int rel;
+	_map *maps;               /* Address to file, sorted by address */
+	size_t nmaps;
+	uint64_t *bases;          /* ET_REL: address given to each section */
+	_ranges tiers[_TIERS][2]; /* Per tier and space */
+	rwelf_size_entry *labels;
+	size_t nlabels;
+	size_t cap;
+	size_t *slots;            /* Label hash set, index + 1 */
+	size_t nslots;
+	char **owned;             /* Label names built here */
+	size_t nowned;
+	int error;
+} _ctx;
+
+static int _range_cmp(const void *a, const void *b)
+{
+	const _range *x = a, *y = b;
+
+	if (x->start != y->start) {
+		return x->start < y->start ? -1 : 1;
+	}
+	if (x->end != y->end) {
+		return x->end > y->end ? -1 : 1;
+	}
+	return x->label < y->label ? -1 : x->label > y->label;
+}
+
+static int _map_cmp(const void *a, const void *b)
+{
+	const _map *x = a, *y = b;
+
+	return x->vaddr < y->vaddr ? -1 : x->vaddr > y->vaddr;
+}
+
+static int _entry_cmp(const void *a, const void *b)
+{
+	const rwelf_size_entry *x = a, *y = b;
+	uint64_t mx = x->file_size > x->vm_size ? x->file_size : x->vm_size;
+	uint64_t my = y->file_size > y->vm_size ? y->file_size : y->vm_size;
+
+	if (mx != my) {
+		return mx > my ? -1 : 1;
+	}
+	return strcmp(x->name, y->name);
+}
+
+static int _grow_slots(_ctx *ctx)
+{
+	size_t nslots = ctx->nslots ? ctx->nslots * 2 : 256, i;
+	size_t *slots = calloc(nslots, sizeof(size_t));
+
+	if (!slots) {
+		return -1;
+	}
+	for (i = 0; i < ctx->nlabels; ++i) {
+		const char *name = ctx->labels[i].name;
+		size_t h = rwelf_hash64(name, strlen(name), 0) & (nslots - 1);
+
+		while (slots[h]) {
+			h = (h + 1) & (nslots - 1);
+		}
+		slots[h] = i + 1;
+	}
+	free(ctx->slots);
+	ctx->slots  = slots;
+	ctx->nslots = nslots;
+
+	return 0;
+}
+
+/**
+ * Returns the label by name, adding it on first use. Labels with the same
+ * name (static functions of several units, say) are one
+ */
+static size_t _label(_ctx *ctx, const char *name)
+{
+	size_t h;
+
+	if (ctx->nlabels * 2 >= ctx->nslots && _grow_slots(ctx) == -1) {
+		ctx->error = 1;
+		return 0;
+	}
+
+	h = rwelf_hash64(name, strlen(name), 0) & (ctx->nslots - 1);
+
+	while (ctx->slots[h]) {
+		if (strcmp(ctx->labels[ctx->slots[h] - 1].name, name) == 0) {
+			return ctx->slots[h] - 1;
+		}
+		h = (h + 1) & (ctx->nslots - 1);
+	}
+
+	if (ctx->nlabels == ctx->cap) {
+		size_t cap = ctx->cap ? ctx->cap * 2 : 64;
+		rwelf_size_entry *labels = realloc(ctx->labels,
+			cap * sizeof(rwelf_size_entry));
+
+		if (!labels) {
+			ctx->error = 1;
+			return 0;
+		}
+		ctx->labels = labels;
+		ctx->cap = cap;
+	}
+	ctx->labels[ctx->nlabels].name      = name;
+	ctx->labels[ctx->nlabels].file_size = 0;
+	ctx->labels[ctx->nlabels].vm_size   = 0;
+	ctx->slots[h] = ctx->nlabels + 1;
+
+	return ctx->nlabels++;
+}
+
+/**
+ * Label whose name is built here, kept until the end of the profile
+ */
+static size_t _label_fmt(_ctx *ctx, const char *fmt, const char *a,
+	const char *b)
+{
+	size_t len = strlen(fmt) + strlen(a) + strlen(b) + 1;
+	char **owned = realloc(ctx->owned, (ctx->nowned + 1) * sizeof(char*));
+	char *name;
+
+	if (!owned) {
+		ctx->error = 1;
+		return 0;
+	}
+	ctx->owned = owned;
+
+	if ((name = malloc(len)) == NULL) {
+		ctx->error = 1;
+		return 0;
+	}
+	snprintf(name, len, fmt, a, b);
+	ctx->owned[ctx->nowned++] = name;
+
+	return _label(ctx, name);
+}
+
+static void _add(_ctx *ctx, int tier, int space, size_t label, uint64_t start,
+	uint64_t size)
+{
+	_ranges *rs = &ctx->tiers[tier][space];
+
+	if (!size || ctx->error) {
+		return;
+	}
+	if (space == _SPACE_FILE) {
+		/* Never past the end of a truncated file */
+		if (start >= ctx->elf->size) {
+			return;
+		}
+		if (size > ctx->elf->size - start) {
+			size = ctx->elf->size - start;
+		}
+	} else if (start + size < start) {
+		size = -start;
+	}
+
+	if (rs->n == rs->cap) {
+		size_t cap = rs->cap ? rs->cap * 2 : 64;
+		_range *r = realloc(rs->r, cap * sizeof(_range));
+
+		if (!r) {
+			ctx->error = 1;
+			return;
+		}
+		rs->r = r;
+		rs->cap = cap;
+	}
+	rs->r[rs->n].start = start;
+	rs->r[rs->n].end   = start + size;
+	rs->r[rs->n].label = label;
+	++rs->n;
+}
+
+/**
+ * Adds the part of [start, start+size) that is loaded as VM range and,
+ * when with_file is set, its image in the file as file range
+ */
+static void _add_vm(_ctx *ctx, int tier, size_t label, uint64_t start,
+	uint64_t size, int with_file)
+{
+	uint64_t end = start + size < start ? (uint64_t) -1 : start + size;
+	size_t lo = 0, hi = ctx->nmaps;
+
+	/* First map ending past start; the maps may overlap, walk from it */
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+
+		if (ctx->maps[mid].vaddr + ctx->maps[mid].memsz <= start) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+
+	for (; lo < ctx->nmaps && ctx->maps[lo].vaddr < end; ++lo) {
+		const _map *m = &ctx->maps[lo];
+		uint64_t s = start > m->vaddr ? start : m->vaddr;
+		uint64_t e = end < m->vaddr + m->memsz ? end : m->vaddr + m->memsz;
+
+		if (s >= e) {
+			continue;
+		}
+		_add(ctx, tier, _SPACE_VM, label, s, e - s);
+
+		if (with_file && s - m->vaddr < m->filesz) {
+			uint64_t fe = e - m->vaddr < m->filesz ? e - m->vaddr : m->filesz;
+
+			_add(ctx, tier, _SPACE_FILE, label, m->offset + (s - m->vaddr),
+				fe - (s - m->vaddr));
+		}
+	}
+}
+
+/**
+ * Address of a section: its own, or the one given to it for ET_REL
+ */
+static uint64_t _section_addr(const _ctx *ctx, size_t n)
+{
+	return ctx->rel ? ctx->bases[n] : RWELF_SHDR(ctx->elf, sh_addr, n);
+}
+
+static int _tls_nobits(const rwelf *elf, size_t n)
+{
+	return (RWELF_SHDR(elf, sh_flags, n) & SHF_TLS)
+		&& RWELF_SHDR(elf, sh_type, n) == SHT_NOBITS;
+}
+
+/**
+ * Builds the address to file maps: the PT_LOAD segments, or for ET_REL
+ * the allocated sections one after the other
+ */
+static int _build_maps(_ctx *ctx)
+{
+	const rwelf *elf = ctx->elf;
+	size_t nshdrs = elf->shstrtab ? RWELF_EHDR(elf, e_shnum) : 0;
+	size_t nphdrs = RWELF_EHDR(elf, e_phnum), i;
+	uint64_t next = 0;
+
+	ctx->rel = RWELF_EHDR(elf, e_type) == ET_REL;
+
+	if ((ctx->maps = malloc((nphdrs + nshdrs + 1) * sizeof(_map))) == NULL
+		|| (ctx->bases = calloc(nshdrs + 1, sizeof(uint64_t))) == NULL) {
+		return -1;
+	}
+
+	if (!ctx->rel) {
+		for (i = 0; i < nphdrs; ++i) {
+			_map *m = &ctx->maps[ctx->nmaps];
+
+			if (RWELF_PHDR(elf, p_type, i) != PT_LOAD) {
+				continue;
+			}
+			m->vaddr  = RWELF_PHDR(elf, p_vaddr, i);
+			m->memsz  = RWELF_PHDR(elf, p_memsz, i);
+			m->offset = RWELF_PHDR(elf, p_offset, i);
+			m->filesz = RWELF_PHDR(elf, p_filesz, i);
+			ctx->nmaps += m->memsz != 0;
+		}
+	} else {
+		for (i = 1; i < nshdrs; ++i) {
+			_map *m = &ctx->maps[ctx->nmaps];
+			uint64_t align = RWELF_SHDR(elf, sh_addralign, i);
+
+			if (!(RWELF_SHDR(elf, sh_flags, i) & SHF_ALLOC)
+				|| !RWELF_SHDR(elf, sh_size, i)) {
+				continue;
+			}
+			if (align > 1 && !(align & (align - 1))) {
+				next = (next + align - 1) & ~(align - 1);
+			}
+			ctx->bases[i] = next;
+
+			m->vaddr  = next;
+			m->memsz  = RWELF_SHDR(elf, sh_size, i);
+			m->offset = RWELF_SHDR(elf, sh_offset, i);
+			m->filesz = RWELF_SHDR(elf, sh_type, i) == SHT_NOBITS ? 0 : m->memsz;
+			next += m->memsz;
+			++ctx->nmaps;
+		}
+	}
+	qsort(ctx->maps, ctx->nmaps, sizeof(_map), _map_cmp);
+
+	return 0;
+}
+
+/**
+ * Sections as labels, named as they are for the sections domain and in
+ * brackets when they only catch what the domain left
+ */
+static void _add_sections(_ctx *ctx, int tier)
+{
+	const rwelf *elf = ctx->elf;
+	size_t nshdrs = elf->shstrtab ? RWELF_EHDR(elf, e_shnum) : 0, i;
+
+	for (i = 1; i < nshdrs && !ctx->error; ++i) {
+		const char *name = (const char*)(elf->shstrtab + RWELF_SHDR(elf, sh_name, i));
+		uint64_t size = RWELF_SHDR(elf, sh_size, i);
+		size_t label = tier == _TIER_DOMAIN ? _label(ctx, name)
+			: _label_fmt(ctx, "[%s%s]", name, "");
+
+		if (RWELF_SHDR(elf, sh_type, i) != SHT_NOBITS) {
+			_add(ctx, tier, _SPACE_FILE, label, RWELF_SHDR(elf, sh_offset, i), size);
+		}
+		/* .tbss takes no room in the image, only in each thread */
+		if ((RWELF_SHDR(elf, sh_flags, i) & SHF_ALLOC) && !_tls_nobits(elf, i)) {
+			_add_vm(ctx, tier, label, _section_addr(ctx, i), size, 0);
+		}
+	}
+}
+
+static void _add_segments(_ctx *ctx, int tier)
+{
+	const rwelf *elf = ctx->elf;
+	size_t i;
+
+	for (i = 0; i < RWELF_EHDR(elf, e_phnum) && !ctx->error; ++i) {
+		uint32_t flags = RWELF_PHDR(elf, p_flags, i);
+		char num[32], perms[8];
+		size_t label;
+
+		if (RWELF_PHDR(elf, p_type, i) != PT_LOAD) {
+			continue;
+		}
+		snprintf(num, sizeof(num), "%zu", i);
+		snprintf(perms, sizeof(perms), "%c%c%c", (flags & PF_R) ? 'R' : ' ',
+			(flags & PF_W) ? 'W' : ' ', (flags & PF_X) ? 'X' : ' ');
+
+		label = _label_fmt(ctx, tier == _TIER_DOMAIN ? "LOAD #%s [%s]"
+			: "[LOAD #%s [%s]]", num, perms);
+
+		_add(ctx, tier, _SPACE_FILE, label, RWELF_PHDR(elf, p_offset, i),
+			RWELF_PHDR(elf, p_filesz, i));
+		_add(ctx, tier, _SPACE_VM, label, RWELF_PHDR(elf, p_vaddr, i),
+			RWELF_PHDR(elf, p_memsz, i));
+	}
+}
+
+static void _add_headers(_ctx *ctx)
+{
+	const rwelf *elf = ctx->elf;
+	size_t label = _label(ctx, "[ELF Headers]");
+
+	_add(ctx, _TIER_HEADERS, _SPACE_FILE, label, 0, RWELF_EHDR(elf, e_ehsize));
+	_add(ctx, _TIER_HEADERS, _SPACE_FILE, label, RWELF_EHDR(elf, e_phoff),
+		(uint64_t) RWELF_EHDR(elf, e_phnum) * RWELF_EHDR(elf, e_phentsize));
+	_add(ctx, _TIER_HEADERS, _SPACE_FILE, label, RWELF_EHDR(elf, e_shoff),
+		(uint64_t) RWELF_EHDR(elf, e_shnum) * RWELF_EHDR(elf, e_shentsize));
+}
+
+/**
+ * Symbols with a size in a section, from .symtab or else .dynsym
+ */
+static void _add_symbols(_ctx *ctx)
+{
+	const rwelf *elf = ctx->elf;
+	int dynamic = !elf->nsyms;
+	const unsigned char *strtab = dynamic ? elf->dynstr : elf->strtab;
+	size_t nshdrs = elf->shstrtab ? RWELF_EHDR(elf, e_shnum) : 0;
+	size_t i, n = dynamic ? elf->ndynsyms : elf->nsyms;
+
+	for (i = 1; i < n && strtab && !ctx->error; ++i) {
+#define SYM(_field) (dynamic ? RWELF(elf, DYNSYM, _field, i) : RWELF(elf, SYM, _field, i))
+		int type = ELF64_ST_TYPE(SYM(st_info));
+		size_t shndx = SYM(st_shndx);
+		uint64_t addr = SYM(st_value);
+		const char *name = (const char*)(strtab + SYM(st_name));
+
+		/* TLS symbols are offsets in the block of each thread, they go
+		 * to .tdata/.tbss as a whole */
+		if (!SYM(st_size) || !*name || type == STT_SECTION || type == STT_FILE
+			|| type == STT_TLS || shndx == SHN_UNDEF || shndx >= SHN_LORESERVE) {
+			continue;
+		}
+		if (ctx->rel) {
+			if (shndx >= nshdrs || !(RWELF_SHDR(elf, sh_flags, shndx) & SHF_ALLOC)) {
+				continue;
+			}
+			addr += ctx->bases[shndx];
+		}
+		_add_vm(ctx, _TIER_DOMAIN, _label(ctx, name), addr, SYM(st_size), 1);
+#undef SYM
+	}
+}
+
+static uint64_t _read_word(const unsigned char *p, size_t len)
+{
+	uint64_t u64 = 0;
+	uint32_t u32;
+	uint16_t u16;
+
+	switch (len) {
+		case 1:
+			return *p;
+		case 2:
+			memcpy(&u16, p, 2);
+			return u16;
+		case 4:
+			memcpy(&u32, p, 4);
+			return u32;
+		case 8:
+			memcpy(&u64, p, 8);
+			return u64;
+	}
+	return 0;
+}
+
+/**
+ * Reads the unit length at p and sets the offset size. Returns the end of
+ * the unit, or NULL when it does not fit
+ */
+static const unsigned char *_unit_length(const unsigned char **pp,
+	const unsigned char *end, size_t *offsz)
+{
+	const unsigned char *p = *pp;
+	uint64_t len;
+
+	if (end - p < 4) {
+		return NULL;
+	}
+	len = _read_word(p, 4);
+	p += 4;
+	*offsz = 4;
+
+	if (len == 0xffffffff) {
+		if (end - p < 8) {
+			return NULL;
+		}
+		len = _read_word(p, 8);
+		p += 8;
+		*offsz = 8;
+	} else if (len >= 0xfffffff0) {
+		return NULL;
+	}
+	if (len > (uint64_t)(end - p)) {
+		return NULL;
+	}
+	*pp = p;
+
+	return p + len;
+}
+
+static int _debug_section(const rwelf *elf, const char *name, _debug_sec *sec)
+{
+	Elf_Shdr shdr;
+
+	sec->data = NULL;
+	sec->size = 0;
+
+	if (!elf->shstrtab || rwelf_get_section_by_name(elf, name, &shdr) == -1
+		|| rwelf_get_section_type(&shdr) == SHT_NOBITS
+		|| (RWELF_SHDR_DATA(&shdr, sh_flags) & SHF_COMPRESSED)) {
+		return -1;
+	}
+	sec->size = rwelf_get_section_size(&shdr);
+	sec->data = rwelf_get_data(elf, rwelf_get_section_offset(&shdr), sec->size);
+
+	return sec->data ? 0 : -1;
+}
+
+typedef struct {
+	_debug_sec info;
+	_debug_sec abbrev;
+	_debug_sec str;
+	_debug_sec line_str;
+} _dwarf;
+
+/**
+ * Skips an attribute value. Returns -1 when it does not fit or the form
+ * is not known
+ */
+static int _skip_form(const unsigned char **pp, const unsigned char *end,
+	uint64_t form, size_t offsz, size_t addrsz, int version)
+{
+	const unsigned char *p = *pp;
+	uint64_t len = 0;
+
+	switch (form) {
+		case DW_FORM_flag_present:
+		case DW_FORM_implicit_const:
+			break;
+		case DW_FORM_addr:
+			len = addrsz;
+			break;
+		case DW_FORM_data1:
+		case DW_FORM_ref1:
+		case DW_FORM_flag:
+		case DW_FORM_strx1:
+		case DW_FORM_addrx1:
+			len = 1;
+			break;
+		case DW_FORM_data2:
+		case DW_FORM_ref2:
+		case DW_FORM_strx2:
+		case DW_FORM_addrx2:
+			len = 2;
+			break;
+		case DW_FORM_strx3:
+		case DW_FORM_addrx3:
+			len = 3;
+			break;
+		case DW_FORM_data4:
+		case DW_FORM_ref4:
+		case DW_FORM_ref_sup4:
+		case DW_FORM_strx4:
+		case DW_FORM_addrx4:
+			len = 4;
+			break;
+		case DW_FORM_data8:
+		case DW_FORM_ref8:
+		case DW_FORM_ref_sig8:
+		case DW_FORM_ref_sup8:
+			len = 8;
+			break;
+		case DW_FORM_data16:
+			len = 16;
+			break;
+		case DW_FORM_strp:
+		case DW_FORM_line_strp:
+		case DW_FORM_sec_offset:
+		case DW_FORM_strp_sup:
+		case DW_FORM_GNU_ref_alt:
+		case DW_FORM_GNU_strp_alt:
+			len = offsz;
+			break;
+		case DW_FORM_ref_addr:
+			len = version == 2 ? addrsz : offsz;
+			break;
+		case DW_FORM_string:
+			while (p < end && *p) {
+				++p;
+			}
+			len = 1;
+			break;
+		case DW_FORM_block1:
+			if (p >= end) {
+				return -1;
+			}
+			len = 1 + *p;
+			break;
+		case DW_FORM_block2:
+			if (end - p < 2) {
+				return -1;
+			}
+			len = 2 + _read_word(p, 2);
+			break;
+		case DW_FORM_block4:
+			if (end - p < 4) {
+				return -1;
+			}
+			len = 4 + _read_word(p, 4);
+			break;
+		case DW_FORM_block:
+		case DW_FORM_exprloc:
+			if (_uleb(&p, end, &len) == -1) {
+				return -1;
+			}
+			break;
+		case DW_FORM_sdata:
+		case DW_FORM_udata:
+		case DW_FORM_ref_udata:
+		case DW_FORM_strx:
+		case DW_FORM_addrx:
+		case DW_FORM_loclistx:
+		case DW_FORM_rnglistx:
+		case DW_FORM_GNU_addr_index:
+		case DW_FORM_GNU_str_index:
+			if (_uleb(&p, end, &len) == -1) {
+				return -1;
+			}
+			len = 0;
+			break;
+		default:
+			return -1;
+	}
+	if (len > (uint64_t)(end - p)) {
+		return -1;
+	}
+	*pp = p + len;
+
+	return 0;
+}
+
+typedef struct {
+	const char *name;
+	uint64_t low_pc;
+	uint64_t high_pc;
+	int has_low;
+	int has_high;
+	int high_is_size;
+} _unit;
+
+/**
+ * Reads the name and the low/high pc of the unit DIE at off of .debug_info
+ */
+static int _read_unit(const _dwarf *dw, uint64_t off, _unit *unit)
+{
+	const unsigned char *p, *end, *ab, *abend;
+	uint64_t abbrev_off, code, acode, tag, attr, form, value;
+	size_t offsz, addrsz;
+	int version;
+
+	memset(unit, 0, sizeof(_unit));
+
+	if (off >= dw->info.size) {
+		return -1;
+	}
+	p = dw->info.data + off;
+
+	if ((end = _unit_length(&p, dw->info.data + dw->info.size, &offsz)) == NULL
+		|| end - p < 2) {
+		return -1;
+	}
+	version = _read_word(p, 2);
+	p += 2;
+
+	if (version < 2 || version > 5) {
+		return -1;
+	}
+	if (version == 5) {
+		uint8_t type;
+
+		if ((size_t)(end - p) < 2 + offsz) {
+			return -1;
+		}
+		type   = p[0];
+		addrsz = p[1];
+		abbrev_off = _read_word(p + 2, offsz);
+		p += 2 + offsz;
+
+		/* DW_UT_skeleton and DW_UT_split_compile carry a dwo id */
+		if (type == 4 || type == 5) {
+			p += 8;
+		} else if (type != 1 && type != 3) {
+			return -1;
+		}
+	} else {
+		if ((size_t)(end - p) < offsz + 1) {
+			return -1;
+		}
+		abbrev_off = _read_word(p, offsz);
+		addrsz = p[offsz];
+		p += offsz + 1;
+	}
+	if (p > end || (addrsz != 4 && addrsz != 8)
+		|| _uleb(&p, end, &code) == -1 || !code
+		|| abbrev_off >= dw->abbrev.size) {
+		return -1;
+	}
+
+	/* The abbreviation of the unit DIE */
+	ab = dw->abbrev.data + abbrev_off;
+	abend = dw->abbrev.data + dw->abbrev.size;
+
+	while (1) {
+		if (_uleb(&ab, abend, &acode) == -1 || !acode
+			|| _uleb(&ab, abend, &tag) == -1 || ab >= abend) {
+			return -1;
+		}
+		++ab;
+
+		if (acode == code) {
+			break;
+		}
+		do {
+			if (_uleb(&ab, abend, &attr) == -1 || _uleb(&ab, abend, &form) == -1) {
+				return -1;
+			}
+			if (form == DW_FORM_implicit_const && _uleb(&ab, abend, &value) == -1) {
+				return -1;
+			}
+		} while (attr || form);
+	}
+	if (tag != DW_TAG_compile_unit && tag != DW_TAG_partial_unit
+		&& tag != DW_TAG_skeleton_unit) {
+		return -1;
+	}
+
+	while (1) {
+		const unsigned char *val;
+
+		if (_uleb(&ab, abend, &attr) == -1 || _uleb(&ab, abend, &form) == -1) {
+			return -1;
+		}
+		if (!attr && !form) {
+			break;
+		}
+		if (form == DW_FORM_implicit_const && _uleb(&ab, abend, &value) == -1) {
+			return -1;
+		}
+		while (form == DW_FORM_indirect) {
+			if (_uleb(&p, end, &form) == -1) {
+				return -1;
+			}
+		}
+		val = p;
+
+		if (_skip_form(&p, end, form, offsz, addrsz, version) == -1) {
+			return -1;
+		}
+
+		switch (attr) {
+			case DW_AT_name:
+				if (form == DW_FORM_string) {
+					unit->name = (const char*) val;
+				} else if (form == DW_FORM_strp || form == DW_FORM_line_strp) {
+					const _debug_sec *s = form == DW_FORM_strp ? &dw->str : &dw->line_str;
+					uint64_t soff = _read_word(val, offsz);
+
+					if (s->data && soff < s->size
+						&& memchr(s->data + soff, 0, s->size - soff)) {
+						unit->name = (const char*)(s->data + soff);
+					}
+				}
+				break;
+			case DW_AT_low_pc:
+				if (form == DW_FORM_addr) {
+					unit->low_pc  = _read_word(val, addrsz);
+					unit->has_low = 1;
+				}
+				break;
+			case DW_AT_high_pc:
+				if (form == DW_FORM_addr) {
+					unit->high_pc  = _read_word(val, addrsz);
+					unit->has_high = 1;
+				} else if (form >= DW_FORM_data2 && form <= DW_FORM_data8) {
+					unit->high_pc  = _read_word(val, form == DW_FORM_data2 ? 2
+						: form == DW_FORM_data4 ? 4 : 8);
+					unit->has_high = unit->high_is_size = 1;
+				} else if (form == DW_FORM_data1) {
+					unit->high_pc  = *val;
+					unit->has_high = unit->high_is_size = 1;
+				} else if (form == DW_FORM_udata) {
+					_uleb(&val, end, &unit->high_pc);
+					unit->has_high = unit->high_is_size = 1;
+				}
+				break;
+		}
+	}
+	return 0;
+}
+
+static size_t _unit_label(_ctx *ctx, const _unit *unit, uint64_t off)
+{
+	char buf[32];
+
+	if (unit->name && *unit->name) {
+		return _label(ctx, unit->name);
+	}
+	snprintf(buf, sizeof(buf), "%#" PRIx64, off);
+
+	return _label_fmt(ctx, "[unit at %s]%s", buf, "");
+}
+
+/**
+ * Compile units from .debug_aranges, or from the pc range of every unit
+ * of .debug_info. Returns -1 when there is no debug information
+ */
+static int _add_units(_ctx *ctx)
+{
+	const rwelf *elf = ctx->elf;
+	_debug_sec aranges;
+	_dwarf dw;
+	_unit unit;
+
+	if (_debug_section(elf, ".debug_info", &dw.info) == -1
+		|| _debug_section(elf, ".debug_abbrev", &dw.abbrev) == -1) {
+		return -1;
+	}
+	_debug_section(elf, ".debug_str", &dw.str);
+	_debug_section(elf, ".debug_line_str", &dw.line_str);
+
+	/* Addresses of ET_REL units are relocated, only aranges works */
+	if (_debug_section(elf, ".debug_aranges", &aranges) == 0 && !ctx->rel) {
+		const unsigned char *p = aranges.data, *end = p + aranges.size;
+		uint64_t last_off = (uint64_t) -1;
+		size_t label = 0;
+
+		while (p < end && !ctx->error) {
+			const unsigned char *set_end, *start;
+			uint64_t info_off;
+			size_t offsz, addrsz, align;
+
+			start = p;
+
+			if ((set_end = _unit_length(&p, end, &offsz)) == NULL
+				|| (size_t)(set_end - p) < 2 + offsz + 2) {
+				break;
+			}
+			info_off = _read_word(p + 2, offsz);
+			addrsz   = p[2 + offsz];
+			p += 2 + offsz + 2;
+
+			if (addrsz != 4 && addrsz != 8) {
+				p = set_end;
+				continue;
+			}
+			/* Tuples are aligned to twice the address size from the set */
+			align = 2 * addrsz;
+			p = start + ((p - start + align - 1) / align) * align;
+
+			if (info_off != last_off) {
+				_read_unit(&dw, info_off, &unit);
+				label = _unit_label(ctx, &unit, info_off);
+				last_off = info_off;
+			}
+			while (p < set_end && (size_t)(set_end - p) >= align) {
+				uint64_t addr = _read_word(p, addrsz);
+				uint64_t len  = _read_word(p + addrsz, addrsz);
+
+				p += align;
+
+				if (!addr && !len) {
+					break;
+				}
+				_add_vm(ctx, _TIER_DOMAIN, label, addr, len, 1);
+			}
+			p = set_end;
+		}
+		return 0;
+	}
+
+	if (!ctx->rel) {
+		const unsigned char *p = dw.info.data, *end = p + dw.info.size;
+
+		while (p < end && !ctx->error) {
+			uint64_t off = p - dw.info.data;
+			const unsigned char *unit_end;
+			size_t offsz;
+
+			if ((unit_end = _unit_length(&p, end, &offsz)) == NULL) {
+				break;
+			}
+			if (_read_unit(&dw, off, &unit) == 0 && unit.has_low && unit.has_high) {
+				uint64_t size = unit.high_is_size ? unit.high_pc
+					: unit.high_pc - unit.low_pc;
+
+				if (unit.high_is_size || unit.high_pc > unit.low_pc) {
+					_add_vm(ctx, _TIER_DOMAIN, _unit_label(ctx, &unit, off),
+						unit.low_pc, size, 1);
+				}
+			}
+			p = unit_end;
+		}
+	}
+	return 0;
+}
+
+/**
+ * Gives the ranges of a tier the bytes no earlier tier took, then merges
+ * what they took into the covered ranges
+ */
+static int _sweep(_ctx *ctx, _ranges *rs, _ranges *cov, int space)
+{
+	_range *merged, *taken;
+	size_t i, ci = 0, ntaken = 0, nmerged = 0, j = 0;
+	uint64_t pos = 0;
+
+	if (!rs->n) {
+		return 0;
+	}
+	qsort(rs->r, rs->n, sizeof(_range), _range_cmp);
+
+	/* The ranges of a tier never take more pieces than they are plus the
+	 * gaps of the covered list */
+	if ((taken = malloc((rs->n + cov->n + 1) * sizeof(_range))) == NULL) {
+		return -1;
+	}
+
+	for (i = 0; i < rs->n; ++i) {
+		uint64_t x = rs->r[i].start > pos ? rs->r[i].start : pos;
+		uint64_t e = rs->r[i].end;
+
+		while (x < e) {
+			uint64_t gap_end = e;
+
+			while (ci < cov->n && cov->r[ci].end <= x) {
+				++ci;
+			}
+			if (ci < cov->n && cov->r[ci].start <= x) {
+				x = cov->r[ci].end;
+				continue;
+			}
+			if (ci < cov->n && cov->r[ci].start < e) {
+				gap_end = cov->r[ci].start;
+			}
+
+			if (space == _SPACE_VM) {
+				ctx->labels[rs->r[i].label].vm_size += gap_end - x;
+			} else {
+				ctx->labels[rs->r[i].label].file_size += gap_end - x;
+			}
+			if (ntaken && taken[ntaken - 1].end == x) {
+				taken[ntaken - 1].end = gap_end;
+			} else {
+				taken[ntaken].start = x;
+				taken[ntaken].end   = gap_end;
+				++ntaken;
+			}
+			x = gap_end;
+		}
+		if (e > pos) {
+			pos = e;
+		}
+	}
+
+	if ((merged = malloc((cov->n + ntaken + 1) * sizeof(_range))) == NULL) {
+		free(taken);
+		return -1;
+	}
+	for (i = 0; i < cov->n || j < ntaken; ) {
+		const _range *r = (j >= ntaken || (i < cov->n && cov->r[i].start < taken[j].start))
+			? &cov->r[i++] : &taken[j++];
+
+		if (nmerged && merged[nmerged - 1].end >= r->start) {
+			if (r->end > merged[nmerged - 1].end) {
+				merged[nmerged - 1].end = r->end;
+			}
+		} else {
+			merged[nmerged++] = *r;
+		}
+	}
+	free(taken);
+	free(cov->r);
+
+	cov->r = merged;
+	cov->n = nmerged;
+	cov->cap = cov->n + ntaken + 1;
+
+	return 0;
+}
+
+static void _free_ctx(_ctx *ctx)
+{
+	size_t i, j;
+
+	for (i = 0; i < _TIERS; ++i) {
+		for (j = 0; j < 2; ++j) {
+			free(ctx->tiers[i][j].r);
+		}
+	}
+	for (i = 0; i < ctx->nowned; ++i) {
+		free(ctx->owned[i]);
+	}
+	free(ctx->owned);
+	free(ctx->labels);
+	free(ctx->slots);
+	free(ctx->maps);
+	free(ctx->bases);
+}
+
+/**
+ * rwelf_size_profile(const rwelf*, int, int (*)(const rwelf_size_entry*, void*), void*)
+ * Breaks the file size and the VM size down by the domain asked for
+ * (RWELF_SIZE_SEGMENTS, _SECTIONS, _SYMBOLS or _UNITS). Every byte goes
+ * to one label; the callback is called for each, largest first, and stops
+ * the walk by returning non-zero. Returns -1 on error or when _UNITS is
+ * asked for a file without DWARF, otherwise 0
+ */
+int rwelf_size_profile(const rwelf *elf, int by,
+	int (*cb)(const rwelf_size_entry*, void*), void *arg)
+{
+	_ranges cov[2];
+	_ctx ctx;
+	size_t i;
+	int t, ret = -1;
+
+	assert(elf != NULL);
+	assert(cb != NULL);
+
+	memset(&ctx, 0, sizeof(ctx));
+	memset(cov, 0, sizeof(cov));
+	ctx.elf = elf;
+
+	if (_build_maps(&ctx) == -1) {
+		goto out;
+	}
+
+	switch (by) {
+		case RWELF_SIZE_SEGMENTS:
+			_add_segments(&ctx, _TIER_DOMAIN);
+			break;
+		case RWELF_SIZE_SECTIONS:
+			_add_sections(&ctx, _TIER_DOMAIN);
+			break;
+		case RWELF_SIZE_SYMBOLS:
+			_add_symbols(&ctx);
+			break;
+		case RWELF_SIZE_UNITS:
+			if (_add_units(&ctx) == -1) {
+				goto out;
+			}
+			break;
+		default:
+			goto out;
+	}
+
+	if (by != RWELF_SIZE_SECTIONS) {
+		_add_sections(&ctx, _TIER_SECTIONS);
+	}
+	_add_headers(&ctx);
+
+	if (by != RWELF_SIZE_SEGMENTS) {
+		_add_segments(&ctx, _TIER_LOAD);
+	}
+	_add(&ctx, _TIER_UNMAPPED, _SPACE_FILE, _label(&ctx, "[Unmapped]"), 0, elf->size);
+
+	if (ctx.error) {
+		goto out;
+	}
+
+	for (t = 0; t < _TIERS; ++t) {
+		if (_sweep(&ctx, &ctx.tiers[t][_SPACE_VM], &cov[_SPACE_VM], _SPACE_VM) == -1
+			|| _sweep(&ctx, &ctx.tiers[t][_SPACE_FILE], &cov[_SPACE_FILE],
+				_SPACE_FILE) == -1) {
+			goto out;
+		}
+	}
+
+	qsort(ctx.labels, ctx.nlabels, sizeof(rwelf_size_entry), _entry_cmp);
+
+	for (i = 0; i < ctx.nlabels; ++i) {
+		if ((ctx.labels[i].file_size || ctx.labels[i].vm_size)
+			&& cb(&ctx.labels[i], arg)) {
+			break;
+		}
+	}
+	ret = 0;
+out:
+	free(cov[0].r);
+	free(cov[1].r);
+	_free_ctx(&ctx);
+
+	return ret;
+}
@@ -0,0 +1,180 @@
+/**
+ * rwelf
+ * Copyright (c) 2012-2013 Felipe Pena <felipensp(at)gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "rwelf.h"
+#include <string.h>
+
+/**
+ * Instrumentation
+ *
+ * The library counts what it does only when built with RWELF_STATS
+ * (make DEFS=-DRWELF_STATS): the RWELF_STAT() calls in the hot paths
+ * expand to nothing otherwise. Every counter is kept globally and per
+ * handle, with relaxed atomics so handles shared by threads stay cheap,
+ * and each increment is also handed to the trace hook when one is set.
+ * Resident pages are sampled from the residency of the file (see
+ * rwelf_resident_bytes), which is not the same as the pages the library
+ * accessed: pages cached by earlier readers count, evicted ones do not.
+ */
+
+static uint64_t _global[RWELF_STAT_MAX];
+
+static rwelf_trace_hook _hook;
+static void *_hook_arg;
+
+static const char *_names[RWELF_STAT_MAX] = {
+	"opens",
+	"bytes_mapped",
+	"resident_pages",
+	"section_by_name",
+	"section_by_num",
+	"symbol_by_name",
+	"symbol_by_num",
+	"dynamic_by_tag",
+	"dynamic_by_num",
+	"index_lookups",
+	"scan_steps",
+	"index_builds",
+	"index_build_ns"
+};
+
+/**
+ * rwelf_stats_enabled()
+ * Returns whether the library was built with RWELF_STATS
+ */
+int rwelf_stats_enabled(void)
+{
+#ifdef RWELF_STATS
+	return 1;
+#else
+	return 0;
+#endif
+}
+
+/**
+ * rwelf_stat_name(int)
+ * Returns the name of a RWELF_STAT_* counter
+ */
+const char *rwelf_stat_name(int id)
+{
+	return id >= 0 && id < RWELF_STAT_MAX ? _names[id] : NULL;
+}
+
+/**
+ * rwelf_stat_add(const rwelf*, int, uint64_t)
+ * Adds n to a counter of the handle, which may be NULL, and to the global
+ * one, then calls the trace hook
+ */
+void rwelf_stat_add(const rwelf *elf, int id, uint64_t n)
+{
+	rwelf_trace_hook hook;
+
+	assert(id >= 0 && id < RWELF_STAT_MAX);
+
+	__atomic_fetch_add(&_global[id], n, __ATOMIC_RELAXED);
+
+	if (elf && elf->stats) {
+		__atomic_fetch_add(&((rwelf_stats*) elf->stats)->counters[id], n,
+			__ATOMIC_RELAXED);
+	}
+
+	if ((hook = __atomic_load_n(&_hook, __ATOMIC_ACQUIRE)) != NULL) {
+		hook(elf, id, n, _hook_arg);
+	}
+}
+
+static void _load(uint64_t *dst, uint64_t *src)
+{
+	size_t i;
+
+	for (i = 0; i < RWELF_STAT_MAX; ++i) {
+		dst[i] = __atomic_load_n(&src[i], __ATOMIC_RELAXED);
+	}
+}
+
+/**
+ * rwelf_get_stats(const rwelf*, rwelf_stats*)
+ * Fills stats with the counters of the handle. Resident pages are the
+ * pages of the file in memory right now. Returns -1 when the library was
+ * built without RWELF_STATS
+ */
+int rwelf_get_stats(const rwelf *elf, rwelf_stats *stats)
+{
+	assert(elf != NULL);
+	assert(stats != NULL);
+
+	memset(stats, 0, sizeof(rwelf_stats));
+
+	if (!elf->stats) {
+		return -1;
+	}
+	_load(stats->counters, ((rwelf_stats*) elf->stats)->counters);
+
+	stats->counters[RWELF_STAT_RESIDENT_PAGES] =
+		(rwelf_resident_bytes(elf) + RWELF_STAT_PAGE - 1) / RWELF_STAT_PAGE;
+
+	return 0;
+}
+
+/**
+ * rwelf_get_global_stats(rwelf_stats*)
+ * Fills stats with the counters of every handle since the start or the
+ * last reset. Resident pages are added as each handle is closed, so a
+ * file open in several handles counts once per handle.
+ * Returns -1 when the library was built without RWELF_STATS
+ */
+int rwelf_get_global_stats(rwelf_stats *stats)
+{
+	assert(stats != NULL);
+
+	_load(stats->counters, _global);
+
+	return rwelf_stats_enabled() ? 0 : -1;
+}
+
+/**
+ * rwelf_reset_global_stats()
+ * Zeroes the global counters
+ */
+void rwelf_reset_global_stats(void)
+{
+	size_t i;
+
+	for (i = 0; i < RWELF_STAT_MAX; ++i) {
+		__atomic_store_n(&_global[i], 0, __ATOMIC_RELAXED);
+	}
+}
+
+/**
+ * rwelf_set_trace_hook(rwelf_trace_hook, void*)
+ * Sets the function called on every counter increment, NULL removes it.
+ * The hook runs on the thread doing the work, so it must be thread safe
+ * and cheap. Must not be changed while other threads use the library
+ */
+void rwelf_set_trace_hook(rwelf_trace_hook hook, void *arg)
+{
+	_hook_arg = arg;
+	__atomic_store_n(&_hook, hook, __ATOMIC_RELEASE);
+}
@@ -0,0 +1,865 @@
+/**
+ * rwelf
+ * Copyright (c) 2012-2013 Felipe Pena <felipensp(at)gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "rwelf.h"
+#include <sys/stat.h>
+#include <unistd.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * String table building
+ *
+ * rwelf_strtab interns strings in an open-addressing hash set, so every
+ * string is kept once whatever the number of references. Finalizing
+ * sorts the strings by their reversed bytes, longest first among equal
+ * tails: a string that is the tail of another one ("printf" of
+ * "fprintf") then comes right after a string it is the tail of, and
+ * takes an offset inside it instead of its own bytes. The emitted table
+ * is the minimal one for the set, offset 0 being the empty string.
+ *
+ * rwelf_rewrite_strtabs() rebuilds .strtab, .dynstr and .shstrtab of a
+ * file from the names actually referenced: st_name of the symbol tables,
+ * the string entries of .dynamic, the names of .gnu.version_d and
+ * .gnu.version_r and sh_name. The places holding an offset are gathered
+ * once per table, interned, and patched from the old to new offset map in
+ * one pass. A loaded table (.dynstr) shrinks in place, its tail zeroed and
+ * DT_STRSZ updated, as nothing mapped may move. The sections after the
+ * last byte of any segment are repacked, so the bytes saved in the other
+ * tables are gone from the file.
+ */
+
+#define _BLOCK_SIZE (64 * 1024)
+
+typedef struct {
+	const char *str;
+	size_t len;
+	uint64_t hash;
+	uint64_t off;
+} _str;
+
+struct rwelf_strtab {
+	_str *strs;
+	size_t nstrs;
+	size_t cap;
+	size_t *slots;            /* Hash set, string number + 1 */
+	size_t nslots;
+	char **blocks;            /* Copies of the strings */
+	size_t nblocks;
+	size_t used;              /* Bytes used in the last block */
+	size_t block_size;
+	unsigned char *data;      /* Built by rwelf_strtab_finalize */
+	size_t size;
+};
+
+/**
+ * Copies a string into the blocks of the table
+ */
+static const char *_copy(rwelf_strtab *st, const char *str, size_t len)
+{
+	char *p;
+
+	if (!st->nblocks || st->used + len + 1 > st->block_size) {
+		size_t size = len + 1 > _BLOCK_SIZE ? len + 1 : _BLOCK_SIZE;
+		char **blocks = realloc(st->blocks, (st->nblocks + 1) * sizeof(char*));
+
+		if (!blocks) {
+			return NULL;
+		}
+		st->blocks = blocks;
+
+		if ((st->blocks[st->nblocks] = malloc(size)) == NULL) {
+			return NULL;
+		}
+		++st->nblocks;
+		st->used = 0;
+		st->block_size = size;
+	}
+	p = st->blocks[st->nblocks - 1] + st->used;
+	memcpy(p, str, len);
+	p[len] = '\0';
+	st->used += len + 1;
+
+	return p;
+}
+
+static int _grow(rwelf_strtab *st)
+{
+	size_t nslots = st->nslots ? st->nslots * 2 : 1024, i;
+	size_t *slots = calloc(nslots, sizeof(size_t));
+
+	if (!slots) {
+		return -1;
+	}
+	for (i = 0; i < st->nstrs; ++i) {
+		size_t h = st->strs[i].hash & (nslots - 1);
+
+		while (slots[h]) {
+			h = (h + 1) & (nslots - 1);
+		}
+		slots[h] = i + 1;
+	}
+	free(st->slots);
+	st->slots  = slots;
+	st->nslots = nslots;
+
+	return 0;
+}
+
+/**
+ * Orders by reversed bytes, descending, so the longer of two strings
+ * sharing a tail comes first
+ */
+static int _tail_cmp(const void *a, const void *b)
+{
+	const _str *x = *(const _str* const*) a, *y = *(const _str* const*) b;
+	const unsigned char *p = (const unsigned char*) x->str + x->len;
+	const unsigned char *q = (const unsigned char*) y->str + y->len;
+	size_t n = x->len < y->len ? x->len : y->len;
+
+	while (n--) {
+		if (*--p != *--q) {
+			return *p < *q ? 1 : -1;
+		}
+	}
+	return x->len < y->len ? 1 : x->len > y->len ? -1 : 0;
+}
+
+/**
+ * rwelf_strtab_create(void)
+ * Creates an empty string table. Returns NULL when out of memory
+ */
+rwelf_strtab *rwelf_strtab_create(void)
+{
+	rwelf_strtab *st = calloc(1, sizeof(rwelf_strtab));
+
+	if (st && rwelf_strtab_add(st, "") == (size_t) -1) {
+		rwelf_strtab_destroy(st);
+		return NULL;
+	}
+	return st;
+}
+
+/**
+ * rwelf_strtab_destroy(rwelf_strtab*)
+ * Releases the table and the strings it holds
+ */
+void rwelf_strtab_destroy(rwelf_strtab *st)
+{
+	size_t i;
+
+	assert(st != NULL);
+
+	for (i = 0; i < st->nblocks; ++i) {
+		free(st->blocks[i]);
+	}
+	free(st->blocks);
+	free(st->strs);
+	free(st->slots);
+	free(st->data);
+	free(st);
+}
+
+/**
+ * rwelf_strtab_add(rwelf_strtab*, const char*)
+ * Interns a string, which is copied, and returns its number in the table;
+ * adding it again returns the same number. The empty string is number 0.
+ * Returns (size_t) -1 when out of memory or once the table is finalized
+ */
+size_t rwelf_strtab_add(rwelf_strtab *st, const char *str)
+{
+	size_t len, h;
+	uint64_t hash;
+	_str *s;
+
+	assert(st != NULL);
+	assert(str != NULL);
+
+	if (st->data) {
+		return (size_t) -1;
+	}
+	if (st->nstrs * 2 >= st->nslots && _grow(st) == -1) {
+		return (size_t) -1;
+	}
+
+	len  = strlen(str);
+	hash = rwelf_hash64(str, len, 0);
+	h    = hash & (st->nslots - 1);
+
+	while (st->slots[h]) {
+		s = &st->strs[st->slots[h] - 1];
+
+		if (s->hash == hash && s->len == len && memcmp(s->str, str, len) == 0) {
+			return st->slots[h] - 1;
+		}
+		h = (h + 1) & (st->nslots - 1);
+	}
+
+	if (st->nstrs == st->cap) {
+		size_t cap = st->cap ? st->cap * 2 : 1024;
+		_str *strs = realloc(st->strs, cap * sizeof(_str));
+
+		if (!strs) {
+			return (size_t) -1;
+		}
+		st->strs = strs;
+		st->cap = cap;
+	}
+	s = &st->strs[st->nstrs];
+
+	if ((s->str = _copy(st, str, len)) == NULL) {
+		return (size_t) -1;
+	}
+	s->len  = len;
+	s->hash = hash;
+	s->off  = 0;
+	st->slots[h] = ++st->nstrs;
+
+	return st->nstrs - 1;
+}
+
+/**
+ * rwelf_strtab_finalize(rwelf_strtab*)
+ * Lays the strings out, merging the ones that are the tail of another,
+ * and builds the table. No string can be added afterwards. Returns -1
+ * when out of memory
+ */
+int rwelf_strtab_finalize(rwelf_strtab *st)
+{
+	const _str *prev = NULL;
+	_str **order;
+	size_t i, size = 1;
+
+	assert(st != NULL);
+
+	if (st->data) {
+		return 0;
+	}
+	if ((order = malloc(st->nstrs * sizeof(_str*))) == NULL) {
+		return -1;
+	}
+	for (i = 1; i < st->nstrs; ++i) {
+		order[i - 1] = &st->strs[i];
+	}
+	qsort(order, st->nstrs - 1, sizeof(_str*), _tail_cmp);
+
+	/* The previous string is the longest one sharing the tail, or merged
+	 * into one that is, so comparing with it is enough */
+	for (i = 0; i + 1 < st->nstrs; ++i) {
+		_str *s = order[i];
+
+		if (prev && prev->len >= s->len
+			&& memcmp(prev->str + prev->len - s->len, s->str, s->len) == 0) {
+			s->off = prev->off + prev->len - s->len;
+		} else {
+			s->off = size;
+			size += s->len + 1;
+		}
+		prev = s;
+	}
+
+	if ((st->data = calloc(1, size)) == NULL) {
+		free(order);
+		return -1;
+	}
+	for (i = 1; i < st->nstrs; ++i) {
+		memcpy(st->data + st->strs[i].off, st->strs[i].str, st->strs[i].len);
+	}
+	st->size = size;
+	free(order);
+
+	return 0;
+}
+
+/**
+ * rwelf_strtab_offset(const rwelf_strtab*, size_t)
+ * Returns the offset of the string by number in the finalized table
+ */
+uint64_t rwelf_strtab_offset(const rwelf_strtab *st, size_t n)
+{
+	assert(st != NULL);
+	assert(st->data != NULL);
+	assert(st->nstrs > n);
+
+	return st->strs[n].off;
+}
+
+/**
+ * rwelf_strtab_data(const rwelf_strtab*, size_t*)
+ * Returns the bytes of the finalized table and sets size, otherwise NULL
+ * is returned
+ */
+const unsigned char *rwelf_strtab_data(const rwelf_strtab *st, size_t *size)
+{
+	assert(st != NULL);
+
+	if (size) {
+		*size = st->size;
+	}
+	return st->data;
+}
+
+/**
+ * Place in the file copy holding an offset into a string table
+ */
+typedef struct {
+	uint64_t pos;
+	int width;                /* 4, or the word size for .dynamic */
+} _ref;
+
+typedef struct {
+	const rwelf *elf;
+	unsigned char *buf;       /* Copy of the file being patched */
+	size_t size;
+	uint64_t *sh_size;        /* New sh_size of each section */
+	_ref *refs;
+	size_t nrefs;
+	size_t cap;
+	int error;
+} _ctx;
+
+static uint64_t _get(const _ctx *ctx, uint64_t pos, int width)
+{
+	uint64_t u64 = 0;
+	uint32_t u32;
+
+	if (width == 4) {
+		memcpy(&u32, ctx->buf + pos, 4);
+		return u32;
+	}
+	memcpy(&u64, ctx->buf + pos, 8);
+	return u64;
+}
+
+static void _put(_ctx *ctx, uint64_t pos, int width, uint64_t val)
+{
+	uint32_t u32 = val;
+
+	if (width == 4) {
+		memcpy(ctx->buf + pos, &u32, 4);
+	} else {
+		memcpy(ctx->buf + pos, &val, 8);
+	}
+}
+
+static void _add_ref(_ctx *ctx, uint64_t pos, int width)
+{
+	if (pos > ctx->size || width > ctx->size - pos) {
+		ctx->error = 1;
+		return;
+	}
+	if (ctx->nrefs == ctx->cap) {
+		size_t cap = ctx->cap ? ctx->cap * 2 : 1024;
+		_ref *refs = realloc(ctx->refs, cap * sizeof(_ref));
+
+		if (!refs) {
+			ctx->error = 1;
+			return;
+		}
+		ctx->refs = refs;
+		ctx->cap = cap;
+	}
+	ctx->refs[ctx->nrefs].pos   = pos;
+	ctx->refs[ctx->nrefs].width = width;
+	++ctx->nrefs;
+}
+
+/**
+ * Whether the string tag of .dynamic holds a .dynstr offset
+ */
+static int _dyn_string(int64_t tag)
+{
+	switch (tag) {
+		case DT_NEEDED:
+		case DT_SONAME:
+		case DT_RPATH:
+		case DT_RUNPATH:
+		case DT_AUXILIARY:
+		case DT_FILTER:
+		case DT_CONFIG:
+		case DT_DEPAUDIT:
+		case DT_AUDIT:
+			return 1;
+	}
+	return 0;
+}
+
+static void _refs_dynamic(_ctx *ctx, size_t n, uint64_t *strsz)
+{
+	const rwelf *elf = ctx->elf;
+	int word = ELF_IS_64(elf) ? 8 : 4;
+	uint64_t off = RWELF_SHDR(elf, sh_offset, n), i;
+	uint64_t count = RWELF_SHDR(elf, sh_size, n) / (2 * word);
+
+	for (i = 0; i < count && !ctx->error; ++i) {
+		uint64_t pos = off + i * 2 * word;
+		int64_t tag;
+
+		if (pos > ctx->size || 2 * word > ctx->size - pos) {
+			ctx->error = 1;
+			return;
+		}
+		tag = word == 8 ? (int64_t) _get(ctx, pos, 8) : (int32_t) _get(ctx, pos, 4);
+
+		if (tag == DT_NULL) {
+			break;
+		}
+		if (tag == DT_STRSZ) {
+			*strsz = pos + word;
+		} else if (_dyn_string(tag)) {
+			_add_ref(ctx, pos + word, word);
+		}
+	}
+}
+
+/**
+ * Names of .gnu.version_d (vda_name) and .gnu.version_r (vn_file and
+ * vna_name), whose layout is the same for both classes
+ */
+static void _refs_version(_ctx *ctx, size_t n, int need)
+{
+	const rwelf *elf = ctx->elf;
+	uint64_t off = RWELF_SHDR(elf, sh_offset, n);
+	uint64_t end = off + RWELF_SHDR(elf, sh_size, n), pos = off, aux;
+	uint64_t count = RWELF_SHDR(elf, sh_info, n), i, j;
+
+	if (end > ctx->size || end < off) {
+		ctx->error = 1;
+		return;
+	}
+
+	for (i = 0; i < count && !ctx->error; ++i) {
+		uint32_t next;
+		uint16_t cnt;
+
+		if (pos < off || end - pos < (need ? sizeof(Elf64_Verneed)
+				: sizeof(Elf64_Verdef))) {
+			ctx->error = 1;
+			return;
+		}
+		if (need) {
+			memcpy(&cnt, ctx->buf + pos + offsetof(Elf64_Verneed, vn_cnt), 2);
+			_add_ref(ctx, pos + offsetof(Elf64_Verneed, vn_file), 4);
+			aux  = pos + _get(ctx, pos + offsetof(Elf64_Verneed, vn_aux), 4);
+			next = _get(ctx, pos + offsetof(Elf64_Verneed, vn_next), 4);
+		} else {
+			memcpy(&cnt, ctx->buf + pos + offsetof(Elf64_Verdef, vd_cnt), 2);
+			aux  = pos + _get(ctx, pos + offsetof(Elf64_Verdef, vd_aux), 4);
+			next = _get(ctx, pos + offsetof(Elf64_Verdef, vd_next), 4);
+		}
+
+		for (j = 0; j < cnt && !ctx->error; ++j) {
+			uint32_t aux_next;
+
+			if (aux < off || aux >= end || end - aux < (need ? sizeof(Elf64_Vernaux)
+					: sizeof(Elf64_Verdaux))) {
+				ctx->error = 1;
+				return;
+			}
+			if (need) {
+				_add_ref(ctx, aux + offsetof(Elf64_Vernaux, vna_name), 4);
+				aux_next = _get(ctx, aux + offsetof(Elf64_Vernaux, vna_next), 4);
+			} else {
+				_add_ref(ctx, aux + offsetof(Elf64_Verdaux, vda_name), 4);
+				aux_next = _get(ctx, aux + offsetof(Elf64_Verdaux, vda_next), 4);
+			}
+			if (!aux_next) {
+				break;
+			}
+			aux += aux_next;
+		}
+		if (!next) {
+			break;
+		}
+		pos += next;
+	}
+}
+
+/**
+ * Gathers every place referencing the table. Returns -1 when a section
+ * of a kind not understood links to it, so the table is left alone
+ */
+static int _gather_refs(_ctx *ctx, size_t table, uint64_t *strsz)
+{
+	const rwelf *elf = ctx->elf;
+	size_t nshdrs = RWELF_EHDR(elf, e_shnum), i;
+
+	ctx->nrefs = 0;
+	*strsz = 0;
+
+	for (i = 1; i < nshdrs; ++i) {
+		uint64_t off = RWELF_SHDR(elf, sh_offset, i);
+		uint64_t size = RWELF_SHDR(elf, sh_size, i);
+		uint64_t entsize = RWELF_SHDR(elf, sh_entsize, i), j;
+
+		if (RWELF_SHDR(elf, sh_link, i) != table) {
+			continue;
+		}
+		switch (RWELF_SHDR(elf, sh_type, i)) {
+			case SHT_SYMTAB:
+			case SHT_DYNSYM:
+				if (!entsize) {
+					return -1;
+				}
+				/* st_name is the first field for both classes */
+				for (j = 0; j < size / entsize; ++j) {
+					_add_ref(ctx, off + j * entsize, 4);
+				}
+				break;
+			case SHT_DYNAMIC:
+				_refs_dynamic(ctx, i, strsz);
+				break;
+			case SHT_GNU_verdef:
+				_refs_version(ctx, i, 0);
+				break;
+			case SHT_GNU_verneed:
+				_refs_version(ctx, i, 1);
+				break;
+			default:
+				return -1;
+		}
+	}
+
+	if (table == RWELF_EHDR(elf, e_shstrndx)) {
+		for (i = 0; i < nshdrs; ++i) {
+			_add_ref(ctx, RWELF_EHDR(elf, e_shoff)
+				+ i * RWELF_EHDR(elf, e_shentsize), 4);
+		}
+	}
+	return ctx->error ? -1 : 0;
+}
+
+/**
+ * Rebuilds one table in the copy. Returns -1 when the table is left as
+ * it was
+ */
+static int _rebuild(_ctx *ctx, size_t table)
+{
+	const rwelf *elf = ctx->elf;
+	uint64_t off = RWELF_SHDR(elf, sh_offset, table);
+	uint64_t size = RWELF_SHDR(elf, sh_size, table), strsz;
+	const unsigned char *data;
+	size_t i, *ids = NULL, new_size;
+	rwelf_strtab *st = NULL;
+	int ret = -1;
+
+	if (RWELF_SHDR(elf, sh_type, table) != SHT_STRTAB || !size
+		|| off > ctx->size || size > ctx->size - off
+		|| _gather_refs(ctx, table, &strsz) == -1) {
+		return -1;
+	}
+	data = ctx->buf + off;
+
+	if ((ids = malloc((ctx->nrefs + 1) * sizeof(size_t))) == NULL
+		|| (st = rwelf_strtab_create()) == NULL) {
+		goto out;
+	}
+
+	/* Old offsets to strings, interned */
+	for (i = 0; i < ctx->nrefs; ++i) {
+		uint64_t old = _get(ctx, ctx->refs[i].pos, ctx->refs[i].width);
+
+		if (old >= size || !memchr(data + old, 0, size - old)) {
+			goto out;
+		}
+		if ((ids[i] = rwelf_strtab_add(st, (const char*)(data + old))) == (size_t) -1) {
+			goto out;
+		}
+	}
+	if (rwelf_strtab_finalize(st) == -1) {
+		goto out;
+	}
+	rwelf_strtab_data(st, &new_size);
+
+	if (new_size > size) {
+		goto out;
+	}
+
+	/* Every reference moved to its new offset at once */
+	for (i = 0; i < ctx->nrefs; ++i) {
+		_put(ctx, ctx->refs[i].pos, ctx->refs[i].width,
+			rwelf_strtab_offset(st, ids[i]));
+	}
+	memcpy(ctx->buf + off, rwelf_strtab_data(st, NULL), new_size);
+	memset(ctx->buf + off + new_size, 0, size - new_size);
+
+	ctx->sh_size[table] = new_size;
+
+	if (strsz && (RWELF_SHDR(elf, sh_flags, table) & SHF_ALLOC)) {
+		_put(ctx, strsz, ELF_IS_64(elf) ? 8 : 4, new_size);
+	}
+	ret = 0;
+out:
+	if (st) {
+		rwelf_strtab_destroy(st);
+	}
+	free(ids);
+
+	return ret;
+}
+
+typedef struct {
+	uint64_t off;
+	size_t num;
+} _sec;
+
+static int _sec_cmp(const void *a, const void *b)
+{
+	const _sec *x = a, *y = b;
+
+	if (x->off != y->off) {
+		return x->off < y->off ? -1 : 1;
+	}
+	return x->num < y->num ? -1 : x->num > y->num;
+}
+
+static void _set_shdr(_ctx *ctx, size_t n, uint64_t off, uint64_t size)
+{
+	const rwelf *elf = ctx->elf;
+	uint64_t pos = RWELF_EHDR(elf, e_shoff) + n * RWELF_EHDR(elf, e_shentsize);
+
+	if (ELF_IS_64(elf)) {
+		_put(ctx, pos + offsetof(Elf64_Shdr, sh_offset), 8, off);
+		_put(ctx, pos + offsetof(Elf64_Shdr, sh_size), 8, size);
+	} else {
+		_put(ctx, pos + offsetof(Elf32_Shdr, sh_offset), 4, off);
+		_put(ctx, pos + offsetof(Elf32_Shdr, sh_size), 4, size);
+	}
+}
+
+/**
+ * Lays out again the sections past every segment, in their order, and
+ * the section headers after them. Returns the new image, or NULL
+ */
+static unsigned char *_repack(_ctx *ctx, size_t *out_size)
+{
+	const rwelf *elf = ctx->elf;
+	size_t nshdrs = RWELF_EHDR(elf, e_shnum), nphdrs = RWELF_EHDR(elf, e_phnum);
+	uint64_t fixed = RWELF_EHDR(elf, e_ehsize), shoff = RWELF_EHDR(elf, e_shoff);
+	uint64_t shsize = (uint64_t) nshdrs * RWELF_EHDR(elf, e_shentsize), pos;
+	uint64_t word = ELF_IS_64(elf) ? 8 : 4;
+	size_t i, nsecs = 0;
+	unsigned char *out;
+	_sec *secs;
+
+	if (nphdrs) {
+		uint64_t end = RWELF_EHDR(elf, e_phoff)
+			+ (uint64_t) nphdrs * RWELF_EHDR(elf, e_phentsize);
+
+		fixed = end > fixed ? end : fixed;
+	}
+	for (i = 0; i < nphdrs; ++i) {
+		uint64_t end = RWELF_PHDR(elf, p_offset, i) + RWELF_PHDR(elf, p_filesz, i);
+
+		fixed = end > fixed ? end : fixed;
+	}
+
+	if ((secs = malloc((nshdrs + 1) * sizeof(_sec))) == NULL) {
+		return NULL;
+	}
+	for (i = 1; i < nshdrs; ++i) {
+		if (RWELF_SHDR(elf, sh_type, i) != SHT_NOBITS) {
+			secs[nsecs].off = RWELF_SHDR(elf, sh_offset, i);
+			secs[nsecs++].num = i;
+		}
+	}
+	qsort(secs, nsecs, sizeof(_sec), _sec_cmp);
+
+	/* What starts before the fixed part ends stays, and so its end too */
+	for (i = 0; i < nsecs && secs[i].off < fixed; ++i) {
+		uint64_t end = secs[i].off + RWELF_SHDR(elf, sh_size, secs[i].num);
+
+		fixed = end > fixed ? end : fixed;
+	}
+	if (shoff < fixed && shoff + shsize > fixed) {
+		fixed = shoff + shsize;
+	}
+
+	/* Sizes first: the alignment may add bytes the old layout did not */
+	for (pos = fixed, i = 0; i < nsecs; ++i) {
+		uint64_t align = RWELF_SHDR(elf, sh_addralign, secs[i].num);
+
+		if (secs[i].off < fixed) {
+			continue;
+		}
+		if (align > 1) {
+			pos = (pos + align - 1) / align * align;
+		}
+		pos += ctx->sh_size[secs[i].num];
+	}
+	if (shoff >= fixed) {
+		pos = (pos + word - 1) & ~(word - 1);
+		pos += shsize;
+	}
+
+	if (fixed > ctx->size || (out = calloc(1, pos)) == NULL) {
+		free(secs);
+		return NULL;
+	}
+	*out_size = pos;
+
+	for (pos = fixed, i = 0; i < nsecs; ++i) {
+		size_t n = secs[i].num;
+		uint64_t align = RWELF_SHDR(elf, sh_addralign, n);
+
+		if (secs[i].off < fixed) {
+			_set_shdr(ctx, n, secs[i].off, ctx->sh_size[n]);
+			continue;
+		}
+		if (align > 1) {
+			pos = (pos + align - 1) / align * align;
+		}
+		if (secs[i].off > ctx->size || ctx->sh_size[n] > ctx->size - secs[i].off) {
+			free(secs);
+			free(out);
+			return NULL;
+		}
+		memcpy(out + pos, ctx->buf + secs[i].off, ctx->sh_size[n]);
+		_set_shdr(ctx, n, pos, ctx->sh_size[n]);
+		pos += ctx->sh_size[n];
+	}
+	free(secs);
+
+	if (shoff >= fixed) {
+		pos = (pos + word - 1) & ~(word - 1);
+		memcpy(out + pos, ctx->buf + shoff, shsize);
+
+		/* e_shoff is at the same place for both classes, after e_entry
+		 * and e_phoff that are words */
+		shoff = pos;
+		if (ELF_IS_64(elf)) {
+			memcpy(ctx->buf + offsetof(Elf64_Ehdr, e_shoff), &shoff, 8);
+		} else {
+			uint32_t shoff32 = shoff;
+			memcpy(ctx->buf + offsetof(Elf32_Ehdr, e_shoff), &shoff32, 4);
+		}
+	}
+	memcpy(out, ctx->buf, fixed);
+
+	return out;
+}
+
+/**
+ * rwelf_rewrite_strtabs(const rwelf*, const char*, int)
+ * Writes to path a copy of the file whose string tables selected by flags
+ * (RWELF_STRTAB_SYMTAB, _DYNSTR, _SHSTRTAB) hold only the strings
+ * referenced, once, tails merged, every reference patched. The file is
+ * written next to path and renamed over it. Tables referenced from a
+ * section kind not understood are kept as they are. Returns -1 when the
+ * file has no section headers or cannot be written
+ */
+int rwelf_rewrite_strtabs(const rwelf *elf, const char *path, int flags)
+{
+	size_t nshdrs, i, out_size = 0;
+	unsigned char *out = NULL;
+	const unsigned char *data;
+	struct stat st;
+	char *tmp = NULL;
+	FILE *fp = NULL;
+	_ctx ctx;
+	int ret = -1;
+
+	assert(elf != NULL);
+	assert(path != NULL);
+
+	nshdrs = elf->shstrtab ? RWELF_EHDR(elf, e_shnum) : 0;
+
+	if (!nshdrs || (data = rwelf_get_data(elf, 0, elf->size)) == NULL
+		|| RWELF_EHDR(elf, e_shoff) > elf->size
+		|| (uint64_t) nshdrs * RWELF_EHDR(elf, e_shentsize)
+			> elf->size - RWELF_EHDR(elf, e_shoff)) {
+		return -1;
+	}
+
+	memset(&ctx, 0, sizeof(ctx));
+	ctx.elf     = elf;
+	ctx.size    = elf->size;
+	ctx.buf     = malloc(elf->size);
+	ctx.sh_size = malloc(nshdrs * sizeof(uint64_t));
+
+	if (!ctx.buf || !ctx.sh_size) {
+		goto out;
+	}
+	memcpy(ctx.buf, data, elf->size);
+
+	for (i = 0; i < nshdrs; ++i) {
+		ctx.sh_size[i] = RWELF_SHDR(elf, sh_size, i);
+	}
+
+	for (i = 1; i < nshdrs; ++i) {
+		size_t link = RWELF_SHDR(elf, sh_link, i);
+		int type = RWELF_SHDR(elf, sh_type, i);
+
+		if (((type == SHT_SYMTAB && (flags & RWELF_STRTAB_SYMTAB))
+				|| (type == SHT_DYNSYM && (flags & RWELF_STRTAB_DYNSTR)))
+			&& link && link < nshdrs && link != RWELF_EHDR(elf, e_shstrndx)) {
+			ctx.error = 0;
+			_rebuild(&ctx, link);
+		}
+	}
+	if ((flags & RWELF_STRTAB_SHSTRTAB) && RWELF_EHDR(elf, e_shstrndx) < nshdrs) {
+		ctx.error = 0;
+		_rebuild(&ctx, RWELF_EHDR(elf, e_shstrndx));
+	}
+
+	if ((out = _repack(&ctx, &out_size)) == NULL) {
+		goto out;
+	}
+
+	if ((tmp = malloc(strlen(path) + 32)) == NULL) {
+		goto out;
+	}
+	sprintf(tmp, "%s.tmp.%ld", path, (long) getpid());
+
+	if ((fp = fopen(tmp, "wb")) == NULL) {
+		goto out;
+	}
+	if (elf->fd != -1 && fstat(elf->fd, &st) == 0) {
+		fchmod(fileno(fp), st.st_mode & 07777);
+	}
+	fwrite(out, 1, out_size, fp);
+
+	ret = ferror(fp) ? -1 : 0;
+
+	if (fclose(fp) != 0) {
+		ret = -1;
+	}
+	if (ret == 0 && rename(tmp, path) == -1) {
+		ret = -1;
+	}
+	if (ret == -1) {
+		unlink(tmp);
+	}
+out:
+	free(tmp);
+	free(out);
+	free(ctx.refs);
+	free(ctx.sh_size);
+	free(ctx.buf);
+
+	return ret;
+}
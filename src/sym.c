@@ -49,6 +49,8 @@ void rwelf_get_symbol_by_num(const rwelf *elf, size_t num, Elf_Sym *sym)
 	assert(elf != NULL);
 	assert(elf->nsyms > num);
 
+	RWELF_STAT(elf, RWELF_STAT_SYMBOL_BY_NUM, 1);
+
 	if (sym) {
 		_copy_sym(0, elf, sym, num);
 	}
@@ -67,16 +69,21 @@ int rwelf_get_symbol_by_name(const rwelf *elf, const char *sname,
 	assert(elf->strtab != NULL);
 	assert(sname != NULL);
 
+	RWELF_STAT(elf, RWELF_STAT_SYMBOL_BY_NAME, 1);
+
 	for (i = 0; i < elf->nsyms; ++i) {
 		const char *name = (char*)(elf->strtab + RWELF_SYM(elf, st_name, i));
 
 		if (name && memcmp(name, sname, strlen(name)+1) == 0) {
+			RWELF_STAT(elf, RWELF_STAT_SCAN_STEPS, i + 1);
+
 			if (sym) {
 				_copy_sym(0, elf, sym, i);
 			}
 			return i;
 		}
 	}
+	RWELF_STAT(elf, RWELF_STAT_SCAN_STEPS, i);
 
 	return -1;
 }
@@ -104,6 +111,11 @@ const unsigned char *rwelf_get_symbol_section(const Elf_Sym *sym)
 	assert(sym != NULL);
 	assert(sym->elf != NULL);
 
+	/* Reserved indexes, or any index when there are no section headers */
+	if (RWELF_SYM_DATA(sym, st_shndx) >= RWELF_EHDR(sym->elf, e_shnum)) {
+		return NULL;
+	}
+
 	switch (RWELF_SYM_DATA(sym, st_shndx)) {
 		case SHN_ABS:
 		case SHN_COMMON:
@@ -141,6 +153,113 @@ uint64_t rwelf_get_symbol_value(const Elf_Sym *sym)
 	return RWELF_SYM_DATA(sym, st_value);
 }
 
+/**
+ * rwelf_get_symbol_shndx(const Elf_Sym*)
+ * Returns the index of the section related to the symbol
+ */
+uint16_t rwelf_get_symbol_shndx(const Elf_Sym *sym)
+{
+	assert(sym != NULL);
+	assert(sym->elf != NULL);
+
+	return RWELF_SYM_DATA(sym, st_shndx);
+}
+
+/**
+ * rwelf_get_symbol_type(const Elf_Sym*)
+ * Returns the symbol type (STT_*)
+ */
+unsigned char rwelf_get_symbol_type(const Elf_Sym *sym)
+{
+	assert(sym != NULL);
+	assert(sym->elf != NULL);
+
+	/* ELF32_ST_TYPE and ELF64_ST_TYPE are the same */
+	return ELF64_ST_TYPE(RWELF_SYM_DATA(sym, st_info));
+}
+
+/**
+ * rwelf_get_symbol_bind(const Elf_Sym*)
+ * Returns the symbol binding (STB_*)
+ */
+unsigned char rwelf_get_symbol_bind(const Elf_Sym *sym)
+{
+	assert(sym != NULL);
+	assert(sym->elf != NULL);
+
+	return ELF64_ST_BIND(RWELF_SYM_DATA(sym, st_info));
+}
+
+/**
+ * rwelf_get_symbol_visibility(const Elf_Sym*)
+ * Returns the symbol visibility (STV_*)
+ */
+unsigned char rwelf_get_symbol_visibility(const Elf_Sym *sym)
+{
+	assert(sym != NULL);
+	assert(sym->elf != NULL);
+
+	return ELF64_ST_VISIBILITY(RWELF_SYM_DATA(sym, st_other));
+}
+
+/**
+ * rwelf_get_symbol_type_name(const Elf_Sym*)
+ * Returns the symbol type as string
+ */
+const char *rwelf_get_symbol_type_name(const Elf_Sym *sym)
+{
+#define CASE(x) case x: return #x
+	switch (rwelf_get_symbol_type(sym)) {
+		CASE(STT_NOTYPE);
+		CASE(STT_OBJECT);
+		CASE(STT_FUNC);
+		CASE(STT_SECTION);
+		CASE(STT_FILE);
+		CASE(STT_COMMON);
+		CASE(STT_TLS);
+		CASE(STT_GNU_IFUNC);
+		default:
+			return "UNKNOWN";
+	}
+#undef CASE
+}
+
+/**
+ * rwelf_get_symbol_bind_name(const Elf_Sym*)
+ * Returns the symbol binding as string
+ */
+const char *rwelf_get_symbol_bind_name(const Elf_Sym *sym)
+{
+#define CASE(x) case x: return #x
+	switch (rwelf_get_symbol_bind(sym)) {
+		CASE(STB_LOCAL);
+		CASE(STB_GLOBAL);
+		CASE(STB_WEAK);
+		CASE(STB_GNU_UNIQUE);
+		default:
+			return "UNKNOWN";
+	}
+#undef CASE
+}
+
+/**
+ * rwelf_get_symbol_visibility_name(const Elf_Sym*)
+ * Returns the symbol visibility as string
+ */
+const char *rwelf_get_symbol_visibility_name(const Elf_Sym *sym)
+{
+#define CASE(x) case x: return #x
+	switch (rwelf_get_symbol_visibility(sym)) {
+		CASE(STV_DEFAULT);
+		CASE(STV_INTERNAL);
+		CASE(STV_HIDDEN);
+		CASE(STV_PROTECTED);
+		default:
+			return "UNKNOWN";
+	}
+#undef CASE
+}
+
 /* .dynsym symbols */
 
 /**
@@ -151,6 +270,8 @@ void rwelf_get_dyn_symbol_by_num(const rwelf *elf, size_t n, Elf_Sym *sym)
 	assert(elf != NULL);
 	assert(elf->dynstr != NULL);
 
+	RWELF_STAT(elf, RWELF_STAT_SYMBOL_BY_NUM, 1);
+
 	sym->elf = elf;
 	_copy_sym(1, elf, sym, n);
 }
@@ -167,3 +288,162 @@ const unsigned char *rwelf_get_dyn_symbol_name(const Elf_Sym *sym)
 
 	return sym->elf->dynstr + RWELF_SYM_DATA(sym, st_name);
 }
+
+/* Filtered iteration */
+
+/* Symbols prefetched ahead of the scan, names are prefetched half as far */
+#define _SYM_AHEAD 8
+
+#ifdef __GNUC__
+# define _PREFETCH(_p) __builtin_prefetch(_p)
+#else
+# define _PREFETCH(_p)
+#endif
+
+/**
+ * Evaluates the filter on the raw symbol fields
+ */
+static inline int _sym_match(const rwelf_sym_filter *filter,
+	unsigned char info, unsigned char other, uint16_t shndx)
+{
+	if (filter->types && !(filter->types & (1u << ELF64_ST_TYPE(info)))) {
+		return 0;
+	}
+	if (filter->binds && !(filter->binds & (1u << ELF64_ST_BIND(info)))) {
+		return 0;
+	}
+	if (filter->visibilities
+		&& !(filter->visibilities & (1u << ELF64_ST_VISIBILITY(other)))) {
+		return 0;
+	}
+	if ((filter->flags & RWELF_SYMF_DEFINED) && shndx == SHN_UNDEF) {
+		return 0;
+	}
+	if ((filter->flags & RWELF_SYMF_SECTION) && shndx != filter->shndx) {
+		return 0;
+	}
+	return 1;
+}
+
+/**
+ * Returns the index of the first symbol from i on matching the filter,
+ * or count when there is none
+ */
+static size_t _sym_next_match(const rwelf_sym_cursor *cursor, size_t i)
+{
+	const rwelf *elf = cursor->elf;
+	const unsigned char *strtab = cursor->strtab;
+	size_t count = cursor->count;
+
+#define SCAN(_table) \
+	for (; i < count; ++i) {                                          \
+		if (i + _SYM_AHEAD < count) {                                 \
+			_PREFETCH(&(_table)[i + _SYM_AHEAD]);                     \
+			if (strtab) {                                             \
+				_PREFETCH(strtab + (_table)[i + _SYM_AHEAD / 2].st_name); \
+			}                                                         \
+		}                                                             \
+		if (_sym_match(&cursor->filter, (_table)[i].st_info,          \
+				(_table)[i].st_other, (_table)[i].st_shndx)) {        \
+			break;                                                    \
+		}                                                             \
+	}
+
+	if (ELF_IS_64(elf)) {
+		SCAN(cursor->dynamic ? DYNSYM64(elf) : SYM64(elf));
+	} else {
+		SCAN(cursor->dynamic ? DYNSYM32(elf) : SYM32(elf));
+	}
+#undef SCAN
+
+	return i;
+}
+
+/**
+ * rwelf_sym_cursor_init(rwelf_sym_cursor*, const rwelf*,
+ *   const rwelf_sym_filter*)
+ * Prepares a cursor over .symtab, or .dynsym with RWELF_SYMF_DYNAMIC.
+ * A NULL filter matches every symbol
+ */
+void rwelf_sym_cursor_init(rwelf_sym_cursor *cursor, const rwelf *elf,
+	const rwelf_sym_filter *filter)
+{
+	assert(cursor != NULL);
+	assert(elf != NULL);
+
+	memset(cursor, 0, sizeof(rwelf_sym_cursor));
+
+	if (filter) {
+		cursor->filter = *filter;
+	}
+	cursor->elf     = elf;
+	cursor->dynamic = (cursor->filter.flags & RWELF_SYMF_DYNAMIC) != 0;
+	cursor->count   = cursor->dynamic ? elf->ndynsyms : elf->nsyms;
+	cursor->strtab  = cursor->dynamic ? elf->dynstr : elf->strtab;
+}
+
+/**
+ * rwelf_sym_cursor_next(rwelf_sym_cursor*, Elf_Sym*)
+ * Moves to the next matching symbol and fills the sym param with it. Its
+ * number is left in cursor->index. Returns 0 when there are no more
+ * symbols, otherwise 1
+ */
+int rwelf_sym_cursor_next(rwelf_sym_cursor *cursor, Elf_Sym *sym)
+{
+	size_t i;
+
+	assert(cursor != NULL);
+
+	if ((i = _sym_next_match(cursor, cursor->pos)) >= cursor->count) {
+		cursor->pos = cursor->count;
+		return 0;
+	}
+
+	cursor->index = i;
+	cursor->pos   = i + 1;
+
+	if (sym) {
+		_copy_sym(cursor->dynamic, cursor->elf, sym, i);
+	}
+	return 1;
+}
+
+/**
+ * rwelf_sym_cursor_name(const rwelf_sym_cursor*, const Elf_Sym*)
+ * Returns the name of a symbol got from the cursor, from the string table
+ * of the table being walked
+ */
+const char *rwelf_sym_cursor_name(const rwelf_sym_cursor *cursor,
+	const Elf_Sym *sym)
+{
+	assert(cursor != NULL);
+	assert(sym != NULL);
+
+	if (!cursor->strtab) {
+		return "";
+	}
+	return (const char*)(cursor->strtab + RWELF_SYM_DATA(sym, st_name));
+}
+
+/**
+ * rwelf_foreach_symbol(const rwelf*, const rwelf_sym_filter*,
+ *   int (*)(const Elf_Sym*, size_t, const char*, void*), void*)
+ * Calls the callback with the number and the name of every symbol matching
+ * the filter. Iteration stops when the callback returns non-zero
+ */
+void rwelf_foreach_symbol(const rwelf *elf, const rwelf_sym_filter *filter,
+	int (*cb)(const Elf_Sym*, size_t, const char*, void*), void *arg)
+{
+	rwelf_sym_cursor cursor;
+	Elf_Sym sym;
+
+	assert(cb != NULL);
+
+	rwelf_sym_cursor_init(&cursor, elf, filter);
+
+	while (rwelf_sym_cursor_next(&cursor, &sym)) {
+		if (cb(&sym, cursor.index, rwelf_sym_cursor_name(&cursor, &sym), arg)) {
+			break;
+		}
+	}
+}